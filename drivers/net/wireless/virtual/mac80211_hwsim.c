@@ -32,6 +32,7 @@
 #include <net/net_namespace.h>
 #include <net/netns/generic.h>
 #include <linux/rhashtable.h>
+#include <linux/hashtable.h>
 #include <linux/nospec.h>
 #include <linux/virtio.h>
 #include <linux/virtio_ids.h>
@@ -41,6 +42,12 @@
 #define WARN_QUEUE 100
 #define MAX_QUEUE 200
 
+/* HWSIM_CMD_FRAMES messages to wmediumd, so the skb fits in 16 KiB */
+#define HWSIM_NL_BATCH_SIZE	(SZ_16K - SZ_1K)
+#define HWSIM_NL_BATCH_FRAMES	32
+/* attributes of a frame in the message, other than its data */
+#define HWSIM_NL_FRAME_OVERHEAD	192
+
 MODULE_AUTHOR("Jouni Malinen");
 MODULE_DESCRIPTION("Software simulator of 802.11 radio(s) for mac80211");
 MODULE_LICENSE("GPL");
@@ -73,6 +80,26 @@ static bool multi_radio;
 module_param(multi_radio, bool, 0444);
 MODULE_PARM_DESC(multi_radio, "Support Multiple Radios per wiphy");
 
+static unsigned int tx_dequeue_batch;
+module_param(tx_dequeue_batch, uint, 0444);
+MODULE_PARM_DESC(tx_dequeue_batch,
+		 "Frames pulled per TXQ dequeue call (0: dequeue one frame at a time)");
+
+static bool tx_amsdu_frag_list;
+module_param(tx_amsdu_frag_list, bool, 0444);
+MODULE_PARM_DESC(tx_amsdu_frag_list,
+		 "Build A-MSDUs in software, chaining the subframes as a frag list");
+
+static bool rx_list_batch;
+module_param(rx_list_batch, bool, 0444);
+MODULE_PARM_DESC(rx_list_batch,
+		 "Pass received frames to the network stack in per-interface batches");
+
+static bool tx_airtime;
+module_param(tx_airtime, bool, 0444);
+MODULE_PARM_DESC(tx_airtime,
+		 "Drain TXQs from a timer, aggregate frames and simulate their airtime (enables AQL and airtime fairness)");
+
 /**
  * enum hwsim_regtest - the type of regulatory tests we offer
  *
@@ -277,6 +304,8 @@ static inline void hwsim_clear_sta_magic(struct ieee80211_sta *sta)
 
 struct hwsim_chanctx_priv {
 	u32 magic;
+	/* channel this context was added to the receiver index with */
+	struct ieee80211_channel *listen_chan;
 };
 
 #define HWSIM_CHANCTX_MAGIC 0x6d53774a
@@ -306,6 +335,7 @@ static DEFINE_IDA(hwsim_netgroup_ida);
 struct hwsim_net {
 	int netgroup;
 	u32 wmediumd;
+	bool wmediumd_batch;
 };
 
 static inline int hwsim_net_get_netgroup(struct net *net)
@@ -330,11 +360,20 @@ static inline u32 hwsim_net_get_wmediumd(struct net *net)
 	return hwsim_net->wmediumd;
 }
 
-static inline void hwsim_net_set_wmediumd(struct net *net, u32 portid)
+static inline void hwsim_net_set_wmediumd(struct net *net, u32 portid,
+					  bool batch)
 {
 	struct hwsim_net *hwsim_net = net_generic(net, hwsim_net_id);
 
 	hwsim_net->wmediumd = portid;
+	hwsim_net->wmediumd_batch = batch;
+}
+
+static inline bool hwsim_net_get_wmediumd_batch(struct net *net)
+{
+	struct hwsim_net *hwsim_net = net_generic(net, hwsim_net_id);
+
+	return hwsim_net->wmediumd_batch;
 }
 
 static struct class *hwsim_class;
@@ -646,6 +685,50 @@ static struct rhashtable hwsim_radios_rht;
 static int hwsim_radio_idx;
 static int hwsim_radios_generation = 1;
 
+/*
+ * Receiver index of the internal datapath: the radios by the channels they
+ * may receive on, hashed together with their netgroup, so that sending a
+ * frame only looks at the radios on its channel. A radio is indexed on its
+ * operating channel, the channels of its channel contexts and those of a
+ * pending hw scan or remain-on-channel. The index may hold more than what
+ * the radio receives on at the moment, the usual checks are still applied
+ * to every radio found there. Updates are serialized by hwsim_radio_lock,
+ * the datapath only uses RCU.
+ */
+#define HWSIM_CHAN_HASH_BITS	8
+static DEFINE_HASHTABLE(hwsim_chan_index, HWSIM_CHAN_HASH_BITS);
+
+struct hwsim_chan_listener {
+	struct hlist_node hnode;
+	struct list_head list;
+	struct rcu_head rcu_head;
+	struct mac80211_hwsim_data *data;
+	u32 center_freq;
+	unsigned int refs;
+};
+
+/*
+ * Link model of the internal datapath, for the frames one radio sends to
+ * another, set with HWSIM_CMD_SET_LINK. Like the receiver index, updated
+ * under hwsim_radio_lock and used with RCU.
+ */
+#define HWSIM_LINK_HASH_BITS	10
+static DEFINE_HASHTABLE(hwsim_links, HWSIM_LINK_HASH_BITS);
+
+struct hwsim_link {
+	struct hlist_node hnode;
+	struct rcu_head rcu_head;
+	struct mac80211_hwsim_data *tx, *rx;
+	bool has_snr;
+	s32 snr;
+	u32 loss;
+	u32 delay, jitter;
+	/* due time of the last delayed frame, under rx->rx_delayed.lock */
+	ktime_t last_due;
+};
+
+#define HWSIM_NOISE_FLOOR	-91 /* dBm */
+
 static struct platform_driver mac80211_hwsim_driver = {
 	.driver = {
 		.name = "mac80211_hwsim",
@@ -715,8 +798,38 @@ struct mac80211_hwsim_data {
 	bool ps_poll_pending;
 	struct dentry *debugfs;
 
+	/*
+	 * serializes mac80211_hwsim_wake_tx_queue() in batched mode, and
+	 * protects tx_busy in airtime mode
+	 */
+	spinlock_t wake_tx_lock;
+
+	/*
+	 * Airtime mode: tx_timer sends one PPDU at a time and fires again
+	 * when it is off the air, to report the status of the frames that
+	 * were in it (tx_done) and send the next one. tx_busy is set while
+	 * the timer is armed, tx_ac is the next AC to send from.
+	 */
+	struct hrtimer tx_timer;
+	struct sk_buff_head tx_done;
+	bool tx_busy;
+	u8 tx_ac;
+
+	/* entries in hwsim_chan_index, one per channel */
+	struct list_head listeners;
+
+	/* number of links in hwsim_links this radio transmits on */
+	unsigned int n_links;
+	/* frames received on links with a delay, by due time in tstamp */
+	struct sk_buff_head rx_delayed;
+	struct hrtimer rx_delay_timer;
+
 	atomic_t pending_cookie;
 	struct sk_buff_head pending;	/* packets pending */
+
+	/* TX status with HE/EHT rates, reported by tx_status_work */
+	struct sk_buff_head tx_status;
+	struct work_struct tx_status_work;
 	/*
 	 * Only radios in the same group can communicate together (the
 	 * channel has to match too). Each bit represents a group. A
@@ -728,6 +841,22 @@ struct mac80211_hwsim_data {
 	int netgroup;
 	/* wmediumd portid responsible for netgroup of this radio */
 	u32 wmediumd;
+	/* wmediumd takes frames in HWSIM_CMD_FRAMES messages */
+	bool wmediumd_batch;
+
+	/*
+	 * HWSIM_CMD_FRAMES message being filled with nl_batch_n frames, their
+	 * cookies are used to drop them from the pending queue if it can't be
+	 * sent
+	 */
+	spinlock_t nl_batch_lock;
+	struct sk_buff *nl_batch;
+	void *nl_batch_hdr;
+	struct nlattr *nl_batch_frames;
+	unsigned int nl_batch_n;
+	u32 nl_batch_portid;
+	uintptr_t nl_batch_cookies[HWSIM_NL_BATCH_FRAMES];
+	struct hrtimer nl_batch_timer;
 
 	/* difference between this hw's clock and the real clock, in usecs */
 	s64 tsf_offset;
@@ -784,6 +913,234 @@ static struct mac80211_hwsim_data *get_hwsim_data_ref_from_addr(const u8 *addr)
 	return rhashtable_lookup_fast(&hwsim_radios_rht, addr, hwsim_rht_params);
 }
 
+static u32 hwsim_chan_key(int netgroup, u32 center_freq)
+{
+	return center_freq ^ ((u32)netgroup << 17);
+}
+
+static int hwsim_chan_listen(struct mac80211_hwsim_data *data,
+			     struct ieee80211_channel *chan)
+{
+	struct hwsim_chan_listener *l, *new;
+
+	if (!chan)
+		return 0;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	spin_lock_bh(&hwsim_radio_lock);
+	list_for_each_entry(l, &data->listeners, list) {
+		if (l->center_freq == chan->center_freq) {
+			l->refs++;
+			goto out;
+		}
+	}
+
+	new->data = data;
+	new->center_freq = chan->center_freq;
+	new->refs = 1;
+	list_add(&new->list, &data->listeners);
+	hash_add_rcu(hwsim_chan_index, &new->hnode,
+		     hwsim_chan_key(data->netgroup, new->center_freq));
+	new = NULL;
+out:
+	spin_unlock_bh(&hwsim_radio_lock);
+	kfree(new);
+	return 0;
+}
+
+static void hwsim_chan_unlisten(struct mac80211_hwsim_data *data,
+				struct ieee80211_channel *chan)
+{
+	struct hwsim_chan_listener *l;
+
+	if (!chan)
+		return;
+
+	spin_lock_bh(&hwsim_radio_lock);
+	list_for_each_entry(l, &data->listeners, list) {
+		if (l->center_freq != chan->center_freq)
+			continue;
+
+		if (!--l->refs) {
+			hash_del_rcu(&l->hnode);
+			list_del(&l->list);
+			kfree_rcu(l, rcu_head);
+		}
+		break;
+	}
+	spin_unlock_bh(&hwsim_radio_lock);
+}
+
+/* must be called after unregistering the radio, before freeing it */
+static void hwsim_chan_unlisten_all(struct mac80211_hwsim_data *data)
+{
+	struct hwsim_chan_listener *l, *tmp;
+
+	spin_lock_bh(&hwsim_radio_lock);
+	list_for_each_entry_safe(l, tmp, &data->listeners, list) {
+		hash_del_rcu(&l->hnode);
+		list_del(&l->list);
+		kfree_rcu(l, rcu_head);
+	}
+	spin_unlock_bh(&hwsim_radio_lock);
+
+	/* wait for the datapath to stop delivering frames to it */
+	synchronize_rcu();
+}
+
+static void hwsim_chan_unlisten_scan(struct mac80211_hwsim_data *data,
+				     struct cfg80211_scan_request *req)
+{
+	int i;
+
+	for (i = 0; i < req->n_channels; i++)
+		hwsim_chan_unlisten(data, req->channels[i]);
+}
+
+static u32 hwsim_link_key(struct mac80211_hwsim_data *tx,
+			  struct mac80211_hwsim_data *rx)
+{
+	return ((u32)tx->idx << 16) ^ rx->idx;
+}
+
+/* called under RCU or hwsim_radio_lock */
+static struct hwsim_link *hwsim_link_find(struct mac80211_hwsim_data *tx,
+					  struct mac80211_hwsim_data *rx)
+{
+	struct hwsim_link *link;
+
+	hash_for_each_possible_rcu(hwsim_links, link, hnode,
+				   hwsim_link_key(tx, rx)) {
+		if (link->tx == tx && link->rx == rx)
+			return link;
+	}
+
+	return NULL;
+}
+
+static void hwsim_link_free(struct hwsim_link *link)
+{
+	lockdep_assert_held(&hwsim_radio_lock);
+
+	link->tx->n_links--;
+	hash_del_rcu(&link->hnode);
+	kfree_rcu(link, rcu_head);
+}
+
+/* must be followed by an RCU grace period before freeing the radio */
+static void hwsim_links_del_radio(struct mac80211_hwsim_data *data)
+{
+	struct hlist_node *tmp;
+	struct hwsim_link *link;
+	int bkt;
+
+	spin_lock_bh(&hwsim_radio_lock);
+	hash_for_each_safe(hwsim_links, bkt, tmp, link, hnode) {
+		if (link->tx == data || link->rx == data)
+			hwsim_link_free(link);
+	}
+	spin_unlock_bh(&hwsim_radio_lock);
+}
+
+/*
+ * SNR in dB at which the frames sent at an MCS see 10% PER, at 20 MHz with
+ * one spatial stream, close to the minimum sensitivities of the standard.
+ * HT, VHT, HE and EHT share the MCS table.
+ */
+static const s8 hwsim_mcs_snr[] = {
+	2, 5, 9, 11, 15, 18, 20, 25, 29, 31, 34, 37, 40, 43,
+};
+
+static const struct {
+	u16 bitrate;
+	s8 snr;
+} hwsim_legacy_snr[] = {
+	{ 10, 0 }, { 20, 1 }, { 55, 4 }, { 110, 7 },
+	{ 60, 2 }, { 90, 4 }, { 120, 5 }, { 180, 8 },
+	{ 240, 11 }, { 360, 15 }, { 480, 19 }, { 540, 20 },
+};
+
+/* PER in per mille by the SNR margin over the 10% PER point, from -4 dB */
+static const u16 hwsim_per_curve[] = {
+	1000, 900, 700, 400, 100, 30, 10, 3, 0,
+};
+
+static u32 hwsim_link_per(struct ieee80211_hw *hw,
+			  const struct ieee80211_rx_status *rx_status, s32 snr)
+{
+	struct ieee80211_supported_band *sband;
+	int i, req = 0, margin;
+
+	switch (rx_status->encoding) {
+	case RX_ENC_LEGACY:
+		sband = hw->wiphy->bands[rx_status->band];
+		if (!sband || rx_status->rate_idx >= sband->n_bitrates)
+			break;
+		for (i = 0; i < ARRAY_SIZE(hwsim_legacy_snr); i++) {
+			if (hwsim_legacy_snr[i].bitrate ==
+			    sband->bitrates[rx_status->rate_idx].bitrate) {
+				req = hwsim_legacy_snr[i].snr;
+				break;
+			}
+		}
+		break;
+	case RX_ENC_HT:
+		/* about 3 dB more for each additional spatial stream */
+		req = hwsim_mcs_snr[rx_status->rate_idx % 8] +
+		      3 * (rx_status->rate_idx / 8);
+		break;
+	default:
+		req = hwsim_mcs_snr[min_t(u8, rx_status->rate_idx,
+					  ARRAY_SIZE(hwsim_mcs_snr) - 1)] +
+		      3 * (max_t(u8, rx_status->nss, 1) - 1);
+		break;
+	}
+
+	/* the noise grows by 3 dB with each doubling of the bandwidth */
+	switch (rx_status->bw) {
+	case RATE_INFO_BW_40:
+		req += 3;
+		break;
+	case RATE_INFO_BW_80:
+		req += 6;
+		break;
+	case RATE_INFO_BW_160:
+		req += 9;
+		break;
+	case RATE_INFO_BW_320:
+		req += 12;
+		break;
+	default:
+		break;
+	}
+
+	margin = snr - req + 4;
+	if (margin < 0)
+		return 1000;
+	if (margin >= ARRAY_SIZE(hwsim_per_curve))
+		return 0;
+	return hwsim_per_curve[margin];
+}
+
+static bool hwsim_link_lost(struct ieee80211_hw *hw,
+			    const struct hwsim_link *link,
+			    const struct ieee80211_rx_status *rx_status)
+{
+	u32 per;
+
+	if (link->loss && get_random_u32_below(1000) < link->loss)
+		return true;
+
+	if (!link->has_snr)
+		return false;
+
+	per = hwsim_link_per(hw, rx_status, link->snr);
+	return per && get_random_u32_below(1000) < per;
+}
+
 /* MAC80211_HWSIM netlink family */
 static struct genl_family hwsim_genl_family;
 
@@ -926,6 +1283,14 @@ static const struct nla_policy hwsim_genl_policy[HWSIM_ATTR_MAX + 1] = {
 	[HWSIM_ATTR_PMSR_SUPPORT] = NLA_POLICY_NESTED(hwsim_pmsr_capa_policy),
 	[HWSIM_ATTR_PMSR_RESULT] = NLA_POLICY_NESTED(hwsim_pmsr_peers_result_policy),
 	[HWSIM_ATTR_MULTI_RADIO] = { .type = NLA_FLAG },
+	[HWSIM_ATTR_LINK_SNR] = NLA_POLICY_RANGE(NLA_S32, -20, 100),
+	[HWSIM_ATTR_LINK_LOSS] = NLA_POLICY_MAX(NLA_U32, 1000),
+	[HWSIM_ATTR_LINK_DELAY] = NLA_POLICY_MAX(NLA_U32, USEC_PER_SEC),
+	[HWSIM_ATTR_LINK_JITTER] = NLA_POLICY_MAX(NLA_U32, USEC_PER_SEC),
+	[HWSIM_ATTR_FRAMES_BATCH] = { .type = NLA_FLAG },
+	[HWSIM_ATTR_FRAMES] = { .type = NLA_NESTED_ARRAY },
+	[HWSIM_ATTR_TX_INFO_FRAMES] = { .type = NLA_NESTED_ARRAY },
+	[HWSIM_ATTR_RATE_INFO] = NLA_POLICY_NESTED(hwsim_rate_info_policy),
 };
 
 #if IS_REACHABLE(CONFIG_VIRTIO)
@@ -1249,7 +1614,11 @@ static void mac80211_hwsim_monitor_rx(struct ieee80211_hw *hw,
 	struct hwsim_radiotap_hdr *hdr;
 	u16 flags, bitrate;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx_skb);
-	struct ieee80211_rate *txrate = ieee80211_get_tx_rate(hw, info);
+	struct ieee80211_rate *txrate = NULL;
+
+	/* HE/EHT rates from the rate table aren't in the TX rates */
+	if (info->control.rates[0].idx >= 0)
+		txrate = ieee80211_get_tx_rate(hw, info);
 
 	if (!txrate)
 		bitrate = 0;
@@ -1507,51 +1876,61 @@ static inline u16 trans_tx_rate_flags_ieee2hwsim(struct ieee80211_tx_rate *rate)
 	return result;
 }
 
-static void mac80211_hwsim_tx_frame_nl(struct ieee80211_hw *hw,
-				       struct sk_buff *my_skb,
-				       int dst_portid,
-				       struct ieee80211_channel *channel)
+static int hwsim_put_rate_info(struct sk_buff *skb, int attrtype,
+			       const struct rate_info *ri)
 {
-	struct sk_buff *skb;
-	struct mac80211_hwsim_data *data = hw->priv;
-	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) my_skb->data;
-	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(my_skb);
-	void *msg_head;
-	unsigned int hwsim_flags = 0;
-	int i;
-	struct hwsim_tx_rate tx_attempts[IEEE80211_TX_MAX_RATES];
-	struct hwsim_tx_rate_flag tx_attempts_flags[IEEE80211_TX_MAX_RATES];
-	uintptr_t cookie;
+	struct nlattr *rate = nla_nest_start_noflag(skb, attrtype);
 
-	if (data->ps != PS_DISABLED)
-		hdr->frame_control |= cpu_to_le16(IEEE80211_FCTL_PM);
-	/* If the queue contains MAX_QUEUE skb's drop some */
-	if (skb_queue_len(&data->pending) >= MAX_QUEUE) {
-		/* Dropping until WARN_QUEUE level */
-		while (skb_queue_len(&data->pending) >= WARN_QUEUE) {
-			ieee80211_free_txskb(hw, skb_dequeue(&data->pending));
-			data->tx_dropped++;
-		}
-	}
+	if (!rate)
+		return -EMSGSIZE;
 
-	skb = genlmsg_new(GENLMSG_DEFAULT_SIZE, GFP_ATOMIC);
-	if (skb == NULL)
-		goto nla_put_failure;
+	if (nla_put_u8(skb, HWSIM_RATE_INFO_ATTR_FLAGS, ri->flags) ||
+	    nla_put_u8(skb, HWSIM_RATE_INFO_ATTR_MCS, ri->mcs) ||
+	    nla_put_u16(skb, HWSIM_RATE_INFO_ATTR_LEGACY, ri->legacy) ||
+	    nla_put_u8(skb, HWSIM_RATE_INFO_ATTR_NSS, ri->nss) ||
+	    nla_put_u8(skb, HWSIM_RATE_INFO_ATTR_BW, ri->bw))
+		return -EMSGSIZE;
 
-	msg_head = genlmsg_put(skb, 0, 0, &hwsim_genl_family, 0,
-			       HWSIM_CMD_FRAME);
-	if (msg_head == NULL) {
-		pr_debug("mac80211_hwsim: problem with msg_head\n");
-		goto nla_put_failure;
-	}
+	if (ri->flags & RATE_INFO_FLAGS_HE_MCS &&
+	    (nla_put_u8(skb, HWSIM_RATE_INFO_ATTR_HE_GI, ri->he_gi) ||
+	     nla_put_u8(skb, HWSIM_RATE_INFO_ATTR_HE_DCM, ri->he_dcm) ||
+	     nla_put_u8(skb, HWSIM_RATE_INFO_ATTR_HE_RU_ALLOC,
+			ri->he_ru_alloc)))
+		return -EMSGSIZE;
+
+	if (ri->flags & RATE_INFO_FLAGS_EHT_MCS &&
+	    (nla_put_u8(skb, HWSIM_RATE_INFO_ATTR_EHT_GI, ri->eht_gi) ||
+	     nla_put_u8(skb, HWSIM_RATE_INFO_ATTR_EHT_RU_ALLOC,
+			ri->eht_ru_alloc)))
+		return -EMSGSIZE;
+
+	nla_nest_end(skb, rate);
+	return 0;
+}
+
+static int hwsim_put_frame_nl(struct sk_buff *skb,
+			      struct mac80211_hwsim_data *data,
+			      struct sk_buff *my_skb,
+			      struct ieee80211_channel *channel,
+			      const struct rate_info *txrate,
+			      uintptr_t cookie)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(my_skb);
+	struct hwsim_tx_rate tx_attempts[IEEE80211_TX_MAX_RATES];
+	struct hwsim_tx_rate_flag tx_attempts_flags[IEEE80211_TX_MAX_RATES];
+	struct nlattr *frame_attr;
+	unsigned int hwsim_flags = 0;
+	int i;
 
 	if (nla_put(skb, HWSIM_ATTR_ADDR_TRANSMITTER,
 		    ETH_ALEN, data->addresses[1].addr))
-		goto nla_put_failure;
+		return -EMSGSIZE;
 
-	/* We get the skb->data */
-	if (nla_put(skb, HWSIM_ATTR_FRAME, my_skb->len, my_skb->data))
-		goto nla_put_failure;
+	/* We get the frame data, which may be in a frag list for A-MSDUs */
+	frame_attr = nla_reserve(skb, HWSIM_ATTR_FRAME, my_skb->len);
+	if (!frame_attr ||
+	    skb_copy_bits(my_skb, 0, nla_data(frame_attr), my_skb->len))
+		return -EMSGSIZE;
 
 	/* We get the flags for this transmission, and we translate them to
 	   wmediumd flags  */
@@ -1563,10 +1942,10 @@ static void mac80211_hwsim_tx_frame_nl(struct ieee80211_hw *hw,
 		hwsim_flags |= HWSIM_TX_CTL_NO_ACK;
 
 	if (nla_put_u32(skb, HWSIM_ATTR_FLAGS, hwsim_flags))
-		goto nla_put_failure;
+		return -EMSGSIZE;
 
 	if (nla_put_u32(skb, HWSIM_ATTR_FREQ, channel->center_freq))
-		goto nla_put_failure;
+		return -EMSGSIZE;
 
 	/* We get the tx control (rate and retries) info*/
 
@@ -1582,62 +1961,272 @@ static void mac80211_hwsim_tx_frame_nl(struct ieee80211_hw *hw,
 	if (nla_put(skb, HWSIM_ATTR_TX_INFO,
 		    sizeof(struct hwsim_tx_rate)*IEEE80211_TX_MAX_RATES,
 		    tx_attempts))
-		goto nla_put_failure;
+		return -EMSGSIZE;
 
 	if (nla_put(skb, HWSIM_ATTR_TX_INFO_FLAGS,
 		    sizeof(struct hwsim_tx_rate_flag) * IEEE80211_TX_MAX_RATES,
 		    tx_attempts_flags))
-		goto nla_put_failure;
+		return -EMSGSIZE;
+
+	/* HE/EHT rates from the rate table aren't in the TX info */
+	if (txrate && hwsim_put_rate_info(skb, HWSIM_ATTR_RATE_INFO, txrate))
+		return -EMSGSIZE;
 
-	/* We create a cookie to identify this skb */
-	cookie = atomic_inc_return(&data->pending_cookie);
-	info->rate_driver_data[0] = (void *)cookie;
 	if (nla_put_u64_64bit(skb, HWSIM_ATTR_COOKIE, cookie, HWSIM_ATTR_PAD))
-		goto nla_put_failure;
+		return -EMSGSIZE;
 
-	genlmsg_end(skb, msg_head);
+	return 0;
+}
 
-	if (hwsim_virtio_enabled) {
-		if (hwsim_tx_virtio(data, skb))
-			goto err_free_txskb;
-	} else {
-		if (hwsim_unicast_netgroup(data, skb, dst_portid))
-			goto err_free_txskb;
-	}
+/* drop the pending frames of a batch that could not be sent */
+static void hwsim_pending_drop(struct mac80211_hwsim_data *data,
+			       const uintptr_t *cookies, unsigned int n_cookies)
+{
+	struct sk_buff *skb, *tmp;
+	struct sk_buff_head drop;
+	unsigned long flags;
+	unsigned int i;
 
-	/* Enqueue the packet */
-	skb_queue_tail(&data->pending, my_skb);
-	data->tx_pkts++;
-	data->tx_bytes += my_skb->len;
-	return;
+	__skb_queue_head_init(&drop);
 
-nla_put_failure:
-	nlmsg_free(skb);
-err_free_txskb:
-	pr_debug("mac80211_hwsim: error occurred in %s\n", __func__);
-	ieee80211_free_txskb(hw, my_skb);
-	data->tx_failed++;
+	spin_lock_irqsave(&data->pending.lock, flags);
+	skb_queue_walk_safe(&data->pending, skb, tmp) {
+		struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+		uintptr_t cookie = (uintptr_t)info->rate_driver_data[0];
+
+		for (i = 0; i < n_cookies; i++)
+			if (cookies[i] == cookie)
+				break;
+		if (i == n_cookies)
+			continue;
+
+		__skb_unlink(skb, &data->pending);
+		__skb_queue_tail(&drop, skb);
+	}
+	spin_unlock_irqrestore(&data->pending.lock, flags);
+
+	while ((skb = __skb_dequeue(&drop))) {
+		ieee80211_free_txskb(data->hw, skb);
+		data->tx_failed++;
+	}
 }
 
-static bool hwsim_chans_compat(struct ieee80211_channel *c1,
-			       struct ieee80211_channel *c2)
+/* called with nl_batch_lock held */
+static void hwsim_nl_batch_flush(struct mac80211_hwsim_data *data)
 {
-	if (!c1 || !c2)
-		return false;
+	struct sk_buff *skb = data->nl_batch;
 
-	return c1->center_freq == c2->center_freq;
-}
+	if (!skb)
+		return;
 
-struct tx_iter_data {
-	struct ieee80211_channel *channel;
-	bool receive;
-};
+	data->nl_batch = NULL;
+	nla_nest_end(skb, data->nl_batch_frames);
+	genlmsg_end(skb, data->nl_batch_hdr);
 
-static void mac80211_hwsim_tx_iter(void *_data, u8 *addr,
-				   struct ieee80211_vif *vif)
+	if (hwsim_unicast_netgroup(data, skb, data->nl_batch_portid))
+		hwsim_pending_drop(data, data->nl_batch_cookies,
+				   data->nl_batch_n);
+}
+
+static enum hrtimer_restart hwsim_nl_batch_timer(struct hrtimer *timer)
 {
-	struct tx_iter_data *data = _data;
-	int i;
+	struct mac80211_hwsim_data *data =
+		container_of(timer, struct mac80211_hwsim_data, nl_batch_timer);
+
+	spin_lock_bh(&data->nl_batch_lock);
+	hwsim_nl_batch_flush(data);
+	spin_unlock_bh(&data->nl_batch_lock);
+
+	return HRTIMER_NORESTART;
+}
+
+/* forget about a batch that wasn't sent yet, its frames are still pending */
+static void hwsim_nl_batch_drop(struct mac80211_hwsim_data *data)
+{
+	hrtimer_cancel(&data->nl_batch_timer);
+
+	spin_lock_bh(&data->nl_batch_lock);
+	nlmsg_free(data->nl_batch);
+	data->nl_batch = NULL;
+	spin_unlock_bh(&data->nl_batch_lock);
+}
+
+/* called with nl_batch_lock held */
+static bool hwsim_nl_batch_start(struct mac80211_hwsim_data *data,
+				 u32 portid)
+{
+	struct sk_buff *skb;
+
+	skb = genlmsg_new(HWSIM_NL_BATCH_SIZE, GFP_ATOMIC);
+	if (!skb)
+		return false;
+
+	data->nl_batch_hdr = genlmsg_put(skb, 0, 0, &hwsim_genl_family, 0,
+					 HWSIM_CMD_FRAMES);
+	if (!data->nl_batch_hdr)
+		goto err;
+
+	data->nl_batch_frames = nla_nest_start_noflag(skb, HWSIM_ATTR_FRAMES);
+	if (!data->nl_batch_frames)
+		goto err;
+
+	data->nl_batch = skb;
+	data->nl_batch_portid = portid;
+	data->nl_batch_n = 0;
+	return true;
+err:
+	nlmsg_free(skb);
+	return false;
+}
+
+/*
+ * Add a frame to the HWSIM_CMD_FRAMES message for wmediumd, which is sent
+ * when it is full, or else from a timer that fires right away, i.e. once
+ * everything mac80211 transmits in the current softirq run was added.
+ * Returns false if the frame has to go out in a message of its own.
+ */
+static bool hwsim_nl_batch_add(struct mac80211_hwsim_data *data,
+			       struct sk_buff *my_skb, u32 portid,
+			       struct ieee80211_channel *channel,
+			       const struct rate_info *txrate,
+			       uintptr_t cookie)
+{
+	unsigned int len = my_skb->len + HWSIM_NL_FRAME_OVERHEAD;
+	struct nlattr *entry;
+	bool added = false;
+
+	/* long A-MSDUs would leave little room for anything else */
+	if (len > HWSIM_NL_BATCH_SIZE / 2)
+		return false;
+
+	spin_lock_bh(&data->nl_batch_lock);
+	if (data->nl_batch &&
+	    (data->nl_batch_portid != portid ||
+	     skb_tailroom(data->nl_batch) < len))
+		hwsim_nl_batch_flush(data);
+
+	if (!data->nl_batch && !hwsim_nl_batch_start(data, portid))
+		goto out;
+
+	entry = nla_nest_start_noflag(data->nl_batch, data->nl_batch_n + 1);
+	if (!entry)
+		goto out;
+
+	if (hwsim_put_frame_nl(data->nl_batch, data, my_skb, channel, txrate,
+			       cookie)) {
+		nla_nest_cancel(data->nl_batch, entry);
+		goto out;
+	}
+	nla_nest_end(data->nl_batch, entry);
+
+	skb_queue_tail(&data->pending, my_skb);
+	data->tx_pkts++;
+	data->tx_bytes += my_skb->len;
+
+	data->nl_batch_cookies[data->nl_batch_n++] = cookie;
+
+	if (data->nl_batch_n >= HWSIM_NL_BATCH_FRAMES)
+		hwsim_nl_batch_flush(data);
+	else if (data->nl_batch_n == 1)
+		hrtimer_start(&data->nl_batch_timer, 0, HRTIMER_MODE_REL_SOFT);
+	added = true;
+out:
+	spin_unlock_bh(&data->nl_batch_lock);
+	return added;
+}
+
+static void mac80211_hwsim_tx_frame_nl(struct ieee80211_hw *hw,
+				       struct sk_buff *my_skb,
+				       int dst_portid,
+				       struct ieee80211_channel *channel,
+				       const struct rate_info *txrate)
+{
+	struct sk_buff *skb;
+	struct mac80211_hwsim_data *data = hw->priv;
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) my_skb->data;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(my_skb);
+	void *msg_head;
+	uintptr_t cookie;
+
+	if (data->ps != PS_DISABLED)
+		hdr->frame_control |= cpu_to_le16(IEEE80211_FCTL_PM);
+	/* If the queue contains MAX_QUEUE skb's drop some */
+	if (skb_queue_len(&data->pending) >= MAX_QUEUE) {
+		/* Dropping until WARN_QUEUE level */
+		while (skb_queue_len(&data->pending) >= WARN_QUEUE) {
+			ieee80211_free_txskb(hw, skb_dequeue(&data->pending));
+			data->tx_dropped++;
+		}
+	}
+
+	/* We create a cookie to identify this skb */
+	cookie = atomic_inc_return(&data->pending_cookie);
+	info->rate_driver_data[0] = (void *)cookie;
+
+	if (!hwsim_virtio_enabled && READ_ONCE(data->wmediumd_batch) &&
+	    hwsim_nl_batch_add(data, my_skb, dst_portid, channel, txrate,
+			       cookie))
+		return;
+
+	/* A-MSDUs can be longer than the default message size */
+	skb = genlmsg_new(max_t(size_t, GENLMSG_DEFAULT_SIZE,
+				my_skb->len + 1024), GFP_ATOMIC);
+	if (skb == NULL)
+		goto nla_put_failure;
+
+	msg_head = genlmsg_put(skb, 0, 0, &hwsim_genl_family, 0,
+			       HWSIM_CMD_FRAME);
+	if (msg_head == NULL) {
+		pr_debug("mac80211_hwsim: problem with msg_head\n");
+		goto nla_put_failure;
+	}
+
+	if (hwsim_put_frame_nl(skb, data, my_skb, channel, txrate, cookie))
+		goto nla_put_failure;
+
+	genlmsg_end(skb, msg_head);
+
+	if (hwsim_virtio_enabled) {
+		if (hwsim_tx_virtio(data, skb))
+			goto err_free_txskb;
+	} else {
+		if (hwsim_unicast_netgroup(data, skb, dst_portid))
+			goto err_free_txskb;
+	}
+
+	/* Enqueue the packet */
+	skb_queue_tail(&data->pending, my_skb);
+	data->tx_pkts++;
+	data->tx_bytes += my_skb->len;
+	return;
+
+nla_put_failure:
+	nlmsg_free(skb);
+err_free_txskb:
+	pr_debug("mac80211_hwsim: error occurred in %s\n", __func__);
+	ieee80211_free_txskb(hw, my_skb);
+	data->tx_failed++;
+}
+
+static bool hwsim_chans_compat(struct ieee80211_channel *c1,
+			       struct ieee80211_channel *c2)
+{
+	if (!c1 || !c2)
+		return false;
+
+	return c1->center_freq == c2->center_freq;
+}
+
+struct tx_iter_data {
+	struct ieee80211_channel *channel;
+	bool receive;
+};
+
+static void mac80211_hwsim_tx_iter(void *_data, u8 *addr,
+				   struct ieee80211_vif *vif)
+{
+	struct tx_iter_data *data = _data;
+	int i;
 
 	for (i = 0; i < ARRAY_SIZE(vif->link_conf); i++) {
 		struct ieee80211_bss_conf *conf;
@@ -1708,11 +2297,15 @@ static void mac80211_hwsim_add_vendor_rtap(struct sk_buff *skb)
 }
 
 static void mac80211_hwsim_rx(struct mac80211_hwsim_data *data,
-			      struct ieee80211_rx_status *rx_status,
+			      const struct ieee80211_rx_status *rx_status,
 			      struct sk_buff *skb)
 {
+	struct ieee80211_rx_status *status = IEEE80211_SKB_RXCB(skb);
 	struct ieee80211_hdr *hdr = (void *)skb->data;
 
+	/* @rx_status may be shared by all receivers, the link isn't */
+	memcpy(status, rx_status, sizeof(*status));
+
 	if (!ieee80211_has_morefrags(hdr->frame_control) &&
 	    !is_multicast_ether_addr(hdr->addr1) &&
 	    (ieee80211_is_mgmt(hdr->frame_control) ||
@@ -1731,14 +2324,12 @@ static void mac80211_hwsim_rx(struct mac80211_hwsim_data *data,
 			else
 				sp->active_links_rx |= BIT(link_id);
 
-			rx_status->link_valid = true;
-			rx_status->link_id = link_id;
+			status->link_valid = true;
+			status->link_id = link_id;
 		}
 		rcu_read_unlock();
 	}
 
-	memcpy(IEEE80211_SKB_RXCB(skb), rx_status, sizeof(*rx_status));
-
 	mac80211_hwsim_add_vendor_rtap(skb);
 
 	data->rx_pkts++;
@@ -1746,15 +2337,156 @@ static void mac80211_hwsim_rx(struct mac80211_hwsim_data *data,
 	ieee80211_rx_irqsafe(data->hw, skb);
 }
 
+static void mac80211_hwsim_rx_delayed(struct mac80211_hwsim_data *data,
+				      struct hwsim_link *link,
+				      struct ieee80211_rx_status *rx_status,
+				      struct sk_buff *skb, u32 delay)
+{
+	ktime_t due = ktime_add_us(ktime_get(), delay);
+	struct sk_buff *pos;
+
+	memcpy(IEEE80211_SKB_RXCB(skb), rx_status, sizeof(*rx_status));
+
+	spin_lock_bh(&data->rx_delayed.lock);
+	/* the jitter doesn't reorder the frames of a link */
+	if (ktime_before(due, link->last_due))
+		due = link->last_due;
+	link->last_due = due;
+	skb->tstamp = due;
+
+	skb_queue_reverse_walk(&data->rx_delayed, pos) {
+		if (!ktime_after(pos->tstamp, due))
+			break;
+	}
+	__skb_queue_after(&data->rx_delayed, pos, skb);
+
+	if (skb_peek(&data->rx_delayed) == skb)
+		hrtimer_start(&data->rx_delay_timer, due, HRTIMER_MODE_ABS_SOFT);
+	spin_unlock_bh(&data->rx_delayed.lock);
+}
+
+static enum hrtimer_restart mac80211_hwsim_rx_delay_timer(struct hrtimer *timer)
+{
+	struct mac80211_hwsim_data *data =
+		container_of(timer, struct mac80211_hwsim_data, rx_delay_timer);
+	struct ieee80211_rx_status rx_status;
+	ktime_t now = ktime_get();
+	struct sk_buff_head due;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&due);
+
+	spin_lock(&data->rx_delayed.lock);
+	while ((skb = skb_peek(&data->rx_delayed)) &&
+	       !ktime_after(skb->tstamp, now)) {
+		__skb_unlink(skb, &data->rx_delayed);
+		__skb_queue_tail(&due, skb);
+	}
+	if (skb)
+		hrtimer_start(timer, skb->tstamp, HRTIMER_MODE_ABS_SOFT);
+	spin_unlock(&data->rx_delayed.lock);
+
+	while ((skb = __skb_dequeue(&due))) {
+		if (!data->started) {
+			dev_kfree_skb(skb);
+			continue;
+		}
+
+		memcpy(&rx_status, IEEE80211_SKB_RXCB(skb), sizeof(rx_status));
+		skb->tstamp = 0;
+		mac80211_hwsim_rx(data, &rx_status, skb);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Set the rate of @rx_status from @ri, which may also come from user space.
+ * Returns false if it isn't a valid rate in the band of @rx_status.
+ */
+static bool hwsim_rx_status_set_rate(struct ieee80211_hw *hw,
+				     struct ieee80211_rx_status *rx_status,
+				     const struct rate_info *ri)
+{
+	struct ieee80211_supported_band *sband;
+	int i;
+
+	rx_status->bw = ri->bw;
+
+	if (ri->flags & RATE_INFO_FLAGS_EHT_MCS) {
+		if (ri->mcs > 15 || !ri->nss || ri->nss > 8 ||
+		    ri->eht_gi > NL80211_RATE_INFO_EHT_GI_3_2 ||
+		    ri->eht_ru_alloc > NL80211_RATE_INFO_EHT_RU_ALLOC_4x996 ||
+		    ri->bw == RATE_INFO_BW_HE_RU || ri->bw > RATE_INFO_BW_EHT_RU)
+			return false;
+		rx_status->encoding = RX_ENC_EHT;
+		rx_status->eht.gi = ri->eht_gi;
+		rx_status->eht.ru = ri->eht_ru_alloc;
+	} else if (ri->flags & RATE_INFO_FLAGS_HE_MCS) {
+		if (ri->mcs > 11 || !ri->nss || ri->nss > 8 ||
+		    ri->he_gi > NL80211_RATE_INFO_HE_GI_3_2 || ri->he_dcm > 1 ||
+		    ri->he_ru_alloc > NL80211_RATE_INFO_HE_RU_ALLOC_2x996 ||
+		    ri->bw > RATE_INFO_BW_HE_RU)
+			return false;
+		rx_status->encoding = RX_ENC_HE;
+		rx_status->he_gi = ri->he_gi;
+		rx_status->he_dcm = ri->he_dcm;
+		rx_status->he_ru = ri->he_ru_alloc;
+	} else if (ri->flags & RATE_INFO_FLAGS_VHT_MCS) {
+		if (ri->mcs > 9 || !ri->nss || ri->nss > 8 ||
+		    ri->bw > RATE_INFO_BW_160)
+			return false;
+		rx_status->encoding = RX_ENC_VHT;
+	} else if (ri->flags & RATE_INFO_FLAGS_MCS) {
+		if (ri->mcs > 76 || ri->bw > RATE_INFO_BW_40)
+			return false;
+		rx_status->encoding = RX_ENC_HT;
+	} else {
+		/* legacy rates are given by their bitrate */
+		sband = hw->wiphy->bands[rx_status->band];
+		if (!sband || ri->bw > RATE_INFO_BW_10)
+			return false;
+
+		for (i = 0; i < sband->n_bitrates; i++) {
+			if (sband->bitrates[i].bitrate == ri->legacy) {
+				rx_status->encoding = RX_ENC_LEGACY;
+				rx_status->rate_idx = i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	rx_status->rate_idx = ri->mcs;
+	if (rx_status->encoding != RX_ENC_HT)
+		rx_status->nss = ri->nss;
+	if (ri->flags & RATE_INFO_FLAGS_SHORT_GI &&
+	    (rx_status->encoding == RX_ENC_HT ||
+	     rx_status->encoding == RX_ENC_VHT))
+		rx_status->enc_flags |= RX_ENC_FLAG_SHORT_GI;
+
+	return true;
+}
+
+/*
+ * Deliver a frame to the radios on its channel, sent at the rate
+ * @tx_rate_idx of its rate table or at @txrate if given.
+ */
 static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 					  struct sk_buff *skb,
-					  struct ieee80211_channel *chan)
+					  struct ieee80211_channel *chan,
+					  const struct rate_info *txrate,
+					  unsigned int tx_rate_idx)
 {
-	struct mac80211_hwsim_data *data = hw->priv, *data2;
+	struct mac80211_hwsim_data *data = hw->priv;
 	bool ack = false;
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_tx_rate *rate = &info->control.rates[tx_rate_idx];
 	struct ieee80211_rx_status rx_status;
+	struct hwsim_chan_listener *l;
+	struct page *page = NULL;
+	int signal;
 	u64 now;
 
 	memset(&rx_status, 0, sizeof(rx_status));
@@ -1762,31 +2494,35 @@ static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 	rx_status.freq = chan->center_freq;
 	rx_status.freq_offset = chan->freq_offset ? 1 : 0;
 	rx_status.band = chan->band;
-	if (info->control.rates[0].flags & IEEE80211_TX_RC_VHT_MCS) {
-		rx_status.rate_idx =
-			ieee80211_rate_get_vht_mcs(&info->control.rates[0]);
-		rx_status.nss =
-			ieee80211_rate_get_vht_nss(&info->control.rates[0]);
+	if (txrate) {
+		if (WARN_ON_ONCE(!hwsim_rx_status_set_rate(hw, &rx_status,
+							   txrate)))
+			return false;
+		goto rate_done;
+	}
+	if (rate->flags & IEEE80211_TX_RC_VHT_MCS) {
+		rx_status.rate_idx = ieee80211_rate_get_vht_mcs(rate);
+		rx_status.nss = ieee80211_rate_get_vht_nss(rate);
 		rx_status.encoding = RX_ENC_VHT;
 	} else {
-		rx_status.rate_idx = info->control.rates[0].idx;
-		if (info->control.rates[0].flags & IEEE80211_TX_RC_MCS)
+		rx_status.rate_idx = rate->idx;
+		if (rate->flags & IEEE80211_TX_RC_MCS)
 			rx_status.encoding = RX_ENC_HT;
 	}
-	if (info->control.rates[0].flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+	if (rate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
 		rx_status.bw = RATE_INFO_BW_40;
-	else if (info->control.rates[0].flags & IEEE80211_TX_RC_80_MHZ_WIDTH)
+	else if (rate->flags & IEEE80211_TX_RC_80_MHZ_WIDTH)
 		rx_status.bw = RATE_INFO_BW_80;
-	else if (info->control.rates[0].flags & IEEE80211_TX_RC_160_MHZ_WIDTH)
+	else if (rate->flags & IEEE80211_TX_RC_160_MHZ_WIDTH)
 		rx_status.bw = RATE_INFO_BW_160;
 	else
 		rx_status.bw = RATE_INFO_BW_20;
-	if (info->control.rates[0].flags & IEEE80211_TX_RC_SHORT_GI)
+	if (rate->flags & IEEE80211_TX_RC_SHORT_GI)
 		rx_status.enc_flags |= RX_ENC_FLAG_SHORT_GI;
-	/* TODO: simulate optional packet loss */
-	rx_status.signal = data->rx_rssi;
+rate_done:
+	signal = data->rx_rssi;
 	if (info->control.vif)
-		rx_status.signal += info->control.vif->bss_conf.txpower;
+		signal += info->control.vif->bss_conf.txpower;
 
 	if (data->ps != PS_DISABLED)
 		hdr->frame_control |= cpu_to_le16(IEEE80211_FCTL_PM);
@@ -1814,14 +2550,22 @@ static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 	}
 
 	/* Copy skb to all enabled radios that are on the current frequency */
-	spin_lock(&hwsim_radio_lock);
-	list_for_each_entry(data2, &hwsim_radios, list) {
+	rcu_read_lock();
+	hash_for_each_possible_rcu(hwsim_chan_index, l, hnode,
+				   hwsim_chan_key(data->netgroup,
+						  chan->center_freq)) {
+		struct mac80211_hwsim_data *data2 = l->data;
+		struct hwsim_link *link;
 		struct sk_buff *nskb;
 		struct tx_iter_data tx_iter_data = {
 			.receive = false,
 			.channel = chan,
 		};
 
+		if (l->center_freq != chan->center_freq ||
+		    data->netgroup != data2->netgroup)
+			continue;
+
 		if (data == data2)
 			continue;
 
@@ -1832,9 +2576,6 @@ static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 		if (!(data->group & data2->group))
 			continue;
 
-		if (data->netgroup != data2->netgroup)
-			continue;
-
 		if (!hwsim_chans_compat(chan, data2->tmp_chan) &&
 		    !hwsim_chans_compat(chan, data2->channel)) {
 			ieee80211_iterate_active_interfaces_atomic(
@@ -1844,42 +2585,117 @@ static bool mac80211_hwsim_tx_frame_no_nl(struct ieee80211_hw *hw,
 				continue;
 		}
 
+		link = hwsim_link_find(data, data2);
+		if (link && hwsim_link_lost(hw, link, &rx_status))
+			continue;
+
+		if (link && link->has_snr)
+			rx_status.signal = HWSIM_NOISE_FLOOR + link->snr;
+		else
+			rx_status.signal = signal;
+
 		/*
 		 * reserve some space for our vendor and the normal
 		 * radiotap header, since we're copying anyway
 		 */
 		if (skb->len < PAGE_SIZE && paged_rx) {
-			struct page *page = alloc_page(GFP_ATOMIC);
-
-			if (!page)
-				continue;
+			/*
+			 * Copy the frame once, all receivers then share
+			 * the page. It is only read from, mac80211 pulls
+			 * the headers it modifies into the linear part
+			 * and linearizes the frame for decryption.
+			 */
+			if (!page) {
+				page = alloc_page(GFP_ATOMIC);
+				if (!page)
+					continue;
+				skb_copy_bits(skb, 0, page_address(page),
+					      skb->len);
+			}
 
 			nskb = dev_alloc_skb(128);
-			if (!nskb) {
-				__free_page(page);
+			if (!nskb)
 				continue;
-			}
 
-			memcpy(page_address(page), skb->data, skb->len);
+			get_page(page);
 			skb_add_rx_frag(nskb, 0, page, 0, skb->len, skb->len);
+			skb_shinfo(nskb)->flags |= SKBFL_SHARED_FRAG;
 		} else {
 			nskb = skb_copy(skb, GFP_ATOMIC);
 			if (!nskb)
 				continue;
 		}
 
-		if (mac80211_hwsim_addr_match(data2, hdr->addr1))
+		/* group addressed frames are never acked */
+		if (!ack && !is_multicast_ether_addr(hdr->addr1) &&
+		    mac80211_hwsim_addr_match(data2, hdr->addr1))
 			ack = true;
 
 		rx_status.mactime = now + data2->tsf_offset;
 
+		if (link && (link->delay || link->jitter)) {
+			u32 delay = link->delay;
+
+			if (link->jitter)
+				delay += get_random_u32_below(link->jitter + 1);
+			rx_status.mactime += delay;
+			mac80211_hwsim_rx_delayed(data2, link, &rx_status,
+						  nskb, delay);
+			continue;
+		}
+
 		mac80211_hwsim_rx(data2, &rx_status, nskb);
 	}
-	spin_unlock(&hwsim_radio_lock);
+	rcu_read_unlock();
+
+	if (page)
+		put_page(page);
 
 	return ack;
 }
 
+/*
+ * Send a frame on the internal medium. Without links the frame is received
+ * perfectly, so it is sent once at the most favorable rate. Otherwise it
+ * is retried along its rate table until it is acked, as hardware would.
+ * The attempts at each rate are counted in @tries.
+ */
+static bool mac80211_hwsim_tx_attempts(struct ieee80211_hw *hw,
+				       struct sk_buff *skb,
+				       struct ieee80211_channel *chan,
+				       const struct rate_info *txrate,
+				       u8 *tries)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (void *)skb->data;
+	bool retry = READ_ONCE(data->n_links) &&
+		     !(txi->flags & IEEE80211_TX_CTL_NO_ACK);
+	int i, n;
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		struct ieee80211_tx_rate *rate = &txi->control.rates[i];
+
+		if (i && (!retry || rate->idx < 0))
+			break;
+
+		for (n = 0; n < max_t(u8, rate->count, 1); n++) {
+			if (i || n)
+				hdr->frame_control |=
+					cpu_to_le16(IEEE80211_FCTL_RETRY);
+
+			tries[i]++;
+			if (mac80211_hwsim_tx_frame_no_nl(hw, skb, chan,
+							  txrate, i))
+				return true;
+			if (!retry)
+				return false;
+		}
+	}
+
+	return false;
+}
+
 static struct ieee80211_bss_conf *
 mac80211_hwsim_select_tx_link(struct mac80211_hwsim_data *data,
 			      struct ieee80211_vif *vif,
@@ -1930,23 +2746,144 @@ mac80211_hwsim_select_tx_link(struct mac80211_hwsim_data *data,
 	return NULL;
 }
 
-static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
-			      struct ieee80211_tx_control *control,
-			      struct sk_buff *skb)
+/*
+ * HE/EHT rates don't fit into the TX rates, so they're only in the station's
+ * rate table, or in the probe info if rate control wants to sample one. Pick
+ * the rate like a device with a firmware rate table would.
+ */
+static bool mac80211_hwsim_get_he_rate(struct ieee80211_hw *hw,
+				       struct ieee80211_sta *sta,
+				       struct ieee80211_tx_info *txi,
+				       struct rate_info *ri)
+{
+	struct ieee80211_sta_rates *ratetbl;
+	u16 flags;
+	u8 idx;
+
+	if (!sta || !ieee80211_hw_check(hw, SUPPORTS_HE_RC_TABLE) ||
+	    txi->control.rates[0].idx >= 0)
+		return false;
+
+	memset(ri, 0, sizeof(*ri));
+
+	if (txi->control.probe_he || txi->control.probe_eht) {
+		idx = txi->control.probe_idx;
+		ri->bw = txi->control.probe_bw;
+		ri->flags = txi->control.probe_eht ? RATE_INFO_FLAGS_EHT_MCS :
+						     RATE_INFO_FLAGS_HE_MCS;
+	} else {
+		ratetbl = rcu_dereference(sta->rates);
+		if (!ratetbl)
+			return false;
+
+		flags = ratetbl->rate[0].flags;
+		if (!(flags & (IEEE80211_TX_RC_HE_MCS |
+			       IEEE80211_TX_RC_EHT_MCS)))
+			return false;
+
+		idx = ratetbl->rate[0].idx;
+		ri->flags = flags & IEEE80211_TX_RC_EHT_MCS ?
+			    RATE_INFO_FLAGS_EHT_MCS : RATE_INFO_FLAGS_HE_MCS;
+		if (flags & IEEE80211_TX_RC_320_MHZ_WIDTH)
+			ri->bw = RATE_INFO_BW_320;
+		else if (flags & IEEE80211_TX_RC_160_MHZ_WIDTH)
+			ri->bw = RATE_INFO_BW_160;
+		else if (flags & IEEE80211_TX_RC_80_MHZ_WIDTH)
+			ri->bw = RATE_INFO_BW_80;
+		else if (flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+			ri->bw = RATE_INFO_BW_40;
+		else
+			ri->bw = RATE_INFO_BW_20;
+	}
+
+	ri->mcs = idx & 0xf;
+	ri->nss = (idx >> 4) + 1;
+	if (ri->flags & RATE_INFO_FLAGS_EHT_MCS)
+		ri->eht_gi = NL80211_RATE_INFO_EHT_GI_0_8;
+	else
+		ri->he_gi = NL80211_RATE_INFO_HE_GI_0_8;
+
+	return true;
+}
+
+/*
+ * The HE/EHT rate can only be reported with ieee80211_tx_status_ext(), which
+ * can't be called from the TX path. Radios with HE rate tables report all
+ * frames from here, so it's not mixed with ieee80211_tx_status_irqsafe().
+ */
+static void mac80211_hwsim_tx_status_work(struct work_struct *work)
+{
+	struct mac80211_hwsim_data *data =
+		container_of(work, struct mac80211_hwsim_data, tx_status_work);
+	struct sk_buff *skb;
+
+	while ((skb = skb_dequeue(&data->tx_status))) {
+		struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
+		struct ieee80211_hdr *hdr = (void *)skb->data;
+		struct ieee80211_rate_status rs = {
+			.try_count = 1,
+		};
+		struct ieee80211_tx_status status = {
+			.skb = skb,
+			.info = txi,
+		};
+
+		memcpy(&rs.rate_idx, txi->status.status_driver_data,
+		       sizeof(rs.rate_idx));
+
+		local_bh_disable();
+		rcu_read_lock();
+		status.sta = ieee80211_find_sta_by_ifaddr(data->hw, hdr->addr1,
+							  hdr->addr2);
+		if (status.sta && rs.rate_idx.flags) {
+			status.rates = &rs;
+			status.n_rates = 1;
+		}
+		ieee80211_tx_status_ext(data->hw, &status);
+		rcu_read_unlock();
+		local_bh_enable();
+	}
+}
+
+static void mac80211_hwsim_tx_report(struct ieee80211_hw *hw,
+				     struct sk_buff *skb)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+
+	if (ieee80211_hw_check(hw, SUPPORTS_HE_RC_TABLE)) {
+		skb_queue_tail(&data->tx_status, skb);
+		schedule_work(&data->tx_status_work);
+		return;
+	}
+
+	ieee80211_tx_status_irqsafe(hw, skb);
+}
+
+/*
+ * Transmit a frame. If @done is given, a frame transmitted on the internal
+ * medium is added to it instead of reporting its status, and true is
+ * returned; the caller then reports it through mac80211_hwsim_tx_report().
+ */
+static bool __mac80211_hwsim_tx(struct ieee80211_hw *hw,
+				struct ieee80211_tx_control *control,
+				struct sk_buff *skb,
+				struct sk_buff_head *done)
 {
 	struct mac80211_hwsim_data *data = hw->priv;
 	struct ieee80211_tx_info *txi = IEEE80211_SKB_CB(skb);
 	struct ieee80211_hdr *hdr = (void *)skb->data;
 	struct ieee80211_chanctx_conf *chanctx_conf;
 	struct ieee80211_channel *channel;
-	bool ack;
+	struct rate_info he_rate;
+	u8 tries[IEEE80211_TX_MAX_RATES] = {};
+	bool ack, he_valid;
 	enum nl80211_chan_width confbw = NL80211_CHAN_WIDTH_20_NOHT;
 	u32 _portid, i;
 
 	if (WARN_ON(skb->len < 10)) {
 		/* Should not happen; just a sanity check for addr1 use */
 		ieee80211_free_txskb(hw, skb);
-		return;
+		return false;
 	}
 
 	if (!data->use_chanctx) {
@@ -1980,7 +2917,7 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 			     "link:%d, sta:%pM, sta->mlo:%d\n",
 			     link, sta ? sta->addr : NULL, sta ? sta->mlo : -1);
 			ieee80211_free_txskb(hw, skb);
-			return;
+			return false;
 		}
 
 		/* Do address translations only between shared links. It is
@@ -2004,99 +2941,308 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 			/* no need to look at A4, if present it's SA */
 		}
 
-		chanctx_conf = rcu_dereference(bss_conf->chanctx_conf);
-		if (chanctx_conf) {
-			channel = chanctx_conf->def.chan;
-			confbw = chanctx_conf->def.width;
-		} else {
-			channel = NULL;
-		}
-	}
+		chanctx_conf = rcu_dereference(bss_conf->chanctx_conf);
+		if (chanctx_conf) {
+			channel = chanctx_conf->def.chan;
+			confbw = chanctx_conf->def.width;
+		} else {
+			channel = NULL;
+		}
+	}
+
+	if (WARN(!channel, "TX w/o channel - queue = %d\n", txi->hw_queue)) {
+		ieee80211_free_txskb(hw, skb);
+		return false;
+	}
+
+	if (data->idle && !data->tmp_chan) {
+		wiphy_dbg(hw->wiphy, "Trying to TX when idle - reject\n");
+		ieee80211_free_txskb(hw, skb);
+		return false;
+	}
+
+	if (txi->control.vif)
+		hwsim_check_magic(txi->control.vif);
+	if (control->sta)
+		hwsim_check_sta_magic(control->sta);
+
+	if (ieee80211_hw_check(hw, SUPPORTS_RC_TABLE))
+		ieee80211_get_tx_rates(txi->control.vif, control->sta, skb,
+				       txi->control.rates,
+				       ARRAY_SIZE(txi->control.rates));
+
+	for (i = 0; i < ARRAY_SIZE(txi->control.rates); i++) {
+		u16 rflags = txi->control.rates[i].flags;
+		/* initialize to data->bw for 5/10 MHz handling */
+		enum nl80211_chan_width bw = data->bw;
+
+		if (txi->control.rates[i].idx == -1)
+			break;
+
+		if (rflags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+			bw = NL80211_CHAN_WIDTH_40;
+		else if (rflags & IEEE80211_TX_RC_80_MHZ_WIDTH)
+			bw = NL80211_CHAN_WIDTH_80;
+		else if (rflags & IEEE80211_TX_RC_160_MHZ_WIDTH)
+			bw = NL80211_CHAN_WIDTH_160;
+
+		if (WARN_ON(hwsim_get_chanwidth(bw) > hwsim_get_chanwidth(confbw)))
+			return false;
+	}
+
+	if (skb->len >= 24 + 8 &&
+	    ieee80211_is_probe_resp(hdr->frame_control)) {
+		/* fake header transmission time */
+		struct ieee80211_mgmt *mgmt;
+		struct ieee80211_rate *txrate;
+		/* TODO: get MCS */
+		int bitrate = 100;
+		u64 ts;
+
+		mgmt = (struct ieee80211_mgmt *)skb->data;
+		txrate = NULL;
+		if (txi->control.rates[0].idx >= 0)
+			txrate = ieee80211_get_tx_rate(hw, txi);
+		if (txrate)
+			bitrate = txrate->bitrate;
+		ts = mac80211_hwsim_get_tsf_raw();
+		mgmt->u.probe_resp.timestamp =
+			cpu_to_le64(ts + data->tsf_offset +
+				    24 * 8 * 10 / bitrate);
+	}
+
+	mac80211_hwsim_monitor_rx(hw, skb, channel);
+
+	he_valid = mac80211_hwsim_get_he_rate(hw, control->sta, txi, &he_rate);
+
+	/* wmediumd mode check */
+	_portid = READ_ONCE(data->wmediumd);
+
+	if (_portid || hwsim_virtio_enabled) {
+		/*
+		 * The control info isn't needed anymore, keep the rate for
+		 * the TX status in its place, the cookie is not overwritten.
+		 */
+		if (ieee80211_hw_check(hw, SUPPORTS_HE_RC_TABLE)) {
+			if (!he_valid)
+				memset(&he_rate, 0, sizeof(he_rate));
+			memcpy(txi->status.status_driver_data, &he_rate,
+			       sizeof(he_rate));
+		}
+		mac80211_hwsim_tx_frame_nl(hw, skb, _portid, channel,
+					   he_valid ? &he_rate : NULL);
+		return false;
+	}
+
+	/* NO wmediumd detected, perfect medium simulation */
+	data->tx_pkts++;
+	data->tx_bytes += skb->len;
+	ack = mac80211_hwsim_tx_attempts(hw, skb, channel,
+					 he_valid ? &he_rate : NULL, tries);
+
+	if (ack && skb->len >= 16)
+		mac80211_hwsim_monitor_ack(channel, hdr->addr2);
+
+	ieee80211_tx_info_clear_status(txi);
+
+	for (i = 0; i < ARRAY_SIZE(tries) && tries[i]; i++)
+		txi->control.rates[i].count = tries[i];
+	if (i < ARRAY_SIZE(tries))
+		txi->control.rates[i].idx = -1;
+
+	if (!(txi->flags & IEEE80211_TX_CTL_NO_ACK) && ack)
+		txi->flags |= IEEE80211_TX_STAT_ACK;
+
+	if (ieee80211_hw_check(hw, SUPPORTS_HE_RC_TABLE)) {
+		BUILD_BUG_ON(sizeof(he_rate) >
+			     sizeof(txi->status.status_driver_data));
+		if (!he_valid)
+			memset(&he_rate, 0, sizeof(he_rate));
+		memcpy(txi->status.status_driver_data, &he_rate,
+		       sizeof(he_rate));
+	}
+
+	if (done) {
+		__skb_queue_tail(done, skb);
+		return true;
+	}
+
+	mac80211_hwsim_tx_report(hw, skb);
+	return false;
+}
+
+static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
+			      struct ieee80211_tx_control *control,
+			      struct sk_buff *skb)
+{
+	__mac80211_hwsim_tx(hw, control, skb, NULL);
+}
+
+/* limits of an A-MPDU in airtime mode */
+#define HWSIM_TX_AMPDU_FRAMES	64
+#define HWSIM_TX_PPDU_AIRTIME	4000 /* usec */
+
+/*
+ * Send one PPDU from @txq: a single frame, or an A-MPDU of frames of a
+ * block ack session. Return its airtime in usec, frames handed to wmediumd
+ * don't take any airtime here.
+ */
+static u32 mac80211_hwsim_tx_ppdu(struct mac80211_hwsim_data *data,
+				  struct ieee80211_txq *txq)
+{
+	struct ieee80211_hw *hw = data->hw;
+	struct ieee80211_tx_control control = {
+		.sta = txq->sta,
+	};
+	struct ieee80211_tx_info *ampdu_info = NULL;
+	struct sk_buff_head skbs;
+	struct sk_buff *skb;
+	u32 airtime = 0, ampdu_len = 0;
+
+	__skb_queue_head_init(&skbs);
+
+	skb = ieee80211_tx_dequeue(hw, txq);
+	if (!skb)
+		return 0;
+	__skb_queue_tail(&skbs, skb);
+
+	if (IEEE80211_SKB_CB(skb)->flags & IEEE80211_TX_CTL_AMPDU)
+		ieee80211_tx_dequeue_bulk(hw, txq, &skbs,
+					  HWSIM_TX_AMPDU_FRAMES - 1,
+					  HWSIM_TX_PPDU_AIRTIME);
+
+	while ((skb = __skb_dequeue(&skbs))) {
+		struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+		bool ampdu = info->flags & IEEE80211_TX_CTL_AMPDU;
+		u32 len = skb->len + FCS_LEN;
+
+		if (!__mac80211_hwsim_tx(hw, &control, skb, &data->tx_done))
+			continue;
+
+		if (!ampdu) {
+			airtime += ieee80211_calc_tx_airtime(hw, info, len);
+			continue;
+		}
+
+		/* MPDU delimiter and padding, the preamble is sent once */
+		ampdu_len += 4 + ALIGN(len, 4);
+		if (!ampdu_info)
+			ampdu_info = info;
+	}
+
+	if (ampdu_info)
+		airtime += ieee80211_calc_tx_airtime(hw, ampdu_info, ampdu_len);
+
+	if (txq->sta && airtime)
+		ieee80211_sta_register_airtime(txq->sta, txq->tid, airtime, 0);
+
+	return airtime;
+}
+
+/* the ACs take turns, there is no EDCA contention between them */
+static u32 mac80211_hwsim_tx_burst(struct mac80211_hwsim_data *data)
+{
+	struct ieee80211_hw *hw = data->hw;
+	struct ieee80211_txq *txq;
+	u32 airtime = 0;
+	int i;
+
+	rcu_read_lock();
+	for (i = 0; i < IEEE80211_NUM_ACS && !airtime; i++) {
+		u8 ac = (data->tx_ac + i) % IEEE80211_NUM_ACS;
 
-	if (WARN(!channel, "TX w/o channel - queue = %d\n", txi->hw_queue)) {
-		ieee80211_free_txskb(hw, skb);
-		return;
-	}
+		ieee80211_txq_schedule_start(hw, ac);
+		while (!airtime && (txq = ieee80211_next_txq(hw, ac))) {
+			airtime = mac80211_hwsim_tx_ppdu(data, txq);
+			ieee80211_return_txq(hw, txq, false);
+		}
+		ieee80211_txq_schedule_end(hw, ac);
 
-	if (data->idle && !data->tmp_chan) {
-		wiphy_dbg(hw->wiphy, "Trying to TX when idle - reject\n");
-		ieee80211_free_txskb(hw, skb);
-		return;
+		if (airtime)
+			data->tx_ac = (ac + 1) % IEEE80211_NUM_ACS;
 	}
+	rcu_read_unlock();
 
-	if (txi->control.vif)
-		hwsim_check_magic(txi->control.vif);
-	if (control->sta)
-		hwsim_check_sta_magic(control->sta);
+	return airtime;
+}
 
-	if (ieee80211_hw_check(hw, SUPPORTS_RC_TABLE))
-		ieee80211_get_tx_rates(txi->control.vif, control->sta, skb,
-				       txi->control.rates,
-				       ARRAY_SIZE(txi->control.rates));
+static enum hrtimer_restart mac80211_hwsim_tx_timer(struct hrtimer *timer)
+{
+	struct mac80211_hwsim_data *data =
+		container_of(timer, struct mac80211_hwsim_data, tx_timer);
+	struct sk_buff *skb;
+	u32 airtime;
 
-	for (i = 0; i < ARRAY_SIZE(txi->control.rates); i++) {
-		u16 rflags = txi->control.rates[i].flags;
-		/* initialize to data->bw for 5/10 MHz handling */
-		enum nl80211_chan_width bw = data->bw;
+	/* the previous PPDU is off the air, this releases its AQL airtime */
+	while ((skb = __skb_dequeue(&data->tx_done)))
+		mac80211_hwsim_tx_report(data->hw, skb);
 
-		if (txi->control.rates[i].idx == -1)
-			break;
+	/* wakeups from now on must arm the timer again */
+	spin_lock(&data->wake_tx_lock);
+	data->tx_busy = false;
+	spin_unlock(&data->wake_tx_lock);
 
-		if (rflags & IEEE80211_TX_RC_40_MHZ_WIDTH)
-			bw = NL80211_CHAN_WIDTH_40;
-		else if (rflags & IEEE80211_TX_RC_80_MHZ_WIDTH)
-			bw = NL80211_CHAN_WIDTH_80;
-		else if (rflags & IEEE80211_TX_RC_160_MHZ_WIDTH)
-			bw = NL80211_CHAN_WIDTH_160;
+	airtime = mac80211_hwsim_tx_burst(data);
+	if (!airtime)
+		return HRTIMER_NORESTART;
 
-		if (WARN_ON(hwsim_get_chanwidth(bw) > hwsim_get_chanwidth(confbw)))
-			return;
-	}
+	spin_lock(&data->wake_tx_lock);
+	data->tx_busy = true;
+	hrtimer_start(&data->tx_timer, us_to_ktime(airtime),
+		      HRTIMER_MODE_REL_SOFT);
+	spin_unlock(&data->wake_tx_lock);
 
-	if (skb->len >= 24 + 8 &&
-	    ieee80211_is_probe_resp(hdr->frame_control)) {
-		/* fake header transmission time */
-		struct ieee80211_mgmt *mgmt;
-		struct ieee80211_rate *txrate;
-		/* TODO: get MCS */
-		int bitrate = 100;
-		u64 ts;
+	return HRTIMER_NORESTART;
+}
 
-		mgmt = (struct ieee80211_mgmt *)skb->data;
-		txrate = ieee80211_get_tx_rate(hw, txi);
-		if (txrate)
-			bitrate = txrate->bitrate;
-		ts = mac80211_hwsim_get_tsf_raw();
-		mgmt->u.probe_resp.timestamp =
-			cpu_to_le64(ts + data->tsf_offset +
-				    24 * 8 * 10 / bitrate);
+static void mac80211_hwsim_tx_kick(struct mac80211_hwsim_data *data)
+{
+	spin_lock_bh(&data->wake_tx_lock);
+	if (data->started && !data->tx_busy) {
+		data->tx_busy = true;
+		hrtimer_start(&data->tx_timer, 0, HRTIMER_MODE_REL_SOFT);
 	}
+	spin_unlock_bh(&data->wake_tx_lock);
+}
 
-	mac80211_hwsim_monitor_rx(hw, skb, channel);
+static void mac80211_hwsim_wake_tx_queue(struct ieee80211_hw *hw,
+					 struct ieee80211_txq *txq)
+{
+	struct mac80211_hwsim_data *data = hw->priv;
+	struct ieee80211_txq *queue;
+	struct sk_buff_head skbs;
+	struct sk_buff *skb;
 
-	/* wmediumd mode check */
-	_portid = READ_ONCE(data->wmediumd);
+	if (tx_airtime) {
+		mac80211_hwsim_tx_kick(data);
+		return;
+	}
 
-	if (_portid || hwsim_virtio_enabled)
-		return mac80211_hwsim_tx_frame_nl(hw, skb, _portid, channel);
+	if (!tx_dequeue_batch) {
+		ieee80211_handle_wake_tx_queue(hw, txq);
+		return;
+	}
 
-	/* NO wmediumd detected, perfect medium simulation */
-	data->tx_pkts++;
-	data->tx_bytes += skb->len;
-	ack = mac80211_hwsim_tx_frame_no_nl(hw, skb, channel);
+	__skb_queue_head_init(&skbs);
 
-	if (ack && skb->len >= 16)
-		mac80211_hwsim_monitor_ack(channel, hdr->addr2);
+	spin_lock(&data->wake_tx_lock);
 
-	ieee80211_tx_info_clear_status(txi);
+	ieee80211_txq_schedule_start(hw, txq->ac);
+	while ((queue = ieee80211_next_txq(hw, txq->ac))) {
+		struct ieee80211_tx_control control = {
+			.sta = queue->sta,
+		};
 
-	/* frame was transmitted at most favorable rate at first attempt */
-	txi->control.rates[0].count = 1;
-	txi->control.rates[1].idx = -1;
+		while (ieee80211_tx_dequeue_bulk(hw, queue, &skbs,
+						 tx_dequeue_batch, 0)) {
+			while ((skb = __skb_dequeue(&skbs)))
+				mac80211_hwsim_tx(hw, &control, skb);
+		}
+		ieee80211_return_txq(hw, queue, false);
+	}
+	ieee80211_txq_schedule_end(hw, txq->ac);
 
-	if (!(txi->flags & IEEE80211_TX_CTL_NO_ACK) && ack)
-		txi->flags |= IEEE80211_TX_STAT_ACK;
-	ieee80211_tx_status_irqsafe(hw, skb);
+	spin_unlock(&data->wake_tx_lock);
 }
 
 
@@ -2119,9 +3265,22 @@ static void mac80211_hwsim_stop(struct ieee80211_hw *hw, bool suspend)
 	for (i = 0; i < ARRAY_SIZE(data->link_data); i++)
 		hrtimer_cancel(&data->link_data[i].beacon_timer);
 
+	hwsim_nl_batch_drop(data);
 	while (!skb_queue_empty(&data->pending))
 		ieee80211_free_txskb(hw, skb_dequeue(&data->pending));
 
+	if (tx_airtime) {
+		hrtimer_cancel(&data->tx_timer);
+		data->tx_busy = false;
+		ieee80211_purge_tx_queue(hw, &data->tx_done);
+	}
+
+	hrtimer_cancel(&data->rx_delay_timer);
+	skb_queue_purge(&data->rx_delayed);
+
+	cancel_work_sync(&data->tx_status_work);
+	ieee80211_purge_tx_queue(hw, &data->tx_status);
+
 	wiphy_dbg(hw->wiphy, "%s\n", __func__);
 }
 
@@ -2210,11 +3369,11 @@ static void mac80211_hwsim_tx_frame(struct ieee80211_hw *hw,
 	mac80211_hwsim_monitor_rx(hw, skb, chan);
 
 	if (_portid || hwsim_virtio_enabled)
-		return mac80211_hwsim_tx_frame_nl(hw, skb, _portid, chan);
+		return mac80211_hwsim_tx_frame_nl(hw, skb, _portid, chan, NULL);
 
 	data->tx_pkts++;
 	data->tx_bytes += skb->len;
-	mac80211_hwsim_tx_frame_no_nl(hw, skb, chan);
+	mac80211_hwsim_tx_frame_no_nl(hw, skb, chan, NULL, 0);
 	dev_kfree_skb(skb);
 }
 
@@ -2385,6 +3544,7 @@ static int mac80211_hwsim_config(struct ieee80211_hw *hw, u32 changed)
 		[IEEE80211_SMPS_STATIC] = "static",
 		[IEEE80211_SMPS_DYNAMIC] = "dynamic",
 	};
+	struct ieee80211_channel *old_chan;
 	int idx;
 
 	if (conf->chandef.chan)
@@ -2411,6 +3571,13 @@ static int mac80211_hwsim_config(struct ieee80211_hw *hw, u32 changed)
 	WARN_ON(conf->chandef.chan && data->use_chanctx);
 
 	mutex_lock(&data->mutex);
+	old_chan = data->channel;
+	if (old_chan != conf->chandef.chan &&
+	    hwsim_chan_listen(data, conf->chandef.chan)) {
+		mutex_unlock(&data->mutex);
+		return -ENOMEM;
+	}
+
 	if (data->scanning && conf->chandef.chan) {
 		for (idx = 0; idx < ARRAY_SIZE(data->survey_data); idx++) {
 			if (data->survey_data[idx].channel == data->channel) {
@@ -2436,6 +3603,9 @@ static int mac80211_hwsim_config(struct ieee80211_hw *hw, u32 changed)
 		data->channel = conf->chandef.chan;
 		data->bw = conf->chandef.width;
 	}
+
+	if (old_chan != data->channel)
+		hwsim_chan_unlisten(data, old_chan);
 	mutex_unlock(&data->mutex);
 
 	for (idx = 0; idx < ARRAY_SIZE(data->link_data); idx++) {
@@ -2925,6 +4095,7 @@ static void hw_scan_work(struct work_struct *work)
 		};
 
 		wiphy_dbg(hwsim->hw->wiphy, "hw scan complete\n");
+		hwsim_chan_unlisten_scan(hwsim, req);
 		ieee80211_scan_completed(hwsim->hw, &info);
 		hwsim->hw_scan_request = NULL;
 		hwsim->hw_scan_vif = NULL;
@@ -2999,12 +4170,23 @@ static int mac80211_hwsim_hw_scan(struct ieee80211_hw *hw,
 {
 	struct mac80211_hwsim_data *hwsim = hw->priv;
 	struct cfg80211_scan_request *req = &hw_req->req;
+	int i;
 
 	mutex_lock(&hwsim->mutex);
 	if (WARN_ON(hwsim->tmp_chan || hwsim->hw_scan_request)) {
 		mutex_unlock(&hwsim->mutex);
 		return -EBUSY;
 	}
+
+	for (i = 0; i < req->n_channels; i++) {
+		if (hwsim_chan_listen(hwsim, req->channels[i])) {
+			while (i--)
+				hwsim_chan_unlisten(hwsim, req->channels[i]);
+			mutex_unlock(&hwsim->mutex);
+			return -ENOMEM;
+		}
+	}
+
 	hwsim->hw_scan_request = req;
 	hwsim->hw_scan_vif = vif;
 	hwsim->scan_chan_idx = 0;
@@ -3038,6 +4220,8 @@ static void mac80211_hwsim_cancel_hw_scan(struct ieee80211_hw *hw,
 	cancel_delayed_work_sync(&hwsim->hw_scan);
 
 	mutex_lock(&hwsim->mutex);
+	if (hwsim->hw_scan_request)
+		hwsim_chan_unlisten_scan(hwsim, hwsim->hw_scan_request);
 	ieee80211_scan_completed(hwsim->hw, &info);
 	hwsim->tmp_chan = NULL;
 	hwsim->hw_scan_request = NULL;
@@ -3108,6 +4292,8 @@ static void hw_roc_done(struct work_struct *work)
 
 	mutex_lock(&hwsim->mutex);
 	ieee80211_remain_on_channel_expired(hwsim->hw);
+	hwsim_chan_unlisten(hwsim, hwsim->roc_chan);
+	hwsim->roc_chan = NULL;
 	hwsim->tmp_chan = NULL;
 	mutex_unlock(&hwsim->mutex);
 
@@ -3128,6 +4314,11 @@ static int mac80211_hwsim_roc(struct ieee80211_hw *hw,
 		return -EBUSY;
 	}
 
+	if (hwsim_chan_listen(hwsim, chan)) {
+		mutex_unlock(&hwsim->mutex);
+		return -ENOMEM;
+	}
+
 	hwsim->roc_chan = chan;
 	hwsim->roc_duration = duration;
 	mutex_unlock(&hwsim->mutex);
@@ -3148,6 +4339,8 @@ static int mac80211_hwsim_croc(struct ieee80211_hw *hw,
 	cancel_delayed_work_sync(&hwsim->roc_done);
 
 	mutex_lock(&hwsim->mutex);
+	hwsim_chan_unlisten(hwsim, hwsim->roc_chan);
+	hwsim->roc_chan = NULL;
 	hwsim->tmp_chan = NULL;
 	mutex_unlock(&hwsim->mutex);
 
@@ -3156,9 +4349,42 @@ static int mac80211_hwsim_croc(struct ieee80211_hw *hw,
 	return 0;
 }
 
+static int mac80211_hwsim_listen_chanctx(struct ieee80211_hw *hw,
+					 struct ieee80211_chanctx_conf *ctx)
+{
+	struct hwsim_chanctx_priv *cp = (void *)ctx->drv_priv;
+	int err;
+
+	/* contexts are switched once for each of their interfaces */
+	if (cp->listen_chan == ctx->def.chan)
+		return 0;
+
+	err = hwsim_chan_listen(hw->priv, ctx->def.chan);
+	if (err)
+		return err;
+
+	cp->listen_chan = ctx->def.chan;
+	return 0;
+}
+
+static void mac80211_hwsim_unlisten_chanctx(struct ieee80211_hw *hw,
+					    struct ieee80211_chanctx_conf *ctx)
+{
+	struct hwsim_chanctx_priv *cp = (void *)ctx->drv_priv;
+
+	hwsim_chan_unlisten(hw->priv, cp->listen_chan);
+	cp->listen_chan = NULL;
+}
+
 static int mac80211_hwsim_add_chanctx(struct ieee80211_hw *hw,
 				      struct ieee80211_chanctx_conf *ctx)
 {
+	int err;
+
+	err = mac80211_hwsim_listen_chanctx(hw, ctx);
+	if (err)
+		return err;
+
 	hwsim_set_chanctx_magic(ctx);
 	wiphy_dbg(hw->wiphy,
 		  "add channel context control: %d MHz/width: %d/cfreqs:%d/%d MHz\n",
@@ -3176,17 +4402,33 @@ static void mac80211_hwsim_remove_chanctx(struct ieee80211_hw *hw,
 		  ctx->def.center_freq1, ctx->def.center_freq2);
 	hwsim_check_chanctx_magic(ctx);
 	hwsim_clear_chanctx_magic(ctx);
+	mac80211_hwsim_unlisten_chanctx(hw, ctx);
 }
 
 static void mac80211_hwsim_change_chanctx(struct ieee80211_hw *hw,
 					  struct ieee80211_chanctx_conf *ctx,
 					  u32 changed)
 {
+	struct hwsim_chanctx_priv *cp = (void *)ctx->drv_priv;
+	struct ieee80211_channel *old_chan = cp->listen_chan;
+
 	hwsim_check_chanctx_magic(ctx);
 	wiphy_dbg(hw->wiphy,
 		  "change channel context control: %d MHz/width: %d/cfreqs:%d/%d MHz\n",
 		  ctx->def.chan->center_freq, ctx->def.width,
 		  ctx->def.center_freq1, ctx->def.center_freq2);
+
+	if (old_chan == ctx->def.chan)
+		return;
+
+	/* keep receiving on the old channel rather than on none */
+	if (mac80211_hwsim_listen_chanctx(hw, ctx)) {
+		wiphy_warn(hw->wiphy,
+			   "failed to move channel context to %d MHz\n",
+			   ctx->def.chan->center_freq);
+		return;
+	}
+	hwsim_chan_unlisten(hw->priv, old_chan);
 }
 
 static int mac80211_hwsim_assign_vif_chanctx(struct ieee80211_hw *hw,
@@ -3268,6 +4510,11 @@ static int mac80211_hwsim_switch_vif_chanctx(struct ieee80211_hw *hw,
 			hwsim_check_chanctx_magic(vifs[i].new_ctx);
 			break;
 		case CHANCTX_SWMODE_SWAP_CONTEXTS:
+			if (mac80211_hwsim_listen_chanctx(hw, vifs[i].new_ctx))
+				wiphy_warn(hw->wiphy,
+					   "failed to listen on %d MHz\n",
+					   vifs[i].new_ctx->def.chan->center_freq);
+			mac80211_hwsim_unlisten_chanctx(hw, vifs[i].old_ctx);
 			hwsim_set_chanctx_magic(vifs[i].new_ctx);
 			hwsim_clear_chanctx_magic(vifs[i].old_ctx);
 			break;
@@ -3951,7 +5198,7 @@ out:
 
 #define HWSIM_COMMON_OPS					\
 	.tx = mac80211_hwsim_tx,				\
-	.wake_tx_queue = ieee80211_handle_wake_tx_queue,	\
+	.wake_tx_queue = mac80211_hwsim_wake_tx_queue,		\
 	.start = mac80211_hwsim_start,				\
 	.stop = mac80211_hwsim_stop,				\
 	.add_interface = mac80211_hwsim_add_interface,		\
@@ -5220,6 +6467,11 @@ static int mac80211_hwsim_new_radio(struct genl_info *info,
 	}
 
 	skb_queue_head_init(&data->pending);
+	skb_queue_head_init(&data->tx_status);
+	skb_queue_head_init(&data->tx_done);
+	skb_queue_head_init(&data->rx_delayed);
+	INIT_LIST_HEAD(&data->listeners);
+	INIT_WORK(&data->tx_status_work, mac80211_hwsim_tx_status_work);
 
 	SET_IEEE80211_DEV(hw, data->dev);
 	if (!param->perm_addr) {
@@ -5348,6 +6600,12 @@ static int mac80211_hwsim_new_radio(struct genl_info *info,
 	ieee80211_hw_set(hw, TDLS_WIDER_BW);
 	ieee80211_hw_set(hw, SUPPORTS_MULTI_BSSID);
 	ieee80211_hw_set(hw, STRICT);
+	if (tx_amsdu_frag_list) {
+		ieee80211_hw_set(hw, TX_AMSDU);
+		ieee80211_hw_set(hw, TX_FRAG_LIST);
+	}
+	if (rx_list_batch)
+		ieee80211_hw_set(hw, RX_LIST_BATCHING);
 
 	if (param->mlo) {
 		hw->wiphy->flags |= WIPHY_FLAG_SUPPORTS_MLO;
@@ -5362,8 +6620,10 @@ static int mac80211_hwsim_new_radio(struct genl_info *info,
 	} else {
 		ieee80211_hw_set(hw, HOST_BROADCAST_PS_BUFFERING);
 		ieee80211_hw_set(hw, PS_NULLFUNC_STACK);
-		if (rctbl)
+		if (rctbl) {
 			ieee80211_hw_set(hw, SUPPORTS_RC_TABLE);
+			ieee80211_hw_set(hw, SUPPORTS_HE_RC_TABLE);
+		}
 	}
 
 	hw->wiphy->flags &= ~WIPHY_FLAG_PS_ON_BY_DEFAULT;
@@ -5518,9 +6778,12 @@ static int mac80211_hwsim_new_radio(struct genl_info *info,
 	/* By default all radios belong to the first group */
 	data->group = 1;
 	mutex_init(&data->mutex);
+	spin_lock_init(&data->wake_tx_lock);
+	spin_lock_init(&data->nl_batch_lock);
 
 	data->netgroup = hwsim_net_get_netgroup(net);
 	data->wmediumd = hwsim_net_get_wmediumd(net);
+	data->wmediumd_batch = hwsim_net_get_wmediumd_batch(net);
 
 	/* Enable frame retransmissions for lossy channels */
 	hw->max_rates = 4;
@@ -5550,6 +6813,18 @@ static int mac80211_hwsim_new_radio(struct genl_info *info,
 
 	wiphy_ext_feature_set(hw->wiphy, NL80211_EXT_FEATURE_CQM_RSSI_LIST);
 
+	if (tx_airtime) {
+		wiphy_ext_feature_set(hw->wiphy, NL80211_EXT_FEATURE_AQL);
+		wiphy_ext_feature_set(hw->wiphy,
+				      NL80211_EXT_FEATURE_AIRTIME_FAIRNESS);
+	}
+	hrtimer_setup(&data->tx_timer, mac80211_hwsim_tx_timer,
+		      CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	hrtimer_setup(&data->rx_delay_timer, mac80211_hwsim_rx_delay_timer,
+		      CLOCK_MONOTONIC, HRTIMER_MODE_ABS_SOFT);
+	hrtimer_setup(&data->nl_batch_timer, hwsim_nl_batch_timer,
+		      CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+
 	for (i = 0; i < ARRAY_SIZE(data->link_data); i++) {
 		hrtimer_setup(&data->link_data[i].beacon_timer, mac80211_hwsim_beacon,
 			      CLOCK_MONOTONIC, HRTIMER_MODE_ABS_SOFT);
@@ -5611,6 +6886,8 @@ static int mac80211_hwsim_new_radio(struct genl_info *info,
 failed_final_insert:
 	debugfs_remove_recursive(data->debugfs);
 	ieee80211_unregister_hw(data->hw);
+	hwsim_links_del_radio(data);
+	hwsim_chan_unlisten_all(data);
 failed_hw:
 	device_release_driver(data->dev);
 failed_bind:
@@ -5663,6 +6940,11 @@ static void mac80211_hwsim_del_radio(struct mac80211_hwsim_data *data,
 	hwsim_mcast_del_radio(data->idx, hwname, info);
 	debugfs_remove_recursive(data->debugfs);
 	ieee80211_unregister_hw(data->hw);
+	hwsim_links_del_radio(data);
+	hwsim_chan_unlisten_all(data);
+	/* frames may have been delayed to it until the grace period */
+	hrtimer_cancel(&data->rx_delay_timer);
+	skb_queue_purge(&data->rx_delayed);
 	device_release_driver(data->dev);
 	device_unregister(data->dev);
 	ieee80211_free_hw(data->hw);
@@ -5748,28 +7030,63 @@ static void hwsim_mon_setup(struct net_device *dev)
 	eth_hw_addr_set(dev, addr);
 }
 
-static void hwsim_register_wmediumd(struct net *net, u32 portid)
+static void hwsim_register_wmediumd(struct net *net, u32 portid, bool batch)
 {
 	struct mac80211_hwsim_data *data;
 
-	hwsim_net_set_wmediumd(net, portid);
+	hwsim_net_set_wmediumd(net, portid, batch);
 
 	spin_lock_bh(&hwsim_radio_lock);
 	list_for_each_entry(data, &hwsim_radios, list) {
-		if (data->netgroup == hwsim_net_get_netgroup(net))
-			data->wmediumd = portid;
+		if (data->netgroup == hwsim_net_get_netgroup(net)) {
+			WRITE_ONCE(data->wmediumd, portid);
+			WRITE_ONCE(data->wmediumd_batch, batch);
+		}
 	}
 	spin_unlock_bh(&hwsim_radio_lock);
 }
 
-static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
-					   struct genl_info *info)
+/*
+ * The radio with the given address, if the sender of the message may use
+ * it. Consecutive entries of a HWSIM_CMD_FRAMES message mostly refer to
+ * the same radio, the last one is kept in @last to avoid the lookup.
+ */
+static struct mac80211_hwsim_data *
+hwsim_nl_get_radio(struct genl_info *info, const u8 *addr,
+		   struct mac80211_hwsim_data **last)
 {
+	struct mac80211_hwsim_data *data;
+
+	if (last && *last && ether_addr_equal(addr, (*last)->addresses[1].addr))
+		return *last;
 
+	data = get_hwsim_data_ref_from_addr(addr);
+	if (!data)
+		return NULL;
+
+	if (!hwsim_virtio_enabled) {
+		if (hwsim_net_get_netgroup(genl_info_net(info)) !=
+		    data->netgroup)
+			return NULL;
+
+		if (info->snd_portid != data->wmediumd)
+			return NULL;
+	}
+
+	if (last)
+		*last = data;
+	return data;
+}
+
+static int hwsim_tx_info_frame(struct genl_info *info, struct nlattr **attrs,
+			       struct mac80211_hwsim_data **last)
+{
 	struct ieee80211_hdr *hdr;
 	struct mac80211_hwsim_data *data2;
 	struct ieee80211_tx_info *txi;
 	struct hwsim_tx_rate *tx_attempts;
+	struct rate_info rate = {};
+	bool rate_valid = false;
 	u64 ret_skb_cookie;
 	struct sk_buff *skb, *tmp;
 	const u8 *src;
@@ -5778,28 +7095,34 @@ static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
 	unsigned long flags;
 	bool found = false;
 
-	if (!info->attrs[HWSIM_ATTR_ADDR_TRANSMITTER] ||
-	    !info->attrs[HWSIM_ATTR_FLAGS] ||
-	    !info->attrs[HWSIM_ATTR_COOKIE] ||
-	    !info->attrs[HWSIM_ATTR_SIGNAL] ||
-	    !info->attrs[HWSIM_ATTR_TX_INFO])
+	if (!attrs[HWSIM_ATTR_ADDR_TRANSMITTER] ||
+	    !attrs[HWSIM_ATTR_FLAGS] ||
+	    !attrs[HWSIM_ATTR_COOKIE] ||
+	    !attrs[HWSIM_ATTR_SIGNAL] ||
+	    !attrs[HWSIM_ATTR_TX_INFO])
 		goto out;
 
-	src = (void *)nla_data(info->attrs[HWSIM_ATTR_ADDR_TRANSMITTER]);
-	hwsim_flags = nla_get_u32(info->attrs[HWSIM_ATTR_FLAGS]);
-	ret_skb_cookie = nla_get_u64(info->attrs[HWSIM_ATTR_COOKIE]);
+	src = (void *)nla_data(attrs[HWSIM_ATTR_ADDR_TRANSMITTER]);
+	hwsim_flags = nla_get_u32(attrs[HWSIM_ATTR_FLAGS]);
+	ret_skb_cookie = nla_get_u64(attrs[HWSIM_ATTR_COOKIE]);
 
-	data2 = get_hwsim_data_ref_from_addr(src);
+	data2 = hwsim_nl_get_radio(info, src, last);
 	if (!data2)
 		goto out;
 
-	if (!hwsim_virtio_enabled) {
-		if (hwsim_net_get_netgroup(genl_info_net(info)) !=
-		    data2->netgroup)
+	if (attrs[HWSIM_ATTR_RATE_INFO]) {
+		struct ieee80211_rx_status check = {};
+
+		if (mac80211_hwsim_parse_rate_info(attrs[HWSIM_ATTR_RATE_INFO],
+						   &rate, info))
 			goto out;
 
-		if (info->snd_portid != data2->wmediumd)
+		/* only HE/EHT rates are reported separately */
+		if (!(rate.flags & (RATE_INFO_FLAGS_HE_MCS |
+				    RATE_INFO_FLAGS_EHT_MCS)) ||
+		    !hwsim_rx_status_set_rate(data2->hw, &check, &rate))
 			goto out;
+		rate_valid = true;
 	}
 
 	/* look for the skb matching the cookie passed back from user */
@@ -5826,11 +7149,15 @@ static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
 	 so we get all the necessary info: tx attempts and skb control buff */
 
 	tx_attempts = (struct hwsim_tx_rate *)nla_data(
-		       info->attrs[HWSIM_ATTR_TX_INFO]);
+		       attrs[HWSIM_ATTR_TX_INFO]);
 
 	/* now send back TX status */
 	txi = IEEE80211_SKB_CB(skb);
 
+	/* the rate it was sent at, see __mac80211_hwsim_tx() */
+	if (!rate_valid)
+		memcpy(&rate, txi->status.status_driver_data, sizeof(rate));
+
 	ieee80211_tx_info_clear_status(txi);
 
 	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
@@ -5838,7 +7165,7 @@ static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
 		txi->status.rates[i].count = tx_attempts[i].count;
 	}
 
-	txi->status.ack_signal = nla_get_u32(info->attrs[HWSIM_ATTR_SIGNAL]);
+	txi->status.ack_signal = nla_get_u32(attrs[HWSIM_ATTR_SIGNAL]);
 
 	if (!(hwsim_flags & HWSIM_TX_CTL_NO_ACK) &&
 	   (hwsim_flags & HWSIM_TX_STAT_ACK)) {
@@ -5853,15 +7180,22 @@ static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
 	if (hwsim_flags & HWSIM_TX_CTL_NO_ACK)
 		txi->flags |= IEEE80211_TX_STAT_NOACK_TRANSMITTED;
 
-	ieee80211_tx_status_irqsafe(data2->hw, skb);
+	if (ieee80211_hw_check(data2->hw, SUPPORTS_HE_RC_TABLE))
+		memcpy(txi->status.status_driver_data, &rate, sizeof(rate));
+
+	mac80211_hwsim_tx_report(data2->hw, skb);
+
+	/* the AQL airtime of the frame was released, send more */
+	if (tx_airtime)
+		mac80211_hwsim_tx_kick(data2);
 	return 0;
 out:
 	return -EINVAL;
 
 }
 
-static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
-					  struct genl_info *info)
+static int hwsim_cloned_frame(struct genl_info *info, struct nlattr **attrs,
+			      struct mac80211_hwsim_data **last)
 {
 	struct mac80211_hwsim_data *data2;
 	struct ieee80211_rx_status rx_status;
@@ -5872,15 +7206,15 @@ static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
 	struct sk_buff *skb = NULL;
 	struct ieee80211_channel *channel = NULL;
 
-	if (!info->attrs[HWSIM_ATTR_ADDR_RECEIVER] ||
-	    !info->attrs[HWSIM_ATTR_FRAME] ||
-	    !info->attrs[HWSIM_ATTR_RX_RATE] ||
-	    !info->attrs[HWSIM_ATTR_SIGNAL])
+	if (!attrs[HWSIM_ATTR_ADDR_RECEIVER] ||
+	    !attrs[HWSIM_ATTR_FRAME] ||
+	    (!attrs[HWSIM_ATTR_RX_RATE] && !attrs[HWSIM_ATTR_RATE_INFO]) ||
+	    !attrs[HWSIM_ATTR_SIGNAL])
 		goto out;
 
-	dst = (void *)nla_data(info->attrs[HWSIM_ATTR_ADDR_RECEIVER]);
-	frame_data_len = nla_len(info->attrs[HWSIM_ATTR_FRAME]);
-	frame_data = (void *)nla_data(info->attrs[HWSIM_ATTR_FRAME]);
+	dst = (void *)nla_data(attrs[HWSIM_ATTR_ADDR_RECEIVER]);
+	frame_data_len = nla_len(attrs[HWSIM_ATTR_FRAME]);
+	frame_data = (void *)nla_data(attrs[HWSIM_ATTR_FRAME]);
 
 	if (frame_data_len < sizeof(struct ieee80211_hdr_3addr) ||
 	    frame_data_len > IEEE80211_MAX_DATA_LEN)
@@ -5894,7 +7228,7 @@ static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
 	/* Copy the data */
 	skb_put_data(skb, frame_data, frame_data_len);
 
-	data2 = get_hwsim_data_ref_from_addr(dst);
+	data2 = hwsim_nl_get_radio(info, dst, last);
 	if (!data2)
 		goto out;
 
@@ -5905,15 +7239,6 @@ static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
 		channel = data2->channel;
 	}
 
-	if (!hwsim_virtio_enabled) {
-		if (hwsim_net_get_netgroup(genl_info_net(info)) !=
-		    data2->netgroup)
-			goto out;
-
-		if (info->snd_portid != data2->wmediumd)
-			goto out;
-	}
-
 	/* check if radio is configured properly */
 
 	if ((data2->idle && !data2->tmp_chan) || !data2->started)
@@ -5921,14 +7246,14 @@ static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
 
 	/* A frame is received from user space */
 	memset(&rx_status, 0, sizeof(rx_status));
-	if (info->attrs[HWSIM_ATTR_FREQ]) {
+	if (attrs[HWSIM_ATTR_FREQ]) {
 		struct tx_iter_data iter_data = {};
 
 		/* throw away off-channel packets, but allow both the temporary
 		 * ("hw" scan/remain-on-channel), regular channels and links,
 		 * since the internal datapath also allows this
 		 */
-		rx_status.freq = nla_get_u32(info->attrs[HWSIM_ATTR_FREQ]);
+		rx_status.freq = nla_get_u32(attrs[HWSIM_ATTR_FREQ]);
 
 		iter_data.channel = ieee80211_get_channel(data2->hw->wiphy,
 							  rx_status.freq);
@@ -5954,10 +7279,22 @@ static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
 		rx_status.band = channel->band;
 	}
 
-	rx_status.rate_idx = nla_get_u32(info->attrs[HWSIM_ATTR_RX_RATE]);
-	if (rx_status.rate_idx >= data2->hw->wiphy->bands[rx_status.band]->n_bitrates)
-		goto out;
-	rx_status.signal = nla_get_u32(info->attrs[HWSIM_ATTR_SIGNAL]);
+	if (attrs[HWSIM_ATTR_RATE_INFO]) {
+		struct rate_info rate = {};
+
+		if (mac80211_hwsim_parse_rate_info(attrs[HWSIM_ATTR_RATE_INFO],
+						   &rate, info) ||
+		    !hwsim_rx_status_set_rate(data2->hw, &rx_status, &rate))
+			goto out;
+	} else {
+		struct ieee80211_supported_band *sband =
+			data2->hw->wiphy->bands[rx_status.band];
+
+		rx_status.rate_idx = nla_get_u32(attrs[HWSIM_ATTR_RX_RATE]);
+		if (rx_status.rate_idx >= sband->n_bitrates)
+			goto out;
+	}
+	rx_status.signal = nla_get_u32(attrs[HWSIM_ATTR_SIGNAL]);
 
 	hdr = (void *)skb->data;
 
@@ -5975,12 +7312,65 @@ out:
 	return -EINVAL;
 }
 
+static int hwsim_tx_info_frame_received_nl(struct sk_buff *skb_2,
+					   struct genl_info *info)
+{
+	return hwsim_tx_info_frame(info, info->attrs, NULL);
+}
+
+static int hwsim_cloned_frame_received_nl(struct sk_buff *skb_2,
+					  struct genl_info *info)
+{
+	return hwsim_cloned_frame(info, info->attrs, NULL);
+}
+
+/*
+ * Entries that can't be handled, e.g. frames for a radio that is idle, are
+ * skipped like the corresponding single messages would be rejected.
+ */
+static int hwsim_frames_received_nl(struct sk_buff *skb_2,
+				    struct genl_info *info)
+{
+	struct nlattr *tb[HWSIM_ATTR_MAX + 1];
+	struct mac80211_hwsim_data *last = NULL;
+	struct nlattr *list, *entry;
+	int rem;
+
+	/* TX status first, it releases airtime to send more frames with */
+	list = info->attrs[HWSIM_ATTR_TX_INFO_FRAMES];
+	if (list) {
+		nla_for_each_nested(entry, list, rem) {
+			if (nla_parse_nested_deprecated(tb, HWSIM_ATTR_MAX,
+							entry, hwsim_genl_policy,
+							info->extack))
+				return -EINVAL;
+
+			hwsim_tx_info_frame(info, tb, &last);
+		}
+	}
+
+	list = info->attrs[HWSIM_ATTR_FRAMES];
+	if (list) {
+		nla_for_each_nested(entry, list, rem) {
+			if (nla_parse_nested_deprecated(tb, HWSIM_ATTR_MAX,
+							entry, hwsim_genl_policy,
+							info->extack))
+				return -EINVAL;
+
+			hwsim_cloned_frame(info, tb, &last);
+		}
+	}
+
+	return 0;
+}
+
 static int hwsim_register_received_nl(struct sk_buff *skb_2,
 				      struct genl_info *info)
 {
 	struct net *net = genl_info_net(info);
 	struct mac80211_hwsim_data *data;
 	int chans = 1;
+	bool batch;
 
 	spin_lock_bh(&hwsim_radio_lock);
 	list_for_each_entry(data, &hwsim_radios, list)
@@ -5998,7 +7388,8 @@ static int hwsim_register_received_nl(struct sk_buff *skb_2,
 	if (hwsim_net_get_wmediumd(net))
 		return -EBUSY;
 
-	hwsim_register_wmediumd(net, info->snd_portid);
+	batch = nla_get_flag(info->attrs[HWSIM_ATTR_FRAMES_BATCH]);
+	hwsim_register_wmediumd(net, info->snd_portid, batch);
 
 	pr_debug("mac80211_hwsim: received a REGISTER, "
 	       "switching to wmediumd mode with pid %d\n", info->snd_portid);
@@ -6295,6 +7686,96 @@ static int hwsim_del_radio_nl(struct sk_buff *msg, struct genl_info *info)
 	return -ENODEV;
 }
 
+/* called under hwsim_radio_lock */
+static int hwsim_link_radios(struct genl_info *info,
+			     struct mac80211_hwsim_data **tx,
+			     struct mac80211_hwsim_data **rx)
+{
+	int netgroup = hwsim_net_get_netgroup(genl_info_net(info));
+	struct nlattr *tx_addr = info->attrs[HWSIM_ATTR_ADDR_TRANSMITTER];
+	struct nlattr *rx_addr = info->attrs[HWSIM_ATTR_ADDR_RECEIVER];
+
+	if (!tx_addr || !rx_addr)
+		return -EINVAL;
+
+	*tx = get_hwsim_data_ref_from_addr(nla_data(tx_addr));
+	*rx = get_hwsim_data_ref_from_addr(nla_data(rx_addr));
+	if (!*tx || !*rx || (*tx)->netgroup != netgroup ||
+	    (*rx)->netgroup != netgroup)
+		return -ENODEV;
+
+	if (*tx == *rx)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int hwsim_set_link_nl(struct sk_buff *msg, struct genl_info *info)
+{
+	struct mac80211_hwsim_data *tx, *rx;
+	struct hwsim_link *link, *old;
+	int err;
+
+	link = kzalloc(sizeof(*link), GFP_KERNEL);
+	if (!link)
+		return -ENOMEM;
+
+	if (info->attrs[HWSIM_ATTR_LINK_SNR]) {
+		link->has_snr = true;
+		link->snr = nla_get_s32(info->attrs[HWSIM_ATTR_LINK_SNR]);
+	}
+	link->loss = nla_get_u32_default(info->attrs[HWSIM_ATTR_LINK_LOSS], 0);
+	link->delay = nla_get_u32_default(info->attrs[HWSIM_ATTR_LINK_DELAY],
+					  0);
+	link->jitter = nla_get_u32_default(info->attrs[HWSIM_ATTR_LINK_JITTER],
+					   0);
+
+	spin_lock_bh(&hwsim_radio_lock);
+	err = hwsim_link_radios(info, &tx, &rx);
+	if (err) {
+		spin_unlock_bh(&hwsim_radio_lock);
+		kfree(link);
+		return err;
+	}
+
+	link->tx = tx;
+	link->rx = rx;
+
+	old = hwsim_link_find(tx, rx);
+	if (old) {
+		link->last_due = old->last_due;
+		hlist_replace_rcu(&old->hnode, &link->hnode);
+		kfree_rcu(old, rcu_head);
+	} else {
+		hash_add_rcu(hwsim_links, &link->hnode,
+			     hwsim_link_key(tx, rx));
+		tx->n_links++;
+	}
+	spin_unlock_bh(&hwsim_radio_lock);
+
+	return 0;
+}
+
+static int hwsim_del_link_nl(struct sk_buff *msg, struct genl_info *info)
+{
+	struct mac80211_hwsim_data *tx, *rx;
+	struct hwsim_link *link;
+	int err;
+
+	spin_lock_bh(&hwsim_radio_lock);
+	err = hwsim_link_radios(info, &tx, &rx);
+	if (!err) {
+		link = hwsim_link_find(tx, rx);
+		if (link)
+			hwsim_link_free(link);
+		else
+			err = -ENOENT;
+	}
+	spin_unlock_bh(&hwsim_radio_lock);
+
+	return err;
+}
+
 static int hwsim_get_radio_nl(struct sk_buff *msg, struct genl_info *info)
 {
 	struct mac80211_hwsim_data *data;
@@ -6428,6 +7909,23 @@ static const struct genl_small_ops hwsim_ops[] = {
 		.validate = GENL_DONT_VALIDATE_STRICT | GENL_DONT_VALIDATE_DUMP,
 		.doit = hwsim_pmsr_report_nl,
 	},
+	{
+		.cmd = HWSIM_CMD_SET_LINK,
+		.validate = GENL_DONT_VALIDATE_STRICT | GENL_DONT_VALIDATE_DUMP,
+		.doit = hwsim_set_link_nl,
+		.flags = GENL_UNS_ADMIN_PERM,
+	},
+	{
+		.cmd = HWSIM_CMD_DEL_LINK,
+		.validate = GENL_DONT_VALIDATE_STRICT | GENL_DONT_VALIDATE_DUMP,
+		.doit = hwsim_del_link_nl,
+		.flags = GENL_UNS_ADMIN_PERM,
+	},
+	{
+		.cmd = HWSIM_CMD_FRAMES,
+		.validate = GENL_DONT_VALIDATE_STRICT | GENL_DONT_VALIDATE_DUMP,
+		.doit = hwsim_frames_received_nl,
+	},
 };
 
 static struct genl_family hwsim_genl_family __ro_after_init = {
@@ -6484,7 +7982,7 @@ static int mac80211_hwsim_netlink_notify(struct notifier_block *nb,
 	if (notify->portid == hwsim_net_get_wmediumd(notify->net)) {
 		printk(KERN_INFO "mac80211_hwsim: wmediumd released netlink"
 		       " socket, switching to perfect channel medium\n");
-		hwsim_register_wmediumd(notify->net, 0);
+		hwsim_register_wmediumd(notify->net, 0, false);
 	}
 	return NOTIFY_DONE;
 
@@ -6611,6 +8109,9 @@ static int hwsim_virtio_handle_cmd(struct sk_buff *skb)
 	case HWSIM_CMD_TX_INFO_FRAME:
 		hwsim_tx_info_frame_received_nl(skb, &info);
 		break;
+	case HWSIM_CMD_FRAMES:
+		hwsim_frames_received_nl(skb, &info);
+		break;
 	case HWSIM_CMD_REPORT_PMSR:
 		hwsim_pmsr_report_nl(skb, &info);
 		break;
@@ -53,17 +53,21 @@ enum hwsim_tx_control_flags {
  * @HWSIM_CMD_UNSPEC: unspecified command to catch errors
  *
  * @HWSIM_CMD_REGISTER: request to register and received all broadcasted
- *	frames by any mac80211_hwsim radio device.
+ *	frames by any mac80211_hwsim radio device. With the
+ *	%HWSIM_ATTR_FRAMES_BATCH flag, frames are sent in %HWSIM_CMD_FRAMES
+ *	messages.
  * @HWSIM_CMD_FRAME: send/receive a broadcasted frame from/to kernel/user
  *	space, uses:
  *	%HWSIM_ATTR_ADDR_TRANSMITTER, %HWSIM_ATTR_ADDR_RECEIVER,
  *	%HWSIM_ATTR_FRAME, %HWSIM_ATTR_FLAGS, %HWSIM_ATTR_RX_RATE,
- *	%HWSIM_ATTR_SIGNAL, %HWSIM_ATTR_COOKIE, %HWSIM_ATTR_FREQ (optional)
+ *	%HWSIM_ATTR_SIGNAL, %HWSIM_ATTR_COOKIE, %HWSIM_ATTR_FREQ (optional),
+ *	%HWSIM_ATTR_RATE_INFO (optional)
  * @HWSIM_CMD_TX_INFO_FRAME: Transmission info report from user space to
  *	kernel, uses:
  *	%HWSIM_ATTR_ADDR_TRANSMITTER, %HWSIM_ATTR_FLAGS,
  *	%HWSIM_ATTR_TX_INFO, %WSIM_ATTR_TX_INFO_FLAGS,
- *	%HWSIM_ATTR_SIGNAL, %HWSIM_ATTR_COOKIE
+ *	%HWSIM_ATTR_SIGNAL, %HWSIM_ATTR_COOKIE,
+ *	%HWSIM_ATTR_RATE_INFO (optional)
  * @HWSIM_CMD_NEW_RADIO: create a new radio with the given parameters,
  *	returns the radio ID (>= 0) or negative on errors, if successful
  *	then multicast the result, uses optional parameter:
@@ -86,6 +90,21 @@ enum hwsim_tx_control_flags {
  *	with %HWSIM_CMD_REPORT_PMSR.
  * @HWSIM_CMD_ABORT_PMSR: Abort previously started peer measurement.
  * @HWSIM_CMD_REPORT_PMSR: Report peer measurement data.
+ * @HWSIM_CMD_SET_LINK: set the link model for the frames that the radio
+ *	%HWSIM_ATTR_ADDR_TRANSMITTER sends to the radio
+ *	%HWSIM_ATTR_ADDR_RECEIVER without wmediumd, uses the optional
+ *	%HWSIM_ATTR_LINK_SNR, %HWSIM_ATTR_LINK_LOSS, %HWSIM_ATTR_LINK_DELAY
+ *	and %HWSIM_ATTR_LINK_JITTER. Links are directional, and frames
+ *	between radios without a link are received perfectly. Radios that
+ *	transmit on a link retry unacked frames along their rate table.
+ * @HWSIM_CMD_DEL_LINK: remove the link model between the two radios
+ *	again, uses the same addresses as %HWSIM_CMD_SET_LINK.
+ * @HWSIM_CMD_FRAMES: several frames and TX status reports at once, uses
+ *	%HWSIM_ATTR_FRAMES and %HWSIM_ATTR_TX_INFO_FRAMES. The kernel only
+ *	sends frames, to a wmediumd that registered with
+ *	%HWSIM_ATTR_FRAMES_BATCH; its frames that don't fit into a batch are
+ *	still sent with %HWSIM_CMD_FRAME. Both kinds of messages are always
+ *	accepted from user space.
  * @__HWSIM_CMD_MAX: enum limit
  */
 enum hwsim_commands {
@@ -101,6 +120,9 @@ enum hwsim_commands {
 	HWSIM_CMD_START_PMSR,
 	HWSIM_CMD_ABORT_PMSR,
 	HWSIM_CMD_REPORT_PMSR,
+	HWSIM_CMD_SET_LINK,
+	HWSIM_CMD_DEL_LINK,
+	HWSIM_CMD_FRAMES,
 	__HWSIM_CMD_MAX,
 };
 #define HWSIM_CMD_MAX (_HWSIM_CMD_MAX - 1)
@@ -160,6 +182,29 @@ enum hwsim_commands {
  * @HWSIM_ATTR_MULTI_RADIO: Register multiple wiphy radios (flag).
  *	Adds one radio for each band. Number of supported channels will be set for
  *	each radio instead of for the wiphy.
+ * @HWSIM_ATTR_LINK_SNR: s32 SNR in dB of a link at 20 MHz. It gives the
+ *	signal strength of the received frames, and the error rate of the
+ *	rate they are sent at. Without it, there are no rate dependent
+ *	errors and the signal strength is as without a link.
+ * @HWSIM_ATTR_LINK_LOSS: u32 probability in per mille that a frame is
+ *	lost on a link, regardless of its rate
+ * @HWSIM_ATTR_LINK_DELAY: u32 delay of the frames on a link in usec
+ * @HWSIM_ATTR_LINK_JITTER: u32 maximum random delay in usec added to
+ *	%HWSIM_ATTR_LINK_DELAY. It doesn't reorder the frames of a link.
+ * @HWSIM_ATTR_FRAMES_BATCH: flag in %HWSIM_CMD_REGISTER, the registering
+ *	process handles %HWSIM_CMD_FRAMES messages
+ * @HWSIM_ATTR_FRAMES: nested array of frames in %HWSIM_CMD_FRAMES, each
+ *	with the attributes of a %HWSIM_CMD_FRAME message
+ * @HWSIM_ATTR_TX_INFO_FRAMES: nested array of TX status reports in
+ *	%HWSIM_CMD_FRAMES, each with the attributes of a
+ *	%HWSIM_CMD_TX_INFO_FRAME message. They are handled before the frames
+ *	in the same message.
+ * @HWSIM_ATTR_RATE_INFO: nested rate, see &enum hwsim_rate_info_attributes.
+ *	In a %HWSIM_CMD_FRAME from the kernel it is the HE/EHT rate the frame
+ *	is sent at, which can't be given in %HWSIM_ATTR_TX_INFO. In one from
+ *	user space it is the rate the frame is received at, and replaces
+ *	%HWSIM_ATTR_RX_RATE. In %HWSIM_CMD_TX_INFO_FRAME it is the rate the
+ *	frame was sent at, if it differs from the one it was given with.
  * @__HWSIM_ATTR_MAX: enum limit
  */
 enum hwsim_attrs {
@@ -193,6 +238,14 @@ enum hwsim_attrs {
 	HWSIM_ATTR_PMSR_REQUEST,
 	HWSIM_ATTR_PMSR_RESULT,
 	HWSIM_ATTR_MULTI_RADIO,
+	HWSIM_ATTR_LINK_SNR,
+	HWSIM_ATTR_LINK_LOSS,
+	HWSIM_ATTR_LINK_DELAY,
+	HWSIM_ATTR_LINK_JITTER,
+	HWSIM_ATTR_FRAMES_BATCH,
+	HWSIM_ATTR_FRAMES,
+	HWSIM_ATTR_TX_INFO_FRAMES,
+	HWSIM_ATTR_RATE_INFO,
 	__HWSIM_ATTR_MAX,
 };
 #define HWSIM_ATTR_MAX (__HWSIM_ATTR_MAX - 1)
@@ -2047,6 +2047,20 @@ struct cfg80211_tid_stats {
 
 #define IEEE80211_MAX_CHAINS	4
 
+/**
+ * struct cfg80211_tx_latency - TX latency histograms
+ * @queue: per-AC histogram of the time between queueing a frame and the
+ *	driver dequeueing it
+ * @driver: per-AC histogram of the time between the driver dequeueing a
+ *	frame and reporting its TX status
+ *
+ * See &enum nl80211_tx_latency for the meaning of the bins.
+ */
+struct cfg80211_tx_latency {
+	u32 queue[IEEE80211_NUM_ACS][NL80211_TX_LATENCY_BINS];
+	u32 driver[IEEE80211_NUM_ACS][NL80211_TX_LATENCY_BINS];
+};
+
 /**
  * struct station_info - station information
  *
@@ -2131,6 +2145,14 @@ struct cfg80211_tid_stats {
  *	dump_station() callbacks. User space needs this information to determine
  *	the accepted and rejected affiliated links of the connected station.
  * @assoc_resp_ies_len: Length of @assoc_resp_ies buffer in octets.
+ * @tx_latency: TX latency histograms, see &struct cfg80211_tx_latency.
+ *	Like @pertid, this doesn't use the @filled bit but is used if non-NULL.
+ * @rc_stats_req: set by cfg80211 before calling get_station() or
+ *	dump_station() when user space asked for @rc_stats; drivers should
+ *	only fill @rc_stats when this is set.
+ * @rc_stats: per-rate statistics of the software rate control algorithm,
+ *	allocated with cfg80211_sinfo_alloc_rc_stats(). Also used if non-NULL.
+ * @n_rc_stats: number of entries in @rc_stats
  */
 struct station_info {
 	u64 filled;
@@ -2195,6 +2217,12 @@ struct station_info {
 	u8 mld_addr[ETH_ALEN] __aligned(2);
 	const u8 *assoc_resp_ies;
 	size_t assoc_resp_ies_len;
+
+	struct cfg80211_tx_latency *tx_latency;
+
+	bool rc_stats_req;
+	struct nl80211_rc_rate_stats *rc_stats;
+	unsigned int n_rc_stats;
 };
 
 /**
@@ -8495,6 +8523,31 @@ void cfg80211_tx_mgmt_expired(struct wireless_dev *wdev, u64 cookie,
  */
 int cfg80211_sinfo_alloc_tid_stats(struct station_info *sinfo, gfp_t gfp);
 
+/**
+ * cfg80211_sinfo_alloc_tx_latency - allocate TX latency histograms.
+ *
+ * @sinfo: the station information
+ * @gfp: allocation flags
+ *
+ * Return: 0 on success. Non-zero on error.
+ */
+int cfg80211_sinfo_alloc_tx_latency(struct station_info *sinfo, gfp_t gfp);
+
+/**
+ * cfg80211_sinfo_alloc_rc_stats - allocate rate control statistics.
+ *
+ * @sinfo: the station information
+ * @n_rates: number of rates to allocate statistics for
+ * @gfp: allocation flags
+ *
+ * The caller may reduce @sinfo->n_rc_stats afterwards if it filled in
+ * fewer entries.
+ *
+ * Return: 0 on success. Non-zero on error.
+ */
+int cfg80211_sinfo_alloc_rc_stats(struct station_info *sinfo,
+				  unsigned int n_rates, gfp_t gfp);
+
 /**
  * cfg80211_sinfo_release_content - release contents of station info
  * @sinfo: the station information
@@ -8506,6 +8559,8 @@ int cfg80211_sinfo_alloc_tid_stats(struct station_info *sinfo, gfp_t gfp);
 static inline void cfg80211_sinfo_release_content(struct station_info *sinfo)
 {
 	kfree(sinfo->pertid);
+	kfree(sinfo->tx_latency);
+	kfree(sinfo->rc_stats);
 }
 
 /**
@@ -7,6 +7,7 @@
 #ifndef __NET_SCHED_FQ_H
 #define __NET_SCHED_FQ_H
 
+#include <linux/percpu_counter.h>
 #include <linux/skbuff.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
@@ -27,6 +28,7 @@ struct fq_tin;
  * @backlog: number of bytes pending in the queue. The number of packets can be
  *	found in @queue.qlen
  * @deficit: used for DRR++
+ * @shard: index of the &struct fq_shard this flow belongs to
  */
 struct fq_flow {
 	struct fq_tin *tin;
@@ -34,6 +36,7 @@ struct fq_flow {
 	struct sk_buff_head queue;
 	u32 backlog;
 	int deficit;
+	u8 shard;
 };
 
 /**
@@ -44,6 +47,7 @@ struct fq_flow {
  *
  * @new_flows: linked list of fq_flow
  * @old_flows: linked list of fq_flow
+ * @shard: index of the &struct fq_shard whose lock protects this tin
  */
 struct fq_tin {
 	struct list_head new_flows;
@@ -57,31 +61,187 @@ struct fq_tin {
 	u32 flows;
 	u32 tx_bytes;
 	u32 tx_packets;
+	u8 shard;
 };
 
+#define FQ_MAX_SHARDS	8
+
+/* per-CPU deltas of the global counters in &struct fq before they're folded */
+#define FQ_BACKLOG_BATCH	32
+#define FQ_MEMORY_BATCH		(FQ_BACKLOG_BATCH * 2048)
+
+/**
+ * struct fq_shard - independently locked part of a struct fq
+ *
+ * Each tin is bound to one shard when it is initialised. The shard's lock
+ * protects the tin, its default flow and the slice of the flow table the
+ * tin hashes into, so tins in different shards can be used concurrently.
+ * Packet and memory accounting is kept per shard and summed up against the
+ * limits in &struct fq.
+ *
+ * @lock: protects all tins and flows of this shard, on a cacheline of its own
+ *	so that CPUs waiting for it don't bounce the data it protects
+ * @flows: this shard's slice of &struct fq.flows
+ * @flows_bitmap: flows in @flows that have a backlog
+ * @flows_cnt: number of entries in @flows
+ * @tin_backlog: tins of this shard whose default flow has a backlog
+ * @backlog: number of packets queued in this shard
+ * @memory_usage: truesize of the packets queued in this shard
+ * @overlimit: number of overlimit drops triggered from this shard
+ * @overmemory: number of overmemory drops triggered from this shard
+ * @collisions: number of flow hash collisions in this shard
+ * @tx_bytes: bytes dequeued from this shard
+ * @tx_packets: packets dequeued from this shard
+ * @lock_acquired: number of times @lock was taken through fq_tin_lock_bh()
+ * @lock_contended: number of those acquisitions that had to wait
+ */
+struct fq_shard {
+	spinlock_t lock ____cacheline_aligned_in_smp;
+
+	struct fq_flow *flows ____cacheline_aligned_in_smp;
+	unsigned long *flows_bitmap;
+	u32 flows_cnt;
+
+	struct list_head tin_backlog;
+	u32 backlog;
+	u32 memory_usage;
+	u32 overlimit;
+	u32 overmemory;
+	u32 collisions;
+	u64 tx_bytes;
+	u64 tx_packets;
+	u64 lock_acquired;
+	u64 lock_contended;
+} ____cacheline_aligned_in_smp;
+
 /**
  * struct fq - main container for fair queuing purposes
  *
+ * @flows: flow table, split into one contiguous slice per shard
+ * @shards: independently locked parts of the queue, see &struct fq_shard
+ * @shards_cnt: number of entries used in @shards
+ * @flows_cnt: total number of entries in @flows
+ * @backlog: number of packets queued in all shards, checked against @limit
+ *	on enqueue without touching the other shards
+ * @memory_usage: truesize of the packets queued in all shards, likewise
+ *	checked against @memory_limit
  * @limit: max number of packets that can be queued across all flows
- * @backlog: number of packets queued across all flows
+ * @memory_limit: max truesize that can be queued across all flows
+ * @quantum: DRR++ quantum in bytes
  */
 struct fq {
 	struct fq_flow *flows;
-	unsigned long *flows_bitmap;
-
-	struct list_head tin_backlog;
-	spinlock_t lock;
+	struct fq_shard shards[FQ_MAX_SHARDS];
+	u32 shards_cnt;
 	u32 flows_cnt;
+	struct percpu_counter backlog;
+	struct percpu_counter memory_usage;
 	u32 limit;
 	u32 memory_limit;
-	u32 memory_usage;
 	u32 quantum;
+};
+
+/**
+ * struct fq_stats - aggregated statistics of a struct fq
+ *
+ * See &struct fq_shard for the meaning of the fields; each one is the sum
+ * over all shards.
+ */
+struct fq_stats {
 	u32 backlog;
+	u32 memory_usage;
 	u32 overlimit;
 	u32 overmemory;
 	u32 collisions;
+	u64 tx_bytes;
+	u64 tx_packets;
+	u64 lock_acquired;
+	u64 lock_contended;
 };
 
+static inline struct fq_shard *fq_tin_shard(struct fq *fq, struct fq_tin *tin)
+{
+	return &fq->shards[tin->shard];
+}
+
+static inline struct fq_shard *fq_flow_shard(struct fq *fq,
+					     struct fq_flow *flow)
+{
+	return &fq->shards[flow->shard];
+}
+
+/* Take the lock protecting @tin, accounting for contention on it. */
+static inline void fq_tin_lock_bh(struct fq *fq, struct fq_tin *tin)
+{
+	struct fq_shard *shard = fq_tin_shard(fq, tin);
+
+	local_bh_disable();
+	if (!spin_trylock(&shard->lock)) {
+		spin_lock(&shard->lock);
+		shard->lock_contended++;
+	}
+	shard->lock_acquired++;
+}
+
+static inline void fq_tin_unlock_bh(struct fq *fq, struct fq_tin *tin)
+{
+	spin_unlock_bh(&fq_tin_shard(fq, tin)->lock);
+}
+
+static inline void __fq_lock_all(struct fq *fq)
+{
+	int i;
+
+	for (i = 0; i < fq->shards_cnt; i++)
+		spin_lock_nested(&fq->shards[i].lock, i);
+}
+
+static inline void __fq_unlock_all(struct fq *fq)
+{
+	int i;
+
+	for (i = fq->shards_cnt - 1; i >= 0; i--)
+		spin_unlock(&fq->shards[i].lock);
+}
+
+/* Lock all shards, for operations that need a consistent view of @fq. */
+static inline void fq_lock_all_bh(struct fq *fq)
+{
+	local_bh_disable();
+	__fq_lock_all(fq);
+}
+
+static inline void fq_unlock_all_bh(struct fq *fq)
+{
+	__fq_unlock_all(fq);
+	local_bh_enable();
+}
+
+/*
+ * Sum up the per-shard statistics. Callers that need the numbers to be
+ * consistent with each other must hold all shard locks.
+ */
+static inline void fq_get_stats(struct fq *fq, struct fq_stats *stats)
+{
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (i = 0; i < fq->shards_cnt; i++) {
+		struct fq_shard *shard = &fq->shards[i];
+
+		stats->backlog += READ_ONCE(shard->backlog);
+		stats->memory_usage += READ_ONCE(shard->memory_usage);
+		stats->overlimit += READ_ONCE(shard->overlimit);
+		stats->overmemory += READ_ONCE(shard->overmemory);
+		stats->collisions += READ_ONCE(shard->collisions);
+		stats->tx_bytes += READ_ONCE(shard->tx_bytes);
+		stats->tx_packets += READ_ONCE(shard->tx_packets);
+		stats->lock_acquired += READ_ONCE(shard->lock_acquired);
+		stats->lock_contended += READ_ONCE(shard->lock_contended);
+	}
+}
+
 typedef struct sk_buff *fq_tin_dequeue_t(struct fq *,
 					 struct fq_tin *,
 					 struct fq_flow *flow);
@@ -16,14 +16,19 @@ static void
 __fq_adjust_removal(struct fq *fq, struct fq_flow *flow, unsigned int packets,
 		    unsigned int bytes, unsigned int truesize)
 {
+	struct fq_shard *shard = fq_flow_shard(fq, flow);
 	struct fq_tin *tin = flow->tin;
 	int idx;
 
 	tin->backlog_bytes -= bytes;
 	tin->backlog_packets -= packets;
 	flow->backlog -= bytes;
-	fq->backlog -= packets;
-	fq->memory_usage -= truesize;
+	shard->backlog -= packets;
+	shard->memory_usage -= truesize;
+	percpu_counter_add_batch(&fq->backlog, -(s64)packets,
+				 FQ_BACKLOG_BATCH);
+	percpu_counter_add_batch(&fq->memory_usage, -(s64)truesize,
+				 FQ_MEMORY_BATCH);
 
 	if (flow->backlog)
 		return;
@@ -33,8 +38,8 @@ __fq_adjust_removal(struct fq *fq, struct fq_flow *flow, unsigned int packets,
 		return;
 	}
 
-	idx = flow - fq->flows;
-	__clear_bit(idx, fq->flows_bitmap);
+	idx = flow - shard->flows;
+	__clear_bit(idx, shard->flows_bitmap);
 }
 
 static void fq_adjust_removal(struct fq *fq,
@@ -44,12 +49,22 @@ static void fq_adjust_removal(struct fq *fq,
 	__fq_adjust_removal(fq, flow, 1, skb->len, skb->truesize);
 }
 
+/*
+ * Account for a queued packet whose truesize changed in place, e.g. when
+ * another frame was aggregated into it.
+ */
+static void fq_adjust_truesize(struct fq *fq, struct fq_tin *tin, int delta)
+{
+	fq_tin_shard(fq, tin)->memory_usage += delta;
+	percpu_counter_add_batch(&fq->memory_usage, delta, FQ_MEMORY_BATCH);
+}
+
 static struct sk_buff *fq_flow_dequeue(struct fq *fq,
 				       struct fq_flow *flow)
 {
 	struct sk_buff *skb;
 
-	lockdep_assert_held(&fq->lock);
+	lockdep_assert_held(&fq_flow_shard(fq, flow)->lock);
 
 	skb = __skb_dequeue(&flow->queue);
 	if (!skb)
@@ -68,7 +83,7 @@ static int fq_flow_drop(struct fq *fq, struct fq_flow *flow,
 	struct sk_buff *skb;
 	int pending;
 
-	lockdep_assert_held(&fq->lock);
+	lockdep_assert_held(&fq_flow_shard(fq, flow)->lock);
 
 	pending = min_t(int, 32, skb_queue_len(&flow->queue) / 2);
 	do {
@@ -91,11 +106,12 @@ static struct sk_buff *fq_tin_dequeue(struct fq *fq,
 				      struct fq_tin *tin,
 				      fq_tin_dequeue_t dequeue_func)
 {
+	struct fq_shard *shard = fq_tin_shard(fq, tin);
 	struct fq_flow *flow;
 	struct list_head *head;
 	struct sk_buff *skb;
 
-	lockdep_assert_held(&fq->lock);
+	lockdep_assert_held(&shard->lock);
 
 begin:
 	head = &tin->new_flows;
@@ -130,30 +146,34 @@ begin:
 	flow->deficit -= skb->len;
 	tin->tx_bytes += skb->len;
 	tin->tx_packets++;
+	shard->tx_bytes += skb->len;
+	shard->tx_packets++;
 
 	return skb;
 }
 
-static u32 fq_flow_idx(struct fq *fq, struct sk_buff *skb)
+/* Returns the index of the flow for @skb within the flow slice of @tin. */
+static u32 fq_flow_idx(struct fq *fq, struct fq_tin *tin, struct sk_buff *skb)
 {
 	u32 hash = skb_get_hash(skb);
 
-	return reciprocal_scale(hash, fq->flows_cnt);
+	return reciprocal_scale(hash, fq_tin_shard(fq, tin)->flows_cnt);
 }
 
 static struct fq_flow *fq_flow_classify(struct fq *fq,
 					struct fq_tin *tin, u32 idx,
 					struct sk_buff *skb)
 {
+	struct fq_shard *shard = fq_tin_shard(fq, tin);
 	struct fq_flow *flow;
 
-	lockdep_assert_held(&fq->lock);
+	lockdep_assert_held(&shard->lock);
 
-	flow = &fq->flows[idx];
+	flow = &shard->flows[idx];
 	if (flow->tin && flow->tin != tin) {
 		flow = &tin->default_flow;
 		tin->collisions++;
-		fq->collisions++;
+		shard->collisions++;
 	}
 
 	if (!flow->tin)
@@ -162,56 +182,120 @@ static struct fq_flow *fq_flow_classify(struct fq *fq,
 	return flow;
 }
 
+static u32 fq_backlog(struct fq *fq)
+{
+	u32 backlog = 0;
+	int i;
+
+	for (i = 0; i < fq->shards_cnt; i++)
+		backlog += READ_ONCE(fq->shards[i].backlog);
+
+	return backlog;
+}
+
+static u32 fq_memory_usage(struct fq *fq)
+{
+	u32 usage = 0;
+	int i;
+
+	for (i = 0; i < fq->shards_cnt; i++)
+		usage += READ_ONCE(fq->shards[i].memory_usage);
+
+	return usage;
+}
+
+/*
+ * Check the global counters against the limits, this only sums up the
+ * per-CPU deltas when the queue is close to one of the limits.
+ */
+static bool fq_over_limit(struct fq *fq)
+{
+	return __percpu_counter_compare(&fq->backlog, fq->limit,
+					FQ_BACKLOG_BATCH) > 0 ||
+	       __percpu_counter_compare(&fq->memory_usage, fq->memory_limit,
+					FQ_MEMORY_BATCH) > 0;
+}
+
+/* Must be called with all shard locks held. */
 static struct fq_flow *fq_find_fattest_flow(struct fq *fq)
 {
 	struct fq_tin *tin;
 	struct fq_flow *flow = NULL;
 	u32 len = 0;
-	int i;
+	int i, s;
 
-	for_each_set_bit(i, fq->flows_bitmap, fq->flows_cnt) {
-		struct fq_flow *cur = &fq->flows[i];
-		unsigned int cur_len;
+	for (s = 0; s < fq->shards_cnt; s++) {
+		struct fq_shard *shard = &fq->shards[s];
 
-		cur_len = cur->backlog;
-		if (cur_len <= len)
-			continue;
+		for_each_set_bit(i, shard->flows_bitmap, shard->flows_cnt) {
+			struct fq_flow *cur = &shard->flows[i];
+			unsigned int cur_len;
 
-		flow = cur;
-		len = cur_len;
-	}
+			cur_len = cur->backlog;
+			if (cur_len <= len)
+				continue;
+
+			flow = cur;
+			len = cur_len;
+		}
 
-	list_for_each_entry(tin, &fq->tin_backlog, tin_list) {
-		unsigned int cur_len = tin->default_flow.backlog;
+		list_for_each_entry(tin, &shard->tin_backlog, tin_list) {
+			unsigned int cur_len = tin->default_flow.backlog;
 
-		if (cur_len <= len)
-			continue;
+			if (cur_len <= len)
+				continue;
 
-		flow = &tin->default_flow;
-		len = cur_len;
+			flow = &tin->default_flow;
+			len = cur_len;
+		}
 	}
 
 	return flow;
 }
 
+static void fq_drop_overlimit(struct fq *fq, struct fq_shard *shard,
+			      fq_skb_free_t free_func)
+{
+	struct fq_flow *flow;
+	bool oom;
+
+	oom = (fq_memory_usage(fq) > fq->memory_limit);
+	while (fq_backlog(fq) > fq->limit || oom) {
+		flow = fq_find_fattest_flow(fq);
+		if (!flow)
+			return;
+
+		if (!fq_flow_drop(fq, flow, free_func))
+			return;
+
+		flow->tin->overlimit++;
+		shard->overlimit++;
+		if (oom) {
+			shard->overmemory++;
+			oom = (fq_memory_usage(fq) > fq->memory_limit);
+		}
+	}
+}
+
 static void fq_tin_enqueue(struct fq *fq,
 			   struct fq_tin *tin, u32 idx,
 			   struct sk_buff *skb,
 			   fq_skb_free_t free_func)
 {
+	struct fq_shard *shard = fq_tin_shard(fq, tin);
+	unsigned int packets = 0, truesize = 0;
 	struct fq_flow *flow;
 	struct sk_buff *next;
-	bool oom;
 
-	lockdep_assert_held(&fq->lock);
+	lockdep_assert_held(&shard->lock);
 
 	flow = fq_flow_classify(fq, tin, idx, skb);
 
 	if (!flow->backlog) {
 		if (flow != &tin->default_flow)
-			__set_bit(idx, fq->flows_bitmap);
+			__set_bit(idx, shard->flows_bitmap);
 		else if (list_empty(&tin->tin_list))
-			list_add(&tin->tin_list, &fq->tin_backlog);
+			list_add(&tin->tin_list, &shard->tin_backlog);
 	}
 
 	flow->tin = tin;
@@ -220,10 +304,14 @@ static void fq_tin_enqueue(struct fq *fq,
 		flow->backlog += skb->len;
 		tin->backlog_bytes += skb->len;
 		tin->backlog_packets++;
-		fq->memory_usage += skb->truesize;
-		fq->backlog++;
+		packets++;
+		truesize += skb->truesize;
 		__skb_queue_tail(&flow->queue, skb);
 	}
+	shard->backlog += packets;
+	shard->memory_usage += truesize;
+	percpu_counter_add_batch(&fq->backlog, packets, FQ_BACKLOG_BATCH);
+	percpu_counter_add_batch(&fq->memory_usage, truesize, FQ_MEMORY_BATCH);
 
 	if (list_empty(&flow->flowchain)) {
 		flow->deficit = fq->quantum;
@@ -231,22 +319,25 @@ static void fq_tin_enqueue(struct fq *fq,
 			      &tin->new_flows);
 	}
 
-	oom = (fq->memory_usage > fq->memory_limit);
-	while (fq->backlog > fq->limit || oom) {
-		flow = fq_find_fattest_flow(fq);
-		if (!flow)
-			return;
-
-		if (!fq_flow_drop(fq, flow, free_func))
-			return;
+	if (likely(!fq_over_limit(fq)))
+		return;
 
-		flow->tin->overlimit++;
-		fq->overlimit++;
-		if (oom) {
-			fq->overmemory++;
-			oom = (fq->memory_usage > fq->memory_limit);
-		}
+	if (fq->shards_cnt == 1) {
+		fq_drop_overlimit(fq, shard, free_func);
+		return;
 	}
+
+	/*
+	 * The fattest flow may live in any shard, so take all shard locks
+	 * (in order, hence dropping ours first) to pick the drop victim.
+	 * The caller's shard lock is held again on return, but the tin
+	 * may have changed in between.
+	 */
+	spin_unlock(&shard->lock);
+	__fq_lock_all(fq);
+	fq_drop_overlimit(fq, shard, free_func);
+	__fq_unlock_all(fq);
+	spin_lock(&shard->lock);
 }
 
 static void fq_flow_filter(struct fq *fq,
@@ -258,7 +349,7 @@ static void fq_flow_filter(struct fq *fq,
 	struct fq_tin *tin = flow->tin;
 	struct sk_buff *skb, *tmp;
 
-	lockdep_assert_held(&fq->lock);
+	lockdep_assert_held(&fq_flow_shard(fq, flow)->lock);
 
 	skb_queue_walk_safe(&flow->queue, skb, tmp) {
 		if (!filter_func(fq, tin, flow, skb, filter_data))
@@ -278,7 +369,7 @@ static void fq_tin_filter(struct fq *fq,
 {
 	struct fq_flow *flow;
 
-	lockdep_assert_held(&fq->lock);
+	lockdep_assert_held(&fq_tin_shard(fq, tin)->lock);
 
 	list_for_each_entry(flow, &tin->new_flows, flowchain)
 		fq_flow_filter(fq, flow, filter_func, filter_data, free_func);
@@ -338,43 +429,93 @@ static void fq_flow_init(struct fq_flow *flow)
 	__skb_queue_head_init(&flow->queue);
 }
 
-static void fq_tin_init(struct fq_tin *tin)
+static void fq_tin_init(struct fq_tin *tin, unsigned int shard)
 {
 	INIT_LIST_HEAD(&tin->new_flows);
 	INIT_LIST_HEAD(&tin->old_flows);
 	INIT_LIST_HEAD(&tin->tin_list);
 	fq_flow_init(&tin->default_flow);
+	tin->shard = shard;
+	tin->default_flow.shard = shard;
 }
 
-static int fq_init(struct fq *fq, int flows_cnt)
+static void fq_free_shards(struct fq *fq)
 {
 	int i;
 
+	for (i = 0; i < fq->shards_cnt; i++) {
+		bitmap_free(fq->shards[i].flows_bitmap);
+		fq->shards[i].flows_bitmap = NULL;
+		fq->shards[i].flows = NULL;
+	}
+
+	kvfree(fq->flows);
+	fq->flows = NULL;
+
+	percpu_counter_destroy(&fq->backlog);
+	percpu_counter_destroy(&fq->memory_usage);
+}
+
+/*
+ * Set up @fq with @flows_cnt flows split evenly over @shards_cnt
+ * independently locked shards. Each tin is bound to one of the shards
+ * by fq_tin_init().
+ */
+static int fq_init(struct fq *fq, int flows_cnt, int shards_cnt)
+{
+	u32 per_shard;
+	int i, j;
+
 	memset(fq, 0, sizeof(fq[0]));
-	spin_lock_init(&fq->lock);
-	INIT_LIST_HEAD(&fq->tin_backlog);
-	fq->flows_cnt = max_t(u32, flows_cnt, 1);
+	fq->shards_cnt = clamp_t(int, shards_cnt, 1, FQ_MAX_SHARDS);
+	fq->flows_cnt = max_t(u32, flows_cnt, fq->shards_cnt);
 	fq->quantum = 300;
 	fq->limit = 8192;
 	fq->memory_limit = 16 << 20; /* 16 MBytes */
 
-	fq->flows = kvcalloc(fq->flows_cnt, sizeof(fq->flows[0]), GFP_KERNEL);
-	if (!fq->flows)
+	if (percpu_counter_init(&fq->backlog, 0, GFP_KERNEL))
 		return -ENOMEM;
 
-	fq->flows_bitmap = bitmap_zalloc(fq->flows_cnt, GFP_KERNEL);
-	if (!fq->flows_bitmap) {
-		kvfree(fq->flows);
-		fq->flows = NULL;
+	if (percpu_counter_init(&fq->memory_usage, 0, GFP_KERNEL)) {
+		percpu_counter_destroy(&fq->backlog);
 		return -ENOMEM;
 	}
 
-	for (i = 0; i < fq->flows_cnt; i++)
-		fq_flow_init(&fq->flows[i]);
+	fq->flows = kvcalloc(fq->flows_cnt, sizeof(fq->flows[0]), GFP_KERNEL);
+	if (!fq->flows) {
+		fq_free_shards(fq);
+		return -ENOMEM;
+	}
+
+	per_shard = fq->flows_cnt / fq->shards_cnt;
+
+	for (i = 0; i < fq->shards_cnt; i++) {
+		struct fq_shard *shard = &fq->shards[i];
+
+		spin_lock_init(&shard->lock);
+		INIT_LIST_HEAD(&shard->tin_backlog);
+		shard->flows = fq->flows + i * per_shard;
+		shard->flows_cnt = per_shard;
+		if (i == fq->shards_cnt - 1)
+			shard->flows_cnt = fq->flows_cnt - i * per_shard;
+
+		shard->flows_bitmap = bitmap_zalloc(shard->flows_cnt,
+						    GFP_KERNEL);
+		if (!shard->flows_bitmap) {
+			fq_free_shards(fq);
+			return -ENOMEM;
+		}
+
+		for (j = 0; j < shard->flows_cnt; j++) {
+			fq_flow_init(&shard->flows[j]);
+			shard->flows[j].shard = i;
+		}
+	}
 
 	return 0;
 }
 
+/* Must be called with all shard locks held, see fq_lock_all_bh(). */
 static void fq_reset(struct fq *fq,
 		     fq_skb_free_t free_func)
 {
@@ -383,11 +524,7 @@ static void fq_reset(struct fq *fq,
 	for (i = 0; i < fq->flows_cnt; i++)
 		fq_flow_reset(fq, &fq->flows[i], free_func);
 
-	kvfree(fq->flows);
-	fq->flows = NULL;
-
-	bitmap_free(fq->flows_bitmap);
-	fq->flows_bitmap = NULL;
+	fq_free_shards(fq);
 }
 
 #endif
@@ -1013,6 +1013,9 @@ enum mac80211_tx_info_flags {
  * @IEEE80211_TX_CTRL_DONT_USE_RATE_MASK: Don't use rate mask for this frame
  *	which is transmitted due to scanning or offchannel TX, not in normal
  *	operation on the interface.
+ * @IEEE80211_TX_INTCFL_AMSDU_SUBHDR: completely internal to mac80211,
+ *	marks a buffer in the frag list of an A-MSDU that only holds the
+ *	header of the subframe following it.
  * @IEEE80211_TX_CTRL_MLO_LINK: If not @IEEE80211_LINK_UNSPECIFIED, this
  *	frame should be transmitted on the specific link. This really is
  *	only relevant for frames that do not have data present, and is
@@ -1034,6 +1037,7 @@ enum mac80211_tx_control_flags {
 	IEEE80211_TX_CTRL_DONT_REORDER		= BIT(8),
 	IEEE80211_TX_CTRL_MCAST_MLO_FIRST_TX	= BIT(9),
 	IEEE80211_TX_CTRL_DONT_USE_RATE_MASK	= BIT(10),
+	IEEE80211_TX_INTCFL_AMSDU_SUBHDR	= BIT(11),
 	IEEE80211_TX_CTRL_MLO_LINK		= 0xf0000000,
 };
 
@@ -1090,6 +1094,13 @@ enum mac80211_tx_status_flags {
  *	adjacent 20 MHz channels, if the current channel type is
  *	NL80211_CHAN_HT40MINUS or NL80211_CHAN_HT40PLUS.
  * @IEEE80211_TX_RC_SHORT_GI: Short Guard interval should be used for this rate.
+ * @IEEE80211_TX_RC_HE_MCS: HE MCS rate, the idx field is split like for VHT.
+ *	Only valid in &struct ieee80211_sta_rates, for drivers setting
+ *	%IEEE80211_HW_SUPPORTS_HE_RC_TABLE. HE and EHT rates from the rate
+ *	table always use the 0.8 usec guard interval.
+ * @IEEE80211_TX_RC_EHT_MCS: EHT MCS rate, like %IEEE80211_TX_RC_HE_MCS
+ * @IEEE80211_TX_RC_320_MHZ_WIDTH: Indicates 320 MHz transmission, only
+ *	valid with %IEEE80211_TX_RC_EHT_MCS
  */
 enum mac80211_rate_control_flags {
 	IEEE80211_TX_RC_USE_RTS_CTS		= BIT(0),
@@ -1105,6 +1116,11 @@ enum mac80211_rate_control_flags {
 	IEEE80211_TX_RC_VHT_MCS			= BIT(8),
 	IEEE80211_TX_RC_80_MHZ_WIDTH		= BIT(9),
 	IEEE80211_TX_RC_160_MHZ_WIDTH		= BIT(10),
+
+	/* rate table only, these don't fit into struct ieee80211_tx_rate */
+	IEEE80211_TX_RC_HE_MCS			= BIT(11),
+	IEEE80211_TX_RC_EHT_MCS			= BIT(12),
+	IEEE80211_TX_RC_320_MHZ_WIDTH		= BIT(13),
 };
 
 
@@ -1202,6 +1218,8 @@ ieee80211_rate_get_vht_nss(const struct ieee80211_tx_rate *rate)
  *	see also &enum ieee80211_status_data for the internal documentation
  * @status_data_idr: indicates status data is IDR allocated ID for ack frame
  * @tx_time_est: TX time estimate in units of 4us, used internally
+ * @tx_latency: internal to mac80211, the frame's skb->tstamp holds the time
+ *	it was dequeued, for the station's TX latency statistics
  * @control: union part for control data
  * @control.rates: TX rates array to try
  * @control.rts_cts_rate_idx: rate for RTS or CTS
@@ -1209,6 +1227,12 @@ ieee80211_rate_get_vht_nss(const struct ieee80211_tx_rate *rate)
  * @control.use_cts_prot: use RTS/CTS
  * @control.short_preamble: use short preamble (CCK only)
  * @control.skip_table: skip externally configured rate table
+ * @control.probe_he: try the HE rate given by @control.probe_idx and
+ *	@control.probe_bw first, to probe it for rate control; only used with
+ *	%IEEE80211_HW_SUPPORTS_HE_RC_TABLE
+ * @control.probe_eht: like @control.probe_he, for an EHT rate
+ * @control.probe_idx: HE/EHT rate to probe, NSS and MCS encoded as for VHT
+ * @control.probe_bw: bandwidth of the rate to probe, &enum rate_info_bw
  * @control.jiffies: timestamp for expiry on powersave clients
  * @control.vif: virtual interface (may be NULL)
  * @control.hw_key: key to encrypt with (may be NULL)
@@ -1238,8 +1262,8 @@ struct ieee80211_tx_info {
 	    status_data_idr:1,
 	    status_data:13,
 	    hw_queue:4,
-	    tx_time_est:10;
-	/* 1 free bit */
+	    tx_time_est:10,
+	    tx_latency:1;
 
 	union {
 		struct {
@@ -1257,7 +1281,10 @@ struct ieee80211_tx_info {
 					/* for injection only (bitmap) */
 					u8 antennas:2;
 
-					/* 14 bits free */
+					u8 probe_he:1;
+					u8 probe_eht:1;
+					u8 probe_idx;
+					u8 probe_bw;
 				};
 				/* only needed before rate control */
 				unsigned long jiffies;
@@ -2857,6 +2884,17 @@ struct ieee80211_txq {
  *	HW flag so drivers can opt in according to their own control, e.g. in
  *	testing.
  *
+ * @IEEE80211_HW_RX_LIST_BATCHING: Frames handed to mac80211 through
+ *	ieee80211_rx_irqsafe() are collected over a whole run of the RX
+ *	tasklet and passed to the network stack in batches, grouped per
+ *	interface, instead of one by one.
+ *
+ * @IEEE80211_HW_SUPPORTS_HE_RC_TABLE: The driver reads the rate selection
+ *	table (&struct ieee80211_sta_rates) directly and handles HE and EHT
+ *	entries in it, see %IEEE80211_TX_RC_HE_MCS. It also handles HE and EHT
+ *	rates to probe, given in the @probe_* fields of the TX control info.
+ *	Requires %IEEE80211_HW_SUPPORTS_RC_TABLE.
+ *
  * @NUM_IEEE80211_HW_FLAGS: number of hardware flags, used for sizing arrays
  */
 enum ieee80211_hw_flags {
@@ -2918,6 +2956,8 @@ enum ieee80211_hw_flags {
 	IEEE80211_HW_DISALLOW_PUNCTURING_5GHZ,
 	IEEE80211_HW_HANDLES_QUIET_CSA,
 	IEEE80211_HW_STRICT,
+	IEEE80211_HW_RX_LIST_BATCHING,
+	IEEE80211_HW_SUPPORTS_HE_RC_TABLE,
 
 	/* keep last, obviously */
 	NUM_IEEE80211_HW_FLAGS
@@ -5129,6 +5169,25 @@ void ieee80211_restart_hw(struct ieee80211_hw *hw);
 void ieee80211_rx_list(struct ieee80211_hw *hw, struct ieee80211_sta *sta,
 		       struct sk_buff *skb, struct list_head *list);
 
+/**
+ * ieee80211_rx_list_deliver - pass frames collected by ieee80211_rx_list()
+ *
+ * Hand the frames that one or more calls to ieee80211_rx_list() stored in
+ * @list to the network stack. Drivers can use this to collect all frames
+ * received during a NAPI poll and deliver them at the end of it.
+ *
+ * The frames are grouped per interface, keeping their order within each
+ * interface, and every group is passed up with a single call to
+ * netif_receive_skb_list(). @list is empty when this function returns.
+ *
+ * This function must be called with BHs disabled.
+ *
+ * @hw: the hardware the frames came in on
+ * @list: the list of frames
+ */
+void ieee80211_rx_list_deliver(struct ieee80211_hw *hw,
+			       struct list_head *list);
+
 /**
  * ieee80211_rx_napi - receive frame from NAPI context
  *
@@ -7069,6 +7128,9 @@ struct rate_control_ops {
 				struct dentry *dir);
 
 	u32 (*get_expected_throughput)(void *priv_sta);
+	unsigned int (*get_rate_stats)(void *priv, void *priv_sta,
+				       struct nl80211_rc_rate_stats *stats,
+				       unsigned int n_stats);
 };
 
 static inline int rate_supported(struct ieee80211_sta *sta,
@@ -7450,6 +7512,36 @@ static inline struct sk_buff *ieee80211_tx_dequeue_ni(struct ieee80211_hw *hw,
 	return skb;
 }
 
+/**
+ * ieee80211_tx_dequeue_bulk - dequeue a burst of packets from a software
+ *	tx queue
+ *
+ * Like ieee80211_tx_dequeue(), but pulls up to @max_frames frames from the
+ * queue in one go. The queue lock is taken once for the whole burst and
+ * AQL pending airtime is charged once for all frames, which makes this
+ * cheaper than calling ieee80211_tx_dequeue() in a loop.
+ *
+ * Dequeued frames are appended to @skbs in transmit order; fragments of a
+ * fragmented MSDU are always returned together. The same RCU and softirq
+ * requirements as for ieee80211_tx_dequeue() apply.
+ *
+ * @hw: pointer as obtained from ieee80211_alloc_hw()
+ * @txq: pointer obtained from station or virtual interface, or from
+ *	ieee80211_next_txq()
+ * @skbs: list to append the dequeued frames to
+ * @max_frames: maximum number of frames to dequeue
+ * @max_airtime: stop once the estimated airtime (in usec) of the dequeued
+ *	frames reaches this value, 0 for no limit. Only effective when the
+ *	driver supports AQL, since that provides the per-frame estimate.
+ *
+ * Return: the number of frames appended to @skbs.
+ */
+unsigned int ieee80211_tx_dequeue_bulk(struct ieee80211_hw *hw,
+				       struct ieee80211_txq *txq,
+				       struct sk_buff_head *skbs,
+				       unsigned int max_frames,
+				       u32 max_airtime);
+
 /**
  * ieee80211_handle_wake_tx_queue - mac80211 handler for wake_tx_queue callback
  *
@@ -7542,12 +7634,12 @@ ieee80211_return_txq(struct ieee80211_hw *hw, struct ieee80211_txq *txq,
  * eventually bring the deficit to positive and allow the station to transmit
  * again.
  *
- * The API ieee80211_txq_may_transmit() also ensures that TXQ list will be
- * aligned against driver's own round-robin scheduler list. i.e it rotates
- * the TXQ list till it makes the requested node becomes the first entry
- * in TXQ list. Thus both the TXQ list and driver's list are in sync. If this
- * function returns %true, the driver is expected to schedule packets
- * for transmission, and then return the TXQ through ieee80211_return_txq().
+ * A throttled TXQ is credited with its station's airtime weight and moved
+ * behind the other TXQs due in the current scheduling round, so the order
+ * in which stations get to transmit follows the driver's own round-robin
+ * scheduler list. If this function returns %true, the driver is expected to
+ * schedule packets for transmission, and then return the TXQ through
+ * ieee80211_return_txq().
  *
  * @hw: pointer as obtained from ieee80211_alloc_hw()
  * @txq: pointer obtained from station or virtual interface
@@ -2899,6 +2899,18 @@ enum nl80211_commands {
  *	APs Support". Drivers may set additional flags that they support
  *	in the kernel or device.
  *
+ * @NL80211_ATTR_BSS_DUMP_SINCE_GENERATION: With %NL80211_CMD_GET_SCAN
+ *	dumps, the scan generation (u32) from %NL80211_ATTR_GENERATION of an
+ *	earlier dump. Only BSS entries added or updated since then are
+ *	dumped, followed by entries for the BSSes that were removed since
+ *	then, which carry the %NL80211_BSS_EXPIRED flag. If the kernel no
+ *	longer knows about all removals since that generation, the dump
+ *	fails with -ESTALE and a full dump is needed.
+ *
+ * @NL80211_ATTR_STA_RC_RATE_STATS: Flag attribute for %NL80211_CMD_GET_STATION
+ *	(and its dump) requesting %NL80211_STA_INFO_RC_RATE_STATS to be
+ *	included in the station information. It is never included otherwise.
+ *
  * @NUM_NL80211_ATTR: total number of nl80211_attrs available
  * @NL80211_ATTR_MAX: highest attribute number currently defined
  * @__NL80211_ATTR_AFTER_LAST: internal use
@@ -3456,6 +3468,10 @@ enum nl80211_attrs {
 
 	NL80211_ATTR_ASSOC_MLD_EXT_CAPA_OPS,
 
+	NL80211_ATTR_BSS_DUMP_SINCE_GENERATION,
+
+	NL80211_ATTR_STA_RC_RATE_STATS,
+
 	/* add attributes here, update the policy in nl80211.c */
 
 	__NL80211_ATTR_AFTER_LAST,
@@ -3941,6 +3957,15 @@ enum nl80211_sta_bss_param {
  *	of STA's association
  * @NL80211_STA_INFO_CONNECTED_TO_AS: set to true if STA has a path to a
  *	authentication server (u8, 0 or 1)
+ * @NL80211_STA_INFO_TX_LATENCY: TX latency histograms (see
+ *	&enum nl80211_tx_latency). This is a nested attribute where the inner
+ *	attribute number is the access category (&enum nl80211_ac) + 1, each
+ *	of those is again nested with &enum nl80211_tx_latency attributes.
+ * @NL80211_STA_INFO_RC_RATE_STATS: statistics of the software rate control
+ *	algorithm, an array of &struct nl80211_rc_rate_stats (binary). Only
+ *	rates that were tried in the last statistics period or that the
+ *	algorithm currently uses are in it. Only reported when requested
+ *	with %NL80211_ATTR_STA_RC_RATE_STATS.
  * @__NL80211_STA_INFO_AFTER_LAST: internal
  * @NL80211_STA_INFO_MAX: highest possible station info attribute
  */
@@ -3989,6 +4014,8 @@ enum nl80211_sta_info {
 	NL80211_STA_INFO_AIRTIME_LINK_METRIC,
 	NL80211_STA_INFO_ASSOC_AT_BOOTTIME,
 	NL80211_STA_INFO_CONNECTED_TO_AS,
+	NL80211_STA_INFO_TX_LATENCY,
+	NL80211_STA_INFO_RC_RATE_STATS,
 
 	/* keep last */
 	__NL80211_STA_INFO_AFTER_LAST,
@@ -4028,6 +4055,107 @@ enum nl80211_tid_stats {
 	NL80211_TID_STATS_MAX = NUM_NL80211_TID_STATS - 1
 };
 
+/* number of bins in the TX latency histograms */
+#define NL80211_TX_LATENCY_BINS	20
+
+/**
+ * enum nl80211_tx_latency - TX latency histogram attributes
+ *
+ * Each histogram is a nested attribute where the inner attribute number is
+ * the bin + 1 and the value is the number of frames in that bin (u32). Bin 0
+ * counts delays below 1 usec, bin n > 0 counts delays of at least 2^(n-1)
+ * and below 2^n usec; the last bin also counts all longer delays. Empty bins
+ * are left out.
+ *
+ * @__NL80211_TX_LATENCY_INVALID: attribute number 0 is reserved
+ * @NL80211_TX_LATENCY_QUEUE: histogram of the time frames spent in the
+ *	TX queue, from being queued until the driver dequeued them
+ * @NL80211_TX_LATENCY_DRIVER: histogram of the time frames spent in the
+ *	driver and device, from being dequeued until their TX status
+ * @NUM_NL80211_TX_LATENCY: number of attributes here
+ * @NL80211_TX_LATENCY_MAX: highest numbered attribute here
+ */
+enum nl80211_tx_latency {
+	__NL80211_TX_LATENCY_INVALID,
+	NL80211_TX_LATENCY_QUEUE,
+	NL80211_TX_LATENCY_DRIVER,
+
+	/* keep last */
+	NUM_NL80211_TX_LATENCY,
+	NL80211_TX_LATENCY_MAX = NUM_NL80211_TX_LATENCY - 1
+};
+
+/**
+ * enum nl80211_rc_rate_encoding - rate encoding in rate control statistics
+ * @NL80211_RC_RATE_ENC_LEGACY: legacy (CCK or OFDM) rate
+ * @NL80211_RC_RATE_ENC_HT: HT MCS
+ * @NL80211_RC_RATE_ENC_VHT: VHT MCS
+ * @NL80211_RC_RATE_ENC_HE: HE MCS
+ * @NL80211_RC_RATE_ENC_EHT: EHT MCS
+ */
+enum nl80211_rc_rate_encoding {
+	NL80211_RC_RATE_ENC_LEGACY,
+	NL80211_RC_RATE_ENC_HT,
+	NL80211_RC_RATE_ENC_VHT,
+	NL80211_RC_RATE_ENC_HE,
+	NL80211_RC_RATE_ENC_EHT,
+};
+
+/**
+ * enum nl80211_rc_rate_flags - flags in rate control statistics
+ * @NL80211_RC_RATE_F_SHORT_GI: the rate uses the short guard interval
+ * @NL80211_RC_RATE_F_SHORT_PREAMBLE: the rate uses the short preamble
+ * @NL80211_RC_RATE_F_MAX_PROB: the rate is the one with the highest
+ *	probability of success, used as the last fallback
+ * @NL80211_RC_RATE_F_SAMPLE: the rate is currently being sampled
+ */
+enum nl80211_rc_rate_flags {
+	NL80211_RC_RATE_F_SHORT_GI		= 1 << 0,
+	NL80211_RC_RATE_F_SHORT_PREAMBLE	= 1 << 1,
+	NL80211_RC_RATE_F_MAX_PROB		= 1 << 2,
+	NL80211_RC_RATE_F_SAMPLE		= 1 << 3,
+};
+
+/**
+ * struct nl80211_rc_rate_stats - rate control statistics of a single rate
+ * @encoding: encoding of the rate, see &enum nl80211_rc_rate_encoding
+ * @bw: channel width, see &enum nl80211_chan_width
+ * @nss: number of spatial streams, 0 for legacy rates
+ * @mcs: MCS index, for HT as in the HT MCS table (0-31), 0 for legacy rates
+ * @bitrate: bitrate of legacy rates in 100 kbit/s, 0 for MCS rates
+ * @flags: see &enum nl80211_rc_rate_flags
+ * @tp_rank: 1-based position of the rate in the rate control's list of
+ *	highest throughput rates, 0 if the rate isn't in that list
+ * @throughput: expected throughput at this rate in kbit/s, based on the
+ *	current success probability
+ * @prob: averaged success probability in units of 1/1000
+ * @retry_count: number of retries allowed at this rate
+ * @last_attempts: number of transmission attempts in the last statistics
+ *	period
+ * @last_success: number of successful transmissions in the last
+ *	statistics period
+ * @attempts: total number of transmission attempts
+ * @success: total number of successful transmissions
+ * @reserved: reserved, zero
+ */
+struct nl80211_rc_rate_stats {
+	__u8 encoding;
+	__u8 bw;
+	__u8 nss;
+	__u8 mcs;
+	__u16 bitrate;
+	__u8 flags;
+	__u8 tp_rank;
+	__u32 throughput;
+	__u16 prob;
+	__u8 retry_count;
+	__u8 reserved;
+	__u16 last_attempts;
+	__u16 last_success;
+	__u32 attempts;
+	__u32 success;
+};
+
 /**
  * enum nl80211_txq_stats - per TXQ statistics attributes
  * @__NL80211_TXQ_STATS_INVALID: attribute number 0 is reserved
@@ -5251,6 +5379,14 @@ enum nl80211_bss_cannot_use_reasons {
  *	This is a u64 attribute containing a bitmap of values from
  *	&enum nl80211_cannot_use_reasons, note that the attribute may be missing
  *	if no reasons are specified.
+ * @NL80211_BSS_GENERATION: the scan generation (u32) in which this entry
+ *	was last added or updated, or removed for %NL80211_BSS_EXPIRED entries.
+ *	Changes of only the status or the age of an entry aren't updates.
+ * @NL80211_BSS_EXPIRED: flag indicating that the BSS entry was removed,
+ *	see %NL80211_ATTR_BSS_DUMP_SINCE_GENERATION. Such entries only carry
+ *	the %NL80211_BSS_BSSID, %NL80211_BSS_FREQUENCY,
+ *	%NL80211_BSS_FREQUENCY_OFFSET and %NL80211_BSS_GENERATION attributes,
+ *	and %NL80211_BSS_INFORMATION_ELEMENTS with only the SSID element.
  * @__NL80211_BSS_AFTER_LAST: internal
  * @NL80211_BSS_MAX: highest BSS attribute
  */
@@ -5280,6 +5416,8 @@ enum nl80211_bss {
 	NL80211_BSS_MLD_ADDR,
 	NL80211_BSS_USE_FOR,
 	NL80211_BSS_CANNOT_USE_REASONS,
+	NL80211_BSS_GENERATION,
+	NL80211_BSS_EXPIRED,
 
 	/* keep last */
 	__NL80211_BSS_AFTER_LAST,
@@ -46,12 +46,8 @@ static void ieee80211_free_tid_rx(struct rcu_head *h)
 {
 	struct tid_ampdu_rx *tid_rx =
 		container_of(h, struct tid_ampdu_rx, rcu_head);
-	int i;
 
-	for (i = 0; i < tid_rx->buf_size; i++)
-		__skb_queue_purge(&tid_rx->reorder_buf[i]);
-	kfree(tid_rx->reorder_buf);
-	kfree(tid_rx->reorder_time);
+	ieee80211_rx_reorder_free(tid_rx);
 	kfree(tid_rx);
 }
 
@@ -282,7 +278,7 @@ void __ieee80211_start_rx_ba_session(struct sta_info *sta,
 		.timeout = timeout,
 		.ssn = start_seq_num,
 	};
-	int i, ret = -EOPNOTSUPP;
+	int ret = -EOPNOTSUPP;
 	u16 status = WLAN_STATUS_REQUEST_DECLINED;
 	u16 max_buf_size;
 
@@ -403,26 +399,16 @@ void __ieee80211_start_rx_ba_session(struct sta_info *sta,
 		    sta_rx_agg_reorder_timer_expired, 0);
 
 	/* prepare reordering buffer */
-	tid_agg_rx->reorder_buf =
-		kcalloc(buf_size, sizeof(struct sk_buff_head), GFP_KERNEL);
-	tid_agg_rx->reorder_time =
-		kcalloc(buf_size, sizeof(unsigned long), GFP_KERNEL);
-	if (!tid_agg_rx->reorder_buf || !tid_agg_rx->reorder_time) {
-		kfree(tid_agg_rx->reorder_buf);
-		kfree(tid_agg_rx->reorder_time);
+	if (ieee80211_rx_reorder_alloc(tid_agg_rx, buf_size, GFP_KERNEL)) {
 		kfree(tid_agg_rx);
 		goto end;
 	}
 
-	for (i = 0; i < buf_size; i++)
-		__skb_queue_head_init(&tid_agg_rx->reorder_buf[i]);
-
 	ret = drv_ampdu_action(local, sta->sdata, &params);
 	ht_dbg(sta->sdata, "Rx A-MPDU request on %pM tid %d result %d\n",
 	       sta->sta.addr, tid, ret);
 	if (ret) {
-		kfree(tid_agg_rx->reorder_buf);
-		kfree(tid_agg_rx->reorder_time);
+		ieee80211_rx_reorder_free(tid_agg_rx);
 		kfree(tid_agg_rx);
 		goto end;
 	}
@@ -193,9 +193,9 @@ ieee80211_agg_stop_txq(struct sta_info *sta, int tid)
 	fq = &sdata->local->fq;
 
 	/* Lock here to protect against further seqno updates on dequeue */
-	spin_lock_bh(&fq->lock);
+	fq_tin_lock_bh(fq, &txqi->tin);
 	set_bit(IEEE80211_TXQ_STOP, &txqi->flags);
-	spin_unlock_bh(&fq->lock);
+	fq_tin_unlock_bh(fq, &txqi->tin);
 }
 
 static void
@@ -520,7 +520,8 @@ void ieee80211_tx_ba_session_handle_start(struct sta_info *sta, int tid)
 	 */
 	synchronize_net();
 
-	params.ssn = sta->tid_seq[tid] >> 4;
+	params.ssn = (atomic_read(&sta->tid_seq[tid]) &
+		      IEEE80211_SCTL_SEQ) >> 4;
 	ret = drv_ampdu_action(local, sdata, &params);
 	tid_tx->ssn = params.ssn;
 	if (ret == IEEE80211_AMPDU_TX_START_DELAY_ADDBA) {
@@ -4,6 +4,7 @@
  * Copyright (C) 2021-2022 Intel Corporation
  */
 
+#include <linux/math64.h>
 #include <net/mac80211.h>
 #include "ieee80211_i.h"
 #include "sta_info.h"
@@ -291,7 +292,7 @@ struct mcs_group {
 	u16 duration[MCS_GROUP_RATES];
 };
 
-static const struct mcs_group airtime_mcs_groups[] = {
+static const struct mcs_group airtime_mcs_groups[] __initconst = {
 	MCS_GROUP(1, 0, BW_20),
 	MCS_GROUP(2, 0, BW_20),
 	MCS_GROUP(3, 0, BW_20),
@@ -481,7 +482,42 @@ static const struct mcs_group airtime_mcs_groups[] = {
 	EHT_GROUP_RANGE(EHT_GI_32, BW_320),
 };
 
-static u32
+/*
+ * The durations of airtime_mcs_groups with the group shift applied, i.e. the
+ * airtime of each byte of a frame in units of 2^-20 usec, so that a frame's
+ * airtime is a single multiplication.
+ */
+static u32 airtime_mcs_duration[ARRAY_SIZE(airtime_mcs_groups)][MCS_GROUP_RATES]
+	__ro_after_init;
+
+/* highest legacy bitrate (in 100 kbps) with a precomputed reciprocal */
+#define AIRTIME_MAX_LEGACY_BITRATE	540
+
+/*
+ * Reciprocals of the legacy bitrates, scaled by 2^(31 + ilog2(bitrate)).
+ * Rounding them up makes (bits * recip) >> shift equal to bits / bitrate
+ * for all bits < 2^30.
+ */
+static u32 airtime_legacy_recip[AIRTIME_MAX_LEGACY_BITRATE + 1] __ro_after_init;
+
+void __init ieee80211_airtime_init(void)
+{
+	int group, idx, rate;
+
+	for (group = 0; group < ARRAY_SIZE(airtime_mcs_groups); group++) {
+		const struct mcs_group *g = &airtime_mcs_groups[group];
+
+		for (idx = 0; idx < MCS_GROUP_RATES; idx++)
+			airtime_mcs_duration[group][idx] =
+				(u32)g->duration[idx] << g->shift;
+	}
+
+	for (rate = 1; rate <= AIRTIME_MAX_LEGACY_BITRATE; rate++)
+		airtime_legacy_recip[rate] =
+			DIV_ROUND_UP_ULL(1ULL << (31 + ilog2(rate)), rate);
+}
+
+VISIBLE_IF_MAC80211_KUNIT u32
 ieee80211_calc_legacy_rate_duration(u16 bitrate, bool short_pre,
 				    bool cck, int len)
 {
@@ -498,10 +534,17 @@ ieee80211_calc_legacy_rate_duration(u16 bitrate, bool short_pre,
 	}
 
 	len <<= 3;
-	duration += (len * 10) / bitrate;
+	len *= 10;
+	if (likely(bitrate && bitrate <= AIRTIME_MAX_LEGACY_BITRATE &&
+		   len >= 0 && len < BIT(30)))
+		duration += mul_u32_u32(len, airtime_legacy_recip[bitrate]) >>
+			    (31 + ilog2(bitrate));
+	else
+		duration += len / bitrate;
 
 	return duration;
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(ieee80211_calc_legacy_rate_duration);
 
 static u32 ieee80211_get_rate_duration(struct ieee80211_hw *hw,
 				       struct ieee80211_rx_status *status,
@@ -574,8 +617,7 @@ static u32 ieee80211_get_rate_duration(struct ieee80211_hw *hw,
 	if (idx >= MCS_GROUP_RATES)
 		return 0;
 
-	duration = airtime_mcs_groups[group].duration[idx];
-	duration <<= airtime_mcs_groups[group].shift;
+	duration = airtime_mcs_duration[group][idx];
 	*overhead = 36 + (streams << 2);
 
 	return duration;
@@ -4627,9 +4627,10 @@ static int ieee80211_get_txq_stats(struct wiphy *wiphy,
 {
 	struct ieee80211_local *local = wiphy_priv(wiphy);
 	struct ieee80211_sub_if_data *sdata;
+	struct fq_stats stats;
 	int ret = 0;
 
-	spin_lock_bh(&local->fq.lock);
+	fq_lock_all_bh(&local->fq);
 	rcu_read_lock();
 
 	if (wdev) {
@@ -4647,17 +4648,18 @@ static int ieee80211_get_txq_stats(struct wiphy *wiphy,
 				    BIT(NL80211_TXQ_STATS_OVERMEMORY) |
 				    BIT(NL80211_TXQ_STATS_COLLISIONS) |
 				    BIT(NL80211_TXQ_STATS_MAX_FLOWS);
-		txqstats->backlog_packets = local->fq.backlog;
-		txqstats->backlog_bytes = local->fq.memory_usage;
-		txqstats->overlimit = local->fq.overlimit;
-		txqstats->overmemory = local->fq.overmemory;
-		txqstats->collisions = local->fq.collisions;
+		fq_get_stats(&local->fq, &stats);
+		txqstats->backlog_packets = stats.backlog;
+		txqstats->backlog_bytes = stats.memory_usage;
+		txqstats->overlimit = stats.overlimit;
+		txqstats->overmemory = stats.overmemory;
+		txqstats->collisions = stats.collisions;
 		txqstats->max_flows = local->fq.flows_cnt;
 	}
 
 out:
 	rcu_read_unlock();
-	spin_unlock_bh(&local->fq.lock);
+	fq_unlock_all_bh(&local->fq);
 
 	return ret;
 }
@@ -78,38 +78,72 @@ static ssize_t aqm_read(struct file *file,
 {
 	struct ieee80211_local *local = file->private_data;
 	struct fq *fq = &local->fq;
-	char buf[200];
-	int len = 0;
+	size_t bufsz = 512 + 160 * FQ_MAX_SHARDS;
+	char *buf = kzalloc(bufsz, GFP_KERNEL), *p = buf;
+	struct fq_stats stats;
+	ssize_t rv;
+	int i;
 
-	spin_lock_bh(&local->fq.lock);
+	if (!buf)
+		return -ENOMEM;
+
+	fq_lock_all_bh(fq);
 	rcu_read_lock();
 
-	len = scnprintf(buf, sizeof(buf),
-			"access name value\n"
-			"R fq_flows_cnt %u\n"
-			"R fq_backlog %u\n"
-			"R fq_overlimit %u\n"
-			"R fq_overmemory %u\n"
-			"R fq_collisions %u\n"
-			"R fq_memory_usage %u\n"
-			"RW fq_memory_limit %u\n"
-			"RW fq_limit %u\n"
-			"RW fq_quantum %u\n",
-			fq->flows_cnt,
-			fq->backlog,
-			fq->overmemory,
-			fq->overlimit,
-			fq->collisions,
-			fq->memory_usage,
-			fq->memory_limit,
-			fq->limit,
-			fq->quantum);
+	fq_get_stats(fq, &stats);
+
+	p += scnprintf(p, bufsz + buf - p,
+		       "access name value\n"
+		       "R fq_flows_cnt %u\n"
+		       "R fq_backlog %u\n"
+		       "R fq_overlimit %u\n"
+		       "R fq_overmemory %u\n"
+		       "R fq_collisions %u\n"
+		       "R fq_memory_usage %u\n"
+		       "RW fq_memory_limit %u\n"
+		       "RW fq_limit %u\n"
+		       "RW fq_quantum %u\n"
+		       "R fq_shards %u\n"
+		       "R fq_tx_packets %llu\n"
+		       "R fq_tx_bytes %llu\n"
+		       "R fq_lock_acquired %llu\n"
+		       "R fq_lock_contended %llu\n",
+		       fq->flows_cnt,
+		       stats.backlog,
+		       stats.overmemory,
+		       stats.overlimit,
+		       stats.collisions,
+		       stats.memory_usage,
+		       fq->memory_limit,
+		       fq->limit,
+		       fq->quantum,
+		       fq->shards_cnt,
+		       stats.tx_packets,
+		       stats.tx_bytes,
+		       stats.lock_acquired,
+		       stats.lock_contended);
+
+	for (i = 0; i < fq->shards_cnt; i++) {
+		struct fq_shard *shard = &fq->shards[i];
+
+		p += scnprintf(p, bufsz + buf - p,
+			       "R fq_shard%d_backlog %u\n"
+			       "R fq_shard%d_tx_packets %llu\n"
+			       "R fq_shard%d_lock_acquired %llu\n"
+			       "R fq_shard%d_lock_contended %llu\n",
+			       i, shard->backlog,
+			       i, shard->tx_packets,
+			       i, shard->lock_acquired,
+			       i, shard->lock_contended);
+	}
 
 	rcu_read_unlock();
-	spin_unlock_bh(&local->fq.lock);
+	fq_unlock_all_bh(fq);
 
-	return simple_read_from_buffer(user_buf, count, ppos,
-				       buf, len);
+	rv = simple_read_from_buffer(user_buf, count, ppos, buf, p - buf);
+	kfree(buf);
+
+	return rv;
 }
 
 static ssize_t aqm_write(struct file *file,
@@ -493,6 +527,8 @@ static const char *hw_flag_names[] = {
 	FLAG(DISALLOW_PUNCTURING_5GHZ),
 	FLAG(HANDLES_QUIET_CSA),
 	FLAG(STRICT),
+	FLAG(RX_LIST_BATCHING),
+	FLAG(SUPPORTS_HE_RC_TABLE),
 #undef FLAG
 };
 
@@ -730,6 +766,8 @@ void debugfs_hw_add(struct ieee80211_local *local)
 	DEBUGFS_STATS_ADD(tx_expand_skb_head);
 	DEBUGFS_STATS_ADD(tx_expand_skb_head_cloned);
 	DEBUGFS_STATS_ADD(rx_expand_skb_head_defrag);
+	DEBUGFS_STATS_ADD(rx_list_batches);
+	DEBUGFS_STATS_ADD(rx_list_frames);
 	DEBUGFS_STATS_ADD(rx_handlers_fragments);
 	DEBUGFS_STATS_ADD(tx_status_drop);
 #endif
@@ -624,7 +624,7 @@ static ssize_t ieee80211_if_fmt_aqm(
 
 	txqi = to_txq_info(sdata->vif.txq);
 
-	spin_lock_bh(&local->fq.lock);
+	fq_tin_lock_bh(&local->fq, &txqi->tin);
 	rcu_read_lock();
 
 	len = scnprintf(buf,
@@ -643,7 +643,7 @@ static ssize_t ieee80211_if_fmt_aqm(
 			txqi->tin.tx_packets);
 
 	rcu_read_unlock();
-	spin_unlock_bh(&local->fq.lock);
+	fq_tin_unlock_bh(&local->fq, &txqi->tin);
 
 	return len;
 }
@@ -131,6 +131,16 @@ static ssize_t sta_last_seq_ctrl_read(struct file *file, char __user *userbuf,
 }
 STA_OPS(last_seq_ctrl);
 
+static ssize_t sta_tx_filtered_read(struct file *file, char __user *userbuf,
+				    size_t count, loff_t *ppos)
+{
+	struct sta_info *sta = file->private_data;
+
+	return mac80211_format_buffer(userbuf, count, ppos, "%llu\n",
+				      sta_get_tx_filtered(&sta->deflink));
+}
+STA_OPS(tx_filtered);
+
 #define AQM_TXQ_ENTRY_LEN 130
 
 static ssize_t sta_aqm_read(struct file *file, char __user *userbuf,
@@ -147,7 +157,7 @@ static ssize_t sta_aqm_read(struct file *file, char __user *userbuf,
 	if (!buf)
 		return -ENOMEM;
 
-	spin_lock_bh(&local->fq.lock);
+	fq_lock_all_bh(&local->fq);
 	rcu_read_lock();
 
 	p += scnprintf(p,
@@ -185,7 +195,7 @@ static ssize_t sta_aqm_read(struct file *file, char __user *userbuf,
 	}
 
 	rcu_read_unlock();
-	spin_unlock_bh(&local->fq.lock);
+	fq_unlock_all_bh(&local->fq);
 
 	rv = simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
 	kfree(buf);
@@ -212,6 +222,7 @@ static ssize_t sta_airtime_read(struct file *file, char __user *userbuf,
 		spin_lock_bh(&local->active_txq_lock[ac]);
 		rx_airtime += sta->airtime[ac].rx_airtime;
 		tx_airtime += sta->airtime[ac].tx_airtime;
+		ieee80211_sta_sync_airtime(sta, ac);
 		deficit[ac] = sta->airtime[ac].deficit;
 		spin_unlock_bh(&local->active_txq_lock[ac]);
 	}
@@ -309,6 +320,56 @@ static ssize_t sta_aql_write(struct file *file, const char __user *userbuf,
 }
 STA_OPS_RW(aql);
 
+static ssize_t sta_tx_latency_read(struct file *file, char __user *userbuf,
+				   size_t count, loff_t *ppos)
+{
+	struct sta_info *sta = file->private_data;
+	struct cfg80211_tx_latency *lat;
+	size_t bufsz = 4096;
+	char *buf, *p;
+	ssize_t rv;
+	int ac, bin;
+
+	lat = kmalloc(sizeof(*lat), GFP_KERNEL);
+	if (!lat)
+		return -ENOMEM;
+
+	buf = kzalloc(bufsz, GFP_KERNEL);
+	if (!buf) {
+		kfree(lat);
+		return -ENOMEM;
+	}
+	p = buf;
+
+	sta_fold_tx_latency(sta, lat);
+
+	/* each row counts the frames delayed by [usec, 2 * usec), the last
+	 * one also all longer delays
+	 */
+	p += scnprintf(p, bufsz + buf - p,
+		       "%8s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+		       "usec", "queue VO", "queue VI", "queue BE", "queue BK",
+		       "driver VO", "driver VI", "driver BE", "driver BK");
+
+	for (bin = 0; bin < NL80211_TX_LATENCY_BINS; bin++) {
+		p += scnprintf(p, bufsz + buf - p, "%8u",
+			       bin ? 1U << (bin - 1) : 0);
+		for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+			p += scnprintf(p, bufsz + buf - p, " %10u",
+				       lat->queue[ac][bin]);
+		for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+			p += scnprintf(p, bufsz + buf - p, " %10u",
+				       lat->driver[ac][bin]);
+		p += scnprintf(p, bufsz + buf - p, "\n");
+	}
+
+	rv = simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+	kfree(buf);
+	kfree(lat);
+	return rv;
+}
+STA_OPS(tx_latency);
+
 
 static ssize_t sta_agg_status_do_read(struct wiphy *wiphy, struct file *file,
 				      char *buf, size_t bufsz, void *data)
@@ -1265,10 +1326,11 @@ void ieee80211_sta_debugfs_add(struct sta_info *sta)
 	DEBUGFS_ADD(last_seq_ctrl);
 	DEBUGFS_ADD(agg_status);
 	/* FIXME: Kept here as the statistics are only done on the deflink */
-	DEBUGFS_ADD_COUNTER(tx_filtered, deflink.status_stats.filtered);
+	DEBUGFS_ADD(tx_filtered);
 
 	DEBUGFS_ADD(aqm);
 	DEBUGFS_ADD(airtime);
+	DEBUGFS_ADD(tx_latency);
 
 	if (wiphy_ext_feature_isset(local->hw.wiphy,
 				    NL80211_EXT_FEATURE_AQL))
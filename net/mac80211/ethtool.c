@@ -103,7 +103,7 @@ static void ieee80211_get_stats(struct net_device *dev,
 								\
 		data[i++] += sinfo.tx_packets;			\
 		data[i++] += sinfo.tx_bytes;			\
-		data[i++] += (sta)->status_stats.filtered;	\
+		data[i++] += sta_get_tx_filtered(sta);		\
 		data[i++] += sinfo.tx_failed;			\
 		data[i++] += sinfo.tx_retries;			\
 	} while (0)
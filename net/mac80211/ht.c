@@ -396,7 +396,7 @@ void ieee80211_ba_session_work(struct wiphy *wiphy, struct wiphy_work *work)
 				vif_to_sdata(txqi->txq.vif);
 			struct fq *fq = &sdata->local->fq;
 
-			spin_lock_bh(&fq->lock);
+			fq_tin_lock_bh(fq, &txqi->tin);
 
 			/* Allow only frags to be dequeued */
 			set_bit(IEEE80211_TXQ_STOP, &txqi->flags);
@@ -406,7 +406,7 @@ void ieee80211_ba_session_work(struct wiphy *wiphy, struct wiphy_work *work)
 				 * finish. Reschedule worker to retry later.
 				 */
 
-				spin_unlock_bh(&fq->lock);
+				fq_tin_unlock_bh(fq, &txqi->tin);
 				spin_unlock_bh(&sta->lock);
 
 				/* Give the task working on the txq a chance
@@ -418,7 +418,7 @@ void ieee80211_ba_session_work(struct wiphy *wiphy, struct wiphy_work *work)
 				return;
 			}
 
-			spin_unlock_bh(&fq->lock);
+			fq_tin_unlock_bh(fq, &txqi->tin);
 
 			/*
 			 * Assign it over to the normal tid_tx array
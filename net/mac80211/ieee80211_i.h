@@ -54,6 +54,9 @@ struct ieee80211_mesh_fast_tx;
 #define IEEE80211_ENCRYPT_HEADROOM 8
 #define IEEE80211_ENCRYPT_TAILROOM 18
 
+/* A-MSDU subframe header: padding, DA, SA, length and RFC 1042 header */
+#define IEEE80211_AMSDU_SUBHDR_MAX (3 + 2 * ETH_ALEN + 2 + 6)
+
 /* power level hasn't been configured (or set to automatic) */
 #define IEEE80211_UNSET_POWER_LEVEL	INT_MIN
 
@@ -169,6 +172,8 @@ typedef unsigned __bitwise ieee80211_tx_result;
 
 #define IEEE80211_TX_UNICAST		BIT(1)
 #define IEEE80211_TX_PS_BUFFERED	BIT(2)
+/* the driver picks an HE/EHT rate from the rate table, tx->rate is unset */
+#define IEEE80211_TX_DRV_RATE		BIT(3)
 
 struct ieee80211_tx_data {
 	struct sk_buff *skb;
@@ -705,6 +710,9 @@ struct mesh_csa_settings {
 	struct cfg80211_csa_settings settings;
 };
 
+/* number of slots in the expiry wheel of a mesh path table */
+#define MESH_PATH_EXPIRE_SLOTS	64
+
 /**
  * struct mesh_table - mesh hash table
  *
@@ -713,7 +721,12 @@ struct mesh_csa_settings {
  * @gates_lock: protects updates to known_gates
  * @rhead: the rhashtable containing struct mesh_paths, keyed by dest addr
  * @walk_head: linked list containing all mesh_path objects
- * @walk_lock: lock protecting walk_head
+ * @walk_lock: lock protecting walk_head, the expiry wheel and all removals
+ *	from the table
+ * @nexthop_lock: protects the per next hop lists of mesh paths, nests inside
+ *	the mesh path state_lock
+ * @expire_wheel: mesh paths hashed by the time they are due to expire
+ * @expire_next: start of the first expiry wheel slot not processed yet
  * @entries: number of entries in the table
  */
 struct mesh_table {
@@ -722,6 +735,9 @@ struct mesh_table {
 	struct rhashtable rhead;
 	struct hlist_head walk_head;
 	spinlock_t walk_lock;
+	spinlock_t nexthop_lock;
+	struct hlist_head expire_wheel[MESH_PATH_EXPIRE_SLOTS];
+	unsigned long expire_next;
 	atomic_t entries;		/* Up to MAX_MESH_NEIGHBOURS */
 };
 
@@ -929,6 +945,32 @@ enum txq_info_flags {
 	IEEE80211_TXQ_DIRTY,
 };
 
+#define IEEE80211_TXQ_SCHED_SLOTS	64
+
+/**
+ * struct ieee80211_txq_sched - per-AC calendar of active TXQs
+ *
+ * The airtime deficit round robin runs in numbered rounds, and every round
+ * credits each station with a negative deficit with its airtime weight.
+ * Rather than rotating all active TXQs through a list once per round, a TXQ
+ * is filed under the round in which its station's deficit will have turned
+ * non-negative again; the credits themselves are applied lazily, see
+ * ieee80211_sta_sync_airtime(). Round N lives in slot
+ * N % %IEEE80211_TXQ_SCHED_SLOTS, and TXQs due further out than the
+ * calendar reaches are parked in its last slot and re-filed from there.
+ *
+ * @slots: per-round lists of TXQs, linked by &txq_info.schedule_order
+ * @used: bitmap of the non-empty @slots
+ * @round: current round
+ * @num_txqs: number of TXQs on the calendar
+ */
+struct ieee80211_txq_sched {
+	struct list_head slots[IEEE80211_TXQ_SCHED_SLOTS];
+	u64 used;
+	u64 round;
+	unsigned int num_txqs;
+};
+
 /**
  * struct txq_info - per tid queue
  *
@@ -936,8 +978,10 @@ enum txq_info_flags {
  * @def_cvars: codel vars for the @tin's default_flow
  * @cstats: code statistics for this queue
  * @frags: used to keep fragments created after dequeue
- * @schedule_order: used with ieee80211_local->active_txqs
+ * @schedule_order: entry in a slot of the AC's &struct ieee80211_txq_sched
  * @schedule_round: counter to prevent infinite loops on TXQ scheduling
+ * @sched_round: scheduler round this TXQ is due in while on the calendar
+ * @sched_slot: calendar slot @schedule_order is on
  * @flags: TXQ flags from &enum txq_info_flags
  * @txq: the driver visible part
  */
@@ -947,7 +991,9 @@ struct txq_info {
 	struct codel_stats cstats;
 
 	u16 schedule_round;
+	u8 sched_slot;
 	struct list_head schedule_order;
+	u64 sched_round;
 
 	struct sk_buff_head frags;
 
@@ -979,6 +1025,36 @@ struct ieee80211_if_nan {
 	struct idr function_inst_ids;
 };
 
+/**
+ * struct ieee80211_elems_cache - cache of the last parsed elements
+ *
+ * Used by ieee802_11_parse_elems_cached() to avoid parsing the elements
+ * of every beacon again when nothing but the TIM changed.
+ *
+ * @elems: the parsed elements, pointing into @ies
+ * @ies: copy of the elements that were parsed
+ * @len: length of @ies
+ * @key: CRC over the elements, with only the length of the TIM included
+ * @key_valid: @key can be used, the elements were well-formed
+ * @mode: connection mode the elements were parsed for
+ * @filter: CRC element filter the elements were parsed with
+ * @crc: initial CRC the elements were parsed with
+ * @bss: BSS the elements were parsed for
+ * @from_ap: the elements were parsed as coming from an AP
+ */
+struct ieee80211_elems_cache {
+	struct ieee802_11_elems *elems;
+	u8 *ies;
+	size_t len;
+	u32 key;
+	bool key_valid;
+	enum ieee80211_conn_mode mode;
+	u64 filter;
+	u32 crc;
+	struct cfg80211_bss *bss;
+	bool from_ap;
+};
+
 struct ieee80211_link_data_managed {
 	u8 bssid[ETH_ALEN] __aligned(2);
 
@@ -1013,6 +1089,7 @@ struct ieee80211_link_data_managed {
 
 	bool beacon_crc_valid;
 	u32 beacon_crc;
+	struct ieee80211_elems_cache beacon_elems;
 	struct ewma_beacon_signal ave_beacon_signal;
 	int last_ave_beacon_signal;
 
@@ -1357,9 +1434,9 @@ struct ieee80211_local {
 	struct codel_vars *cvars;
 	struct codel_params cparams;
 
-	/* protects active_txqs and txqi->schedule_order */
+	/* protects txq_sched, txqi->schedule_order and sta airtime deficits */
 	spinlock_t active_txq_lock[IEEE80211_NUM_ACS];
-	struct list_head active_txqs[IEEE80211_NUM_ACS];
+	struct ieee80211_txq_sched txq_sched[IEEE80211_NUM_ACS];
 	u16 schedule_round[IEEE80211_NUM_ACS];
 
 	/* serializes ieee80211_handle_wake_tx_queue */
@@ -1462,6 +1539,8 @@ struct ieee80211_local {
 	 * skb_queue_unreliable may be dropped if the total length of these
 	 * queues increases over the limit. */
 #define IEEE80211_IRQSAFE_QUEUE_LIMIT 128
+	/* max. number of frames collected before passing them up, if batching */
+#define IEEE80211_RX_LIST_BATCH_MAX 64
 	struct tasklet_struct tasklet;
 	struct sk_buff_head skb_queue;
 	struct sk_buff_head skb_queue_unreliable;
@@ -1564,6 +1643,8 @@ struct ieee80211_local {
 	unsigned int tx_expand_skb_head;
 	unsigned int tx_expand_skb_head_cloned;
 	unsigned int rx_expand_skb_head_defrag;
+	unsigned int rx_list_batches;
+	unsigned int rx_list_frames;
 	unsigned int rx_handlers_fragments;
 	unsigned int tx_status_drop;
 #define I802_DEBUG_INC(c) (c)++
@@ -2188,6 +2269,9 @@ void ieee80211_stop_tx_ba_cb(struct sta_info *sta, int tid,
 void ieee80211_ba_session_work(struct wiphy *wiphy, struct wiphy_work *work);
 void ieee80211_tx_ba_session_handle_start(struct sta_info *sta, int tid);
 void ieee80211_release_reorder_timeout(struct sta_info *sta, int tid);
+int ieee80211_rx_reorder_alloc(struct tid_ampdu_rx *tid_agg_rx, u16 buf_size,
+			       gfp_t gfp);
+void ieee80211_rx_reorder_free(struct tid_ampdu_rx *tid_agg_rx);
 
 u8 ieee80211_mcs_to_chains(const struct ieee80211_mcs_info *mcs);
 enum nl80211_smps_mode
@@ -2382,6 +2466,11 @@ struct ieee80211_elems_parse_params {
 
 struct ieee802_11_elems *
 ieee802_11_parse_elems_full(struct ieee80211_elems_parse_params *params);
+struct ieee802_11_elems *
+ieee802_11_parse_elems_cached(struct ieee80211_elems_cache *cache,
+			      struct ieee80211_elems_parse_params *params,
+			      bool *hit);
+void ieee80211_elems_cache_flush(struct ieee80211_elems_cache *cache);
 
 static inline struct ieee802_11_elems *
 ieee802_11_parse_elems_crc(const u8 *start, size_t len, bool action,
@@ -2537,6 +2626,9 @@ void ieee80211_txq_init(struct ieee80211_sub_if_data *sdata,
 			struct txq_info *txq, int tid);
 void ieee80211_txq_purge(struct ieee80211_local *local,
 			 struct txq_info *txqi);
+void ieee80211_txq_sched_init(struct ieee80211_local *local);
+void ieee80211_txq_sched_del(struct ieee80211_local *local,
+			     struct txq_info *txqi);
 void ieee80211_purge_sta_txqs(struct sta_info *sta);
 void ieee80211_txq_remove_vlan(struct ieee80211_local *local,
 			       struct ieee80211_sub_if_data *sdata);
@@ -2751,6 +2843,7 @@ u8 *ieee80211_get_bssid(struct ieee80211_hdr *hdr, size_t len,
 
 extern const struct ethtool_ops ieee80211_ethtool_ops;
 
+void ieee80211_airtime_init(void);
 u32 ieee80211_calc_expected_tx_airtime(struct ieee80211_hw *hw,
 				       struct ieee80211_vif *vif,
 				       struct ieee80211_sta *pubsta,
@@ -2812,6 +2905,13 @@ ieee80211_determine_chan_mode(struct ieee80211_sub_if_data *sdata,
 			      struct ieee80211_chan_req *chanreq,
 			      struct cfg80211_chan_def *ap_chandef,
 			      unsigned long *userspace_selectors);
+__le16 ieee80211_tx_next_seq(struct sta_info *sta, int tid);
+bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata,
+				      struct tid_ampdu_rx *tid_agg_rx,
+				      struct sk_buff *skb,
+				      struct sk_buff_head *frames);
+u32 ieee80211_calc_legacy_rate_duration(u16 bitrate, bool short_pre,
+					bool cck, int len);
 #else
 #define EXPORT_SYMBOL_IF_MAC80211_KUNIT(sym)
 #define VISIBLE_IF_MAC80211_KUNIT static
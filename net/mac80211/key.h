@@ -171,4 +171,15 @@ int ieee80211_key_switch_links(struct ieee80211_sub_if_data *sdata,
 void ieee80211_delayed_tailroom_dec(struct wiphy *wiphy,
 				    struct wiphy_work *wk);
 
+/*
+ * Allocate the next TX PN of @key. This is a single atomic operation so
+ * that several TX queues can transmit with the same key concurrently, and
+ * it guarantees that each PN is handed out only once and in strictly
+ * increasing order.
+ */
+static inline u64 ieee80211_key_next_tx_pn(struct ieee80211_key *key)
+{
+	return atomic64_inc_return(&key->conf.tx_pn);
+}
+
 #endif /* IEEE80211_KEY_H */
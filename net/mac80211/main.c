@@ -429,7 +429,10 @@ u64 ieee80211_reset_erp_info(struct ieee80211_sub_if_data *sdata)
 /* context: requires softirqs disabled */
 void ieee80211_handle_queued_frames(struct ieee80211_local *local)
 {
+	bool batch = ieee80211_hw_check(&local->hw, RX_LIST_BATCHING);
+	unsigned int n_rx = 0;
 	struct sk_buff *skb;
+	LIST_HEAD(rx_list);
 
 	while ((skb = skb_dequeue(&local->skb_queue)) ||
 	       (skb = skb_dequeue(&local->skb_queue_unreliable))) {
@@ -438,7 +441,20 @@ void ieee80211_handle_queued_frames(struct ieee80211_local *local)
 			/* Clear skb->pkt_type in order to not confuse kernel
 			 * netstack. */
 			skb->pkt_type = 0;
-			ieee80211_rx(&local->hw, skb);
+			if (!batch) {
+				ieee80211_rx(&local->hw, skb);
+				break;
+			}
+
+			rcu_read_lock();
+			ieee80211_rx_list(&local->hw, NULL, skb, &rx_list);
+			rcu_read_unlock();
+
+			/* don't hold on to frames for too long */
+			if (++n_rx >= IEEE80211_RX_LIST_BATCH_MAX) {
+				ieee80211_rx_list_deliver(&local->hw, &rx_list);
+				n_rx = 0;
+			}
 			break;
 		case IEEE80211_TX_STATUS_MSG:
 			skb->pkt_type = 0;
@@ -451,6 +467,8 @@ void ieee80211_handle_queued_frames(struct ieee80211_local *local)
 			break;
 		}
 	}
+
+	ieee80211_rx_list_deliver(&local->hw, &rx_list);
 }
 
 static void ieee80211_tasklet_handler(struct tasklet_struct *t)
@@ -959,9 +977,9 @@ struct ieee80211_hw *ieee80211_alloc_hw_nm(size_t priv_data_len,
 	spin_lock_init(&local->rx_path_lock);
 	spin_lock_init(&local->queue_stop_reason_lock);
 
+	ieee80211_txq_sched_init(local);
+
 	for (i = 0; i < IEEE80211_NUM_ACS; i++) {
-		INIT_LIST_HEAD(&local->active_txqs[i]);
-		spin_lock_init(&local->active_txq_lock[i]);
 		local->aql_txq_limit_low[i] = IEEE80211_DEFAULT_AQL_TXQ_LIMIT_L;
 		local->aql_txq_limit_high[i] =
 			IEEE80211_DEFAULT_AQL_TXQ_LIMIT_H;
@@ -1765,6 +1783,8 @@ static int __init ieee80211_init(void)
 	BUILD_BUG_ON(offsetof(struct ieee80211_tx_info, driver_data) +
 		     IEEE80211_TX_INFO_DRIVER_DATA_SIZE > sizeof(skb->cb));
 
+	ieee80211_airtime_init();
+
 	ret = rc80211_minstrel_init();
 	if (ret)
 		return ret;
@@ -70,6 +70,10 @@ enum mesh_deferred_task_flags {
  * @rhash: rhashtable list pointer
  * @walk_list: linked list containing all mesh_path objects.
  * @gate_list: list pointer for known gates list
+ * @nexthop_list: list of the mesh paths through the same next hop, headed
+ *	by &struct mesh_sta.mpaths and protected by the table's nexthop_lock
+ * @expire_list: list pointer for the expiry wheel slot of the table, also
+ *	used to batch the release of deleted paths
  * @sdata: mesh subif
  * @next_hop: mesh neighbor to which frames for this destination will be
  *	forwarded
@@ -108,6 +112,8 @@ struct mesh_path {
 	struct rhash_head rhash;
 	struct hlist_node walk_list;
 	struct hlist_node gate_list;
+	struct hlist_node nexthop_list;
+	struct hlist_node expire_list;
 	struct ieee80211_sub_if_data *sdata;
 	struct sta_info __rcu *next_hop;
 	struct timer_list timer;
@@ -222,6 +228,14 @@ struct mesh_rmc {
 
 #define MESH_PATH_EXPIRE (600 * HZ)
 
+/*
+ * Granularity of the expiry wheel, a power of two so that the slots stay
+ * consistent across jiffies wrap-arounds. Between a quarter and half of the
+ * housekeeping interval, which is how often the wheel is advanced.
+ */
+#define MESH_PATH_EXPIRE_SHIFT \
+	ilog2(IEEE80211_MESH_HOUSEKEEPING_INTERVAL / 2)
+
 /* Default maximum number of plinks per interface */
 #define MESH_MAX_PLINKS		256
 
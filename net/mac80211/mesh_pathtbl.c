@@ -17,6 +17,7 @@
 #include "mesh.h"
 #include <linux/rhashtable.h>
 
+static void mesh_path_kill(struct mesh_table *tbl, struct mesh_path *mpath);
 static void mesh_path_free_rcu(struct mesh_table *tbl, struct mesh_path *mpath);
 
 static u32 mesh_table_hash(const void *addr, u32 len, u32 seed)
@@ -81,16 +82,23 @@ static void mesh_path_rht_free(void *ptr, void *tblptr)
 	struct mesh_path *mpath = ptr;
 	struct mesh_table *tbl = tblptr;
 
+	mesh_path_kill(tbl, mpath);
 	mesh_path_free_rcu(tbl, mpath);
 }
 
 static void mesh_table_init(struct mesh_table *tbl)
 {
+	int i;
+
 	INIT_HLIST_HEAD(&tbl->known_gates);
 	INIT_HLIST_HEAD(&tbl->walk_head);
+	for (i = 0; i < MESH_PATH_EXPIRE_SLOTS; i++)
+		INIT_HLIST_HEAD(&tbl->expire_wheel[i]);
+	tbl->expire_next = round_down(jiffies, BIT(MESH_PATH_EXPIRE_SHIFT));
 	atomic_set(&tbl->entries,  0);
 	spin_lock_init(&tbl->gates_lock);
 	spin_lock_init(&tbl->walk_lock);
+	spin_lock_init(&tbl->nexthop_lock);
 
 	/* rhashtable_init() may fail only in case of wrong
 	 * mesh_rht_params
@@ -104,6 +112,29 @@ static void mesh_table_free(struct mesh_table *tbl)
 				    mesh_path_rht_free, tbl);
 }
 
+static struct hlist_head *mesh_path_expire_slot(struct mesh_table *tbl,
+						unsigned long time)
+{
+	return &tbl->expire_wheel[(time >> MESH_PATH_EXPIRE_SHIFT) &
+				  (MESH_PATH_EXPIRE_SLOTS - 1)];
+}
+
+/*
+ * File a path in the expiry wheel slot of the given time. The wheel is only
+ * updated when a path is added or its slot comes due, not every time its
+ * exp_time changes, see mesh_path_tbl_expire().
+ *
+ * Locking: tbl->walk_lock must be held
+ */
+static void mesh_path_expire_queue(struct mesh_table *tbl,
+				   struct mesh_path *mpath, unsigned long time)
+{
+	lockdep_assert_held(&tbl->walk_lock);
+	if (!hlist_unhashed(&mpath->expire_list))
+		hlist_del(&mpath->expire_list);
+	hlist_add_head(&mpath->expire_list, mesh_path_expire_slot(tbl, time));
+}
+
 /**
  * mesh_path_assign_nexthop - update mesh path next hop
  *
@@ -114,11 +145,27 @@ static void mesh_table_free(struct mesh_table *tbl)
  */
 void mesh_path_assign_nexthop(struct mesh_path *mpath, struct sta_info *sta)
 {
+	struct mesh_table *tbl = &mpath->sdata->u.mesh.mesh_paths;
 	struct sk_buff *skb;
 	struct ieee80211_hdr *hdr;
 	unsigned long flags;
 
-	rcu_assign_pointer(mpath->next_hop, sta);
+	lockdep_assert_held(&mpath->state_lock);
+
+	/*
+	 * A deleted path must not be linked again, it is no longer reachable
+	 * from the table and mesh_path_flush_by_nexthop() would not see it.
+	 */
+	if (rcu_access_pointer(mpath->next_hop) != sta &&
+	    !(mpath->flags & MESH_PATH_DELETED)) {
+		spin_lock(&tbl->nexthop_lock);
+		hlist_del_init(&mpath->nexthop_list);
+		hlist_add_head(&mpath->nexthop_list, &sta->mesh->mpaths);
+		rcu_assign_pointer(mpath->next_hop, sta);
+		spin_unlock(&tbl->nexthop_lock);
+	} else {
+		rcu_assign_pointer(mpath->next_hop, sta);
+	}
 
 	spin_lock_irqsave(&mpath->frame_queue.lock, flags);
 	skb_queue_walk(&mpath->frame_queue, skb) {
@@ -130,6 +177,7 @@ void mesh_path_assign_nexthop(struct mesh_path *mpath, struct sta_info *sta)
 
 	spin_unlock_irqrestore(&mpath->frame_queue.lock, flags);
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(mesh_path_assign_nexthop);
 
 static void prepare_for_gate(struct sk_buff *skb, char *dst_addr,
 			     struct mesh_path *gate_mpath)
@@ -269,6 +317,7 @@ mesh_path_lookup(struct ieee80211_sub_if_data *sdata, const u8 *dst)
 {
 	return mpath_lookup(&sdata->u.mesh.mesh_paths, dst, sdata);
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(mesh_path_lookup);
 
 struct mesh_path *
 mpp_path_lookup(struct ieee80211_sub_if_data *sdata, const u8 *dst)
@@ -635,6 +684,20 @@ void mesh_fast_tx_flush_mpath(struct mesh_path *mpath)
 	spin_unlock_bh(&cache->walk_lock);
 }
 
+/* flush the entries of all paths marked as deleted in a single pass */
+static void mesh_fast_tx_flush_deleted(struct ieee80211_sub_if_data *sdata)
+{
+	struct mesh_tx_cache *cache = &sdata->u.mesh.tx_cache;
+	struct ieee80211_mesh_fast_tx *entry;
+	struct hlist_node *n;
+
+	spin_lock_bh(&cache->walk_lock);
+	hlist_for_each_entry_safe(entry, n, &cache->walk_head, walk_list)
+		if (entry->mpath->flags & MESH_PATH_DELETED)
+			mesh_fast_tx_entry_free(cache, entry);
+	spin_unlock_bh(&cache->walk_lock);
+}
+
 void mesh_fast_tx_flush_sta(struct ieee80211_sub_if_data *sdata,
 			    struct sta_info *sta)
 {
@@ -702,8 +765,11 @@ struct mesh_path *mesh_path_add(struct ieee80211_sub_if_data *sdata,
 	mpath = rhashtable_lookup_get_insert_fast(&tbl->rhead,
 						  &new_mpath->rhash,
 						  mesh_rht_params);
-	if (!mpath)
+	if (!mpath) {
 		hlist_add_head(&new_mpath->walk_list, &tbl->walk_head);
+		mesh_path_expire_queue(tbl, new_mpath,
+				       new_mpath->exp_time + MESH_PATH_EXPIRE);
+	}
 	spin_unlock_bh(&tbl->walk_lock);
 
 	if (mpath) {
@@ -718,6 +784,7 @@ struct mesh_path *mesh_path_add(struct ieee80211_sub_if_data *sdata,
 	sdata->u.mesh.mesh_paths_generation++;
 	return new_mpath;
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(mesh_path_add);
 
 int mpp_path_add(struct ieee80211_sub_if_data *sdata,
 		 const u8 *dst, const u8 *mpp)
@@ -745,8 +812,11 @@ int mpp_path_add(struct ieee80211_sub_if_data *sdata,
 	ret = rhashtable_lookup_insert_fast(&tbl->rhead,
 					    &new_mpath->rhash,
 					    mesh_rht_params);
-	if (!ret)
+	if (!ret) {
 		hlist_add_head_rcu(&new_mpath->walk_list, &tbl->walk_head);
+		mesh_path_expire_queue(tbl, new_mpath,
+				       new_mpath->exp_time + MESH_PATH_EXPIRE);
+	}
 	spin_unlock_bh(&tbl->walk_lock);
 
 	if (ret)
@@ -773,34 +843,69 @@ void mesh_plink_broken(struct sta_info *sta)
 	struct mesh_table *tbl = &sdata->u.mesh.mesh_paths;
 	static const u8 bcast[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 	struct mesh_path *mpath;
+	HLIST_HEAD(todo);
 
-	rcu_read_lock();
-	hlist_for_each_entry_rcu(mpath, &tbl->walk_head, walk_list) {
-		if (rcu_access_pointer(mpath->next_hop) == sta &&
-		    mpath->flags & MESH_PATH_ACTIVE &&
+	/*
+	 * Only visit the paths through this peer. The state_lock can't be
+	 * taken with the nexthop_lock held, so they are moved to a private
+	 * list and back one at a time, and the walk_lock keeps them from
+	 * being deleted in the meantime.
+	 */
+	spin_lock_bh(&tbl->walk_lock);
+	spin_lock(&tbl->nexthop_lock);
+	hlist_move_list(&sta->mesh->mpaths, &todo);
+	spin_unlock(&tbl->nexthop_lock);
+
+	for (;;) {
+		bool broken = false;
+		u32 sn = 0;
+
+		spin_lock(&tbl->nexthop_lock);
+		mpath = hlist_entry_safe(todo.first, struct mesh_path,
+					 nexthop_list);
+		if (mpath) {
+			hlist_del(&mpath->nexthop_list);
+			hlist_add_head(&mpath->nexthop_list,
+				       &sta->mesh->mpaths);
+		}
+		spin_unlock(&tbl->nexthop_lock);
+		if (!mpath)
+			break;
+
+		spin_lock_bh(&mpath->state_lock);
+		if (mpath->flags & MESH_PATH_ACTIVE &&
 		    !(mpath->flags & MESH_PATH_FIXED)) {
-			spin_lock_bh(&mpath->state_lock);
 			mpath->flags &= ~MESH_PATH_ACTIVE;
-			++mpath->sn;
-			spin_unlock_bh(&mpath->state_lock);
+			sn = ++mpath->sn;
+			broken = true;
+		}
+		spin_unlock_bh(&mpath->state_lock);
+		if (broken)
 			mesh_path_error_tx(sdata,
 				sdata->u.mesh.mshcfg.element_ttl,
-				mpath->dst, mpath->sn,
+				mpath->dst, sn,
 				WLAN_REASON_MESH_PATH_DEST_UNREACHABLE, bcast);
-		}
 	}
-	rcu_read_unlock();
+	spin_unlock_bh(&tbl->walk_lock);
 }
 
-static void mesh_path_free_rcu(struct mesh_table *tbl,
-			       struct mesh_path *mpath)
+/* mark a path as deleted and drop it from the gate and next hop lists */
+static void mesh_path_kill(struct mesh_table *tbl, struct mesh_path *mpath)
 {
-	struct ieee80211_sub_if_data *sdata = mpath->sdata;
-
 	spin_lock_bh(&mpath->state_lock);
 	mpath->flags |= MESH_PATH_RESOLVING | MESH_PATH_DELETED;
 	mesh_gate_del(tbl, mpath);
+	spin_lock(&tbl->nexthop_lock);
+	hlist_del_init(&mpath->nexthop_list);
+	spin_unlock(&tbl->nexthop_lock);
 	spin_unlock_bh(&mpath->state_lock);
+}
+
+static void mesh_path_free_rcu(struct mesh_table *tbl,
+			       struct mesh_path *mpath)
+{
+	struct ieee80211_sub_if_data *sdata = mpath->sdata;
+
 	timer_shutdown_sync(&mpath->timer);
 	atomic_dec(&sdata->u.mesh.mpaths);
 	atomic_dec(&tbl->entries);
@@ -808,15 +913,44 @@ static void mesh_path_free_rcu(struct mesh_table *tbl,
 	kfree_rcu(mpath, rcu);
 }
 
-static void __mesh_path_del(struct mesh_table *tbl, struct mesh_path *mpath)
+/*
+ * Unlink a path from the table and collect it on @dead, the expiry wheel
+ * node is free for that once the path is off the wheel. The paths are then
+ * released together by mesh_paths_free() after dropping the walk_lock.
+ *
+ * Locking: tbl->walk_lock must be held
+ */
+static void __mesh_path_del(struct mesh_table *tbl, struct mesh_path *mpath,
+			    struct hlist_head *dead)
 {
 	hlist_del_rcu(&mpath->walk_list);
+	hlist_del(&mpath->expire_list);
 	rhashtable_remove_fast(&tbl->rhead, &mpath->rhash, mesh_rht_params);
-	if (tbl == &mpath->sdata->u.mesh.mpp_paths)
-		mesh_fast_tx_flush_addr(mpath->sdata, mpath->dst);
-	else
-		mesh_fast_tx_flush_mpath(mpath);
-	mesh_path_free_rcu(tbl, mpath);
+	mesh_path_kill(tbl, mpath);
+	hlist_add_head(&mpath->expire_list, dead);
+}
+
+static void mesh_paths_free(struct mesh_table *tbl, struct hlist_head *dead)
+{
+	struct ieee80211_sub_if_data *sdata;
+	struct mesh_path *mpath;
+	struct hlist_node *n;
+
+	if (hlist_empty(dead))
+		return;
+
+	mpath = hlist_entry(dead->first, struct mesh_path, expire_list);
+	sdata = mpath->sdata;
+
+	/* the paths are all marked as deleted, flush their cache entries */
+	if (tbl == &sdata->u.mesh.mesh_paths)
+		mesh_fast_tx_flush_deleted(sdata);
+
+	hlist_for_each_entry_safe(mpath, n, dead, expire_list) {
+		if (tbl == &sdata->u.mesh.mpp_paths)
+			mesh_fast_tx_flush_addr(sdata, mpath->dst);
+		mesh_path_free_rcu(tbl, mpath);
+	}
 }
 
 /**
@@ -835,15 +969,26 @@ void mesh_path_flush_by_nexthop(struct sta_info *sta)
 	struct ieee80211_sub_if_data *sdata = sta->sdata;
 	struct mesh_table *tbl = &sdata->u.mesh.mesh_paths;
 	struct mesh_path *mpath;
-	struct hlist_node *n;
+	HLIST_HEAD(dead);
 
 	spin_lock_bh(&tbl->walk_lock);
-	hlist_for_each_entry_safe(mpath, n, &tbl->walk_head, walk_list) {
-		if (rcu_access_pointer(mpath->next_hop) == sta)
-			__mesh_path_del(tbl, mpath);
+	for (;;) {
+		spin_lock(&tbl->nexthop_lock);
+		mpath = hlist_entry_safe(sta->mesh->mpaths.first,
+					 struct mesh_path, nexthop_list);
+		if (mpath)
+			hlist_del_init(&mpath->nexthop_list);
+		spin_unlock(&tbl->nexthop_lock);
+		if (!mpath)
+			break;
+
+		__mesh_path_del(tbl, mpath, &dead);
 	}
 	spin_unlock_bh(&tbl->walk_lock);
+
+	mesh_paths_free(tbl, &dead);
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(mesh_path_flush_by_nexthop);
 
 static void mpp_flush_by_proxy(struct ieee80211_sub_if_data *sdata,
 			       const u8 *proxy)
@@ -851,25 +996,31 @@ static void mpp_flush_by_proxy(struct ieee80211_sub_if_data *sdata,
 	struct mesh_table *tbl = &sdata->u.mesh.mpp_paths;
 	struct mesh_path *mpath;
 	struct hlist_node *n;
+	HLIST_HEAD(dead);
 
 	spin_lock_bh(&tbl->walk_lock);
 	hlist_for_each_entry_safe(mpath, n, &tbl->walk_head, walk_list) {
 		if (ether_addr_equal(mpath->mpp, proxy))
-			__mesh_path_del(tbl, mpath);
+			__mesh_path_del(tbl, mpath, &dead);
 	}
 	spin_unlock_bh(&tbl->walk_lock);
+
+	mesh_paths_free(tbl, &dead);
 }
 
 static void table_flush_by_iface(struct mesh_table *tbl)
 {
 	struct mesh_path *mpath;
 	struct hlist_node *n;
+	HLIST_HEAD(dead);
 
 	spin_lock_bh(&tbl->walk_lock);
 	hlist_for_each_entry_safe(mpath, n, &tbl->walk_head, walk_list) {
-		__mesh_path_del(tbl, mpath);
+		__mesh_path_del(tbl, mpath, &dead);
 	}
 	spin_unlock_bh(&tbl->walk_lock);
+
+	mesh_paths_free(tbl, &dead);
 }
 
 /**
@@ -899,6 +1050,7 @@ static int table_path_del(struct mesh_table *tbl,
 			  const u8 *addr)
 {
 	struct mesh_path *mpath;
+	HLIST_HEAD(dead);
 
 	spin_lock_bh(&tbl->walk_lock);
 	mpath = rhashtable_lookup_fast(&tbl->rhead, addr, mesh_rht_params);
@@ -907,8 +1059,10 @@ static int table_path_del(struct mesh_table *tbl,
 		return -ENXIO;
 	}
 
-	__mesh_path_del(tbl, mpath);
+	__mesh_path_del(tbl, mpath, &dead);
 	spin_unlock_bh(&tbl->walk_lock);
+
+	mesh_paths_free(tbl, &dead);
 	return 0;
 }
 
@@ -1068,22 +1222,52 @@ void mesh_pathtbl_init(struct ieee80211_sub_if_data *sdata)
 	mesh_table_init(&sdata->u.mesh.mpp_paths);
 	mesh_fast_tx_init(sdata);
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(mesh_pathtbl_init);
 
+/*
+ * Paths sit in the expiry wheel slot of the time they were due when they
+ * were queued. Only the slots whose time has fully passed are visited, and
+ * a path found there that was refreshed since, or is resolving or fixed, is
+ * queued again rather than deleted. The cost thus depends on the number of
+ * paths coming due, not on the size of the table. A path whose exp_time was
+ * moved backwards is only reclaimed once the slot it sits in comes due.
+ */
 static
 void mesh_path_tbl_expire(struct ieee80211_sub_if_data *sdata,
 			  struct mesh_table *tbl)
 {
+	unsigned long tick = BIT(MESH_PATH_EXPIRE_SHIFT);
+	unsigned long now = jiffies;
+	struct hlist_head *slot;
 	struct mesh_path *mpath;
 	struct hlist_node *n;
+	HLIST_HEAD(dead);
+	int i;
 
 	spin_lock_bh(&tbl->walk_lock);
-	hlist_for_each_entry_safe(mpath, n, &tbl->walk_head, walk_list) {
-		if ((!(mpath->flags & MESH_PATH_RESOLVING)) &&
-		    (!(mpath->flags & MESH_PATH_FIXED)) &&
-		     time_after(jiffies, mpath->exp_time + MESH_PATH_EXPIRE))
-			__mesh_path_del(tbl, mpath);
+	for (i = 0; i < MESH_PATH_EXPIRE_SLOTS &&
+		    time_after_eq(now, tbl->expire_next + tick); i++) {
+		slot = mesh_path_expire_slot(tbl, tbl->expire_next);
+		hlist_for_each_entry_safe(mpath, n, slot, expire_list) {
+			unsigned long deadline = mpath->exp_time +
+						 MESH_PATH_EXPIRE;
+
+			if (mpath->flags & (MESH_PATH_RESOLVING |
+					    MESH_PATH_FIXED))
+				mesh_path_expire_queue(tbl, mpath, now);
+			else if (time_after(now, deadline))
+				__mesh_path_del(tbl, mpath, &dead);
+			else
+				mesh_path_expire_queue(tbl, mpath, deadline);
+		}
+		tbl->expire_next += tick;
 	}
+	/* every slot was visited, skip ahead to the current one */
+	if (time_after_eq(now, tbl->expire_next + tick))
+		tbl->expire_next = round_down(now, tick);
 	spin_unlock_bh(&tbl->walk_lock);
+
+	mesh_paths_free(tbl, &dead);
 }
 
 void mesh_path_expire(struct ieee80211_sub_if_data *sdata)
@@ -1091,6 +1275,7 @@ void mesh_path_expire(struct ieee80211_sub_if_data *sdata)
 	mesh_path_tbl_expire(sdata, &sdata->u.mesh.mesh_paths);
 	mesh_path_tbl_expire(sdata, &sdata->u.mesh.mpp_paths);
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(mesh_path_expire);
 
 void mesh_pathtbl_unregister(struct ieee80211_sub_if_data *sdata)
 {
@@ -1098,3 +1283,4 @@ void mesh_pathtbl_unregister(struct ieee80211_sub_if_data *sdata)
 	mesh_table_free(&sdata->u.mesh.mesh_paths);
 	mesh_table_free(&sdata->u.mesh.mpp_paths);
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(mesh_pathtbl_unregister);
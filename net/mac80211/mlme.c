@@ -7206,6 +7206,7 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_link_data *link,
 	bool erp_valid;
 	u8 erp_value = 0;
 	u32 ncrc = 0;
+	bool cached;
 	u8 *bssid, *variable = mgmt->u.beacon.variable;
 	u8 deauth_buf[IEEE80211_DEAUTH_FRAME_LEN];
 	struct ieee80211_elems_parse_params parse_params = {
@@ -7323,7 +7324,8 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_link_data *link,
 	parse_params.bss = bss_conf->bss;
 	parse_params.filter = care_about_ies;
 	parse_params.crc = ncrc;
-	elems = ieee802_11_parse_elems_full(&parse_params);
+	elems = ieee802_11_parse_elems_cached(&link->u.mgd.beacon_elems,
+					      &parse_params, &cached);
 	if (!elems)
 		return;
 
@@ -7410,7 +7412,21 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_link_data *link,
 
 	if ((ncrc == link->u.mgd.beacon_crc && link->u.mgd.beacon_crc_valid) ||
 	    ieee80211_is_s1g_short_beacon(mgmt->frame_control))
-		goto free;
+		return;
+
+	/*
+	 * Processing an earlier beacon may have modified the cached elements
+	 * (e.g. defragmented the multi-link element in place), so parse them
+	 * again if they need to be processed despite not having changed.
+	 */
+	if (cached) {
+		ieee80211_elems_cache_flush(&link->u.mgd.beacon_elems);
+		elems = ieee802_11_parse_elems_cached(&link->u.mgd.beacon_elems,
+						      &parse_params, &cached);
+		if (!elems)
+			return;
+	}
+
 	link->u.mgd.beacon_crc = ncrc;
 	link->u.mgd.beacon_crc_valid = true;
 
@@ -7462,17 +7478,15 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_link_data *link,
 				erp_valid, erp_value);
 
 	sta = sta_info_get(sdata, sdata->vif.cfg.ap_addr);
-	if (WARN_ON(!sta)) {
-		goto free;
-	}
+	if (WARN_ON(!sta))
+		return;
 	link_sta = rcu_dereference_protected(sta->link[link->link_id],
 					     lockdep_is_held(&local->hw.wiphy->mtx));
-	if (WARN_ON(!link_sta)) {
-		goto free;
-	}
+	if (WARN_ON(!link_sta))
+		return;
 
 	if (WARN_ON(!bss_conf->chanreq.oper.chan))
-		goto free;
+		return;
 
 	sband = local->hw.wiphy->bands[bss_conf->chanreq.oper.chan->band];
 
@@ -7486,7 +7500,7 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_link_data *link,
 					    sizeof(deauth_buf), true,
 					    WLAN_REASON_DEAUTH_LEAVING,
 					    false);
-		goto free;
+		return;
 	}
 
 	if (elems->opmode_notif)
@@ -7505,8 +7519,6 @@ static void ieee80211_rx_mgmt_beacon(struct ieee80211_link_data *link,
 				      le64_to_cpu(mgmt->u.beacon.timestamp));
 
 	ieee80211_link_info_change_notify(sdata, link, changed);
-free:
-	kfree(elems);
 }
 
 static void ieee80211_apply_neg_ttlm(struct ieee80211_sub_if_data *sdata,
@@ -9198,6 +9210,7 @@ ieee80211_setup_assoc_link(struct ieee80211_sub_if_data *sdata,
 	}
 
 	link->u.mgd.beacon_crc_valid = false;
+	ieee80211_elems_cache_flush(&link->u.mgd.beacon_elems);
 	link->u.mgd.dtim_period = 0;
 	link->u.mgd.have_beacon = false;
 
@@ -9818,6 +9831,7 @@ void ieee80211_mgd_stop_link(struct ieee80211_link_data *link)
 			  &link->u.mgd.recalc_smps);
 	wiphy_delayed_work_cancel(link->sdata->local->hw.wiphy,
 				  &link->u.mgd.csa.switch_work);
+	ieee80211_elems_cache_flush(&link->u.mgd.beacon_elems);
 }
 
 void ieee80211_mgd_stop(struct ieee80211_sub_if_data *sdata)
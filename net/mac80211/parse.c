@@ -994,6 +994,27 @@ ieee80211_mle_defrag_epcs(struct ieee80211_elems_parse *elems_parse)
 	elems_parse->scratch_pos += ml_len;
 }
 
+static void ieee80211_elems_set_dtim(struct ieee802_11_elems *elems)
+{
+	if (elems->tim && !elems->parse_error) {
+		const struct ieee80211_tim_ie *tim_ie = elems->tim;
+
+		elems->dtim_period = tim_ie->dtim_period;
+		elems->dtim_count = tim_ie->dtim_count;
+	}
+
+	/* Override DTIM period and count if needed */
+	if (elems->bssid_index &&
+	    elems->bssid_index_len >=
+	    offsetofend(struct ieee80211_bssid_index, dtim_period))
+		elems->dtim_period = elems->bssid_index->dtim_period;
+
+	if (elems->bssid_index &&
+	    elems->bssid_index_len >=
+	    offsetofend(struct ieee80211_bssid_index, dtim_count))
+		elems->dtim_count = elems->bssid_index->dtim_count;
+}
+
 struct ieee802_11_elems *
 ieee802_11_parse_elems_full(struct ieee80211_elems_parse_params *params)
 {
@@ -1075,27 +1096,132 @@ ieee802_11_parse_elems_full(struct ieee80211_elems_parse_params *params)
 
 	ieee80211_mle_defrag_epcs(elems_parse);
 
-	if (elems->tim && !elems->parse_error) {
-		const struct ieee80211_tim_ie *tim_ie = elems->tim;
+	ieee80211_elems_set_dtim(elems);
 
-		elems->dtim_period = tim_ie->dtim_period;
-		elems->dtim_count = tim_ie->dtim_count;
+	return elems;
+}
+EXPORT_SYMBOL_IF_KUNIT(ieee802_11_parse_elems_full);
+
+void ieee80211_elems_cache_flush(struct ieee80211_elems_cache *cache)
+{
+	kfree(cache->elems);
+	kfree(cache->ies);
+	memset(cache, 0, sizeof(*cache));
+}
+EXPORT_SYMBOL_IF_KUNIT(ieee80211_elems_cache_flush);
+
+static u32 ieee80211_elems_cache_key(const u8 *start, size_t len, u32 crc,
+				     bool *valid)
+{
+	const struct element *elem;
+
+	for_each_element(elem, start, len) {
+		/* the TIM contents change all the time, only take the length */
+		if (elem->id == WLAN_EID_TIM)
+			crc = crc32_be(crc, (const void *)elem, 2);
+		else
+			crc = crc32_be(crc, (const void *)elem,
+				       elem->datalen + 2);
 	}
 
-	/* Override DTIM period and count if needed */
-	if (elems->bssid_index &&
-	    elems->bssid_index_len >=
-	    offsetofend(struct ieee80211_bssid_index, dtim_period))
-		elems->dtim_period = elems->bssid_index->dtim_period;
+	*valid = for_each_element_completed(elem, start, len);
 
-	if (elems->bssid_index &&
-	    elems->bssid_index_len >=
-	    offsetofend(struct ieee80211_bssid_index, dtim_count))
-		elems->dtim_count = elems->bssid_index->dtim_count;
+	return crc;
+}
+
+static bool
+ieee80211_elems_cache_update_tim(struct ieee80211_elems_cache *cache,
+				 const u8 *start, size_t len)
+{
+	struct ieee802_11_elems *elems = cache->elems;
+	const struct element *tim;
+	size_t offs;
+
+	if (!elems->tim)
+		return true;
+
+	offs = (const u8 *)elems->tim - cache->ies;
+	if (offs >= cache->len)
+		return false;
+
+	tim = cfg80211_find_elem(WLAN_EID_TIM, start, len);
+	if (!tim || tim->datalen != elems->tim_len)
+		return false;
+
+	memcpy(cache->ies + offs, tim->data, tim->datalen);
+	ieee80211_elems_set_dtim(elems);
+
+	return true;
+}
+
+/*
+ * Parse the elements like ieee802_11_parse_elems_full(), but if they're
+ * the same as in the last call (except for the TIM contents), only update
+ * the TIM and return the elements parsed last time. This saves allocating
+ * and parsing everything again for each beacon.
+ *
+ * Only parsing for the transmitting or a non-transmitted BSS is supported,
+ * not for a specific link. The returned elements belong to the cache and
+ * remain valid until the next call or ieee80211_elems_cache_flush(); any
+ * changes the caller makes to them are seen by later callers on a hit.
+ *
+ * Like the beacon CRC check, this relies on the CRC to detect changes.
+ */
+struct ieee802_11_elems *
+ieee802_11_parse_elems_cached(struct ieee80211_elems_cache *cache,
+			      struct ieee80211_elems_parse_params *params,
+			      bool *hit)
+{
+	struct ieee80211_elems_parse_params copy = *params;
+	struct ieee802_11_elems *elems;
+	bool key_valid;
+	u32 key;
+
+	*hit = false;
+
+	if (WARN_ON(params->link_id >= 0 || params->action))
+		return NULL;
+
+	key = ieee80211_elems_cache_key(params->start, params->len,
+					params->crc, &key_valid);
+
+	if (cache->elems && cache->key_valid && key_valid &&
+	    cache->key == key && cache->len == params->len &&
+	    cache->mode == params->mode && cache->filter == params->filter &&
+	    cache->crc == params->crc && cache->bss == params->bss &&
+	    cache->from_ap == params->from_ap &&
+	    ieee80211_elems_cache_update_tim(cache, params->start,
+					     params->len)) {
+		*hit = true;
+		return cache->elems;
+	}
+
+	ieee80211_elems_cache_flush(cache);
+
+	cache->ies = kmemdup(params->start, params->len, GFP_ATOMIC);
+	if (!cache->ies)
+		return NULL;
+
+	copy.start = cache->ies;
+	elems = ieee802_11_parse_elems_full(&copy);
+	if (!elems) {
+		ieee80211_elems_cache_flush(cache);
+		return NULL;
+	}
+
+	cache->elems = elems;
+	cache->len = params->len;
+	cache->key = key;
+	cache->key_valid = key_valid;
+	cache->mode = params->mode;
+	cache->filter = params->filter;
+	cache->crc = params->crc;
+	cache->bss = params->bss;
+	cache->from_ap = params->from_ap;
 
 	return elems;
 }
-EXPORT_SYMBOL_IF_KUNIT(ieee802_11_parse_elems_full);
+EXPORT_SYMBOL_IF_KUNIT(ieee802_11_parse_elems_cached);
 
 int ieee80211_parse_bitrates(enum nl80211_chan_width width,
 			     const struct ieee80211_supported_band *sband,
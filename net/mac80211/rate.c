@@ -753,7 +753,8 @@ static void rate_control_fill_sta_table(struct ieee80211_sta *sta,
 		    info->control.rates[i].count) {
 			if (rates != info->control.rates)
 				rates[i] = info->control.rates[i];
-		} else if (ratetbl) {
+		} else if (ratetbl &&
+			   !rate_control_table_rate_is_he(ratetbl->rate[i].flags)) {
 			rates[i].idx = ratetbl->rate[i].idx;
 			rates[i].flags = ratetbl->rate[i].flags;
 			if (info->control.use_rts)
@@ -842,6 +843,9 @@ rate_control_apply_mask_ratetbl(struct sta_info *sta,
 		if (rates->rate[i].idx < 0)
 			break;
 
+		if (rate_control_table_rate_is_he(rates->rate[i].flags))
+			continue;
+
 		rate_idx_match_mask(&rates->rate[i].idx, &rates->rate[i].flags,
 				    sband, chan_width, mask, mcs_mask,
 				    vht_mask);
@@ -936,6 +940,8 @@ void rate_control_get_rate(struct ieee80211_sub_if_data *sdata,
 		info->control.rates[i].flags = 0;
 		info->control.rates[i].count = 0;
 	}
+	info->control.probe_he = 0;
+	info->control.probe_eht = 0;
 
 	if (rate_control_send_low(sta ? &sta->sta : NULL, txrc))
 		return;
@@ -62,6 +62,36 @@ static inline void rate_control_add_sta_debugfs(struct sta_info *sta)
 #endif
 }
 
+/*
+ * The algorithm is called under sta->rate_ctrl_lock and must not sleep,
+ * first without @stats to count the entries, then to fill them in. The
+ * array is allocated in between, outside of the lock.
+ */
+static inline void rate_control_get_rate_stats(struct sta_info *sta,
+					       struct station_info *sinfo)
+{
+	struct rate_control_ref *ref = sta->rate_ctrl;
+	unsigned int n;
+
+	if (!ref || !ref->ops->get_rate_stats ||
+	    !test_sta_flag(sta, WLAN_STA_RATE_CONTROL))
+		return;
+
+	spin_lock_bh(&sta->rate_ctrl_lock);
+	n = ref->ops->get_rate_stats(ref->priv, sta->rate_ctrl_priv, NULL, 0);
+	spin_unlock_bh(&sta->rate_ctrl_lock);
+
+	if (!n || cfg80211_sinfo_alloc_rc_stats(sinfo, n, GFP_KERNEL))
+		return;
+
+	/* the rate set may have changed in between, only report what fits */
+	spin_lock_bh(&sta->rate_ctrl_lock);
+	sinfo->n_rc_stats = ref->ops->get_rate_stats(ref->priv,
+						     sta->rate_ctrl_priv,
+						     sinfo->rc_stats, n);
+	spin_unlock_bh(&sta->rate_ctrl_lock);
+}
+
 extern const struct debugfs_short_fops rcname_ops;
 
 static inline void rate_control_add_debugfs(struct ieee80211_local *local)
@@ -87,6 +117,15 @@ static inline void rate_control_add_debugfs(struct ieee80211_local *local)
 
 void ieee80211_check_rate_mask(struct ieee80211_link_data *link);
 
+/*
+ * HE/EHT entries of the rate table have no struct ieee80211_tx_rate
+ * representation, only drivers reading the table directly can use them.
+ */
+static inline bool rate_control_table_rate_is_he(u16 flags)
+{
+	return flags & (IEEE80211_TX_RC_HE_MCS | IEEE80211_TX_RC_EHT_MCS);
+}
+
 /* Get a reference to the rate control algorithm. If `name' is NULL, get the
  * first available algorithm. */
 int ieee80211_init_rate_ctrl_alg(struct ieee80211_local *local,
@@ -36,9 +36,21 @@
 #define MCS_DURATION(streams, sgi, bps) \
 	(MCS_SYMBOL_TIME(sgi, MCS_NSYMS((streams) * (bps))) / AVG_AMPDU_SIZE)
 
+/*
+ * Transmission time (nanoseconds) for a packet containing (syms) HE/EHT
+ * symbols, 12.8 us + 0.8 us GI each, like HE_SYMBOL_TIME() in airtime.c
+ */
+#define HE_SYMBOL_TIME(syms)	((syms) * 13600)
+
+/* Transmit duration for the raw data part of an average sized packet */
+#define HE_DURATION(streams, bps) \
+	(HE_SYMBOL_TIME(MCS_NSYMS((streams) * (bps))) / AVG_AMPDU_SIZE)
+
 #define BW_20			0
 #define BW_40			1
 #define BW_80			2
+#define BW_160			3
+#define BW_320			4
 
 /*
  * Define group sort order: HT40 -> SGI -> #streams
@@ -134,6 +146,130 @@
 	__VHT_GROUP(_streams, _sgi, _bw,				\
 		    VHT_GROUP_SHIFT(_streams, _sgi, _bw))
 
+#define HE_GROUP_IDX(_streams, _bw)					\
+	(MINSTREL_HE_GROUP_0 +						\
+	 MINSTREL_MAX_STREAMS * (_bw) +					\
+	 (_streams) - 1)
+
+#define HE_BW_FLAGS(_bw)						\
+	(_bw == BW_320 ? IEEE80211_TX_RC_320_MHZ_WIDTH :		\
+	 _bw == BW_160 ? IEEE80211_TX_RC_160_MHZ_WIDTH :		\
+	 _bw == BW_80 ? IEEE80211_TX_RC_80_MHZ_WIDTH :			\
+	 _bw == BW_40 ? IEEE80211_TX_RC_40_MHZ_WIDTH : 0)
+
+/* data bits per symbol, the same as in airtime.c */
+#define HE_BW2VBPS(_bw, r4, r3, r2, r1)					\
+	(_bw == BW_160 ? r4 : BW2VBPS(_bw, r3, r2, r1))
+
+#define __HE_GROUP(_streams, _bw, _s)					\
+	[HE_GROUP_IDX(_streams, _bw)] = {				\
+	.streams = _streams,						\
+	.shift = _s,							\
+	.bw = _bw,							\
+	.flags = IEEE80211_TX_RC_HE_MCS | HE_BW_FLAGS(_bw),		\
+	.duration = {							\
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw,   979,  489,  230,  115)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw,  1958,  979,  475,  230)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw,  2937, 1468,  705,  345)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw,  3916, 1958,  936,  475)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw,  5875, 2937, 1411,  705)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw,  7833, 3916, 1872,  936)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw,  8827, 4406, 2102, 1051)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw,  9806, 4896, 2347, 1166)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw, 11764, 5875, 2808, 1411)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw, 13060, 6523, 3124, 1555)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw, 14702, 7344, 3513, 1756)) >> _s, \
+		HE_DURATION(_streams,					\
+			    HE_BW2VBPS(_bw, 16329, 8164, 3902, 1944)) >> _s  \
+	}								\
+}
+
+#define HE_GROUP_SHIFT(_streams, _bw)					\
+	GROUP_SHIFT(HE_DURATION(_streams,				\
+				HE_BW2VBPS(_bw, 979, 489, 230, 115)))
+
+#define HE_GROUP(_streams, _bw)						\
+	__HE_GROUP(_streams, _bw, HE_GROUP_SHIFT(_streams, _bw))
+
+#define HE_GROUP_RANGE(_bw)						\
+	HE_GROUP(1, _bw),						\
+	HE_GROUP(2, _bw),						\
+	HE_GROUP(3, _bw),						\
+	HE_GROUP(4, _bw)
+
+#define EHT_GROUP_IDX(_streams, _bw)					\
+	(MINSTREL_EHT_GROUP_0 +						\
+	 MINSTREL_MAX_STREAMS * (_bw) +					\
+	 (_streams) - 1)
+
+#define EHT_BW2VBPS(_bw, r5, r4, r3, r2, r1)				\
+	(_bw == BW_320 ? r5 : HE_BW2VBPS(_bw, r4, r3, r2, r1))
+
+#define EHT_DURATION(_streams, _bw, r5, r4, r3, r2, r1, _s)		\
+	(HE_DURATION(_streams, EHT_BW2VBPS(_bw, r5, r4, r3, r2, r1)) >> _s)
+
+#define __EHT_GROUP(_streams, _bw, _s)					\
+	[EHT_GROUP_IDX(_streams, _bw)] = {				\
+	.streams = _streams,						\
+	.shift = _s,							\
+	.bw = _bw,							\
+	.flags = IEEE80211_TX_RC_EHT_MCS | HE_BW_FLAGS(_bw),		\
+	.duration = {							\
+		EHT_DURATION(_streams, _bw,				\
+			      1960,   980,  490,  234,  117, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			      3920,  1960,  980,  468,  234, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			      5880,  2937, 1470,  702,  351, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			      7840,  3920, 1960,  936,  468, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			     11760,  5880, 2940, 1404,  702, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			     15680,  7840, 3920, 1872,  936, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			     17640,  8820, 4410, 2106, 1053, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			     19600,  9800, 4900, 2340, 1170, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			     23520, 11760, 5880, 2808, 1404, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			     26133, 13066, 6533, 3120, 1560, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			     29400, 14700, 7350, 3510, 1755, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			     32666, 16333, 8166, 3900, 1950, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			     35280, 17640, 8820, 4212, 2106, _s),	\
+		EHT_DURATION(_streams, _bw,				\
+			     39200, 19600, 9800, 4680, 2340, _s)	\
+	}								\
+}
+
+#define EHT_GROUP_SHIFT(_streams, _bw)					\
+	GROUP_SHIFT(EHT_DURATION(_streams, _bw,				\
+				 1960, 980, 490, 234, 117, 0))
+
+#define EHT_GROUP(_streams, _bw)					\
+	__EHT_GROUP(_streams, _bw, EHT_GROUP_SHIFT(_streams, _bw))
+
+#define EHT_GROUP_RANGE(_bw)						\
+	EHT_GROUP(1, _bw),						\
+	EHT_GROUP(2, _bw),						\
+	EHT_GROUP(3, _bw),						\
+	EHT_GROUP(4, _bw)
+
 #define CCK_DURATION(_bitrate, _short)			\
 	(1000 * (10 /* SIFS */ +			\
 	 (_short ? 72 + 24 : 144 + 48) +		\
@@ -197,7 +333,7 @@
 static bool minstrel_vht_only = true;
 module_param(minstrel_vht_only, bool, 0644);
 MODULE_PARM_DESC(minstrel_vht_only,
-		 "Use only VHT rates when VHT is supported by sta.");
+		 "Use only the rates of the newest PHY (VHT, HE or EHT) supported by sta.");
 
 /*
  * To enable sufficiently targeted rate sampling, MCS rates are divided into
@@ -260,7 +396,19 @@ const struct mcs_group minstrel_mcs_groups[] = {
 	VHT_GROUP(2, 1, BW_80),
 	VHT_GROUP(3, 1, BW_80),
 	VHT_GROUP(4, 1, BW_80),
+
+	HE_GROUP_RANGE(BW_20),
+	HE_GROUP_RANGE(BW_40),
+	HE_GROUP_RANGE(BW_80),
+	HE_GROUP_RANGE(BW_160),
+
+	EHT_GROUP_RANGE(BW_20),
+	EHT_GROUP_RANGE(BW_40),
+	EHT_GROUP_RANGE(BW_80),
+	EHT_GROUP_RANGE(BW_160),
+	EHT_GROUP_RANGE(BW_320),
 };
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(minstrel_mcs_groups);
 
 const s16 minstrel_cck_bitrates[4] = { 10, 20, 55, 110 };
 const s16 minstrel_ofdm_bitrates[8] = { 60, 90, 120, 180, 240, 360, 480, 540 };
@@ -316,6 +464,74 @@ minstrel_get_valid_vht_rates(int bw, int nss, __le16 mcs_map)
 	return 0x3ff & ~mask;
 }
 
+/*
+ * Returns the HE MCS map for struct minstrel_mcs_group_data.supported, there
+ * are no invalid MCS/NSS combinations in HE.
+ */
+static u16
+minstrel_get_valid_he_rates(const struct ieee80211_sta_he_cap *he_cap,
+			    int bw, int nss)
+{
+	__le16 mcs_map;
+
+	if (bw == BW_160)
+		mcs_map = he_cap->he_mcs_nss_supp.rx_mcs_160;
+	else
+		mcs_map = he_cap->he_mcs_nss_supp.rx_mcs_80;
+
+	switch ((le16_to_cpu(mcs_map) >> (2 * (nss - 1))) & 3) {
+	case IEEE80211_HE_MCS_SUPPORT_0_7:
+		return 0xff;
+	case IEEE80211_HE_MCS_SUPPORT_0_9:
+		return 0x3ff;
+	case IEEE80211_HE_MCS_SUPPORT_0_11:
+		return 0xfff;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Returns the EHT MCS map for struct minstrel_mcs_group_data.supported from
+ * the max NSS per MCS range, the 20 MHz-only format is used by non-AP
+ * stations that don't support any wider channel.
+ */
+static u16
+minstrel_get_valid_eht_rates(const struct ieee80211_sta *sta, bool from_ap,
+			     int bw, int nss)
+{
+	static const u16 masks_20[] = { 0xff, 0x300, 0xc00, 0x3000 };
+	static const u16 masks[] = { 0x3ff, 0xc00, 0x3000 };
+	const struct ieee80211_eht_mcs_nss_supp *supp =
+		&sta->deflink.eht_cap.eht_mcs_nss_supp;
+	const struct ieee80211_eht_mcs_nss_supp_bw *bw_supp;
+	u8 phy_cap0 = sta->deflink.he_cap.he_cap_elem.phy_cap_info[0];
+	u16 mask = 0;
+	int i;
+
+	if (!from_ap &&
+	    !(phy_cap0 & IEEE80211_HE_PHY_CAP0_CHANNEL_WIDTH_SET_MASK_ALL)) {
+		for (i = 0; i < ARRAY_SIZE(masks_20); i++)
+			if ((supp->only_20mhz.rx_tx_max_nss[i] &
+			     IEEE80211_EHT_MCS_NSS_RX) >= nss)
+				mask |= masks_20[i];
+		return mask;
+	}
+
+	if (bw == BW_320)
+		bw_supp = &supp->bw._320;
+	else if (bw == BW_160)
+		bw_supp = &supp->bw._160;
+	else
+		bw_supp = &supp->bw._80;
+
+	for (i = 0; i < ARRAY_SIZE(masks); i++)
+		if ((bw_supp->rx_tx_max_nss[i] & IEEE80211_EHT_MCS_NSS_RX) >= nss)
+			mask |= masks[i];
+
+	return mask;
+}
+
 static bool
 minstrel_ht_is_legacy_group(int group)
 {
@@ -366,9 +582,75 @@ minstrel_vht_ri_get_group_idx(struct rate_info *rate)
 			     2*!!(rate->bw & RATE_INFO_BW_80));
 }
 
-static struct minstrel_rate_stats *
-minstrel_ht_get_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
-		      struct ieee80211_tx_rate *rate)
+/*
+ * Look up an HE/EHT group index based on new cfg80211 rate_info, only 0.8us
+ * GI is tracked, the other GI values are accounted for in the same group.
+ */
+static int
+minstrel_he_ri_get_group_idx(struct rate_info *rate)
+{
+	int bw;
+
+	switch (rate->bw) {
+	case RATE_INFO_BW_40:
+		bw = BW_40;
+		break;
+	case RATE_INFO_BW_80:
+		bw = BW_80;
+		break;
+	case RATE_INFO_BW_160:
+		bw = BW_160;
+		break;
+	case RATE_INFO_BW_320:
+		bw = BW_320;
+		break;
+	default:
+		bw = BW_20;
+		break;
+	}
+
+	if (rate->flags & RATE_INFO_FLAGS_EHT_MCS)
+		return EHT_GROUP_IDX(rate->nss, bw);
+
+	return HE_GROUP_IDX(rate->nss, min(bw, BW_160));
+}
+
+/*
+ * Map a legacy hw rate index to the minstrel rate, using the table filled
+ * in minstrel_ht_init_legacy_rates()
+ */
+static u16
+minstrel_ht_legacy_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
+			int hw_idx, bool short_preamble)
+{
+	u16 rate;
+	int idx;
+
+	if (hw_idx < 0 || hw_idx >= MINSTREL_MAX_HW_RATES)
+		return MI_RATE(MINSTREL_OFDM_GROUP, 0);
+
+	rate = mp->legacy_rates[mi->band][hw_idx];
+	if (!rate)
+		return MI_RATE(MINSTREL_OFDM_GROUP, 0);
+
+	if (MI_RATE_GROUP(rate) != MINSTREL_CCK_GROUP)
+		return rate;
+
+	idx = MI_RATE_IDX(rate);
+	if (!(mi->supported[MINSTREL_CCK_GROUP] & BIT(idx)))
+		return MI_RATE(MINSTREL_OFDM_GROUP, 0);
+
+	/* short preamble */
+	if ((mi->supported[MINSTREL_CCK_GROUP] & BIT(idx + 4)) &&
+	    short_preamble)
+		idx += 4;
+
+	return MI_RATE(MINSTREL_CCK_GROUP, idx);
+}
+
+static u16
+minstrel_ht_get_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
+		     struct ieee80211_tx_rate *rate)
 {
 	int group, idx;
 
@@ -384,37 +666,33 @@ minstrel_ht_get_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
 		goto out;
 	}
 
-	group = MINSTREL_CCK_GROUP;
-	for (idx = 0; idx < ARRAY_SIZE(mp->cck_rates); idx++) {
-		if (!(mi->supported[group] & BIT(idx)))
-			continue;
-
-		if (rate->idx != mp->cck_rates[idx])
-			continue;
+	return minstrel_ht_legacy_rate(mp, mi, rate->idx,
+				       rate->flags & IEEE80211_TX_RC_USE_SHORT_PREAMBLE);
+out:
+	return MI_RATE(group, idx);
+}
 
-		/* short preamble */
-		if ((mi->supported[group] & BIT(idx + 4)) &&
-		    (rate->flags & IEEE80211_TX_RC_USE_SHORT_PREAMBLE))
-			idx += 4;
-		goto out;
-	}
+static int
+minstrel_ht_ri_get_legacy_idx(struct minstrel_priv *mp,
+			      struct minstrel_ht_sta *mi, u16 bitrate)
+{
+	struct ieee80211_supported_band *sband;
+	int i;
 
-	group = MINSTREL_OFDM_GROUP;
-	for (idx = 0; idx < ARRAY_SIZE(mp->ofdm_rates[0]); idx++)
-		if (rate->idx == mp->ofdm_rates[mi->band][idx])
-			goto out;
+	sband = mp->hw->wiphy->bands[mi->band];
+	for (i = 0; i < sband->n_bitrates; i++)
+		if (sband->bitrates[i].bitrate == bitrate)
+			return i;
 
-	idx = 0;
-out:
-	return &mi->groups[group].rates[idx];
+	return -1;
 }
 
 /*
- * Get the minstrel rate statistics for specified STA and rate info.
+ * Get the minstrel rate index for specified STA and rate info.
  */
-static struct minstrel_rate_stats *
-minstrel_ht_ri_get_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
-			  struct ieee80211_rate_status *rate_status)
+VISIBLE_IF_MAC80211_KUNIT u16
+minstrel_ht_ri_get_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
+			struct ieee80211_rate_status *rate_status)
 {
 	int group, idx;
 	struct rate_info *rate = &rate_status->rate_idx;
@@ -431,32 +709,56 @@ minstrel_ht_ri_get_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
 		goto out;
 	}
 
-	group = MINSTREL_CCK_GROUP;
-	for (idx = 0; idx < ARRAY_SIZE(mp->cck_rates); idx++) {
-		if (rate->legacy != minstrel_cck_bitrates[ mp->cck_rates[idx] ])
-			continue;
-
-		/* short preamble */
-		if ((mi->supported[group] & BIT(idx + 4)) &&
-							mi->use_short_preamble)
-			idx += 4;
+	if (rate->flags & (RATE_INFO_FLAGS_HE_MCS | RATE_INFO_FLAGS_EHT_MCS)) {
+		group = minstrel_he_ri_get_group_idx(rate);
+		idx = rate->mcs;
 		goto out;
 	}
 
-	group = MINSTREL_OFDM_GROUP;
-	for (idx = 0; idx < ARRAY_SIZE(mp->ofdm_rates[0]); idx++)
-		if (rate->legacy == minstrel_ofdm_bitrates[ mp->ofdm_rates[mi->band][idx] ])
-			goto out;
-
-	idx = 0;
+	return minstrel_ht_legacy_rate(mp, mi,
+				       minstrel_ht_ri_get_legacy_idx(mp, mi,
+								     rate->legacy),
+				       mi->use_short_preamble);
 out:
-	return &mi->groups[group].rates[idx];
+	return MI_RATE(group, idx);
+}
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(minstrel_ht_ri_get_rate);
+
+static inline struct minstrel_group_stats *
+minstrel_get_group_stats(struct minstrel_ht_sta *mi, int index)
+{
+	return &mi->groups[MI_RATE_GROUP(index)].stats;
+}
+
+static inline int
+minstrel_ht_get_prob_avg(struct minstrel_ht_sta *mi, int rate)
+{
+	int group = MI_RATE_GROUP(rate);
+	rate = MI_RATE_IDX(rate);
+	return mi->groups[group].stats.prob_avg[rate];
 }
 
-static inline struct minstrel_rate_stats *
-minstrel_get_ratestats(struct minstrel_ht_sta *mi, int index)
+static inline void
+minstrel_ht_account_tx(struct minstrel_ht_sta *mi, int index, u32 success,
+		       u32 attempts)
 {
-	return &mi->groups[MI_RATE_GROUP(index)].rates[MI_RATE_IDX(index)];
+	struct minstrel_group_stats *st = minstrel_get_group_stats(mi, index);
+	int idx = MI_RATE_IDX(index);
+
+	st->success[idx] += success;
+	st->attempts[idx] += attempts;
+	__set_bit(MI_RATE_GROUP(index), mi->tx_groups);
+}
+
+/* check for sudden death of a rate within the current sampling period */
+static inline bool
+minstrel_ht_rate_failing(struct minstrel_ht_sta *mi, int index)
+{
+	struct minstrel_group_stats *st = minstrel_get_group_stats(mi, index);
+	int idx = MI_RATE_IDX(index);
+
+	return st->attempts[idx] > 30 &&
+	       st->success[idx] < st->attempts[idx] / 4;
 }
 
 static inline int minstrel_get_duration(int index)
@@ -544,13 +846,13 @@ minstrel_ht_sort_best_tp_rates(struct minstrel_ht_sta *mi, u16 index,
 
 	cur_group = MI_RATE_GROUP(index);
 	cur_idx = MI_RATE_IDX(index);
-	cur_prob = mi->groups[cur_group].rates[cur_idx].prob_avg;
+	cur_prob = mi->groups[cur_group].stats.prob_avg[cur_idx];
 	cur_tp_avg = minstrel_ht_get_tp_avg(mi, cur_group, cur_idx, cur_prob);
 
 	do {
 		tmp_group = MI_RATE_GROUP(tp_list[j - 1]);
 		tmp_idx = MI_RATE_IDX(tp_list[j - 1]);
-		tmp_prob = mi->groups[tmp_group].rates[tmp_idx].prob_avg;
+		tmp_prob = mi->groups[tmp_group].stats.prob_avg[tmp_idx];
 		tmp_tp_avg = minstrel_ht_get_tp_avg(mi, tmp_group, tmp_idx,
 						    tmp_prob);
 		if (cur_tp_avg < tmp_tp_avg ||
@@ -574,28 +876,27 @@ static void
 minstrel_ht_set_best_prob_rate(struct minstrel_ht_sta *mi, u16 *dest, u16 index)
 {
 	struct minstrel_mcs_group_data *mg;
-	struct minstrel_rate_stats *mrs;
 	int tmp_group, tmp_idx, tmp_tp_avg, tmp_prob;
 	int max_tp_group, max_tp_idx, max_tp_prob;
-	int cur_tp_avg, cur_group, cur_idx;
+	int cur_tp_avg, cur_group, cur_idx, cur_prob;
 	int max_gpr_group, max_gpr_idx;
 	int max_gpr_tp_avg, max_gpr_prob;
 
 	cur_group = MI_RATE_GROUP(index);
 	cur_idx = MI_RATE_IDX(index);
 	mg = &mi->groups[cur_group];
-	mrs = &mg->rates[cur_idx];
+	cur_prob = mg->stats.prob_avg[cur_idx];
 
 	tmp_group = MI_RATE_GROUP(*dest);
 	tmp_idx = MI_RATE_IDX(*dest);
-	tmp_prob = mi->groups[tmp_group].rates[tmp_idx].prob_avg;
+	tmp_prob = mi->groups[tmp_group].stats.prob_avg[tmp_idx];
 	tmp_tp_avg = minstrel_ht_get_tp_avg(mi, tmp_group, tmp_idx, tmp_prob);
 
 	/* if max_tp_rate[0] is from MCS_GROUP max_prob_rate get selected from
 	 * MCS_GROUP as well as CCK_GROUP rates do not allow aggregation */
 	max_tp_group = MI_RATE_GROUP(mi->max_tp_rate[0]);
 	max_tp_idx = MI_RATE_IDX(mi->max_tp_rate[0]);
-	max_tp_prob = mi->groups[max_tp_group].rates[max_tp_idx].prob_avg;
+	max_tp_prob = mi->groups[max_tp_group].stats.prob_avg[max_tp_idx];
 
 	if (minstrel_ht_is_legacy_group(MI_RATE_GROUP(index)) &&
 	    !minstrel_ht_is_legacy_group(max_tp_group))
@@ -603,16 +904,16 @@ minstrel_ht_set_best_prob_rate(struct minstrel_ht_sta *mi, u16 *dest, u16 index)
 
 	/* skip rates faster than max tp rate with lower prob */
 	if (minstrel_get_duration(mi->max_tp_rate[0]) > minstrel_get_duration(index) &&
-	    mrs->prob_avg < max_tp_prob)
+	    cur_prob < max_tp_prob)
 		return;
 
 	max_gpr_group = MI_RATE_GROUP(mg->max_group_prob_rate);
 	max_gpr_idx = MI_RATE_IDX(mg->max_group_prob_rate);
-	max_gpr_prob = mi->groups[max_gpr_group].rates[max_gpr_idx].prob_avg;
+	max_gpr_prob = mi->groups[max_gpr_group].stats.prob_avg[max_gpr_idx];
 
-	if (mrs->prob_avg > MINSTREL_FRAC(75, 100)) {
+	if (cur_prob > MINSTREL_FRAC(75, 100)) {
 		cur_tp_avg = minstrel_ht_get_tp_avg(mi, cur_group, cur_idx,
-						    mrs->prob_avg);
+						    cur_prob);
 		if (cur_tp_avg > tmp_tp_avg)
 			*dest = index;
 
@@ -622,9 +923,9 @@ minstrel_ht_set_best_prob_rate(struct minstrel_ht_sta *mi, u16 *dest, u16 index)
 		if (cur_tp_avg > max_gpr_tp_avg)
 			mg->max_group_prob_rate = index;
 	} else {
-		if (mrs->prob_avg > tmp_prob)
+		if (cur_prob > tmp_prob)
 			*dest = index;
-		if (mrs->prob_avg > max_gpr_prob)
+		if (cur_prob > max_gpr_prob)
 			mg->max_group_prob_rate = index;
 	}
 }
@@ -646,12 +947,12 @@ minstrel_ht_assign_best_tp_rates(struct minstrel_ht_sta *mi,
 
 	tmp_group = MI_RATE_GROUP(tmp_legacy_tp_rate[0]);
 	tmp_idx = MI_RATE_IDX(tmp_legacy_tp_rate[0]);
-	tmp_prob = mi->groups[tmp_group].rates[tmp_idx].prob_avg;
+	tmp_prob = mi->groups[tmp_group].stats.prob_avg[tmp_idx];
 	tmp_cck_tp = minstrel_ht_get_tp_avg(mi, tmp_group, tmp_idx, tmp_prob);
 
 	tmp_group = MI_RATE_GROUP(tmp_mcs_tp_rate[0]);
 	tmp_idx = MI_RATE_IDX(tmp_mcs_tp_rate[0]);
-	tmp_prob = mi->groups[tmp_group].rates[tmp_idx].prob_avg;
+	tmp_prob = mi->groups[tmp_group].stats.prob_avg[tmp_idx];
 	tmp_mcs_tp = minstrel_ht_get_tp_avg(mi, tmp_group, tmp_idx, tmp_prob);
 
 	if (tmp_cck_tp > tmp_mcs_tp) {
@@ -674,18 +975,19 @@ minstrel_ht_prob_rate_reduce_streams(struct minstrel_ht_sta *mi)
 	int tmp_max_streams, group, tmp_idx, tmp_prob;
 	int tmp_tp = 0;
 
-	if (!mi->sta->deflink.ht_cap.ht_supported)
+	if (!mi->sta->deflink.ht_cap.ht_supported &&
+	    !mi->supported[MINSTREL_HE_GROUP_0])
 		return;
 
 	group = MI_RATE_GROUP(mi->max_tp_rate[0]);
 	tmp_max_streams = minstrel_mcs_groups[group].streams;
 	for (group = 0; group < ARRAY_SIZE(minstrel_mcs_groups); group++) {
-		mg = &mi->groups[group];
 		if (!mi->supported[group] || group == MINSTREL_CCK_GROUP)
 			continue;
 
+		mg = &mi->groups[group];
 		tmp_idx = MI_RATE_IDX(mg->max_group_prob_rate);
-		tmp_prob = mi->groups[group].rates[tmp_idx].prob_avg;
+		tmp_prob = mi->groups[group].stats.prob_avg[tmp_idx];
 
 		if (tmp_tp < minstrel_ht_get_tp_avg(mi, group, tmp_idx, tmp_prob) &&
 		   (minstrel_mcs_groups[group].streams < tmp_max_streams)) {
@@ -760,26 +1062,29 @@ out:
 }
 
 /*
-* Recalculate statistics and counters of a given rate
+* Recalculate statistics and counters of all rates of a group
 */
 static void
-minstrel_ht_calc_rate_stats(struct minstrel_priv *mp,
-			    struct minstrel_rate_stats *mrs)
+minstrel_ht_calc_group_stats(struct minstrel_group_stats *st)
 {
 	unsigned int cur_prob;
+	int i;
 
-	if (unlikely(mrs->attempts > 0)) {
-		cur_prob = MINSTREL_FRAC(mrs->success, mrs->attempts);
-		minstrel_filter_avg_add(&mrs->prob_avg,
-					&mrs->prob_avg_1, cur_prob);
-		mrs->att_hist += mrs->attempts;
-		mrs->succ_hist += mrs->success;
+	for (i = 0; i < MCS_GROUP_RATES; i++) {
+		if (!st->attempts[i])
+			continue;
+
+		cur_prob = MINSTREL_FRAC(st->success[i], st->attempts[i]);
+		minstrel_filter_avg_add(&st->prob_avg[i], &st->prob_avg_1[i],
+					cur_prob);
+		st->att_hist[i] += st->attempts[i];
+		st->succ_hist[i] += st->success[i];
 	}
 
-	mrs->last_success = mrs->success;
-	mrs->last_attempts = mrs->attempts;
-	mrs->success = 0;
-	mrs->attempts = 0;
+	memcpy(st->last_success, st->success, sizeof(st->last_success));
+	memcpy(st->last_attempts, st->attempts, sizeof(st->last_attempts));
+	memset(st->success, 0, sizeof(st->success));
+	memset(st->attempts, 0, sizeof(st->attempts));
 }
 
 static bool
@@ -937,7 +1242,6 @@ static u16
 minstrel_ht_next_jump_rate(struct minstrel_ht_sta *mi, u32 fast_rate_dur,
 			   u32 slow_rate_dur, int *slow_rate_ofs)
 {
-	struct minstrel_rate_stats *mrs;
 	u32 max_duration = slow_rate_dur;
 	int i, index, offset;
 	u16 *slow_rates;
@@ -988,8 +1292,8 @@ minstrel_ht_next_jump_rate(struct minstrel_ht_sta *mi, u32 fast_rate_dur,
 			continue;
 
 		/* skip slow rates with high success probability */
-		mrs = minstrel_get_ratestats(mi, index);
-		if (mrs->prob_avg > MINSTREL_FRAC(95, 100))
+		if (minstrel_ht_get_prob_avg(mi, index) >
+		    MINSTREL_FRAC(95, 100))
 			continue;
 
 		slow_rates[(*slow_rate_ofs)++] = index;
@@ -1055,16 +1359,18 @@ minstrel_ht_refill_sample_rates(struct minstrel_ht_sta *mi)
  *  - as long as the max prob rate has a probability of more than 75%, pick
  *    higher throughput rates, even if the probability is a bit lower
  */
-static void
+VISIBLE_IF_MAC80211_KUNIT void
 minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 {
+	DECLARE_BITMAP(groups, MINSTREL_GROUPS_NB);
 	struct minstrel_mcs_group_data *mg;
-	struct minstrel_rate_stats *mrs;
+	struct minstrel_group_stats *st;
 	int group, i, j, cur_prob;
 	u16 tmp_mcs_tp_rate[MAX_THR_RATES], tmp_group_tp_rate[MAX_THR_RATES];
 	u16 tmp_legacy_tp_rate[MAX_THR_RATES], tmp_max_prob_rate;
 	u16 index;
-	bool ht_supported = mi->sta->deflink.ht_cap.ht_supported;
+	bool ht_supported = mi->sta->deflink.ht_cap.ht_supported ||
+			    mi->supported[MINSTREL_HE_GROUP_0];
 
 	if (mi->ampdu_packets > 0) {
 		if (!ieee80211_hw_check(mp->hw, TX_STATUS_NO_AMPDU_LEN))
@@ -1077,6 +1383,17 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 		mi->ampdu_packets = 0;
 	}
 
+	/*
+	 * Only the groups used in this sampling period have new counters,
+	 * the ones used in the previous period need their last counters
+	 * cleared. All other groups are left alone.
+	 */
+	bitmap_or(groups, mi->tx_groups, mi->last_tx_groups, MINSTREL_GROUPS_NB);
+	for_each_set_bit(group, groups, MINSTREL_GROUPS_NB)
+		minstrel_ht_calc_group_stats(&mi->groups[group].stats);
+	bitmap_copy(mi->last_tx_groups, mi->tx_groups, MINSTREL_GROUPS_NB);
+	bitmap_zero(mi->tx_groups, MINSTREL_GROUPS_NB);
+
 	if (mi->supported[MINSTREL_CCK_GROUP])
 		group = MINSTREL_CCK_GROUP;
 	else if (mi->supported[MINSTREL_OFDM_GROUP])
@@ -1088,7 +1405,11 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 	for (j = 0; j < ARRAY_SIZE(tmp_legacy_tp_rate); j++)
 		tmp_legacy_tp_rate[j] = index;
 
-	if (mi->supported[MINSTREL_VHT_GROUP_0])
+	if (mi->supported[MINSTREL_EHT_GROUP_0])
+		group = MINSTREL_EHT_GROUP_0;
+	else if (mi->supported[MINSTREL_HE_GROUP_0])
+		group = MINSTREL_HE_GROUP_0;
+	else if (mi->supported[MINSTREL_VHT_GROUP_0])
 		group = MINSTREL_VHT_GROUP_0;
 	else if (ht_supported)
 		group = MINSTREL_HT_GROUP_0;
@@ -1111,6 +1432,9 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 		if (!mi->supported[group])
 			continue;
 
+		st = &mg->stats;
+		st->retry_updated = 0;
+
 		/* (re)Initialize group rate indexes */
 		for(j = 0; j < MAX_THR_RATES; j++)
 			tmp_group_tp_rate[j] = MI_RATE(group, 0);
@@ -1124,15 +1448,11 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 
 			index = MI_RATE(group, i);
 
-			mrs = &mg->rates[i];
-			mrs->retry_updated = false;
-			minstrel_ht_calc_rate_stats(mp, mrs);
-
-			if (mrs->att_hist)
-				last_prob = max(last_prob, mrs->prob_avg);
+			if (st->att_hist[i])
+				last_prob = max(last_prob, st->prob_avg[i]);
 			else
-				mrs->prob_avg = max(last_prob, mrs->prob_avg);
-			cur_prob = mrs->prob_avg;
+				st->prob_avg[i] = max(last_prob, st->prob_avg[i]);
+			cur_prob = st->prob_avg[i];
 
 			if (minstrel_ht_get_tp_avg(mi, group, i, cur_prob) == 0)
 				continue;
@@ -1192,13 +1512,12 @@ minstrel_ht_update_stats(struct minstrel_priv *mp, struct minstrel_ht_sta *mi)
 	mi->last_stats_update = jiffies;
 	mi->sample_time = jiffies;
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(minstrel_ht_update_stats);
 
 static bool
 minstrel_ht_txstat_valid(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
 			 struct ieee80211_tx_rate *rate)
 {
-	int i;
-
 	if (rate->idx < 0)
 		return false;
 
@@ -1209,15 +1528,8 @@ minstrel_ht_txstat_valid(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
 	    rate->flags & IEEE80211_TX_RC_VHT_MCS)
 		return true;
 
-	for (i = 0; i < ARRAY_SIZE(mp->cck_rates); i++)
-		if (rate->idx == mp->cck_rates[i])
-			return true;
-
-	for (i = 0; i < ARRAY_SIZE(mp->ofdm_rates[0]); i++)
-		if (rate->idx == mp->ofdm_rates[mi->band][i])
-			return true;
-
-	return false;
+	return rate->idx < MINSTREL_MAX_HW_RATES &&
+	       mp->legacy_rates[mi->band][rate->idx];
 }
 
 /*
@@ -1228,30 +1540,27 @@ minstrel_ht_ri_txstat_valid(struct minstrel_priv *mp,
 			    struct minstrel_ht_sta *mi,
 			    struct ieee80211_rate_status *rate_status)
 {
-	int i;
+	int idx;
 
 	if (!rate_status)
 		return false;
 	if (!rate_status->try_count)
 		return false;
 
-	if (rate_status->rate_idx.flags & RATE_INFO_FLAGS_MCS ||
-	    rate_status->rate_idx.flags & RATE_INFO_FLAGS_VHT_MCS)
+	if (rate_status->rate_idx.flags & (RATE_INFO_FLAGS_MCS |
+					   RATE_INFO_FLAGS_VHT_MCS))
 		return true;
 
-	for (i = 0; i < ARRAY_SIZE(mp->cck_rates); i++) {
-		if (rate_status->rate_idx.legacy ==
-		    minstrel_cck_bitrates[ mp->cck_rates[i] ])
-			return true;
-	}
+	if (rate_status->rate_idx.flags & (RATE_INFO_FLAGS_HE_MCS |
+					   RATE_INFO_FLAGS_EHT_MCS))
+		return minstrel_he_ri_get_group_idx(&rate_status->rate_idx) <
+		       mi->n_groups;
 
-	for (i = 0; i < ARRAY_SIZE(mp->ofdm_rates); i++) {
-		if (rate_status->rate_idx.legacy ==
-		    minstrel_ofdm_bitrates[ mp->ofdm_rates[mi->band][i] ])
-			return true;
-	}
+	idx = minstrel_ht_ri_get_legacy_idx(mp, mi,
+					    rate_status->rate_idx.legacy);
 
-	return false;
+	return idx >= 0 && idx < MINSTREL_MAX_HW_RATES &&
+	       mp->legacy_rates[mi->band][idx];
 }
 
 static void
@@ -1285,10 +1594,10 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 	struct ieee80211_tx_info *info = st->info;
 	struct minstrel_ht_sta *mi = priv_sta;
 	struct ieee80211_tx_rate *ar = info->status.rates;
-	struct minstrel_rate_stats *rate, *rate2;
 	struct minstrel_priv *mp = priv;
 	u32 update_interval = mp->update_interval;
 	bool last, update = false;
+	u16 rate;
 	int i;
 
 	/* Ignore packet that was sent with noAck flag */
@@ -1326,14 +1635,11 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 				!minstrel_ht_ri_txstat_valid(mp, mi,
 							&(st->rates[i + 1]));
 
-			rate = minstrel_ht_ri_get_stats(mp, mi,
-							&(st->rates[i]));
-
-			if (last)
-				rate->success += info->status.ampdu_ack_len;
-
-			rate->attempts += st->rates[i].try_count *
-					  info->status.ampdu_len;
+			rate = minstrel_ht_ri_get_rate(mp, mi, &(st->rates[i]));
+			minstrel_ht_account_tx(mi, rate,
+					       last ? info->status.ampdu_ack_len : 0,
+					       st->rates[i].try_count *
+					       info->status.ampdu_len);
 		}
 	} else {
 		last = !minstrel_ht_txstat_valid(mp, mi, &ar[0]);
@@ -1341,11 +1647,10 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 			last = (i == IEEE80211_TX_MAX_RATES - 1) ||
 				!minstrel_ht_txstat_valid(mp, mi, &ar[i + 1]);
 
-			rate = minstrel_ht_get_stats(mp, mi, &ar[i]);
-			if (last)
-				rate->success += info->status.ampdu_ack_len;
-
-			rate->attempts += ar[i].count * info->status.ampdu_len;
+			rate = minstrel_ht_get_rate(mp, mi, &ar[i]);
+			minstrel_ht_account_tx(mi, rate,
+					       last ? info->status.ampdu_ack_len : 0,
+					       ar[i].count * info->status.ampdu_len);
 		}
 	}
 
@@ -1354,16 +1659,12 @@ minstrel_ht_tx_status(void *priv, struct ieee80211_supported_band *sband,
 		 * check for sudden death of spatial multiplexing,
 		 * downgrade to a lower number of streams if necessary.
 		 */
-		rate = minstrel_get_ratestats(mi, mi->max_tp_rate[0]);
-		if (rate->attempts > 30 &&
-		    rate->success < rate->attempts / 4) {
+		if (minstrel_ht_rate_failing(mi, mi->max_tp_rate[0])) {
 			minstrel_downgrade_rate(mi, &mi->max_tp_rate[0], true);
 			update = true;
 		}
 
-		rate2 = minstrel_get_ratestats(mi, mi->max_tp_rate[1]);
-		if (rate2->attempts > 30 &&
-		    rate2->success < rate2->attempts / 4) {
+		if (minstrel_ht_rate_failing(mi, mi->max_tp_rate[1])) {
 			minstrel_downgrade_rate(mi, &mi->max_tp_rate[1], false);
 			update = true;
 		}
@@ -1382,7 +1683,8 @@ static void
 minstrel_calc_retransmit(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
                          int index)
 {
-	struct minstrel_rate_stats *mrs;
+	struct minstrel_group_stats *st = minstrel_get_group_stats(mi, index);
+	int idx = MI_RATE_IDX(index);
 	unsigned int tx_time, tx_time_rtscts, tx_time_data;
 	unsigned int cw = mp->cw_min;
 	unsigned int ctime = 0;
@@ -1390,16 +1692,15 @@ minstrel_calc_retransmit(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
 	unsigned int ampdu_len = minstrel_ht_avg_ampdu_len(mi);
 	unsigned int overhead = 0, overhead_rtscts = 0;
 
-	mrs = minstrel_get_ratestats(mi, index);
-	if (mrs->prob_avg < MINSTREL_FRAC(1, 10)) {
-		mrs->retry_count = 1;
-		mrs->retry_count_rtscts = 1;
+	if (st->prob_avg[idx] < MINSTREL_FRAC(1, 10)) {
+		st->retry_count[idx] = 1;
+		st->retry_count_rtscts[idx] = 1;
 		return;
 	}
 
-	mrs->retry_count = 2;
-	mrs->retry_count_rtscts = 2;
-	mrs->retry_updated = true;
+	st->retry_count[idx] = 2;
+	st->retry_count_rtscts[idx] = 2;
+	st->retry_updated |= BIT(idx);
 
 	tx_time_data = minstrel_get_duration(index) * ampdu_len / 1000;
 
@@ -1432,9 +1733,9 @@ minstrel_calc_retransmit(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
 		tx_time_rtscts += ctime + overhead_rtscts + tx_time_data;
 
 		if (tx_time_rtscts < mp->segment_size)
-			mrs->retry_count_rtscts++;
+			st->retry_count_rtscts[idx]++;
 	} while ((tx_time < mp->segment_size) &&
-	         (++mrs->retry_count < mp->max_retry));
+	         (++st->retry_count[idx] < mp->max_retry));
 }
 
 
@@ -1444,22 +1745,22 @@ minstrel_ht_set_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
 {
 	int group_idx = MI_RATE_GROUP(index);
 	const struct mcs_group *group = &minstrel_mcs_groups[group_idx];
-	struct minstrel_rate_stats *mrs;
-	u8 idx;
+	struct minstrel_group_stats *st = minstrel_get_group_stats(mi, index);
+	u8 idx = MI_RATE_IDX(index);
 	u16 flags = group->flags;
 
-	mrs = minstrel_get_ratestats(mi, index);
-	if (!mrs->retry_updated)
+	if (!(st->retry_updated & BIT(idx)))
 		minstrel_calc_retransmit(mp, mi, index);
 
-	if (mrs->prob_avg < MINSTREL_FRAC(20, 100) || !mrs->retry_count) {
+	if (st->prob_avg[idx] < MINSTREL_FRAC(20, 100) ||
+	    !st->retry_count[idx]) {
 		ratetbl->rate[offset].count = 2;
 		ratetbl->rate[offset].count_rts = 2;
 		ratetbl->rate[offset].count_cts = 2;
 	} else {
-		ratetbl->rate[offset].count = mrs->retry_count;
-		ratetbl->rate[offset].count_cts = mrs->retry_count;
-		ratetbl->rate[offset].count_rts = mrs->retry_count_rtscts;
+		ratetbl->rate[offset].count = st->retry_count[idx];
+		ratetbl->rate[offset].count_cts = st->retry_count[idx];
+		ratetbl->rate[offset].count_rts = st->retry_count_rtscts[idx];
 	}
 
 	index = MI_RATE_IDX(index);
@@ -1468,7 +1769,9 @@ minstrel_ht_set_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
 	else if (group_idx == MINSTREL_OFDM_GROUP)
 		idx = mp->ofdm_rates[mi->band][index %
 					       ARRAY_SIZE(mp->ofdm_rates[0])];
-	else if (flags & IEEE80211_TX_RC_VHT_MCS)
+	else if (flags & (IEEE80211_TX_RC_VHT_MCS |
+			  IEEE80211_TX_RC_HE_MCS |
+			  IEEE80211_TX_RC_EHT_MCS))
 		idx = ((group->streams - 1) << 4) |
 		      (index & 0xF);
 	else
@@ -1489,14 +1792,6 @@ minstrel_ht_set_rate(struct minstrel_priv *mp, struct minstrel_ht_sta *mi,
 	ratetbl->rate[offset].flags = flags;
 }
 
-static inline int
-minstrel_ht_get_prob_avg(struct minstrel_ht_sta *mi, int rate)
-{
-	int group = MI_RATE_GROUP(rate);
-	rate = MI_RATE_IDX(rate);
-	return mi->groups[group].rates[rate].prob_avg;
-}
-
 static int
 minstrel_ht_get_max_amsdu_len(struct minstrel_ht_sta *mi)
 {
@@ -1506,7 +1801,7 @@ minstrel_ht_get_max_amsdu_len(struct minstrel_ht_sta *mi)
 	unsigned int duration;
 
 	/* Disable A-MSDU if max_prob_rate is bad */
-	if (mi->groups[group].rates[rate].prob_avg < MINSTREL_FRAC(50, 100))
+	if (mi->groups[group].stats.prob_avg[rate] < MINSTREL_FRAC(50, 100))
 		return 1;
 
 	duration = g->duration[rate];
@@ -1539,7 +1834,8 @@ minstrel_ht_get_max_amsdu_len(struct minstrel_ht_sta *mi)
 	 * the limit here to avoid the complexity of having to de-aggregate
 	 * packets in the queue.
 	 */
-	if (!mi->sta->deflink.vht_cap.vht_supported)
+	if (!mi->sta->deflink.vht_cap.vht_supported &&
+	    !mi->sta->deflink.he_cap.has_he)
 		return IEEE80211_MAX_MPDU_LEN_HT_BA;
 
 	/* unlimited */
@@ -1638,6 +1934,36 @@ minstrel_ht_get_rate(void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	} else if (sample_group == &minstrel_mcs_groups[MINSTREL_OFDM_GROUP]) {
 		int idx = sample_idx % ARRAY_SIZE(mp->ofdm_rates[0]);
 		rate->idx = mp->ofdm_rates[mi->band][idx];
+	} else if (sample_group->flags & (IEEE80211_TX_RC_HE_MCS |
+					  IEEE80211_TX_RC_EHT_MCS)) {
+		/*
+		 * These don't fit into the TX rate, leave it unset and let
+		 * the driver pick the probe rate from the info below.
+		 */
+		rate->idx = -1;
+		rate->count = 0;
+		info->control.probe_he =
+			!!(sample_group->flags & IEEE80211_TX_RC_HE_MCS);
+		info->control.probe_eht =
+			!!(sample_group->flags & IEEE80211_TX_RC_EHT_MCS);
+		info->control.probe_idx = ((sample_group->streams - 1) << 4) |
+					  sample_idx;
+		info->control.probe_bw = RATE_INFO_BW_20;
+		switch (sample_group->bw) {
+		case BW_40:
+			info->control.probe_bw = RATE_INFO_BW_40;
+			break;
+		case BW_80:
+			info->control.probe_bw = RATE_INFO_BW_80;
+			break;
+		case BW_160:
+			info->control.probe_bw = RATE_INFO_BW_160;
+			break;
+		case BW_320:
+			info->control.probe_bw = RATE_INFO_BW_320;
+			break;
+		}
+		return;
 	} else if (sample_group->flags & IEEE80211_TX_RC_VHT_MCS) {
 		ieee80211_rate_set_vht(rate, MI_RATE_IDX(sample_idx),
 				       sample_group->streams);
@@ -1706,7 +2032,9 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 	struct ieee80211_sta_vht_cap *vht_cap = &sta->deflink.vht_cap;
 	const struct ieee80211_rate *ctl_rate;
 	struct sta_info *sta_info;
-	bool ldpc, erp;
+	const struct ieee80211_sta_he_cap *he_cap = &sta->deflink.he_cap;
+	bool ldpc, erp, use_he, use_eht, from_ap;
+	u8 n_groups = mi->n_groups;
 	int use_vht;
 	int ack_dur;
 	int stbc;
@@ -1719,7 +2047,17 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 	else
 		use_vht = 0;
 
-	memset(mi, 0, sizeof(*mi));
+	/* HE/EHT rates can only be passed to the driver in the rate table */
+	use_he = n_groups > MINSTREL_HE_GROUP_0 && he_cap->has_he;
+	use_eht = use_he && n_groups > MINSTREL_EHT_GROUP_0 &&
+		  sta->deflink.eht_cap.has_eht;
+
+	sta_info = container_of(sta, struct sta_info, sta);
+	from_ap = sta_info->sdata->vif.type == NL80211_IFTYPE_STATION &&
+		  !sta->tdls;
+
+	memset(mi, 0, struct_size(mi, groups, n_groups));
+	mi->n_groups = n_groups;
 
 	mi->sta = sta;
 	mi->band = sband->band;
@@ -1751,11 +2089,15 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 		ldpc = vht_cap->cap & IEEE80211_VHT_CAP_RXLDPC;
 	}
 
+	if (use_he)
+		ldpc = he_cap->he_cap_elem.phy_cap_info[1] &
+		       IEEE80211_HE_PHY_CAP1_LDPC_CODING_IN_PAYLOAD;
+
 	mi->tx_flags |= stbc << IEEE80211_TX_CTL_STBC_SHIFT;
 	if (ldpc)
 		mi->tx_flags |= IEEE80211_TX_CTL_LDPC;
 
-	for (i = 0; i < ARRAY_SIZE(mi->groups); i++) {
+	for (i = 0; i < ARRAY_SIZE(minstrel_mcs_groups); i++) {
 		u32 gflags = minstrel_mcs_groups[i].flags;
 		int bw, nss;
 
@@ -1783,6 +2125,41 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 		if (sta->deflink.smps_mode == IEEE80211_SMPS_STATIC && nss > 1)
 			continue;
 
+		/* HE/EHT rate */
+		if (gflags & (IEEE80211_TX_RC_HE_MCS |
+			      IEEE80211_TX_RC_EHT_MCS)) {
+			bool eht = gflags & IEEE80211_TX_RC_EHT_MCS;
+
+			if (!(eht ? use_eht : use_he))
+				continue;
+
+			if (!eht && use_eht && minstrel_vht_only)
+				continue;
+
+			bw = minstrel_mcs_groups[i].bw;
+			if ((bw == BW_80 &&
+			     sta->deflink.bandwidth < IEEE80211_STA_RX_BW_80) ||
+			    (bw == BW_160 &&
+			     sta->deflink.bandwidth < IEEE80211_STA_RX_BW_160) ||
+			    (bw == BW_320 &&
+			     sta->deflink.bandwidth < IEEE80211_STA_RX_BW_320))
+				continue;
+
+			if (eht)
+				mi->supported[i] =
+					minstrel_get_valid_eht_rates(sta,
+								     from_ap,
+								     bw, nss);
+			else
+				mi->supported[i] =
+					minstrel_get_valid_he_rates(he_cap,
+								    bw, nss);
+			continue;
+		}
+
+		if (use_he && minstrel_vht_only)
+			continue;
+
 		/* HT rate */
 		if (gflags & IEEE80211_TX_RC_MCS) {
 			if (use_vht && minstrel_vht_only)
@@ -1817,7 +2194,6 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 				vht_cap->vht_mcs.tx_mcs_map);
 	}
 
-	sta_info = container_of(sta, struct sta_info, sta);
 	mi->use_short_preamble = test_sta_flag(sta_info, WLAN_STA_SHORT_PREAMBLE) &&
 				 sta_info->sdata->vif.bss_conf.use_short_preamble;
 
@@ -1846,29 +2222,58 @@ minstrel_ht_rate_update(void *priv, struct ieee80211_supported_band *sband,
 	minstrel_ht_update_caps(priv, sband, chandef, sta, priv_sta);
 }
 
+/*
+ * The HE/EHT groups are more than the others together, only allocate them
+ * if the hardware can use them at all.
+ */
+static u8
+minstrel_ht_hw_groups(struct ieee80211_hw *hw)
+{
+	const struct ieee80211_sband_iftype_data *iftd;
+	struct ieee80211_supported_band *sband;
+	bool he = false, eht = false;
+	int band, i;
+
+	if (!ieee80211_hw_check(hw, SUPPORTS_HE_RC_TABLE))
+		return MINSTREL_HE_GROUP_0;
+
+	for (band = 0; band < NUM_NL80211_BANDS; band++) {
+		sband = hw->wiphy->bands[band];
+		if (!sband)
+			continue;
+
+		for_each_sband_iftype_data(sband, i, iftd) {
+			he |= iftd->he_cap.has_he;
+			eht |= iftd->eht_cap.has_eht;
+		}
+	}
+
+	if (eht)
+		return MINSTREL_GROUPS_NB;
+	if (he)
+		return MINSTREL_EHT_GROUP_0;
+	return MINSTREL_HE_GROUP_0;
+}
+
 static void *
 minstrel_ht_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 {
-	struct ieee80211_supported_band *sband;
 	struct minstrel_ht_sta *mi;
 	struct minstrel_priv *mp = priv;
-	struct ieee80211_hw *hw = mp->hw;
-	int max_rates = 0;
-	int i;
+	u8 n_groups = minstrel_ht_hw_groups(mp->hw);
 
-	for (i = 0; i < NUM_NL80211_BANDS; i++) {
-		sband = hw->wiphy->bands[i];
-		if (sband && sband->n_bitrates > max_rates)
-			max_rates = sband->n_bitrates;
-	}
+	mi = kvzalloc(struct_size(mi, groups, n_groups), gfp);
+	if (!mi)
+		return NULL;
 
-	return kzalloc(sizeof(*mi), gfp);
+	mi->n_groups = n_groups;
+	return mi;
 }
 
 static void
 minstrel_ht_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
 {
-	kfree(priv_sta);
+	kvfree(priv_sta);
 }
 
 static void
@@ -1931,6 +2336,31 @@ minstrel_ht_init_ofdm_rates(struct minstrel_priv *mp, enum nl80211_band band)
 				    rate_flags);
 }
 
+/*
+ * Build the reverse of the cck/ofdm rate arrays, so the TX status can be
+ * mapped to the minstrel rate without searching them for every frame.
+ */
+static void
+minstrel_ht_init_legacy_rates(struct minstrel_priv *mp, enum nl80211_band band)
+{
+	u16 *rates = mp->legacy_rates[band];
+	int i;
+
+	memset(rates, 0, sizeof(mp->legacy_rates[band]));
+
+	for (i = 0; i < ARRAY_SIZE(mp->ofdm_rates[band]); i++)
+		if (mp->ofdm_rates[band][i] < MINSTREL_MAX_HW_RATES)
+			rates[mp->ofdm_rates[band][i]] =
+				MI_RATE(MINSTREL_OFDM_GROUP, i);
+
+	if (band != NL80211_BAND_2GHZ)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(mp->cck_rates); i++)
+		if (mp->cck_rates[i] < MINSTREL_MAX_HW_RATES)
+			rates[mp->cck_rates[i]] = MI_RATE(MINSTREL_CCK_GROUP, i);
+}
+
 static void *
 minstrel_ht_alloc(struct ieee80211_hw *hw)
 {
@@ -1960,8 +2390,10 @@ minstrel_ht_alloc(struct ieee80211_hw *hw)
 	mp->update_interval = HZ / 20;
 
 	minstrel_ht_init_cck_rates(mp);
-	for (i = 0; i < ARRAY_SIZE(mp->hw->wiphy->bands); i++)
-	    minstrel_ht_init_ofdm_rates(mp, i);
+	for (i = 0; i < ARRAY_SIZE(mp->hw->wiphy->bands); i++) {
+		minstrel_ht_init_ofdm_rates(mp, i);
+		minstrel_ht_init_legacy_rates(mp, i);
+	}
 
 	return mp;
 }
@@ -1984,22 +2416,155 @@ minstrel_ht_free(void *priv)
 	kfree(priv);
 }
 
-static u32 minstrel_ht_get_expected_throughput(void *priv_sta)
+static u32 minstrel_ht_get_tp_kbps(struct minstrel_ht_sta *mi, int group,
+				   int rate)
 {
-	struct minstrel_ht_sta *mi = priv_sta;
-	int i, j, prob, tp_avg;
-
-	i = MI_RATE_GROUP(mi->max_tp_rate[0]);
-	j = MI_RATE_IDX(mi->max_tp_rate[0]);
-	prob = mi->groups[i].rates[j].prob_avg;
+	int prob = mi->groups[group].stats.prob_avg[rate];
+	int tp_avg;
 
 	/* convert tp_avg from pkt per second in kbps */
-	tp_avg = minstrel_ht_get_tp_avg(mi, i, j, prob) * 10;
+	tp_avg = minstrel_ht_get_tp_avg(mi, group, rate, prob) * 10;
 	tp_avg = tp_avg * AVG_PKT_SIZE * 8 / 1024;
 
 	return tp_avg;
 }
 
+static u32 minstrel_ht_get_expected_throughput(void *priv_sta)
+{
+	struct minstrel_ht_sta *mi = priv_sta;
+
+	return minstrel_ht_get_tp_kbps(mi, MI_RATE_GROUP(mi->max_tp_rate[0]),
+				       MI_RATE_IDX(mi->max_tp_rate[0]));
+}
+
+bool
+minstrel_ht_is_sample_rate(struct minstrel_ht_sta *mi, int idx)
+{
+	int type, i;
+
+	for (type = 0; type < ARRAY_SIZE(mi->sample); type++)
+		for (i = 0; i < MINSTREL_SAMPLE_RATES; i++)
+			if (mi->sample[type].cur_sample_rates[i] == idx)
+				return true;
+	return false;
+}
+
+/*
+ * Only export the rates that were tried in the last statistics period or
+ * that are in the current rate set, the others have nothing new to report
+ * and a station may support several hundred rates.
+ */
+static bool
+minstrel_ht_rate_stats_wanted(struct minstrel_ht_sta *mi, int group, int rate)
+{
+	u16 idx = MI_RATE(group, rate);
+	int i;
+
+	if (!(mi->supported[group] & BIT(rate)))
+		return false;
+
+	if (mi->groups[group].stats.last_attempts[rate] ||
+	    idx == mi->max_prob_rate)
+		return true;
+
+	for (i = 0; i < MAX_THR_RATES; i++)
+		if (idx == mi->max_tp_rate[i])
+			return true;
+
+	return false;
+}
+
+static void
+minstrel_ht_fill_rate_stats(struct minstrel_ht_sta *mi, int group, int rate,
+			    struct nl80211_rc_rate_stats *rs)
+{
+	static const u8 chan_widths[] = {
+		[BW_20] = NL80211_CHAN_WIDTH_20,
+		[BW_40] = NL80211_CHAN_WIDTH_40,
+		[BW_80] = NL80211_CHAN_WIDTH_80,
+		[BW_160] = NL80211_CHAN_WIDTH_160,
+		[BW_320] = NL80211_CHAN_WIDTH_320,
+	};
+	const struct minstrel_group_stats *st = &mi->groups[group].stats;
+	const struct mcs_group *mg = &minstrel_mcs_groups[group];
+	u16 idx = MI_RATE(group, rate);
+	int i;
+
+	if (minstrel_ht_is_legacy_group(group)) {
+		rs->encoding = NL80211_RC_RATE_ENC_LEGACY;
+		rs->bw = NL80211_CHAN_WIDTH_20_NOHT;
+		if (group == MINSTREL_CCK_GROUP) {
+			rs->bitrate = minstrel_cck_bitrates[rate % 4];
+			if (rate >= 4)
+				rs->flags |= NL80211_RC_RATE_F_SHORT_PREAMBLE;
+		} else {
+			rs->bitrate = minstrel_ofdm_bitrates[rate % 8];
+		}
+	} else {
+		rs->bw = chan_widths[mg->bw];
+		rs->nss = mg->streams;
+		rs->mcs = rate;
+		if (mg->flags & IEEE80211_TX_RC_MCS) {
+			rs->encoding = NL80211_RC_RATE_ENC_HT;
+			rs->mcs += (mg->streams - 1) * 8;
+		} else if (mg->flags & IEEE80211_TX_RC_VHT_MCS) {
+			rs->encoding = NL80211_RC_RATE_ENC_VHT;
+		} else if (mg->flags & IEEE80211_TX_RC_HE_MCS) {
+			rs->encoding = NL80211_RC_RATE_ENC_HE;
+		} else {
+			rs->encoding = NL80211_RC_RATE_ENC_EHT;
+		}
+		if (mg->flags & IEEE80211_TX_RC_SHORT_GI)
+			rs->flags |= NL80211_RC_RATE_F_SHORT_GI;
+	}
+
+	for (i = 0; i < MAX_THR_RATES; i++) {
+		if (idx == mi->max_tp_rate[i]) {
+			rs->tp_rank = i + 1;
+			break;
+		}
+	}
+	if (idx == mi->max_prob_rate)
+		rs->flags |= NL80211_RC_RATE_F_MAX_PROB;
+	if (minstrel_ht_is_sample_rate(mi, idx))
+		rs->flags |= NL80211_RC_RATE_F_SAMPLE;
+
+	rs->throughput = minstrel_ht_get_tp_kbps(mi, group, rate);
+	rs->prob = MINSTREL_TRUNC(st->prob_avg[rate] * 1000);
+	rs->retry_count = st->retry_count[rate];
+	rs->last_attempts = st->last_attempts[rate];
+	rs->last_success = st->last_success[rate];
+	rs->attempts = st->att_hist[rate];
+	rs->success = st->succ_hist[rate];
+}
+
+VISIBLE_IF_MAC80211_KUNIT unsigned int
+minstrel_ht_get_rate_stats(void *priv, void *priv_sta,
+			   struct nl80211_rc_rate_stats *stats,
+			   unsigned int n_stats)
+{
+	struct minstrel_ht_sta *mi = priv_sta;
+	unsigned int n = 0;
+	int group, rate;
+
+	for (group = 0; group < mi->n_groups; group++) {
+		for (rate = 0; rate < MCS_GROUP_RATES; rate++) {
+			if (!minstrel_ht_rate_stats_wanted(mi, group, rate))
+				continue;
+			if (stats) {
+				if (n == n_stats)
+					return n;
+				minstrel_ht_fill_rate_stats(mi, group, rate,
+							    &stats[n]);
+			}
+			n++;
+		}
+	}
+
+	return n;
+}
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(minstrel_ht_get_rate_stats);
+
 static const struct rate_control_ops mac80211_minstrel_ht = {
 	.name = "minstrel_ht",
 	.capa = RATE_CTRL_CAPA_AMPDU_TRIGGER,
@@ -2016,6 +2581,7 @@ static const struct rate_control_ops mac80211_minstrel_ht = {
 	.add_sta_debugfs = minstrel_ht_add_sta_debugfs,
 #endif
 	.get_expected_throughput = minstrel_ht_get_expected_throughput,
+	.get_rate_stats = minstrel_ht_get_rate_stats,
 };
 
 
@@ -42,22 +42,32 @@
 #define MINSTREL_MAX_STREAMS		4
 #define MINSTREL_HT_STREAM_GROUPS	4 /* BW(=2) * SGI(=2) */
 #define MINSTREL_VHT_STREAM_GROUPS	6 /* BW(=3) * SGI(=2) */
+#define MINSTREL_HE_STREAM_GROUPS	4 /* BW(=4), 0.8us GI only */
+#define MINSTREL_EHT_STREAM_GROUPS	5 /* BW(=5), 0.8us GI only */
 
 #define MINSTREL_HT_GROUPS_NB	(MINSTREL_MAX_STREAMS *		\
 				 MINSTREL_HT_STREAM_GROUPS)
 #define MINSTREL_VHT_GROUPS_NB	(MINSTREL_MAX_STREAMS *		\
 				 MINSTREL_VHT_STREAM_GROUPS)
+#define MINSTREL_HE_GROUPS_NB	(MINSTREL_MAX_STREAMS *		\
+				 MINSTREL_HE_STREAM_GROUPS)
+#define MINSTREL_EHT_GROUPS_NB	(MINSTREL_MAX_STREAMS *		\
+				 MINSTREL_EHT_STREAM_GROUPS)
 #define MINSTREL_LEGACY_GROUPS_NB	2
 #define MINSTREL_GROUPS_NB	(MINSTREL_HT_GROUPS_NB +	\
 				 MINSTREL_VHT_GROUPS_NB +	\
+				 MINSTREL_HE_GROUPS_NB +	\
+				 MINSTREL_EHT_GROUPS_NB +	\
 				 MINSTREL_LEGACY_GROUPS_NB)
 
 #define MINSTREL_HT_GROUP_0	0
 #define MINSTREL_CCK_GROUP	(MINSTREL_HT_GROUP_0 + MINSTREL_HT_GROUPS_NB)
 #define MINSTREL_OFDM_GROUP	(MINSTREL_CCK_GROUP + 1)
 #define MINSTREL_VHT_GROUP_0	(MINSTREL_OFDM_GROUP + 1)
+#define MINSTREL_HE_GROUP_0	(MINSTREL_VHT_GROUP_0 + MINSTREL_VHT_GROUPS_NB)
+#define MINSTREL_EHT_GROUP_0	(MINSTREL_HE_GROUP_0 + MINSTREL_HE_GROUPS_NB)
 
-#define MCS_GROUP_RATES		10
+#define MCS_GROUP_RATES		14
 
 #define MI_RATE_IDX_MASK	GENMASK(3, 0)
 #define MI_RATE_GROUP_MASK	GENMASK(15, 4)
@@ -69,6 +79,9 @@
 #define MI_RATE_IDX(_rate) FIELD_GET(MI_RATE_IDX_MASK, _rate)
 #define MI_RATE_GROUP(_rate) FIELD_GET(MI_RATE_GROUP_MASK, _rate)
 
+/* legacy rates are indexed by a u32 bitmap in cfg80211 */
+#define MINSTREL_MAX_HW_RATES		32
+
 #define MINSTREL_SAMPLE_RATES		5 /* rates per sample type */
 #define MINSTREL_SAMPLE_INTERVAL	(HZ / 50)
 
@@ -83,6 +96,9 @@ struct minstrel_priv {
 	u8 cck_rates[4];
 	u8 ofdm_rates[NUM_NL80211_BANDS][8];
 
+	/* minstrel rate index by hw rate index, for the TX status */
+	u16 legacy_rates[NUM_NL80211_BANDS][MINSTREL_MAX_HW_RATES];
+
 #ifdef CPTCFG_MAC80211_DEBUGFS
 	/*
 	 * enable fixed rate processing per RC
@@ -107,23 +123,31 @@ extern const s16 minstrel_cck_bitrates[4];
 extern const s16 minstrel_ofdm_bitrates[8];
 extern const struct mcs_group minstrel_mcs_groups[];
 
-struct minstrel_rate_stats {
+/*
+ * Per-rate statistics of a MCS group, kept as one array per field so that
+ * the periodic update walks each field of a group in one go.
+ */
+struct minstrel_group_stats {
 	/* current / last sampling period attempts/success counters */
-	u16 attempts, last_attempts;
-	u16 success, last_success;
-
-	/* total attempts/success counters */
-	u32 att_hist, succ_hist;
+	u16 attempts[MCS_GROUP_RATES];
+	u16 success[MCS_GROUP_RATES];
+	u16 last_attempts[MCS_GROUP_RATES];
+	u16 last_success[MCS_GROUP_RATES];
 
 	/* prob_avg - moving average of prob */
-	u16 prob_avg;
-	u16 prob_avg_1;
+	u16 prob_avg[MCS_GROUP_RATES];
+	u16 prob_avg_1[MCS_GROUP_RATES];
+
+	/* total attempts/success counters */
+	u32 att_hist[MCS_GROUP_RATES];
+	u32 succ_hist[MCS_GROUP_RATES];
 
 	/* maximum retry counts */
-	u8 retry_count;
-	u8 retry_count_rtscts;
+	u8 retry_count[MCS_GROUP_RATES];
+	u8 retry_count_rtscts[MCS_GROUP_RATES];
 
-	bool retry_updated;
+	/* bitmap of rates with up to date retry counts */
+	u16 retry_updated;
 };
 
 enum minstrel_sample_type {
@@ -142,7 +166,7 @@ struct minstrel_mcs_group_data {
 	u16 max_group_prob_rate;
 
 	/* MCS rate statistics */
-	struct minstrel_rate_stats rates[MCS_GROUP_RATES];
+	struct minstrel_group_stats stats;
 };
 
 struct minstrel_sample_category {
@@ -191,12 +215,34 @@ struct minstrel_ht_sta {
 	/* Bitfield of supported MCS rates of all groups */
 	u16 supported[MINSTREL_GROUPS_NB];
 
+	/* groups with tx status in the current / last sampling period */
+	DECLARE_BITMAP(tx_groups, MINSTREL_GROUPS_NB);
+	DECLARE_BITMAP(last_tx_groups, MINSTREL_GROUPS_NB);
+
+	/*
+	 * number of allocated groups, the HE/EHT groups at the end are only
+	 * there if the hardware can use them
+	 */
+	u8 n_groups;
+
 	/* MCS rate group info and statistics */
-	struct minstrel_mcs_group_data groups[MINSTREL_GROUPS_NB];
+	struct minstrel_mcs_group_data groups[];
 };
 
 void minstrel_ht_add_sta_debugfs(void *priv, void *priv_sta, struct dentry *dir);
 int minstrel_ht_get_tp_avg(struct minstrel_ht_sta *mi, int group, int rate,
 			   int prob_avg);
+bool minstrel_ht_is_sample_rate(struct minstrel_ht_sta *mi, int idx);
+
+#if IS_ENABLED(CPTCFG_MAC80211_KUNIT_TEST)
+void minstrel_ht_update_stats(struct minstrel_priv *mp,
+			      struct minstrel_ht_sta *mi);
+u16 minstrel_ht_ri_get_rate(struct minstrel_priv *mp,
+			    struct minstrel_ht_sta *mi,
+			    struct ieee80211_rate_status *rate_status);
+unsigned int minstrel_ht_get_rate_stats(void *priv, void *priv_sta,
+					struct nl80211_rc_rate_stats *stats,
+					unsigned int n_stats);
+#endif
 
 #endif
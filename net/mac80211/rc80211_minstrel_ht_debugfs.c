@@ -11,6 +11,9 @@
 #include <net/mac80211.h>
 #include "rc80211_minstrel_ht.h"
 
+/* large enough for all HT, VHT, HE and EHT groups of a station */
+#define MINSTREL_STATS_BUF_SIZE	131072
+
 struct minstrel_debugfs_info {
 	size_t len;
 	char buf[];
@@ -28,22 +31,10 @@ minstrel_stats_read(struct file *file, char __user *buf, size_t len, loff_t *ppo
 static int
 minstrel_stats_release(struct inode *inode, struct file *file)
 {
-	kfree(file->private_data);
+	kvfree(file->private_data);
 	return 0;
 }
 
-static bool
-minstrel_ht_is_sample_rate(struct minstrel_ht_sta *mi, int idx)
-{
-	int type, i;
-
-	for (type = 0; type < ARRAY_SIZE(mi->sample); type++)
-		for (i = 0; i < MINSTREL_SAMPLE_RATES; i++)
-			if (mi->sample[type].cur_sample_rates[i] == idx)
-				return true;
-	return false;
-}
-
 static char *
 minstrel_ht_stats_dump(struct minstrel_ht_sta *mi, int i, char *p)
 {
@@ -67,7 +58,7 @@ minstrel_ht_stats_dump(struct minstrel_ht_sta *mi, int i, char *p)
 		gimode = 'S';
 
 	for (j = 0; j < MCS_GROUP_RATES; j++) {
-		struct minstrel_rate_stats *mrs = &mi->groups[i].rates[j];
+		const struct minstrel_group_stats *st = &mi->groups[i].stats;
 		int idx = MI_RATE(i, j);
 		unsigned int duration;
 
@@ -82,6 +73,14 @@ minstrel_ht_stats_dump(struct minstrel_ht_sta *mi, int i, char *p)
 			p += sprintf(p, "VHT%c0 ", htmode);
 			p += sprintf(p, "%cGI ", gimode);
 			p += sprintf(p, "%d  ", mg->streams);
+		} else if (gflags & IEEE80211_TX_RC_HE_MCS) {
+			p += sprintf(p, "HE%-4u", 20 << mg->bw);
+			p += sprintf(p, "0.8 ");
+			p += sprintf(p, "%d  ", mg->streams);
+		} else if (gflags & IEEE80211_TX_RC_EHT_MCS) {
+			p += sprintf(p, "EHT%-3u", 20 << mg->bw);
+			p += sprintf(p, "0.8 ");
+			p += sprintf(p, "%d  ", mg->streams);
 		} else if (i == MINSTREL_OFDM_GROUP) {
 			p += sprintf(p, "OFDM       ");
 			p += sprintf(p, "1 ");
@@ -102,6 +101,9 @@ minstrel_ht_stats_dump(struct minstrel_ht_sta *mi, int i, char *p)
 			p += sprintf(p, "  MCS%-2u", (mg->streams - 1) * 8 + j);
 		} else if (gflags & IEEE80211_TX_RC_VHT_MCS) {
 			p += sprintf(p, "  MCS%-1u/%1u", j, mg->streams);
+		} else if (gflags & (IEEE80211_TX_RC_HE_MCS |
+				     IEEE80211_TX_RC_EHT_MCS)) {
+			p += sprintf(p, " MCS%-2u/%1u", j, mg->streams);
 		} else {
 			int r;
 
@@ -122,8 +124,8 @@ minstrel_ht_stats_dump(struct minstrel_ht_sta *mi, int i, char *p)
 		p += sprintf(p, "%6u  ", tx_time);
 
 		tp_max = minstrel_ht_get_tp_avg(mi, i, j, MINSTREL_FRAC(100, 100));
-		tp_avg = minstrel_ht_get_tp_avg(mi, i, j, mrs->prob_avg);
-		eprob = MINSTREL_TRUNC(mrs->prob_avg * 1000);
+		tp_avg = minstrel_ht_get_tp_avg(mi, i, j, st->prob_avg[j]);
+		eprob = MINSTREL_TRUNC(st->prob_avg[j] * 1000);
 
 		p += sprintf(p, "%4u.%1u    %4u.%1u     %3u.%1u"
 				"     %3u   %3u %-3u   "
@@ -131,11 +133,11 @@ minstrel_ht_stats_dump(struct minstrel_ht_sta *mi, int i, char *p)
 				tp_max / 10, tp_max % 10,
 				tp_avg / 10, tp_avg % 10,
 				eprob / 10, eprob % 10,
-				mrs->retry_count,
-				mrs->last_success,
-				mrs->last_attempts,
-				(unsigned long long)mrs->succ_hist,
-				(unsigned long long)mrs->att_hist);
+				st->retry_count[j],
+				st->last_success[j],
+				st->last_attempts[j],
+				(unsigned long long)st->succ_hist[j],
+				(unsigned long long)st->att_hist[j]);
 	}
 
 	return p;
@@ -149,7 +151,7 @@ minstrel_ht_stats_open(struct inode *inode, struct file *file)
 	unsigned int i;
 	char *p;
 
-	ms = kmalloc(32768, GFP_KERNEL);
+	ms = kvmalloc(MINSTREL_STATS_BUF_SIZE, GFP_KERNEL);
 	if (!ms)
 		return -ENOMEM;
 
@@ -165,7 +167,7 @@ minstrel_ht_stats_open(struct inode *inode, struct file *file)
 	p = minstrel_ht_stats_dump(mi, MINSTREL_CCK_GROUP, p);
 	for (i = 0; i < MINSTREL_CCK_GROUP; i++)
 		p = minstrel_ht_stats_dump(mi, i, p);
-	for (i++; i < ARRAY_SIZE(mi->groups); i++)
+	for (i++; i < mi->n_groups; i++)
 		p = minstrel_ht_stats_dump(mi, i, p);
 
 	p += sprintf(p, "\nTotal packet count::    ideal %d      "
@@ -177,7 +179,7 @@ minstrel_ht_stats_open(struct inode *inode, struct file *file)
 			MINSTREL_TRUNC(mi->avg_ampdu_len),
 			MINSTREL_TRUNC(mi->avg_ampdu_len * 10) % 10);
 	ms->len = p - ms->buf;
-	WARN_ON(ms->len + sizeof(*ms) > 32768);
+	WARN_ON(ms->len + sizeof(*ms) > MINSTREL_STATS_BUF_SIZE);
 
 	return nonseekable_open(inode, file);
 }
@@ -212,7 +214,7 @@ minstrel_ht_stats_csv_dump(struct minstrel_ht_sta *mi, int i, char *p)
 		gimode = 'S';
 
 	for (j = 0; j < MCS_GROUP_RATES; j++) {
-		struct minstrel_rate_stats *mrs = &mi->groups[i].rates[j];
+		const struct minstrel_group_stats *st = &mi->groups[i].stats;
 		int idx = MI_RATE(i, j);
 		unsigned int duration;
 
@@ -227,6 +229,14 @@ minstrel_ht_stats_csv_dump(struct minstrel_ht_sta *mi, int i, char *p)
 			p += sprintf(p, "VHT%c0,", htmode);
 			p += sprintf(p, "%cGI,", gimode);
 			p += sprintf(p, "%d,", mg->streams);
+		} else if (gflags & IEEE80211_TX_RC_HE_MCS) {
+			p += sprintf(p, "HE%u,", 20 << mg->bw);
+			p += sprintf(p, "0.8,");
+			p += sprintf(p, "%d,", mg->streams);
+		} else if (gflags & IEEE80211_TX_RC_EHT_MCS) {
+			p += sprintf(p, "EHT%u,", 20 << mg->bw);
+			p += sprintf(p, "0.8,");
+			p += sprintf(p, "%d,", mg->streams);
 		} else if (i == MINSTREL_OFDM_GROUP) {
 			p += sprintf(p, "OFDM,,1,");
 		} else {
@@ -244,7 +254,9 @@ minstrel_ht_stats_csv_dump(struct minstrel_ht_sta *mi, int i, char *p)
 
 		if (gflags & IEEE80211_TX_RC_MCS) {
 			p += sprintf(p, ",MCS%-2u,", (mg->streams - 1) * 8 + j);
-		} else if (gflags & IEEE80211_TX_RC_VHT_MCS) {
+		} else if (gflags & (IEEE80211_TX_RC_VHT_MCS |
+				     IEEE80211_TX_RC_HE_MCS |
+				     IEEE80211_TX_RC_EHT_MCS)) {
 			p += sprintf(p, ",MCS%-1u/%1u,", j, mg->streams);
 		} else {
 			int r;
@@ -265,19 +277,19 @@ minstrel_ht_stats_csv_dump(struct minstrel_ht_sta *mi, int i, char *p)
 		p += sprintf(p, "%u,", tx_time);
 
 		tp_max = minstrel_ht_get_tp_avg(mi, i, j, MINSTREL_FRAC(100, 100));
-		tp_avg = minstrel_ht_get_tp_avg(mi, i, j, mrs->prob_avg);
-		eprob = MINSTREL_TRUNC(mrs->prob_avg * 1000);
+		tp_avg = minstrel_ht_get_tp_avg(mi, i, j, st->prob_avg[j]);
+		eprob = MINSTREL_TRUNC(st->prob_avg[j] * 1000);
 
 		p += sprintf(p, "%u.%u,%u.%u,%u.%u,%u,%u,"
 				"%u,%llu,%llu,",
 				tp_max / 10, tp_max % 10,
 				tp_avg / 10, tp_avg % 10,
 				eprob / 10, eprob % 10,
-				mrs->retry_count,
-				mrs->last_success,
-				mrs->last_attempts,
-				(unsigned long long)mrs->succ_hist,
-				(unsigned long long)mrs->att_hist);
+				st->retry_count[j],
+				st->last_success[j],
+				st->last_attempts[j],
+				(unsigned long long)st->succ_hist[j],
+				(unsigned long long)st->att_hist[j]);
 		p += sprintf(p, "%d,%d,%d.%d\n",
 				max(0, (int) mi->total_packets -
 				(int) mi->sample_packets),
@@ -297,7 +309,7 @@ minstrel_ht_stats_csv_open(struct inode *inode, struct file *file)
 	unsigned int i;
 	char *p;
 
-	ms = kmalloc(32768, GFP_KERNEL);
+	ms = kvmalloc(MINSTREL_STATS_BUF_SIZE, GFP_KERNEL);
 	if (!ms)
 		return -ENOMEM;
 
@@ -308,11 +320,11 @@ minstrel_ht_stats_csv_open(struct inode *inode, struct file *file)
 	p = minstrel_ht_stats_csv_dump(mi, MINSTREL_CCK_GROUP, p);
 	for (i = 0; i < MINSTREL_CCK_GROUP; i++)
 		p = minstrel_ht_stats_csv_dump(mi, i, p);
-	for (i++; i < ARRAY_SIZE(mi->groups); i++)
+	for (i++; i < mi->n_groups; i++)
 		p = minstrel_ht_stats_csv_dump(mi, i, p);
 
 	ms->len = p - ms->buf;
-	WARN_ON(ms->len + sizeof(*ms) > 32768);
+	WARN_ON(ms->len + sizeof(*ms) > MINSTREL_STATS_BUF_SIZE);
 
 	return nonseekable_open(inode, file);
 }
@@ -1093,25 +1093,109 @@ static ieee80211_rx_result ieee80211_rx_mesh_check(struct ieee80211_rx_data *rx)
 	return RX_CONTINUE;
 }
 
+int ieee80211_rx_reorder_alloc(struct tid_ampdu_rx *tid_agg_rx, u16 buf_size,
+			       gfp_t gfp)
+{
+	tid_agg_rx->buf_size = buf_size;
+	tid_agg_rx->reorder_buf = kcalloc(buf_size,
+					  sizeof(*tid_agg_rx->reorder_buf),
+					  gfp);
+	tid_agg_rx->reorder_stored = bitmap_zalloc(buf_size, gfp);
+	tid_agg_rx->reorder_ready = bitmap_zalloc(buf_size, gfp);
+	if (!tid_agg_rx->reorder_buf || !tid_agg_rx->reorder_stored ||
+	    !tid_agg_rx->reorder_ready) {
+		ieee80211_rx_reorder_free(tid_agg_rx);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(ieee80211_rx_reorder_alloc);
+
+void ieee80211_rx_reorder_free(struct tid_ampdu_rx *tid_agg_rx)
+{
+	unsigned int i;
+
+	if (tid_agg_rx->reorder_buf && tid_agg_rx->reorder_stored) {
+		for_each_set_bit(i, tid_agg_rx->reorder_stored,
+				 tid_agg_rx->buf_size)
+			kfree_skb_list(tid_agg_rx->reorder_buf[i].head);
+	}
+
+	kfree(tid_agg_rx->reorder_buf);
+	bitmap_free(tid_agg_rx->reorder_stored);
+	bitmap_free(tid_agg_rx->reorder_ready);
+	tid_agg_rx->reorder_buf = NULL;
+	tid_agg_rx->reorder_stored = NULL;
+	tid_agg_rx->reorder_ready = NULL;
+}
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(ieee80211_rx_reorder_free);
+
 static inline bool ieee80211_rx_reorder_ready(struct tid_ampdu_rx *tid_agg_rx,
 					      int index)
 {
-	struct sk_buff_head *frames = &tid_agg_rx->reorder_buf[index];
-	struct sk_buff *tail = skb_peek_tail(frames);
-	struct ieee80211_rx_status *status;
-
 	if (tid_agg_rx->reorder_buf_filtered &&
 	    tid_agg_rx->reorder_buf_filtered & BIT_ULL(index))
 		return true;
 
-	if (!tail)
-		return false;
+	return test_bit(index, tid_agg_rx->reorder_ready);
+}
 
-	status = IEEE80211_SKB_RXCB(tail);
-	if (status->flag & RX_FLAG_AMSDU_MORE)
-		return false;
+/* distance from slot @from to slot @to going forward around the ring */
+static inline int ieee80211_rx_reorder_dist(struct tid_ampdu_rx *tid_agg_rx,
+					    int from, int to)
+{
+	return (to - from + tid_agg_rx->buf_size) % tid_agg_rx->buf_size;
+}
 
-	return true;
+/*
+ * Find the first slot at or after @index in ring order whose bit is set in
+ * @map, or return -1 if there's none.
+ */
+static int ieee80211_rx_reorder_find(struct tid_ampdu_rx *tid_agg_rx,
+				     const unsigned long *map, int index)
+{
+	unsigned long next;
+
+	next = find_next_bit(map, tid_agg_rx->buf_size, index);
+	if (next < tid_agg_rx->buf_size)
+		return next;
+
+	next = find_first_bit(map, index);
+	return next < index ? next : -1;
+}
+
+static int ieee80211_rx_reorder_next_ready(struct tid_ampdu_rx *tid_agg_rx,
+					   int index)
+{
+	int i, j;
+
+	if (likely(!tid_agg_rx->reorder_buf_filtered))
+		return ieee80211_rx_reorder_find(tid_agg_rx,
+						 tid_agg_rx->reorder_ready,
+						 index);
+
+	/* filtered frames are rare and only for small buffers, just walk */
+	for (i = 0; i < tid_agg_rx->buf_size; i++) {
+		j = (index + i) % tid_agg_rx->buf_size;
+		if (ieee80211_rx_reorder_ready(tid_agg_rx, j))
+			return j;
+	}
+
+	return -1;
+}
+
+static void ieee80211_rx_reorder_purge(struct tid_ampdu_rx *tid_agg_rx,
+				       int index)
+{
+	struct ieee80211_reorder_slot *slot = &tid_agg_rx->reorder_buf[index];
+
+	kfree_skb_list(slot->head);
+	slot->head = NULL;
+	slot->tail = NULL;
+	__clear_bit(index, tid_agg_rx->reorder_stored);
+	if (__test_and_clear_bit(index, tid_agg_rx->reorder_ready))
+		tid_agg_rx->stored_mpdu_num--;
 }
 
 static void ieee80211_release_reorder_frame(struct ieee80211_sub_if_data *sdata,
@@ -1119,27 +1203,32 @@ static void ieee80211_release_reorder_frame(struct ieee80211_sub_if_data *sdata,
 					    int index,
 					    struct sk_buff_head *frames)
 {
-	struct sk_buff_head *skb_list = &tid_agg_rx->reorder_buf[index];
-	struct sk_buff *skb;
+	struct ieee80211_reorder_slot *slot = &tid_agg_rx->reorder_buf[index];
+	struct sk_buff *skb, *next;
 	struct ieee80211_rx_status *status;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
-	if (skb_queue_empty(skb_list))
+	if (!slot->head)
 		goto no_frame;
 
 	if (!ieee80211_rx_reorder_ready(tid_agg_rx, index)) {
-		__skb_queue_purge(skb_list);
+		ieee80211_rx_reorder_purge(tid_agg_rx, index);
 		goto no_frame;
 	}
 
 	/* release frames from the reorder ring buffer */
-	tid_agg_rx->stored_mpdu_num--;
-	while ((skb = __skb_dequeue(skb_list))) {
+	if (__test_and_clear_bit(index, tid_agg_rx->reorder_ready))
+		tid_agg_rx->stored_mpdu_num--;
+	__clear_bit(index, tid_agg_rx->reorder_stored);
+	skb_list_walk_safe(slot->head, skb, next) {
+		skb_mark_not_on_list(skb);
 		status = IEEE80211_SKB_RXCB(skb);
 		status->rx_flags |= IEEE80211_RX_DEFERRED_RELEASE;
 		__skb_queue_tail(frames, skb);
 	}
+	slot->head = NULL;
+	slot->tail = NULL;
 
 no_frame:
 	if (tid_agg_rx->reorder_buf_filtered)
@@ -1152,12 +1241,32 @@ static void ieee80211_release_reorder_frames(struct ieee80211_sub_if_data *sdata
 					     u16 head_seq_num,
 					     struct sk_buff_head *frames)
 {
-	int index;
+	int index, next, skip;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
 	while (ieee80211_sn_less(tid_agg_rx->head_seq_num, head_seq_num)) {
 		index = tid_agg_rx->head_seq_num % tid_agg_rx->buf_size;
+
+		if (!tid_agg_rx->reorder_buf_filtered &&
+		    !test_bit(index, tid_agg_rx->reorder_stored)) {
+			/* skip all the empty slots up to the next used one */
+			next = ieee80211_rx_reorder_find(tid_agg_rx,
+							 tid_agg_rx->reorder_stored,
+							 index);
+			if (next < 0)
+				skip = tid_agg_rx->buf_size;
+			else
+				skip = ieee80211_rx_reorder_dist(tid_agg_rx,
+								 index, next);
+			skip = min_t(int, skip,
+				     ieee80211_sn_sub(head_seq_num,
+						      tid_agg_rx->head_seq_num));
+			tid_agg_rx->head_seq_num =
+				ieee80211_sn_add(tid_agg_rx->head_seq_num, skip);
+			continue;
+		}
+
 		ieee80211_release_reorder_frame(sdata, tid_agg_rx, index,
 						frames);
 	}
@@ -1178,7 +1287,7 @@ static void ieee80211_sta_reorder_release(struct ieee80211_sub_if_data *sdata,
 					  struct tid_ampdu_rx *tid_agg_rx,
 					  struct sk_buff_head *frames)
 {
-	int index, i, j;
+	int index, i, j, dist, off;
 
 	lockdep_assert_held(&tid_agg_rx->reorder_lock);
 
@@ -1188,24 +1297,41 @@ static void ieee80211_sta_reorder_release(struct ieee80211_sub_if_data *sdata,
 	    tid_agg_rx->stored_mpdu_num) {
 		/*
 		 * No buffers ready to be released, but check whether any
-		 * frames in the reorder buffer have timed out.
+		 * frames in the reorder buffer have timed out. Only the
+		 * ready slots are visited, the gaps in between are counted
+		 * as skipped.
 		 */
 		int skipped = 1;
-		for (j = (index + 1) % tid_agg_rx->buf_size; j != index;
-		     j = (j + 1) % tid_agg_rx->buf_size) {
-			if (!ieee80211_rx_reorder_ready(tid_agg_rx, j)) {
-				skipped++;
-				continue;
-			}
+
+		for (off = 1; off < tid_agg_rx->buf_size; off++) {
+			j = ieee80211_rx_reorder_next_ready(tid_agg_rx,
+					(index + off) % tid_agg_rx->buf_size);
+			if (j < 0)
+				break;
+			dist = ieee80211_rx_reorder_dist(tid_agg_rx, index, j);
+			if (dist < off)
+				break;
+			skipped += dist - off;
+			off = dist;
+
 			if (skipped &&
-			    !time_after(jiffies, tid_agg_rx->reorder_time[j] +
+			    !time_after(jiffies,
+					tid_agg_rx->reorder_buf[j].time +
 					HT_RX_REORDER_BUF_TIMEOUT))
 				goto set_release_timer;
 
 			/* don't leave incomplete A-MSDUs around */
-			for (i = (index + 1) % tid_agg_rx->buf_size; i != j;
-			     i = (i + 1) % tid_agg_rx->buf_size)
-				__skb_queue_purge(&tid_agg_rx->reorder_buf[i]);
+			i = (index + 1) % tid_agg_rx->buf_size;
+			while ((i = ieee80211_rx_reorder_find(tid_agg_rx,
+						tid_agg_rx->reorder_stored,
+						i)) >= 0) {
+				int d = ieee80211_rx_reorder_dist(tid_agg_rx,
+								  index, i);
+
+				if (!d || d >= dist)
+					break;
+				ieee80211_rx_reorder_purge(tid_agg_rx, i);
+			}
 
 			ht_dbg_ratelimited(sdata,
 					   "release an RX reorder frame due to timeout on earlier frames\n");
@@ -1227,19 +1353,16 @@ static void ieee80211_sta_reorder_release(struct ieee80211_sub_if_data *sdata,
 	}
 
 	if (tid_agg_rx->stored_mpdu_num) {
-		j = index = tid_agg_rx->head_seq_num % tid_agg_rx->buf_size;
-
-		for (; j != (index - 1) % tid_agg_rx->buf_size;
-		     j = (j + 1) % tid_agg_rx->buf_size) {
-			if (ieee80211_rx_reorder_ready(tid_agg_rx, j))
-				break;
-		}
+		index = tid_agg_rx->head_seq_num % tid_agg_rx->buf_size;
+		j = ieee80211_rx_reorder_next_ready(tid_agg_rx, index);
+		if (j < 0)
+			j = index;
 
  set_release_timer:
 
 		if (!tid_agg_rx->removed)
 			mod_timer(&tid_agg_rx->reorder_timer,
-				  tid_agg_rx->reorder_time[j] + 1 +
+				  tid_agg_rx->reorder_buf[j].time + 1 +
 				  HT_RX_REORDER_BUF_TIMEOUT);
 	} else {
 		timer_delete(&tid_agg_rx->reorder_timer);
@@ -1251,14 +1374,16 @@ static void ieee80211_sta_reorder_release(struct ieee80211_sub_if_data *sdata,
  * rcu_read_lock protection. It returns false if the frame
  * can be processed immediately, true if it was consumed.
  */
-static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata,
-					     struct tid_ampdu_rx *tid_agg_rx,
-					     struct sk_buff *skb,
-					     struct sk_buff_head *frames)
+VISIBLE_IF_MAC80211_KUNIT bool
+ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata,
+				 struct tid_ampdu_rx *tid_agg_rx,
+				 struct sk_buff *skb,
+				 struct sk_buff_head *frames)
 {
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *) skb->data;
 	struct ieee80211_rx_status *status = IEEE80211_SKB_RXCB(skb);
 	u16 mpdu_seq_num = ieee80211_get_sn(hdr);
+	struct ieee80211_reorder_slot *slot;
 	u16 head_seq_num, buf_size;
 	int index;
 	bool ret = true;
@@ -1334,9 +1459,18 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
 	}
 
 	/* put the frame in the reordering buffer */
-	__skb_queue_tail(&tid_agg_rx->reorder_buf[index], skb);
+	slot = &tid_agg_rx->reorder_buf[index];
+	skb_mark_not_on_list(skb);
+	if (slot->tail)
+		slot->tail->next = skb;
+	else
+		slot->head = skb;
+	slot->tail = skb;
+	__set_bit(index, tid_agg_rx->reorder_stored);
+
 	if (!(status->flag & RX_FLAG_AMSDU_MORE)) {
-		tid_agg_rx->reorder_time[index] = jiffies;
+		slot->time = jiffies;
+		__set_bit(index, tid_agg_rx->reorder_ready);
 		tid_agg_rx->stored_mpdu_num++;
 		ieee80211_sta_reorder_release(sdata, tid_agg_rx, frames);
 	}
@@ -1345,6 +1479,7 @@ static bool ieee80211_sta_manage_reorder_buf(struct ieee80211_sub_if_data *sdata
 	spin_unlock(&tid_agg_rx->reorder_lock);
 	return ret;
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(ieee80211_sta_manage_reorder_buf);
 
 /*
  * Reorder MPDUs from A-MPDUs, keeping them on a buffer. Returns
@@ -1593,8 +1728,7 @@ static void sta_ps_start(struct sta_info *sta)
 		struct txq_info *txqi = to_txq_info(txq);
 
 		spin_lock(&local->active_txq_lock[txq->ac]);
-		if (!list_empty(&txqi->schedule_order))
-			list_del_init(&txqi->schedule_order);
+		ieee80211_txq_sched_del(local, txqi);
 		spin_unlock(&local->active_txq_lock[txq->ac]);
 
 		if (txq_has_queue(txq))
@@ -5423,6 +5557,35 @@ void ieee80211_rx_list(struct ieee80211_hw *hw, struct ieee80211_sta *pubsta,
 }
 EXPORT_SYMBOL(ieee80211_rx_list);
 
+void ieee80211_rx_list_deliver(struct ieee80211_hw *hw,
+			       struct list_head *list)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct sk_buff *skb, *tmp;
+
+	while (!list_empty(list)) {
+		struct net_device *dev;
+		LIST_HEAD(batch);
+
+		/*
+		 * Pull out all frames for the interface of the first one,
+		 * usually that's all of them; any others stay in order on
+		 * the list for the next round.
+		 */
+		dev = list_first_entry(list, struct sk_buff, list)->dev;
+		list_for_each_entry_safe(skb, tmp, list, list) {
+			if (skb->dev != dev)
+				continue;
+			list_move_tail(&skb->list, &batch);
+			I802_DEBUG_INC(local->rx_list_frames);
+		}
+
+		I802_DEBUG_INC(local->rx_list_batches);
+		netif_receive_skb_list(&batch);
+	}
+}
+EXPORT_SYMBOL(ieee80211_rx_list_deliver);
+
 void ieee80211_rx_napi(struct ieee80211_hw *hw, struct ieee80211_sta *pubsta,
 		       struct sk_buff *skb, struct napi_struct *napi)
 {
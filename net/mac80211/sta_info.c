@@ -354,6 +354,7 @@ struct sta_info *sta_info_get_by_idx(struct ieee80211_sub_if_data *sdata,
 static void sta_info_free_link(struct link_sta_info *link_sta)
 {
 	free_percpu(link_sta->pcpu_rx_stats);
+	free_percpu(link_sta->pcpu_tx_stats);
 }
 
 static void sta_remove_link(struct sta_info *sta, unsigned int link_id,
@@ -443,6 +444,7 @@ void sta_info_free(struct ieee80211_local *local, struct sta_info *sta)
 #endif
 
 	sta_info_free_link(&sta->deflink);
+	free_percpu(sta->tx_latency);
 	kfree(sta);
 }
 
@@ -492,7 +494,7 @@ static int sta_info_alloc_link(struct ieee80211_local *local,
 			       gfp_t gfp)
 {
 	struct ieee80211_hw *hw = &local->hw;
-	int i;
+	int i, cpu;
 
 	if (ieee80211_hw_check(hw, USES_RSS)) {
 		link_info->pcpu_rx_stats =
@@ -501,6 +503,18 @@ static int sta_info_alloc_link(struct ieee80211_local *local,
 			return -ENOMEM;
 	}
 
+	link_info->pcpu_tx_stats =
+		alloc_percpu_gfp(struct ieee80211_sta_tx_counters, gfp);
+	if (!link_info->pcpu_tx_stats) {
+		free_percpu(link_info->pcpu_rx_stats);
+		link_info->pcpu_rx_stats = NULL;
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu)
+		u64_stats_init(&per_cpu_ptr(link_info->pcpu_tx_stats,
+					    cpu)->syncp);
+
 	link_info->rx_stats.last_rx = jiffies;
 	u64_stats_init(&link_info->rx_stats.syncp);
 
@@ -569,6 +583,10 @@ __sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 	if (sta_info_alloc_link(local, &sta->deflink, gfp))
 		goto free;
 
+	sta->tx_latency = alloc_percpu_gfp(struct cfg80211_tx_latency, gfp);
+	if (!sta->tx_latency)
+		goto free;
+
 	if (link_id >= 0) {
 		sta_info_add_link(sta, link_id, &sta->deflink,
 				  &sta->sta.deflink);
@@ -716,6 +734,7 @@ free_txq:
 	kfree(to_txq_info(sta->sta.txq[0]));
 free:
 	sta_info_free_link(&sta->deflink);
+	free_percpu(sta->tx_latency);
 #ifdef CPTCFG_MAC80211_MESH
 	kfree(sta->mesh);
 #endif
@@ -2308,6 +2327,33 @@ void ieee80211_sta_set_buffered(struct ieee80211_sta *pubsta,
 }
 EXPORT_SYMBOL(ieee80211_sta_set_buffered);
 
+/*
+ * Apply the weight the scheduler rounds that passed since the station's
+ * deficit was last looked at have credited it with. As with the rotation of
+ * the active TXQs, a round only credits a station while its deficit, less
+ * the airtime still pending, is negative. Must be called with the AC's
+ * active_txq_lock held before the deficit is checked or charged.
+ */
+void ieee80211_sta_sync_airtime(struct sta_info *sta, u8 ac)
+{
+	struct airtime_info *air_info = &sta->airtime[ac];
+	u64 round = sta->local->txq_sched[ac].round;
+	u64 rounds = round - air_info->credit_round;
+	s32 deficit;
+
+	air_info->credit_round = round;
+	if (!rounds)
+		return;
+
+	deficit = air_info->deficit - atomic_read(&air_info->aql_tx_pending);
+	if (deficit >= 0)
+		return;
+
+	rounds = min_t(u64, rounds,
+		       DIV_ROUND_UP((u32)-deficit, sta->airtime_weight));
+	air_info->deficit += rounds * sta->airtime_weight;
+}
+
 void ieee80211_sta_register_airtime(struct ieee80211_sta *pubsta, u8 tid,
 				    u32 tx_airtime, u32 rx_airtime)
 {
@@ -2325,8 +2371,10 @@ void ieee80211_sta_register_airtime(struct ieee80211_sta *pubsta, u8 tid,
 	sta->airtime[ac].tx_airtime += tx_airtime;
 	sta->airtime[ac].rx_airtime += rx_airtime;
 
-	if (ieee80211_sta_keep_active(sta, ac))
+	if (ieee80211_sta_keep_active(sta, ac)) {
+		ieee80211_sta_sync_airtime(sta, ac);
 		sta->airtime[ac].deficit -= airtime;
+	}
 
 	spin_unlock_bh(&local->active_txq_lock[ac]);
 }
@@ -2532,56 +2580,45 @@ static inline u64 sta_get_tidstats_msdu(struct ieee80211_sta_rx_stats *rxstats,
 
 static void sta_set_tidstats(struct sta_info *sta,
 			     struct cfg80211_tid_stats *tidstats,
-			     int tid)
+			     int tid,
+			     const struct ieee80211_sta_rx_counters *rxc,
+			     const struct ieee80211_sta_tx_counters *txc)
 {
 	struct ieee80211_local *local = sta->local;
-	int cpu;
 
 	if (!(tidstats->filled & BIT(NL80211_TID_STATS_RX_MSDU))) {
-		tidstats->rx_msdu += sta_get_tidstats_msdu(&sta->deflink.rx_stats,
-							   tid);
-
-		if (sta->deflink.pcpu_rx_stats) {
-			for_each_possible_cpu(cpu) {
-				struct ieee80211_sta_rx_stats *cpurxs;
-
-				cpurxs = per_cpu_ptr(sta->deflink.pcpu_rx_stats,
-						     cpu);
-				tidstats->rx_msdu +=
-					sta_get_tidstats_msdu(cpurxs, tid);
-			}
-		}
-
+		tidstats->rx_msdu += rxc->msdu[tid];
 		tidstats->filled |= BIT(NL80211_TID_STATS_RX_MSDU);
 	}
 
 	if (!(tidstats->filled & BIT(NL80211_TID_STATS_TX_MSDU))) {
 		tidstats->filled |= BIT(NL80211_TID_STATS_TX_MSDU);
-		tidstats->tx_msdu = sta->deflink.tx_stats.msdu[tid];
+		tidstats->tx_msdu = txc->msdu[tid];
 	}
 
 	if (!(tidstats->filled & BIT(NL80211_TID_STATS_TX_MSDU_RETRIES)) &&
 	    ieee80211_hw_check(&local->hw, REPORTS_TX_ACK_STATUS)) {
 		tidstats->filled |= BIT(NL80211_TID_STATS_TX_MSDU_RETRIES);
-		tidstats->tx_msdu_retries = sta->deflink.status_stats.msdu_retries[tid];
+		tidstats->tx_msdu_retries = txc->msdu_retries[tid];
 	}
 
 	if (!(tidstats->filled & BIT(NL80211_TID_STATS_TX_MSDU_FAILED)) &&
 	    ieee80211_hw_check(&local->hw, REPORTS_TX_ACK_STATUS)) {
 		tidstats->filled |= BIT(NL80211_TID_STATS_TX_MSDU_FAILED);
-		tidstats->tx_msdu_failed = sta->deflink.status_stats.msdu_failed[tid];
+		tidstats->tx_msdu_failed = txc->msdu_failed[tid];
 	}
 
 	if (tid < IEEE80211_NUM_TIDS) {
-		spin_lock_bh(&local->fq.lock);
+		struct txq_info *txqi = to_txq_info(sta->sta.txq[tid]);
+
+		fq_tin_lock_bh(&local->fq, &txqi->tin);
 		rcu_read_lock();
 
 		tidstats->filled |= BIT(NL80211_TID_STATS_TXQ_STATS);
-		ieee80211_fill_txq_stats(&tidstats->txq_stats,
-					 to_txq_info(sta->sta.txq[tid]));
+		ieee80211_fill_txq_stats(&tidstats->txq_stats, txqi);
 
 		rcu_read_unlock();
-		spin_unlock_bh(&local->fq.lock);
+		fq_tin_unlock_bh(&local->fq, &txqi->tin);
 	}
 }
 
@@ -2598,6 +2635,120 @@ static inline u64 sta_get_stats_bytes(struct ieee80211_sta_rx_stats *rxstats)
 	return value;
 }
 
+void sta_fold_rx_stats(struct link_sta_info *link_sta,
+		       struct ieee80211_sta_rx_counters *sum)
+{
+	int cpu, tid;
+
+	memset(sum, 0, sizeof(*sum));
+
+	sum->packets = link_sta->rx_stats.packets;
+	sum->bytes = sta_get_stats_bytes(&link_sta->rx_stats);
+	sum->dropped = link_sta->rx_stats.dropped;
+	for (tid = 0; tid < ARRAY_SIZE(sum->msdu); tid++)
+		sum->msdu[tid] = sta_get_tidstats_msdu(&link_sta->rx_stats, tid);
+
+	if (!link_sta->pcpu_rx_stats)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct ieee80211_sta_rx_stats *cpurxs;
+
+		cpurxs = per_cpu_ptr(link_sta->pcpu_rx_stats, cpu);
+		sum->packets += cpurxs->packets;
+		sum->bytes += sta_get_stats_bytes(cpurxs);
+		sum->dropped += cpurxs->dropped;
+		for (tid = 0; tid < ARRAY_SIZE(sum->msdu); tid++)
+			sum->msdu[tid] += sta_get_tidstats_msdu(cpurxs, tid);
+	}
+}
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(sta_fold_rx_stats);
+
+void sta_fold_tx_stats(struct link_sta_info *link_sta,
+		       struct ieee80211_sta_tx_counters *sum)
+{
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for_each_possible_cpu(cpu) {
+		struct ieee80211_sta_tx_counters *cputxs, snap;
+		unsigned int start;
+
+		cputxs = per_cpu_ptr(link_sta->pcpu_tx_stats, cpu);
+		do {
+			start = u64_stats_fetch_begin(&cputxs->syncp);
+			memcpy(&snap, cputxs, sizeof(snap));
+		} while (u64_stats_fetch_retry(&cputxs->syncp, start));
+
+		for (i = 0; i < IEEE80211_NUM_ACS; i++) {
+			sum->packets[i] += snap.packets[i];
+			sum->bytes[i] += snap.bytes[i];
+		}
+
+		for (i = 0; i < IEEE80211_NUM_TIDS + 1; i++) {
+			sum->msdu[i] += snap.msdu[i];
+			sum->msdu_retries[i] += snap.msdu_retries[i];
+			sum->msdu_failed[i] += snap.msdu_failed[i];
+		}
+
+		sum->filtered += snap.filtered;
+		sum->retry_failed += snap.retry_failed;
+		sum->retry_count += snap.retry_count;
+	}
+}
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(sta_fold_tx_stats);
+
+u64 sta_get_tx_filtered(struct link_sta_info *link_sta)
+{
+	u64 filtered = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct ieee80211_sta_tx_counters *cputxs;
+		unsigned int start;
+		u64 value;
+
+		cputxs = per_cpu_ptr(link_sta->pcpu_tx_stats, cpu);
+		do {
+			start = u64_stats_fetch_begin(&cputxs->syncp);
+			value = cputxs->filtered;
+		} while (u64_stats_fetch_retry(&cputxs->syncp, start));
+
+		filtered += value;
+	}
+
+	return filtered;
+}
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(sta_get_tx_filtered);
+
+/*
+ * The histograms are only ever incremented by a single this_cpu_inc(), so
+ * unlike the TX counters they need no u64_stats_sync to be read.
+ */
+void sta_fold_tx_latency(struct sta_info *sta,
+			 struct cfg80211_tx_latency *sum)
+{
+	int cpu, ac, bin;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for_each_possible_cpu(cpu) {
+		struct cfg80211_tx_latency *cpulat;
+
+		cpulat = per_cpu_ptr(sta->tx_latency, cpu);
+		for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+			for (bin = 0; bin < NL80211_TX_LATENCY_BINS; bin++) {
+				sum->queue[ac][bin] +=
+					READ_ONCE(cpulat->queue[ac][bin]);
+				sum->driver[ac][bin] +=
+					READ_ONCE(cpulat->driver[ac][bin]);
+			}
+		}
+	}
+}
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(sta_fold_tx_latency);
+
 #ifdef CPTCFG_MAC80211_MESH
 static void sta_set_mesh_sinfo(struct sta_info *sta,
 			       struct station_info *sinfo)
@@ -2637,10 +2788,14 @@ void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo,
 	struct ieee80211_sub_if_data *sdata = sta->sdata;
 	struct ieee80211_local *local = sdata->local;
 	u32 thr = 0;
-	int i, ac, cpu;
+	int i, ac;
 	struct ieee80211_sta_rx_stats *last_rxstats;
+	struct ieee80211_sta_rx_counters rxc;
+	struct ieee80211_sta_tx_counters txc;
 
 	last_rxstats = sta_get_last_rx_stats(sta);
+	sta_fold_rx_stats(&sta->deflink, &rxc);
+	sta_fold_tx_stats(&sta->deflink, &txc);
 
 	sinfo->generation = sdata->local->sta_generation;
 
@@ -2674,55 +2829,35 @@ void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo,
 			       BIT_ULL(NL80211_STA_INFO_TX_BYTES)))) {
 		sinfo->tx_bytes = 0;
 		for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
-			sinfo->tx_bytes += sta->deflink.tx_stats.bytes[ac];
+			sinfo->tx_bytes += txc.bytes[ac];
 		sinfo->filled |= BIT_ULL(NL80211_STA_INFO_TX_BYTES64);
 	}
 
 	if (!(sinfo->filled & BIT_ULL(NL80211_STA_INFO_TX_PACKETS))) {
 		sinfo->tx_packets = 0;
 		for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
-			sinfo->tx_packets += sta->deflink.tx_stats.packets[ac];
+			sinfo->tx_packets += txc.packets[ac];
 		sinfo->filled |= BIT_ULL(NL80211_STA_INFO_TX_PACKETS);
 	}
 
 	if (!(sinfo->filled & (BIT_ULL(NL80211_STA_INFO_RX_BYTES64) |
 			       BIT_ULL(NL80211_STA_INFO_RX_BYTES)))) {
-		sinfo->rx_bytes += sta_get_stats_bytes(&sta->deflink.rx_stats);
-
-		if (sta->deflink.pcpu_rx_stats) {
-			for_each_possible_cpu(cpu) {
-				struct ieee80211_sta_rx_stats *cpurxs;
-
-				cpurxs = per_cpu_ptr(sta->deflink.pcpu_rx_stats,
-						     cpu);
-				sinfo->rx_bytes += sta_get_stats_bytes(cpurxs);
-			}
-		}
-
+		sinfo->rx_bytes += rxc.bytes;
 		sinfo->filled |= BIT_ULL(NL80211_STA_INFO_RX_BYTES64);
 	}
 
 	if (!(sinfo->filled & BIT_ULL(NL80211_STA_INFO_RX_PACKETS))) {
-		sinfo->rx_packets = sta->deflink.rx_stats.packets;
-		if (sta->deflink.pcpu_rx_stats) {
-			for_each_possible_cpu(cpu) {
-				struct ieee80211_sta_rx_stats *cpurxs;
-
-				cpurxs = per_cpu_ptr(sta->deflink.pcpu_rx_stats,
-						     cpu);
-				sinfo->rx_packets += cpurxs->packets;
-			}
-		}
+		sinfo->rx_packets = rxc.packets;
 		sinfo->filled |= BIT_ULL(NL80211_STA_INFO_RX_PACKETS);
 	}
 
 	if (!(sinfo->filled & BIT_ULL(NL80211_STA_INFO_TX_RETRIES))) {
-		sinfo->tx_retries = sta->deflink.status_stats.retry_count;
+		sinfo->tx_retries = txc.retry_count;
 		sinfo->filled |= BIT_ULL(NL80211_STA_INFO_TX_RETRIES);
 	}
 
 	if (!(sinfo->filled & BIT_ULL(NL80211_STA_INFO_TX_FAILED))) {
-		sinfo->tx_failed = sta->deflink.status_stats.retry_failed;
+		sinfo->tx_failed = txc.retry_failed;
 		sinfo->filled |= BIT_ULL(NL80211_STA_INFO_TX_FAILED);
 	}
 
@@ -2743,15 +2878,7 @@ void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo,
 		sinfo->filled |= BIT_ULL(NL80211_STA_INFO_AIRTIME_WEIGHT);
 	}
 
-	sinfo->rx_dropped_misc = sta->deflink.rx_stats.dropped;
-	if (sta->deflink.pcpu_rx_stats) {
-		for_each_possible_cpu(cpu) {
-			struct ieee80211_sta_rx_stats *cpurxs;
-
-			cpurxs = per_cpu_ptr(sta->deflink.pcpu_rx_stats, cpu);
-			sinfo->rx_dropped_misc += cpurxs->dropped;
-		}
-	}
+	sinfo->rx_dropped_misc = rxc.dropped;
 
 	if (sdata->vif.type == NL80211_IFTYPE_STATION &&
 	    !(sdata->vif.driver_flags & IEEE80211_VIF_BEACON_FILTER)) {
@@ -2812,9 +2939,16 @@ void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo,
 
 	if (tidstats && !cfg80211_sinfo_alloc_tid_stats(sinfo, GFP_KERNEL)) {
 		for (i = 0; i < IEEE80211_NUM_TIDS + 1; i++)
-			sta_set_tidstats(sta, &sinfo->pertid[i], i);
+			sta_set_tidstats(sta, &sinfo->pertid[i], i,
+					 &rxc, &txc);
 	}
 
+	if (tidstats && !cfg80211_sinfo_alloc_tx_latency(sinfo, GFP_KERNEL))
+		sta_fold_tx_latency(sta, sinfo->tx_latency);
+
+	if (tidstats && sinfo->rc_stats_req)
+		rate_control_get_rate_stats(sta, sinfo);
+
 #ifdef CPTCFG_MAC80211_MESH
 	if (ieee80211_vif_is_mesh(&sdata->vif))
 		sta_set_mesh_sinfo(sta, sinfo);
@@ -140,6 +140,7 @@ struct airtime_info {
 	u64 tx_airtime;
 	unsigned long last_active;
 	s32 deficit;
+	u64 credit_round; /* scheduler round @deficit was last credited for */
 	atomic_t aql_tx_pending; /* Estimated airtime for frames pending */
 	u32 aql_limit_low;
 	u32 aql_limit_high;
@@ -148,6 +149,7 @@ struct airtime_info {
 void ieee80211_sta_update_pending_airtime(struct ieee80211_local *local,
 					  struct sta_info *sta, u8 ac,
 					  u16 tx_airtime, bool tx_completed);
+void ieee80211_sta_sync_airtime(struct sta_info *sta, u8 ac);
 
 struct sta_info;
 
@@ -202,14 +204,30 @@ struct tid_ampdu_tx {
 	u8 tid;
 };
 
+/**
+ * struct ieee80211_reorder_slot - RX reorder ring slot
+ *
+ * @head: first frame stored in this slot; an MPDU may be an A-MSDU with
+ *	individually reported subframes, which are chained through skb->next
+ * @tail: last frame stored in this slot
+ * @time: jiffies when the MPDU was completely stored
+ */
+struct ieee80211_reorder_slot {
+	struct sk_buff *head, *tail;
+	unsigned long time;
+};
+
 /**
  * struct tid_ampdu_rx - TID aggregation information (Rx).
  *
- * @reorder_buf: buffer to reorder incoming aggregated MPDUs. An MPDU may be an
- *	A-MSDU with individually reported subframes.
+ * @reorder_buf: ring buffer to reorder incoming aggregated MPDUs, indexed by
+ *	the sequence number modulo @buf_size
+ * @reorder_stored: bitmap of the @reorder_buf slots that hold any frames
+ * @reorder_ready: bitmap of the @reorder_buf slots that hold a complete MPDU
+ *	that can be released; together with @reorder_stored this lets the
+ *	release paths skip over empty slots a word at a time
  * @reorder_buf_filtered: bitmap indicating where there are filtered frames in
  *	the reorder buffer that should be ignored when releasing frames
- * @reorder_time: jiffies when skb was added
  * @session_timer: check if peer keeps Tx-ing on the TID (by timeout value)
  * @reorder_timer: releases expired frames from the reorder buffer.
  * @sta: station we are attached to
@@ -239,8 +257,9 @@ struct tid_ampdu_rx {
 	struct rcu_head rcu_head;
 	spinlock_t reorder_lock;
 	u64 reorder_buf_filtered;
-	struct sk_buff_head *reorder_buf;
-	unsigned long *reorder_time;
+	struct ieee80211_reorder_slot *reorder_buf;
+	unsigned long *reorder_stored;
+	unsigned long *reorder_ready;
 	struct sta_info *sta;
 	struct timer_list session_timer;
 	struct timer_list reorder_timer;
@@ -388,6 +407,7 @@ DECLARE_EWMA(mesh_tx_rate_avg, 8, 16)
  * @connected_to_as: true if mesh STA has a path to a authentication server
  * @fail_avg: moving percentage of failed MSDUs
  * @tx_rate_avg: moving average of tx bitrate
+ * @mpaths: mesh paths using this STA as their next hop
  */
 struct mesh_sta {
 	struct timer_list plink_timer;
@@ -419,6 +439,8 @@ struct mesh_sta {
 	struct ewma_mesh_fail_avg fail_avg;
 	/* moving average of tx bitrate */
 	struct ewma_mesh_tx_rate_avg tx_rate_avg;
+
+	struct hlist_head mpaths;
 };
 
 DECLARE_EWMA(signal, 10, 8)
@@ -438,6 +460,31 @@ struct ieee80211_sta_rx_stats {
 	u64 msdu[IEEE80211_NUM_TIDS + 1];
 };
 
+/*
+ * TX and TX status counters. These are updated from every TX and TX status
+ * context that touches the station, so they are kept per CPU and only summed
+ * up by sta_fold_tx_stats() when they're read.
+ */
+struct ieee80211_sta_tx_counters {
+	struct u64_stats_sync syncp;
+	u64 packets[IEEE80211_NUM_ACS];
+	u64 bytes[IEEE80211_NUM_ACS];
+	u64 msdu[IEEE80211_NUM_TIDS + 1];
+	u64 filtered;
+	u64 retry_failed;
+	u64 retry_count;
+	u64 msdu_retries[IEEE80211_NUM_TIDS + 1];
+	u64 msdu_failed[IEEE80211_NUM_TIDS + 1];
+};
+
+/* RX counters summed up over the shared and per-CPU RX statistics */
+struct ieee80211_sta_rx_counters {
+	u64 packets;
+	u64 bytes;
+	u64 dropped;
+	u64 msdu[IEEE80211_NUM_TIDS + 1];
+};
+
 /*
  * IEEE 802.11-2016 (10.6 "Defragmentation") recommends support for "concurrent
  * reception of at least one MSDU per access category per associated STA"
@@ -488,24 +535,18 @@ struct ieee80211_fragment_cache {
  * @sta: Points to the STA info
  * @gtk: group keys negotiated with this station, if any
  * @tx_stats: TX statistics
- * @tx_stats.packets: # of packets transmitted
- * @tx_stats.bytes: # of bytes in all packets transmitted
  * @tx_stats.last_rate: last TX rate
- * @tx_stats.msdu: # of transmitted MSDUs per TID
+ * @tx_stats.last_rate_info: last TX rate, as reported by the driver
  * @rx_stats: RX statistics
  * @rx_stats_avg: averaged RX statistics
  * @rx_stats_avg.signal: averaged signal
  * @rx_stats_avg.chain_signal: averaged per-chain signal
  * @pcpu_rx_stats: per-CPU RX statistics, assigned only if the driver needs
  *	this (by advertising the USES_RSS hw flag)
+ * @pcpu_tx_stats: per-CPU TX and TX status counters
  * @status_stats: TX status statistics
- * @status_stats.filtered: # of filtered frames
- * @status_stats.retry_failed: # of frames that failed after retry
- * @status_stats.retry_count: # of retries attempted
  * @status_stats.lost_packets: # of lost packets
  * @status_stats.last_pkt_time: timestamp of last ACKed packet
- * @status_stats.msdu_retries: # of MSDU retries
- * @status_stats.msdu_failed: # of failed MSDUs
  * @status_stats.last_ack: last ack timestamp (jiffies)
  * @status_stats.last_ack_signal: last ACK signal
  * @status_stats.ack_signal_filled: last ACK signal validity
@@ -533,6 +574,7 @@ struct link_sta_info {
 					NUM_DEFAULT_MGMT_KEYS +
 					NUM_DEFAULT_BEACON_KEYS];
 	struct ieee80211_sta_rx_stats __percpu *pcpu_rx_stats;
+	struct ieee80211_sta_tx_counters __percpu *pcpu_tx_stats;
 
 	/* Updated from RX path only, no locking requirements */
 	struct ieee80211_sta_rx_stats rx_stats;
@@ -543,12 +585,8 @@ struct link_sta_info {
 
 	/* Updated from TX status path only, no locking requirements */
 	struct {
-		unsigned long filtered;
-		unsigned long retry_failed, retry_count;
 		unsigned int lost_packets;
 		unsigned long last_pkt_time;
-		u64 msdu_retries[IEEE80211_NUM_TIDS + 1];
-		u64 msdu_failed[IEEE80211_NUM_TIDS + 1];
 		unsigned long last_ack;
 		s8 last_ack_signal;
 		bool ack_signal_filled;
@@ -557,11 +595,8 @@ struct link_sta_info {
 
 	/* Updated from TX path only, no locking requirements */
 	struct {
-		u64 packets[IEEE80211_NUM_ACS];
-		u64 bytes[IEEE80211_NUM_ACS];
 		struct ieee80211_tx_rate last_rate;
 		struct rate_info last_rate_info;
-		u64 msdu[IEEE80211_NUM_TIDS + 1];
 	} tx_stats;
 
 	enum ieee80211_sta_rx_bandwidth cur_max_bandwidth;
@@ -613,10 +648,12 @@ struct link_sta_info {
  * @last_connected: time (in seconds) when a station got connected
  * @last_seq_ctrl: last received seq/frag number from this STA (per TID
  *	plus one for non-QoS frames)
- * @tid_seq: per-TID sequence numbers for sending to this STA
+ * @tid_seq: per-TID sequence numbers for sending to this STA, allocated
+ *	atomically with ieee80211_tx_next_seq()
  * @airtime: per-AC struct airtime_info describing airtime statistics for this
  *	station
  * @airtime_weight: station weight for airtime fairness calculation purposes
+ * @tx_latency: per-CPU TX latency histograms, see sta_tx_latency_bin()
  * @ampdu_mlme: A-MPDU state machine state
  * @mesh: mesh STA information
  * @debugfs_dir: debug filesystem directory dentry
@@ -703,11 +740,13 @@ struct sta_info {
 	/* Plus 1 for non-QoS frames */
 	__le16 last_seq_ctrl[IEEE80211_NUM_TIDS + 1];
 
-	u16 tid_seq[IEEE80211_QOS_CTL_TID_MASK + 1];
+	atomic_t tid_seq[IEEE80211_QOS_CTL_TID_MASK + 1];
 
 	struct airtime_info airtime[IEEE80211_NUM_ACS];
 	u16 airtime_weight;
 
+	struct cfg80211_tx_latency __percpu *tx_latency;
+
 	/*
 	 * Aggregation information, locked with lock.
 	 */
@@ -932,6 +971,42 @@ void sta_set_rate_info_tx(struct sta_info *sta,
 			  struct rate_info *rinfo);
 void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo,
 		   bool tidstats);
+void sta_fold_rx_stats(struct link_sta_info *link_sta,
+		       struct ieee80211_sta_rx_counters *sum);
+void sta_fold_tx_stats(struct link_sta_info *link_sta,
+		       struct ieee80211_sta_tx_counters *sum);
+u64 sta_get_tx_filtered(struct link_sta_info *link_sta);
+
+/*
+ * Update the calling CPU's TX counters of @link_sta; must be called with
+ * BHs disabled, like the TX and TX status paths are.
+ */
+static inline struct ieee80211_sta_tx_counters *
+sta_tx_stats_begin(struct link_sta_info *link_sta)
+{
+	struct ieee80211_sta_tx_counters *stats;
+
+	stats = this_cpu_ptr(link_sta->pcpu_tx_stats);
+	u64_stats_update_begin(&stats->syncp);
+
+	return stats;
+}
+
+static inline void sta_tx_stats_end(struct ieee80211_sta_tx_counters *stats)
+{
+	u64_stats_update_end(&stats->syncp);
+}
+
+void sta_fold_tx_latency(struct sta_info *sta,
+			 struct cfg80211_tx_latency *sum);
+
+/* TX latency histogram bin for a delay of @nsec, see &enum nl80211_tx_latency */
+static inline unsigned int sta_tx_latency_bin(u64 nsec)
+{
+	u32 usec = min_t(u64, div_u64(nsec, NSEC_PER_USEC), U32_MAX);
+
+	return min_t(unsigned int, fls(usec), NL80211_TX_LATENCY_BINS - 1);
+}
 
 u32 sta_get_expected_throughput(struct sta_info *sta);
 
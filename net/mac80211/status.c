@@ -47,6 +47,7 @@ static void ieee80211_handle_filtered_frame(struct ieee80211_local *local,
 {
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	struct ieee80211_hdr *hdr = (void *)skb->data;
+	struct ieee80211_sta_tx_counters *txstats;
 	int ac;
 
 	if (info->flags & (IEEE80211_TX_CTL_NO_PS_BUFFER |
@@ -72,7 +73,9 @@ static void ieee80211_handle_filtered_frame(struct ieee80211_local *local,
 	info->flags |= IEEE80211_TX_INTFL_RETRANSMISSION;
 	info->flags &= ~IEEE80211_TX_TEMPORARY_FLAGS;
 
-	sta->deflink.status_stats.filtered++;
+	txstats = sta_tx_stats_begin(&sta->deflink);
+	txstats->filtered++;
+	sta_tx_stats_end(txstats);
 
 	/*
 	 * Clear more-data bit on filtered frames, it might be set
@@ -1030,11 +1033,14 @@ static void __ieee80211_tx_status(struct ieee80211_hw *hw,
 			ieee80211_handle_filtered_frame(local, sta, skb);
 			return;
 		} else if (ieee80211_is_data_present(fc)) {
+			struct ieee80211_sta_tx_counters *txstats;
+
+			txstats = sta_tx_stats_begin(&sta->deflink);
 			if (!acked && !noack_success)
-				sta->deflink.status_stats.msdu_failed[tid]++;
+				txstats->msdu_failed[tid]++;
 
-			sta->deflink.status_stats.msdu_retries[tid] +=
-				retry_count;
+			txstats->msdu_retries[tid] += retry_count;
+			sta_tx_stats_end(txstats);
 		}
 
 		if (!(info->flags & IEEE80211_TX_CTL_INJECTED) && acked)
@@ -1112,6 +1118,27 @@ void ieee80211_tx_status_skb(struct ieee80211_hw *hw, struct sk_buff *skb)
 }
 EXPORT_SYMBOL(ieee80211_tx_status_skb);
 
+/*
+ * Account the time since ieee80211_tx_dequeue() handed @skb to the driver,
+ * and clear the dequeue time again so it isn't mistaken for an RX timestamp
+ * if the frame is reported to monitor interfaces.
+ */
+static void ieee80211_tx_latency_status(struct sta_info *sta,
+					struct sk_buff *skb)
+{
+	u8 ac = skb_get_queue_mapping(skb);
+	unsigned int bin;
+
+	if (sta) {
+		bin = sta_tx_latency_bin(ktime_get_ns() -
+					 ktime_to_ns(skb->tstamp));
+		this_cpu_inc(sta->tx_latency->driver[ac][bin]);
+	}
+
+	skb->tstamp = 0;
+	IEEE80211_SKB_CB(skb)->tx_latency = 0;
+}
+
 void ieee80211_tx_status_ext(struct ieee80211_hw *hw,
 			     struct ieee80211_tx_status *status)
 {
@@ -1144,6 +1171,9 @@ void ieee80211_tx_status_ext(struct ieee80211_hw *hw,
 		ieee80211_info_set_tx_time_est(IEEE80211_SKB_CB(skb), 0);
 	}
 
+	if (skb && IEEE80211_SKB_CB(skb)->tx_latency)
+		ieee80211_tx_latency_status(sta, skb);
+
 	if (!status->info)
 		goto free;
 
@@ -1156,10 +1186,13 @@ void ieee80211_tx_status_ext(struct ieee80211_hw *hw,
 
 	if (pubsta) {
 		struct ieee80211_sub_if_data *sdata = sta->sdata;
+		struct ieee80211_sta_tx_counters *txstats;
 
+		txstats = sta_tx_stats_begin(&sta->deflink);
 		if (!acked && !noack_success)
-			sta->deflink.status_stats.retry_failed++;
-		sta->deflink.status_stats.retry_count += retry_count;
+			txstats->retry_failed++;
+		txstats->retry_count += retry_count;
+		sta_tx_stats_end(txstats);
 
 		if (ieee80211_hw_check(&local->hw, REPORTS_TX_ACK_STATUS)) {
 			if (sdata->vif.type == NL80211_IFTYPE_STATION &&
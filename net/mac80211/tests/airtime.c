@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the frame airtime calculation
+ */
+#include <kunit/test.h>
+#include "../ieee80211_i.h"
+
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+
+#define AIRTIME_TEST_MAX_BITRATE	600
+
+static const int airtime_test_lens[] = {
+	0, 1, 14, 100, 1024, 1500, 2304, 3839, 7935, 11454, 65535,
+};
+
+/* longest frames for which the legacy reciprocals are used */
+static const int airtime_test_legacy_lens[] = {
+	(1 << 30) / 80 - 1, (1 << 30) / 80, (1 << 30) / 80 + 1,
+};
+
+/*
+ * Data bits per symbol of a single stream, as in the tables in airtime.c.
+ * The last column is the rate used to calculate the shift of the group.
+ */
+static const u16 airtime_test_ht_bps[2][9] = {
+	{ 26, 52, 78, 104, 156, 208, 234, 260, 26 },
+	{ 54, 108, 162, 216, 324, 432, 486, 540, 54 },
+};
+
+static const u16 airtime_test_vht_bps[4][11] = {
+	{ 26, 52, 78, 104, 156, 208, 234, 260, 312, 346, 26 },
+	{ 54, 108, 162, 216, 324, 432, 486, 540, 648, 720, 54 },
+	{ 117, 234, 351, 468, 702, 936, 1053, 1170, 1404, 1560, 117 },
+	/* the shift is calculated with 243, not 234 */
+	{ 234, 468, 702, 936, 1404, 1872, 2106, 2340, 2808, 3120, 243 },
+};
+
+static const u16 airtime_test_he_bps[4][13] = {
+	{ 115, 230, 345, 475, 705, 936, 1051, 1166, 1411, 1555, 1756, 1944,
+	  115 },
+	{ 230, 475, 705, 936, 1411, 1872, 2102, 2347, 2808, 3124, 3513, 3902,
+	  230 },
+	{ 489, 979, 1468, 1958, 2937, 3916, 4406, 4896, 5875, 6523, 7344, 8164,
+	  489 },
+	{ 979, 1958, 2937, 3916, 5875, 7833, 8827, 9806, 11764, 13060, 14702,
+	  16329, 979 },
+};
+
+static const u16 airtime_test_eht_bps[5][15] = {
+	{ 117, 234, 351, 468, 702, 936, 1053, 1170, 1404, 1560, 1755, 1950,
+	  2106, 2340, 117 },
+	{ 234, 468, 702, 936, 1404, 1872, 2106, 2340, 2808, 3120, 3510, 3900,
+	  4212, 4680, 234 },
+	{ 490, 980, 1470, 1960, 2940, 3920, 4410, 4900, 5880, 6533, 7350, 8166,
+	  8820, 9800, 490 },
+	{ 980, 1960, 2937, 3920, 5880, 7840, 8820, 9800, 11760, 13066, 14700,
+	  16333, 17640, 19600, 980 },
+	{ 1960, 3920, 5880, 7840, 11760, 15680, 17640, 19600, 23520, 26133,
+	  29400, 32666, 35280, 39200, 1960 },
+};
+
+static const enum rate_info_bw airtime_test_bws[] = {
+	RATE_INFO_BW_20, RATE_INFO_BW_40, RATE_INFO_BW_80, RATE_INFO_BW_160,
+	RATE_INFO_BW_320,
+};
+
+struct airtime_test_rate {
+	enum mac80211_rx_encoding encoding;
+	int bw, nss, mcs, gi;
+};
+
+/*
+ * Duration (in 1/1024 usec) of the data part of a 1024 byte frame at @bps
+ * data bits per symbol, with the 3.6/4 usec HT/VHT or the 13.6/14.4/16 usec
+ * HE/EHT symbols.
+ */
+static u32 airtime_test_symbols(const struct airtime_test_rate *r, u32 bps)
+{
+	u32 ksyms = DIV_ROUND_UP((1024 * 8) << 10, r->nss * bps);
+
+	switch (r->encoding) {
+	case RX_ENC_HT:
+	case RX_ENC_VHT:
+		return r->gi ? ksyms * 4 * 18 / 20 : ksyms * 4;
+	default:
+		if (r->gi == 0)
+			return ksyms * 16 * 17 / 20;
+		if (r->gi == 1)
+			return ksyms * 16 * 18 / 20;
+		return ksyms * 16;
+	}
+}
+
+/* the airtime of a frame as calculated before the tables were added */
+static u32 airtime_test_ref(const struct airtime_test_rate *r, int len)
+{
+	const u16 *bps;
+	u32 duration;
+	int n_rates, shift;
+
+	switch (r->encoding) {
+	case RX_ENC_HT:
+		bps = airtime_test_ht_bps[r->bw];
+		n_rates = 8;
+		break;
+	case RX_ENC_VHT:
+		bps = airtime_test_vht_bps[r->bw];
+		n_rates = 10;
+		break;
+	case RX_ENC_HE:
+		bps = airtime_test_he_bps[r->bw];
+		n_rates = 12;
+		break;
+	default:
+		bps = airtime_test_eht_bps[r->bw];
+		n_rates = 14;
+		break;
+	}
+
+	/* the durations are stored shifted to fit into a u16 */
+	duration = airtime_test_symbols(r, bps[n_rates]);
+	shift = max(0, 16 - __builtin_clz(duration));
+	duration = (u16)(airtime_test_symbols(r, bps[r->mcs]) >> shift);
+	duration <<= shift;
+
+	duration *= len;
+	duration /= 1024;
+	duration /= 1024;
+
+	return duration + 36 + (r->nss << 2);
+}
+
+static u32 airtime_test_calc(struct ieee80211_hw *hw,
+			     const struct airtime_test_rate *r, int len)
+{
+	struct ieee80211_rx_status status = {
+		.band = NL80211_BAND_5GHZ,
+		.encoding = r->encoding,
+		.bw = airtime_test_bws[r->bw],
+		.nss = r->nss,
+		.rate_idx = r->mcs,
+	};
+
+	switch (r->encoding) {
+	case RX_ENC_HT:
+		status.rate_idx += (r->nss - 1) * 8;
+		fallthrough;
+	case RX_ENC_VHT:
+		if (r->gi)
+			status.enc_flags |= RX_ENC_FLAG_SHORT_GI;
+		break;
+	case RX_ENC_HE:
+		status.he_gi = r->gi;
+		break;
+	default:
+		status.eht.gi = r->gi;
+		break;
+	}
+
+	return ieee80211_calc_rx_airtime(hw, &status, len);
+}
+
+/* call @fn for every valid HT, VHT, HE and EHT rate */
+static void
+airtime_test_for_each_rate(struct kunit *test,
+			   void (*fn)(struct kunit *test,
+				      const struct airtime_test_rate *r))
+{
+	struct airtime_test_rate r;
+
+	r.encoding = RX_ENC_HT;
+	for (r.bw = 0; r.bw < 2; r.bw++)
+		for (r.nss = 1; r.nss <= 4; r.nss++)
+			for (r.gi = 0; r.gi < 2; r.gi++)
+				for (r.mcs = 0; r.mcs < 8; r.mcs++)
+					fn(test, &r);
+
+	r.encoding = RX_ENC_VHT;
+	for (r.bw = 0; r.bw < 4; r.bw++)
+		for (r.nss = 1; r.nss <= 4; r.nss++)
+			for (r.gi = 0; r.gi < 2; r.gi++)
+				for (r.mcs = 0; r.mcs < 10; r.mcs++)
+					fn(test, &r);
+
+	r.encoding = RX_ENC_HE;
+	for (r.bw = 0; r.bw < 4; r.bw++)
+		for (r.nss = 1; r.nss <= 8; r.nss++)
+			for (r.gi = 0; r.gi < 3; r.gi++)
+				for (r.mcs = 0; r.mcs < 12; r.mcs++)
+					fn(test, &r);
+
+	r.encoding = RX_ENC_EHT;
+	for (r.bw = 0; r.bw < 5; r.bw++)
+		for (r.nss = 1; r.nss <= 8; r.nss++)
+			for (r.gi = 0; r.gi < 3; r.gi++)
+				for (r.mcs = 0; r.mcs < 14; r.mcs++)
+					fn(test, &r);
+}
+
+static void airtime_test_check_rate(struct kunit *test,
+				    const struct airtime_test_rate *r)
+{
+	struct ieee80211_hw *hw = test->priv;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(airtime_test_lens); i++)
+		KUNIT_EXPECT_EQ_MSG(test,
+				    airtime_test_calc(hw, r,
+						      airtime_test_lens[i]),
+				    airtime_test_ref(r, airtime_test_lens[i]),
+				    "enc %d bw %d nss %d mcs %d gi %d len %d",
+				    r->encoding, r->bw, r->nss, r->mcs, r->gi,
+				    airtime_test_lens[i]);
+}
+
+static int airtime_test_init(struct kunit *test)
+{
+	struct ieee80211_hw *hw;
+
+	hw = kunit_kzalloc(test, sizeof(*hw), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, hw);
+	test->priv = hw;
+
+	return 0;
+}
+
+static void airtime_mcs(struct kunit *test)
+{
+	airtime_test_for_each_rate(test, airtime_test_check_rate);
+}
+
+static u32 airtime_test_legacy_ref(u16 bitrate, bool short_pre, bool cck,
+				   int len)
+{
+	u32 duration;
+
+	if (cck)
+		duration = (short_pre ? (144 + 48) / 2 : 144 + 48) + 10;
+	else
+		duration = 20 + 16;
+
+	return duration + (len * 8 * 10) / bitrate;
+}
+
+static void airtime_test_check_legacy(struct kunit *test, u16 bitrate,
+				      int len)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		bool short_pre = i & 1, cck = i & 2;
+
+		KUNIT_EXPECT_EQ_MSG(test,
+				    ieee80211_calc_legacy_rate_duration(bitrate,
+									short_pre,
+									cck,
+									len),
+				    airtime_test_legacy_ref(bitrate, short_pre,
+							    cck, len),
+				    "bitrate %u len %d short_pre %d cck %d",
+				    bitrate, len, short_pre, cck);
+	}
+}
+
+static void airtime_legacy(struct kunit *test)
+{
+	u16 bitrate;
+	int i;
+
+	for (bitrate = 1; bitrate <= AIRTIME_TEST_MAX_BITRATE; bitrate++) {
+		for (i = 0; i < ARRAY_SIZE(airtime_test_lens); i++)
+			airtime_test_check_legacy(test, bitrate,
+						  airtime_test_lens[i]);
+		for (i = 0; i < ARRAY_SIZE(airtime_test_legacy_lens); i++)
+			airtime_test_check_legacy(test, bitrate,
+						  airtime_test_legacy_lens[i]);
+	}
+}
+
+static struct kunit_case airtime_test_cases[] = {
+	KUNIT_CASE(airtime_mcs),
+	KUNIT_CASE(airtime_legacy),
+	{}
+};
+
+static struct kunit_suite airtime = {
+	.name = "mac80211-airtime",
+	.init = airtime_test_init,
+	.test_cases = airtime_test_cases,
+};
+
+kunit_test_suite(airtime);
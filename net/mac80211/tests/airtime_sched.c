@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the airtime fairness TXQ scheduler
+ */
+#include <kunit/test.h>
+#include "../ieee80211_i.h"
+#include "../sta_info.h"
+
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+
+#define AIRTIME_TEST_AC		IEEE80211_AC_BE
+#define AIRTIME_TEST_PKT_US	1000
+
+struct airtime_test_ctx {
+	struct ieee80211_local *local;
+	struct sta_info **sta;
+	struct txq_info **txqi;
+	unsigned int n_sta;
+};
+
+/* a minimal local and a set of stations with one active BE TXQ each */
+static struct airtime_test_ctx *airtime_test_init(struct kunit *test,
+						  unsigned int n_sta, bool aql)
+{
+	struct ieee80211_sub_if_data *sdata;
+	struct airtime_test_ctx *ctx;
+	struct ieee80211_local *local;
+	struct wiphy *wiphy;
+	unsigned int i;
+	int ac;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+	ctx->sta = kunit_kcalloc(test, n_sta, sizeof(*ctx->sta), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->sta);
+	ctx->txqi = kunit_kcalloc(test, n_sta, sizeof(*ctx->txqi), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->txqi);
+	ctx->n_sta = n_sta;
+
+	wiphy = kunit_kzalloc(test, sizeof(*wiphy), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, wiphy);
+	wiphy_ext_feature_set(wiphy, NL80211_EXT_FEATURE_AIRTIME_FAIRNESS);
+	if (aql)
+		wiphy_ext_feature_set(wiphy, NL80211_EXT_FEATURE_AQL);
+
+	local = kunit_kzalloc(test, sizeof(*local), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, local);
+	local->hw.wiphy = wiphy;
+	local->airtime_flags = AIRTIME_USE_TX;
+	local->aql_threshold = IEEE80211_AQL_THRESHOLD;
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+		local->aql_txq_limit_low[ac] = IEEE80211_DEFAULT_AQL_TXQ_LIMIT_L;
+		local->aql_txq_limit_high[ac] =
+			IEEE80211_DEFAULT_AQL_TXQ_LIMIT_H;
+	}
+	ieee80211_txq_sched_init(local);
+	ctx->local = local;
+
+	sdata = kunit_kzalloc(test, sizeof(*sdata), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, sdata);
+	sdata->local = local;
+
+	for (i = 0; i < n_sta; i++) {
+		struct sta_info *sta;
+		struct txq_info *txqi;
+
+		sta = kunit_kzalloc(test, sizeof(*sta), GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, sta);
+		sta->local = local;
+		sta->sdata = sdata;
+		sta->sta.aid = i;
+		sta->airtime_weight = IEEE80211_DEFAULT_AIRTIME_WEIGHT;
+		for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+			sta->airtime[ac].deficit = sta->airtime_weight;
+			sta->airtime[ac].aql_limit_low =
+				local->aql_txq_limit_low[ac];
+			sta->airtime[ac].aql_limit_high =
+				local->aql_txq_limit_high[ac];
+		}
+		ctx->sta[i] = sta;
+
+		txqi = kunit_kzalloc(test, sizeof(*txqi), GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, txqi);
+		INIT_LIST_HEAD(&txqi->schedule_order);
+		txqi->txq.sta = &sta->sta;
+		txqi->txq.tid = 0;
+		txqi->txq.ac = AIRTIME_TEST_AC;
+		ctx->txqi[i] = txqi;
+	}
+
+	return ctx;
+}
+
+static void airtime_test_activate(struct airtime_test_ctx *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->n_sta; i++)
+		__ieee80211_schedule_txq(&ctx->local->hw, &ctx->txqi[i]->txq,
+					 true);
+}
+
+/*
+ * Act like a driver that always has more to send: pull TXQs in scheduling
+ * rounds, charge each a fixed amount of airtime per packet and hand it
+ * back. Returns the number of packets sent.
+ */
+static u32 airtime_test_run(struct airtime_test_ctx *ctx, u32 packets)
+{
+	struct ieee80211_hw *hw = &ctx->local->hw;
+	u32 sent = 0;
+
+	while (sent < packets) {
+		struct ieee80211_txq *txq;
+		u32 round_sent = 0;
+
+		ieee80211_txq_schedule_start(hw, AIRTIME_TEST_AC);
+		while (sent < packets &&
+		       (txq = ieee80211_next_txq(hw, AIRTIME_TEST_AC))) {
+			ieee80211_sta_register_airtime(txq->sta, txq->tid,
+						       AIRTIME_TEST_PKT_US, 0);
+			ieee80211_return_txq(hw, txq, true);
+			round_sent++;
+		}
+		ieee80211_txq_schedule_end(hw, AIRTIME_TEST_AC);
+
+		if (!round_sent)
+			break;
+		sent += round_sent;
+	}
+
+	return sent;
+}
+
+static u64 airtime_test_tx_airtime(struct airtime_test_ctx *ctx,
+				   unsigned int i)
+{
+	return ctx->sta[i]->airtime[AIRTIME_TEST_AC].tx_airtime;
+}
+
+static void airtime_sched_weights(struct kunit *test)
+{
+	struct airtime_test_ctx *ctx = airtime_test_init(test, 64, false);
+	u64 light = 0, heavy = 0;
+	unsigned int i;
+
+	/* every other station gets twice the weight */
+	for (i = 1; i < ctx->n_sta; i += 2) {
+		ctx->sta[i]->airtime_weight *= 2;
+		ctx->sta[i]->airtime[AIRTIME_TEST_AC].deficit =
+			ctx->sta[i]->airtime_weight;
+	}
+	airtime_test_activate(ctx);
+
+	KUNIT_ASSERT_EQ(test, airtime_test_run(ctx, 30000), 30000);
+
+	for (i = 0; i < ctx->n_sta; i++) {
+		KUNIT_EXPECT_GT(test, airtime_test_tx_airtime(ctx, i), 0);
+		if (i & 1)
+			heavy += airtime_test_tx_airtime(ctx, i);
+		else
+			light += airtime_test_tx_airtime(ctx, i);
+	}
+
+	/* airtime is shared in proportion to the weights, within 5% */
+	KUNIT_EXPECT_GE(test, heavy * 100, light * 190);
+	KUNIT_EXPECT_LE(test, heavy * 100, light * 210);
+}
+
+static void airtime_sched_aql(struct kunit *test)
+{
+	struct airtime_test_ctx *ctx = airtime_test_init(test, 8, true);
+	unsigned int i;
+
+	/* the first station is over its AQL limit and must be skipped */
+	atomic_set(&ctx->sta[0]->airtime[AIRTIME_TEST_AC].aql_tx_pending,
+		   2 * IEEE80211_DEFAULT_AQL_TXQ_LIMIT_H);
+	airtime_test_activate(ctx);
+
+	KUNIT_ASSERT_EQ(test, airtime_test_run(ctx, 1000), 1000);
+
+	KUNIT_EXPECT_EQ(test, airtime_test_tx_airtime(ctx, 0), 0);
+	for (i = 1; i < ctx->n_sta; i++)
+		KUNIT_EXPECT_GT(test, airtime_test_tx_airtime(ctx, i), 0);
+
+	/* it stays scheduled and is picked again once below the limit */
+	KUNIT_EXPECT_FALSE(test, list_empty(&ctx->txqi[0]->schedule_order));
+	atomic_set(&ctx->sta[0]->airtime[AIRTIME_TEST_AC].aql_tx_pending, 0);
+
+	KUNIT_ASSERT_EQ(test, airtime_test_run(ctx, 1000), 1000);
+	KUNIT_EXPECT_GT(test, airtime_test_tx_airtime(ctx, 0), 0);
+}
+
+static void airtime_sched_may_transmit(struct kunit *test)
+{
+	struct airtime_test_ctx *ctx = airtime_test_init(test, 4, false);
+	struct ieee80211_txq_sched *sched =
+		&ctx->local->txq_sched[AIRTIME_TEST_AC];
+	struct ieee80211_hw *hw = &ctx->local->hw;
+	struct sta_info *sta = ctx->sta[0];
+	struct ieee80211_txq *txq = &ctx->txqi[0]->txq;
+	int i;
+
+	sta->airtime[AIRTIME_TEST_AC].deficit = 1 - 3 * sta->airtime_weight;
+	airtime_test_activate(ctx);
+	KUNIT_EXPECT_EQ(test, sched->num_txqs, ctx->n_sta);
+
+	/* each refusal credits the station with its weight */
+	for (i = 0; i < 3; i++)
+		KUNIT_EXPECT_FALSE(test, ieee80211_txq_may_transmit(hw, txq));
+	KUNIT_EXPECT_EQ(test, sched->num_txqs, ctx->n_sta);
+
+	KUNIT_EXPECT_TRUE(test, ieee80211_txq_may_transmit(hw, txq));
+	KUNIT_EXPECT_TRUE(test, list_empty(&ctx->txqi[0]->schedule_order));
+	KUNIT_EXPECT_EQ(test, sched->num_txqs, ctx->n_sta - 1);
+}
+
+/* with many stations busy, every one of them must get some airtime */
+static void airtime_sched_many_stations(struct kunit *test)
+{
+	struct airtime_test_ctx *ctx = airtime_test_init(test, 128, true);
+	u32 packets = 64 * ctx->n_sta;
+	unsigned int i;
+
+	airtime_test_activate(ctx);
+
+	KUNIT_ASSERT_EQ(test, airtime_test_run(ctx, packets), packets);
+
+	for (i = 0; i < ctx->n_sta; i++)
+		KUNIT_EXPECT_GT(test, airtime_test_tx_airtime(ctx, i), 0);
+}
+
+static struct kunit_case airtime_sched_test_cases[] = {
+	KUNIT_CASE(airtime_sched_weights),
+	KUNIT_CASE(airtime_sched_aql),
+	KUNIT_CASE(airtime_sched_may_transmit),
+	KUNIT_CASE(airtime_sched_many_stations),
+	{}
+};
+
+static struct kunit_suite airtime_sched = {
+	.name = "mac80211-airtime-sched",
+	.test_cases = airtime_sched_test_cases,
+};
+
+kunit_test_suite(airtime_sched);
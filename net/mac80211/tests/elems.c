@@ -89,8 +89,99 @@ free_skb:
 	kfree_skb(skb);
 }
 
+static const u8 cache_test_beacon[] = {
+	WLAN_EID_SSID, 4, 't', 'e', 's', 't',
+	WLAN_EID_DS_PARAMS, 1, 6,
+	/* DTIM count, DTIM period, bitmap control, partial virtual bitmap */
+	WLAN_EID_TIM, 4, 2, 3, 0, 0,
+	WLAN_EID_ERP_INFO, 1, 0,
+};
+
+#define CACHE_TEST_TIM_OFFS	9
+#define CACHE_TEST_ERP_OFFS	15
+
+static void elems_cache(struct kunit *test)
+{
+	struct ieee80211_elems_parse_params parse_params = {
+		.link_id = -1,
+		.from_ap = true,
+		.mode = IEEE80211_CONN_MODE_EHT,
+		.filter = 1ULL << WLAN_EID_ERP_INFO,
+		.crc = 0x12345678,
+	};
+	struct ieee80211_elems_cache cache = {};
+	struct ieee802_11_elems *first, *elems;
+	u8 *beacon;
+	bool hit;
+	u32 crc;
+
+	beacon = kunit_kmalloc(test, sizeof(cache_test_beacon) + 1,
+			       GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, beacon);
+	memcpy(beacon, cache_test_beacon, sizeof(cache_test_beacon));
+
+	parse_params.start = beacon;
+	parse_params.len = sizeof(cache_test_beacon);
+
+	first = ieee802_11_parse_elems_cached(&cache, &parse_params, &hit);
+	KUNIT_ASSERT_NOT_NULL(test, first);
+	KUNIT_EXPECT_FALSE(test, hit);
+	KUNIT_EXPECT_EQ(test, first->dtim_count, 2);
+	KUNIT_EXPECT_EQ(test, first->dtim_period, 3);
+	/* the cache parsed its own copy */
+	KUNIT_EXPECT_PTR_NE(test, first->ssid, beacon + 2);
+	crc = first->crc;
+
+	/* only the TIM contents changed */
+	beacon[CACHE_TEST_TIM_OFFS + 2] = 1;
+	beacon[CACHE_TEST_TIM_OFFS + 5] = 0x10;
+	elems = ieee802_11_parse_elems_cached(&cache, &parse_params, &hit);
+	KUNIT_EXPECT_TRUE(test, hit);
+	KUNIT_EXPECT_PTR_EQ(test, elems, first);
+	KUNIT_EXPECT_EQ(test, elems->crc, crc);
+	KUNIT_EXPECT_EQ(test, elems->dtim_count, 1);
+	KUNIT_EXPECT_EQ(test, elems->tim->virtual_map[0], 0x10);
+
+	/* a different filter gives a different CRC, so it can't be a hit */
+	parse_params.filter = 0;
+	elems = ieee802_11_parse_elems_cached(&cache, &parse_params, &hit);
+	KUNIT_ASSERT_NOT_NULL(test, elems);
+	KUNIT_EXPECT_FALSE(test, hit);
+	parse_params.filter = 1ULL << WLAN_EID_ERP_INFO;
+	elems = ieee802_11_parse_elems_cached(&cache, &parse_params, &hit);
+	KUNIT_ASSERT_NOT_NULL(test, elems);
+	KUNIT_EXPECT_FALSE(test, hit);
+	KUNIT_EXPECT_EQ(test, elems->crc, crc);
+
+	/* a changed element is parsed again */
+	beacon[CACHE_TEST_ERP_OFFS + 2] = WLAN_ERP_USE_PROTECTION;
+	elems = ieee802_11_parse_elems_cached(&cache, &parse_params, &hit);
+	KUNIT_ASSERT_NOT_NULL(test, elems);
+	KUNIT_EXPECT_FALSE(test, hit);
+	KUNIT_EXPECT_NE(test, elems->crc, crc);
+	KUNIT_EXPECT_EQ(test, elems->erp_info[0], WLAN_ERP_USE_PROTECTION);
+	KUNIT_EXPECT_EQ(test, elems->dtim_count, 1);
+
+	/* so is a TIM that changed its length */
+	memmove(beacon + CACHE_TEST_TIM_OFFS + 7,
+		beacon + CACHE_TEST_TIM_OFFS + 6,
+		sizeof(cache_test_beacon) - CACHE_TEST_TIM_OFFS - 6);
+	beacon[CACHE_TEST_TIM_OFFS + 1] = 5;
+	beacon[CACHE_TEST_TIM_OFFS + 6] = 0x01;
+	parse_params.len = sizeof(cache_test_beacon) + 1;
+	elems = ieee802_11_parse_elems_cached(&cache, &parse_params, &hit);
+	KUNIT_ASSERT_NOT_NULL(test, elems);
+	KUNIT_EXPECT_FALSE(test, hit);
+	KUNIT_EXPECT_EQ(test, elems->tim_len, 5);
+	KUNIT_EXPECT_EQ(test, elems->erp_info[0], WLAN_ERP_USE_PROTECTION);
+
+	ieee80211_elems_cache_flush(&cache);
+	KUNIT_EXPECT_NULL(test, cache.elems);
+}
+
 static struct kunit_case element_parsing_test_cases[] = {
 	KUNIT_CASE(mle_defrag),
+	KUNIT_CASE(elems_cache),
 	{}
 };
 
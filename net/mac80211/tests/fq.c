@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the sharded fq accounting
+ */
+#include <linux/skbuff.h>
+#include <net/fq_impl.h>
+#include <kunit/test.h>
+
+#define FQ_TEST_FLOWS	64
+#define FQ_TEST_SHARDS	2
+#define FQ_TEST_LEN	100
+
+static struct sk_buff *fq_test_dequeue(struct fq *fq, struct fq_tin *tin,
+				       struct fq_flow *flow)
+{
+	return fq_flow_dequeue(fq, flow);
+}
+
+static void fq_test_free(struct fq *fq, struct fq_tin *tin,
+			 struct fq_flow *flow, struct sk_buff *skb)
+{
+	kfree_skb(skb);
+}
+
+static struct sk_buff *fq_test_skb(struct kunit *test)
+{
+	struct sk_buff *skb;
+
+	skb = alloc_skb(FQ_TEST_LEN, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, skb);
+	skb_put_zero(skb, FQ_TEST_LEN);
+
+	return skb;
+}
+
+static void fq_test_expect_memory(struct kunit *test, struct fq *fq,
+				  u32 expected)
+{
+	KUNIT_EXPECT_EQ(test, fq_memory_usage(fq), expected);
+	KUNIT_EXPECT_EQ(test, percpu_counter_sum(&fq->memory_usage),
+			(s64)expected);
+}
+
+/*
+ * Aggregate a frame into one that's already queued the way A-MSDU
+ * aggregation does, and check that the per-shard and the per-CPU memory
+ * counters still agree, both while it's queued and after it's dequeued.
+ */
+static void fq_aggregate_truesize(struct kunit *test)
+{
+	struct sk_buff *head, *skb;
+	struct fq_tin *tin;
+	struct fq *fq;
+	int orig_truesize;
+
+	fq = kunit_kzalloc(test, sizeof(*fq), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, fq);
+	tin = kunit_kzalloc(test, sizeof(*tin), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, tin);
+
+	KUNIT_ASSERT_EQ(test, fq_init(fq, FQ_TEST_FLOWS, FQ_TEST_SHARDS), 0);
+	fq_tin_init(tin, FQ_TEST_SHARDS - 1);
+
+	head = fq_test_skb(test);
+	skb = fq_test_skb(test);
+
+	fq_tin_lock_bh(fq, tin);
+	fq_tin_enqueue(fq, tin, 0, head, fq_test_free);
+	fq_test_expect_memory(test, fq, head->truesize);
+
+	/* grow the queued head like ieee80211_amsdu_prepare_head() may */
+	orig_truesize = head->truesize;
+	KUNIT_ASSERT_EQ(test, pskb_expand_head(head, 0, 256, GFP_ATOMIC), 0);
+	KUNIT_ASSERT_GT(test, head->truesize, orig_truesize);
+
+	skb_shinfo(head)->frag_list = skb;
+	head->len += skb->len;
+	head->data_len += skb->len;
+	fq_adjust_truesize(fq, tin, head->truesize - orig_truesize);
+	fq_test_expect_memory(test, fq, head->truesize);
+
+	KUNIT_EXPECT_PTR_EQ(test, fq_tin_dequeue(fq, tin, fq_test_dequeue),
+			    head);
+	fq_test_expect_memory(test, fq, 0);
+	KUNIT_EXPECT_EQ(test, fq_backlog(fq), 0);
+	KUNIT_EXPECT_EQ(test, percpu_counter_sum(&fq->backlog), 0);
+	fq_tin_unlock_bh(fq, tin);
+
+	kfree_skb(head);
+
+	fq_lock_all_bh(fq);
+	fq_reset(fq, fq_test_free);
+	fq_unlock_all_bh(fq);
+}
+
+static struct kunit_case fq_test_cases[] = {
+	KUNIT_CASE(fq_aggregate_truesize),
+	{}
+};
+
+static struct kunit_suite mac80211_fq = {
+	.name = "mac80211-fq",
+	.test_cases = fq_test_cases,
+};
+
+kunit_test_suite(mac80211_fq);
@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the mesh path table
+ */
+#include <kunit/test.h>
+#include "../ieee80211_i.h"
+#include "../sta_info.h"
+#include "../mesh.h"
+
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+
+struct mesh_test_ctx {
+	struct ieee80211_sub_if_data *sdata;
+	struct sta_info **sta;
+	unsigned int n_sta;
+};
+
+static void mesh_test_free(void *data)
+{
+	struct ieee80211_sub_if_data *sdata = data;
+
+	mesh_pathtbl_unregister(sdata);
+}
+
+static struct mesh_test_ctx *mesh_test_init(struct kunit *test,
+					    unsigned int n_sta)
+{
+	struct ieee80211_sub_if_data *sdata;
+	struct mesh_test_ctx *ctx;
+	unsigned int i;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+	ctx->sta = kunit_kcalloc(test, n_sta, sizeof(*ctx->sta), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->sta);
+	ctx->n_sta = n_sta;
+
+	sdata = kunit_kzalloc(test, sizeof(*sdata), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, sdata);
+	strscpy(sdata->name, "mesh-test");
+	sdata->vif.addr[0] = 0x02;
+	INIT_LIST_HEAD(&sdata->u.mesh.preq_queue.list);
+	spin_lock_init(&sdata->u.mesh.mesh_preq_queue_lock);
+	mesh_pathtbl_init(sdata);
+	KUNIT_ASSERT_EQ(test, 0,
+			kunit_add_action_or_reset(test, mesh_test_free, sdata));
+	ctx->sdata = sdata;
+
+	for (i = 0; i < n_sta; i++) {
+		struct sta_info *sta;
+
+		sta = kunit_kzalloc(test, sizeof(*sta), GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, sta);
+		sta->mesh = kunit_kzalloc(test, sizeof(*sta->mesh), GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, sta->mesh);
+		sta->sdata = sdata;
+		sta->sta.addr[0] = 0x12;
+		sta->sta.addr[5] = i;
+		ctx->sta[i] = sta;
+	}
+
+	return ctx;
+}
+
+static void mesh_test_addr(u8 *addr, unsigned int i)
+{
+	eth_zero_addr(addr);
+	addr[0] = 0x22;
+	addr[4] = i >> 8;
+	addr[5] = i;
+}
+
+static void mesh_test_set_nexthop(struct mesh_path *mpath,
+				  struct sta_info *sta)
+{
+	spin_lock_bh(&mpath->state_lock);
+	mesh_path_assign_nexthop(mpath, sta);
+	spin_unlock_bh(&mpath->state_lock);
+}
+
+/* add n_paths paths, spread round-robin over the stations */
+static struct mesh_path **mesh_test_add(struct kunit *test,
+					struct mesh_test_ctx *ctx,
+					unsigned int n_paths)
+{
+	struct mesh_path **mpaths;
+	unsigned int i;
+	u8 addr[ETH_ALEN];
+
+	mpaths = kunit_kcalloc(test, n_paths, sizeof(*mpaths), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, mpaths);
+
+	for (i = 0; i < n_paths; i++) {
+		mesh_test_addr(addr, i);
+		mpaths[i] = mesh_path_add(ctx->sdata, addr);
+		KUNIT_ASSERT_FALSE(test, IS_ERR(mpaths[i]));
+		mesh_test_set_nexthop(mpaths[i], ctx->sta[i % ctx->n_sta]);
+	}
+
+	return mpaths;
+}
+
+static bool mesh_test_exists(struct mesh_test_ctx *ctx, unsigned int i)
+{
+	struct mesh_path *mpath;
+	u8 addr[ETH_ALEN];
+
+	mesh_test_addr(addr, i);
+	rcu_read_lock();
+	mpath = mesh_path_lookup(ctx->sdata, addr);
+	rcu_read_unlock();
+
+	return mpath;
+}
+
+static unsigned int mesh_test_count_nexthop(struct sta_info *sta)
+{
+	struct mesh_path *mpath;
+	unsigned int n = 0;
+
+	hlist_for_each_entry(mpath, &sta->mesh->mpaths, nexthop_list) {
+		if (rcu_access_pointer(mpath->next_hop) != sta)
+			return UINT_MAX;
+		n++;
+	}
+
+	return n;
+}
+
+static void mesh_pathtbl_flush_nexthop(struct kunit *test)
+{
+	struct mesh_test_ctx *ctx = mesh_test_init(test, 16);
+	struct mesh_path **mpaths = mesh_test_add(test, ctx, 256);
+	unsigned int i;
+
+	for (i = 0; i < ctx->n_sta; i++)
+		KUNIT_EXPECT_EQ(test, mesh_test_count_nexthop(ctx->sta[i]), 16);
+
+	/* path 0 moves from the first to the second station */
+	mesh_test_set_nexthop(mpaths[0], ctx->sta[1]);
+	KUNIT_EXPECT_EQ(test, mesh_test_count_nexthop(ctx->sta[0]), 15);
+	KUNIT_EXPECT_EQ(test, mesh_test_count_nexthop(ctx->sta[1]), 17);
+
+	mesh_path_flush_by_nexthop(ctx->sta[0]);
+	KUNIT_EXPECT_EQ(test, mesh_test_count_nexthop(ctx->sta[0]), 0);
+	KUNIT_EXPECT_EQ(test, atomic_read(&ctx->sdata->u.mesh.mpaths), 241);
+	for (i = 0; i < 256; i++)
+		KUNIT_EXPECT_EQ_MSG(test, mesh_test_exists(ctx, i),
+				    i == 0 || i % ctx->n_sta != 0,
+				    "path %u", i);
+
+	mesh_path_flush_by_nexthop(ctx->sta[1]);
+	KUNIT_EXPECT_EQ(test, mesh_test_count_nexthop(ctx->sta[1]), 0);
+	KUNIT_EXPECT_EQ(test, atomic_read(&ctx->sdata->u.mesh.mpaths), 224);
+	KUNIT_EXPECT_FALSE(test, mesh_test_exists(ctx, 0));
+	KUNIT_EXPECT_FALSE(test, mesh_test_exists(ctx, 1));
+	KUNIT_EXPECT_TRUE(test, mesh_test_exists(ctx, 2));
+
+	/* flushing a station without paths is a no-op */
+	mesh_path_flush_by_nexthop(ctx->sta[0]);
+	KUNIT_EXPECT_EQ(test, atomic_read(&ctx->sdata->u.mesh.mpaths), 224);
+}
+
+static void mesh_pathtbl_expire(struct kunit *test)
+{
+	struct mesh_test_ctx *ctx = mesh_test_init(test, 4);
+	struct mesh_path **mpaths = mesh_test_add(test, ctx, 64);
+	struct mesh_table *tbl = &ctx->sdata->u.mesh.mesh_paths;
+	unsigned long turn = MESH_PATH_EXPIRE_SLOTS * BIT(MESH_PATH_EXPIRE_SHIFT);
+	unsigned long expired = jiffies - MESH_PATH_EXPIRE - HZ;
+	unsigned int i;
+
+	/* the odd paths are stale, but two of them are not to be deleted */
+	for (i = 1; i < 64; i += 2)
+		mpaths[i]->exp_time = expired;
+	mpaths[1]->flags |= MESH_PATH_FIXED;
+	mpaths[3]->flags |= MESH_PATH_RESOLVING;
+
+	/* their slots are not due yet */
+	mesh_path_expire(ctx->sdata);
+	KUNIT_EXPECT_EQ(test, atomic_read(&ctx->sdata->u.mesh.mpaths), 64);
+
+	/* pretend that a whole turn of the wheel went by */
+	tbl->expire_next -= turn;
+	mesh_path_expire(ctx->sdata);
+	KUNIT_EXPECT_EQ(test, atomic_read(&ctx->sdata->u.mesh.mpaths), 34);
+	for (i = 0; i < 64; i++)
+		KUNIT_EXPECT_EQ_MSG(test, mesh_test_exists(ctx, i),
+				    !(i & 1) || i == 1 || i == 3,
+				    "path %u", i);
+	for (i = 0; i < ctx->n_sta; i++)
+		KUNIT_EXPECT_EQ(test, mesh_test_count_nexthop(ctx->sta[i]),
+				i & 1 ? 1 : 16);
+
+	/* the survivors are still on the wheel and expire once stale */
+	KUNIT_EXPECT_FALSE(test, hlist_unhashed(&mpaths[0]->expire_list));
+	KUNIT_EXPECT_FALSE(test, hlist_unhashed(&mpaths[1]->expire_list));
+	mpaths[0]->exp_time = expired;
+	mpaths[1]->flags &= ~MESH_PATH_FIXED;
+	tbl->expire_next -= turn;
+	mesh_path_expire(ctx->sdata);
+	KUNIT_EXPECT_EQ(test, atomic_read(&ctx->sdata->u.mesh.mpaths), 32);
+	KUNIT_EXPECT_FALSE(test, mesh_test_exists(ctx, 0));
+	KUNIT_EXPECT_FALSE(test, mesh_test_exists(ctx, 1));
+	KUNIT_EXPECT_TRUE(test, mesh_test_exists(ctx, 3));
+}
+
+static struct kunit_case mesh_pathtbl_test_cases[] = {
+	KUNIT_CASE(mesh_pathtbl_flush_nexthop),
+	KUNIT_CASE(mesh_pathtbl_expire),
+	{}
+};
+
+static struct kunit_suite mesh_pathtbl = {
+	.name = "mac80211-mesh-pathtbl",
+	.test_cases = mesh_pathtbl_test_cases,
+};
+
+kunit_test_suite(mesh_pathtbl);
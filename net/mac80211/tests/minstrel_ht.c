@@ -0,0 +1,390 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the minstrel_ht statistics update
+ */
+#include <kunit/test.h>
+#include "../ieee80211_i.h"
+#include "../rc80211_minstrel_ht.h"
+
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+
+static const struct minstrel_test_case {
+	const char *desc;
+	bool ht, vht;
+} minstrel_test_cases[] = {
+	{
+		.desc = "legacy",
+	},
+	{
+		.desc = "ht",
+		.ht = true,
+	},
+	{
+		.desc = "vht",
+		.ht = true,
+		.vht = true,
+	},
+};
+
+KUNIT_ARRAY_PARAM_DESC(minstrel_test, minstrel_test_cases, desc);
+
+static struct minstrel_priv *minstrel_test_priv(struct kunit *test)
+{
+	struct minstrel_priv *mp;
+
+	mp = kunit_kzalloc(test, sizeof(*mp), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, mp);
+	mp->hw = kunit_kzalloc(test, sizeof(*mp->hw), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, mp->hw);
+#ifdef CPTCFG_MAC80211_DEBUGFS
+	mp->fixed_rate_idx = (u32) -1;
+#endif
+
+	return mp;
+}
+
+/* a two stream station, using the legacy rates and HT/VHT if supported */
+static struct minstrel_ht_sta *
+minstrel_test_sta(struct kunit *test, const struct minstrel_test_case *params)
+{
+	struct minstrel_ht_sta *mi;
+	struct ieee80211_sta *sta;
+	u16 first = MI_RATE(MINSTREL_OFDM_GROUP, 0);
+	int group;
+
+	sta = kunit_kzalloc(test, sizeof(*sta), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, sta);
+	sta->deflink.ht_cap.ht_supported = params->ht;
+
+	mi = kunit_kzalloc(test, struct_size(mi, groups, MINSTREL_GROUPS_NB),
+			   GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, mi);
+	mi->n_groups = MINSTREL_GROUPS_NB;
+	mi->sta = sta;
+	mi->overhead = 100000;
+	mi->overhead_rtscts = 150000;
+	mi->overhead_legacy = 50000;
+	mi->overhead_legacy_rtscts = 100000;
+	mi->supported[MINSTREL_CCK_GROUP] = 0xf;
+	mi->supported[MINSTREL_OFDM_GROUP] = 0xff;
+
+	for (group = 0; group < MINSTREL_GROUPS_NB; group++) {
+		const struct mcs_group *g = &minstrel_mcs_groups[group];
+
+		if (g->streams > 2)
+			continue;
+
+		if ((params->ht && g->flags & IEEE80211_TX_RC_MCS) ||
+		    (params->vht && g->flags & IEEE80211_TX_RC_VHT_MCS)) {
+			mi->supported[group] =
+				g->flags & IEEE80211_TX_RC_MCS ? 0xff : 0x3ff;
+			if (MI_RATE_GROUP(first) == MINSTREL_OFDM_GROUP)
+				first = MI_RATE(group, 0);
+		}
+	}
+
+	mi->max_tp_rate[0] = first;
+	mi->max_tp_rate[1] = first;
+	mi->max_tp_rate[2] = first;
+	mi->max_tp_rate[3] = first;
+	mi->max_prob_rate = first;
+
+	return mi;
+}
+
+static void minstrel_test_tx(struct minstrel_ht_sta *mi, u16 index,
+			     u16 success, u16 attempts)
+{
+	struct minstrel_group_stats *st = &mi->groups[MI_RATE_GROUP(index)].stats;
+
+	st->success[MI_RATE_IDX(index)] += success;
+	st->attempts[MI_RATE_IDX(index)] += attempts;
+	__set_bit(MI_RATE_GROUP(index), mi->tx_groups);
+}
+
+/*
+ * Traffic like in a steady state: mostly on the best rates, and a bit on
+ * one sample rate that moves through the supported rates.
+ */
+static void minstrel_test_traffic(struct minstrel_ht_sta *mi,
+				  unsigned int round)
+{
+	unsigned int n = 0, pick = round * 7;
+	int group, i;
+
+	minstrel_test_tx(mi, mi->max_tp_rate[0], 80, 100);
+	minstrel_test_tx(mi, mi->max_tp_rate[1], 15, 20);
+	minstrel_test_tx(mi, mi->max_prob_rate, 5, 5);
+
+	for (group = 0; group < MINSTREL_GROUPS_NB; group++)
+		n += hweight16(mi->supported[group]);
+
+	pick %= n;
+	for (group = 0; group < MINSTREL_GROUPS_NB; group++) {
+		for (i = 0; i < MCS_GROUP_RATES; i++) {
+			if (!(mi->supported[group] & BIT(i)))
+				continue;
+			if (!pick--) {
+				minstrel_test_tx(mi, MI_RATE(group, i),
+						 round % 3, 2);
+				return;
+			}
+		}
+	}
+}
+
+/*
+ * Skipping the groups without traffic must give the same statistics and
+ * rate selection as recalculating all of them.
+ */
+static void minstrel_ht_idle_groups(struct kunit *test)
+{
+	const struct minstrel_test_case *params = test->param_value;
+	struct minstrel_priv *mp = minstrel_test_priv(test);
+	struct minstrel_ht_sta *mi = minstrel_test_sta(test, params);
+	struct minstrel_ht_sta *full;
+	unsigned int round;
+	int group;
+
+	full = kunit_kmalloc(test, struct_size(mi, groups, mi->n_groups),
+			     GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, full);
+	memcpy(full, mi, struct_size(mi, groups, mi->n_groups));
+
+	for (round = 0; round < 200; round++) {
+		minstrel_test_traffic(mi, round);
+		minstrel_test_traffic(full, round);
+		bitmap_fill(full->tx_groups, MINSTREL_GROUPS_NB);
+
+		minstrel_ht_update_stats(mp, mi);
+		minstrel_ht_update_stats(mp, full);
+
+		for (group = 0; group < MINSTREL_GROUPS_NB; group++)
+			KUNIT_ASSERT_MEMEQ_MSG(test, &mi->groups[group].stats,
+					       &full->groups[group].stats,
+					       sizeof(mi->groups[group].stats),
+					       "round %u group %d", round, group);
+
+		KUNIT_ASSERT_MEMEQ(test, mi->max_tp_rate, full->max_tp_rate,
+				   sizeof(mi->max_tp_rate));
+		KUNIT_ASSERT_EQ(test, mi->max_prob_rate, full->max_prob_rate);
+	}
+
+	/* only the groups used recently are left to be cleared */
+	KUNIT_EXPECT_TRUE(test, bitmap_empty(mi->tx_groups, MINSTREL_GROUPS_NB));
+	KUNIT_EXPECT_LE(test, bitmap_weight(mi->last_tx_groups,
+					    MINSTREL_GROUPS_NB), 4);
+
+	minstrel_ht_update_stats(mp, mi);
+	KUNIT_EXPECT_TRUE(test, bitmap_empty(mi->last_tx_groups,
+					     MINSTREL_GROUPS_NB));
+	for (group = 0; group < MINSTREL_GROUPS_NB; group++) {
+		const struct minstrel_group_stats *st = &mi->groups[group].stats;
+		int i;
+
+		for (i = 0; i < MCS_GROUP_RATES; i++)
+			KUNIT_EXPECT_EQ(test, st->last_attempts[i], 0);
+	}
+}
+
+/*
+ * The exported statistics must cover every rate that was tried in the last
+ * period plus the current rate set, and carry the same counters as the rate
+ * control.
+ */
+static void minstrel_ht_rate_stats(struct kunit *test)
+{
+	const struct minstrel_test_case *params = test->param_value;
+	struct minstrel_priv *mp = minstrel_test_priv(test);
+	struct minstrel_ht_sta *mi = minstrel_test_sta(test, params);
+	struct station_info sinfo = {};
+	u64 attempts = 0, exported = 0;
+	unsigned int round, i, j, n = 0, n_max_tp = 0, n_max_prob = 0;
+	int group;
+
+	for (round = 0; round < 50; round++) {
+		minstrel_test_traffic(mi, round);
+		minstrel_ht_update_stats(mp, mi);
+	}
+
+	for (group = 0; group < MINSTREL_GROUPS_NB; group++) {
+		const struct minstrel_group_stats *st = &mi->groups[group].stats;
+
+		for (i = 0; i < MCS_GROUP_RATES; i++) {
+			bool in_use = MI_RATE(group, i) == mi->max_prob_rate;
+
+			if (!(mi->supported[group] & BIT(i)))
+				continue;
+			for (j = 0; j < MAX_THR_RATES; j++)
+				in_use |= MI_RATE(group, i) ==
+					  mi->max_tp_rate[j];
+			if (!st->last_attempts[i] && !in_use)
+				continue;
+			attempts += st->att_hist[i];
+			n++;
+		}
+	}
+
+	KUNIT_ASSERT_EQ(test, minstrel_ht_get_rate_stats(mp, mi, NULL, 0), n);
+	KUNIT_ASSERT_EQ(test, cfg80211_sinfo_alloc_rc_stats(&sinfo, n,
+							     GFP_KERNEL), 0);
+	sinfo.n_rc_stats = minstrel_ht_get_rate_stats(mp, mi, sinfo.rc_stats,
+						      n);
+	KUNIT_EXPECT_EQ(test, sinfo.n_rc_stats, n);
+
+	/* a short array is filled up to its size, not beyond it */
+	KUNIT_EXPECT_EQ(test, minstrel_ht_get_rate_stats(mp, mi,
+							 sinfo.rc_stats, 1),
+			1);
+
+	for (i = 0; i < sinfo.n_rc_stats; i++) {
+		const struct nl80211_rc_rate_stats *rs = &sinfo.rc_stats[i];
+
+		exported += rs->attempts;
+		KUNIT_EXPECT_LE(test, rs->success, rs->attempts);
+		KUNIT_EXPECT_LE(test, rs->prob, 1000);
+		KUNIT_EXPECT_EQ(test, rs->reserved, 0);
+		if (rs->flags & NL80211_RC_RATE_F_MAX_PROB)
+			n_max_prob++;
+		if (rs->tp_rank == 1)
+			n_max_tp++;
+		if (rs->encoding == NL80211_RC_RATE_ENC_LEGACY)
+			KUNIT_EXPECT_NE(test, rs->bitrate, 0);
+		else
+			KUNIT_EXPECT_NE(test, rs->nss, 0);
+		if (!params->ht)
+			KUNIT_EXPECT_EQ(test, rs->encoding,
+					NL80211_RC_RATE_ENC_LEGACY);
+	}
+
+	KUNIT_EXPECT_EQ(test, exported, attempts);
+	KUNIT_EXPECT_EQ(test, n_max_tp, 1);
+	KUNIT_EXPECT_EQ(test, n_max_prob, 1);
+
+	cfg80211_sinfo_release_content(&sinfo);
+}
+
+static void minstrel_test_he_rate(const struct mcs_group *g, int mcs,
+				  struct ieee80211_rx_status *status)
+{
+	memset(status, 0, sizeof(*status));
+	status->band = NL80211_BAND_6GHZ;
+	status->nss = g->streams;
+	status->rate_idx = mcs;
+	status->bw = g->bw == 4 ? RATE_INFO_BW_320 :
+		     g->bw == 3 ? RATE_INFO_BW_160 :
+		     g->bw == 2 ? RATE_INFO_BW_80 :
+		     g->bw == 1 ? RATE_INFO_BW_40 : RATE_INFO_BW_20;
+	if (g->flags & IEEE80211_TX_RC_EHT_MCS) {
+		status->encoding = RX_ENC_EHT;
+		status->eht.gi = NL80211_RATE_INFO_EHT_GI_0_8;
+	} else {
+		status->encoding = RX_ENC_HE;
+		status->he_gi = NL80211_RATE_INFO_HE_GI_0_8;
+	}
+}
+
+static int minstrel_test_n_rates(const struct mcs_group *g)
+{
+	return g->flags & IEEE80211_TX_RC_EHT_MCS ? 14 : 12;
+}
+
+/*
+ * The HE/EHT group durations are built at compile time, check them against
+ * the airtime estimate for a whole A-MPDU of average sized packets. They
+ * may differ by the symbol rounding and the group shift, which can also
+ * make neighbouring rates equally fast.
+ */
+static void minstrel_ht_he_durations(struct kunit *test)
+{
+	struct minstrel_priv *mp = minstrel_test_priv(test);
+	struct ieee80211_rx_status status;
+	int group, i;
+
+	/* HE 20 MHz, 1 SS, MCS 0: 1336 symbols of 13.6 us per 16 packets */
+	group = MINSTREL_HE_GROUP_0;
+	i = minstrel_mcs_groups[group].shift;
+	KUNIT_EXPECT_EQ(test, minstrel_mcs_groups[group].duration[0] << i,
+			(1135600 >> i) << i);
+
+	for (group = MINSTREL_HE_GROUP_0; group < MINSTREL_GROUPS_NB;
+	     group++) {
+		const struct mcs_group *g = &minstrel_mcs_groups[group];
+		u32 prev = U32_MAX;
+
+		KUNIT_EXPECT_NE(test, g->flags & (IEEE80211_TX_RC_HE_MCS |
+						  IEEE80211_TX_RC_EHT_MCS), 0);
+
+		for (i = 0; i < minstrel_test_n_rates(g); i++) {
+			u32 duration = g->duration[i] << g->shift;
+			u32 ampdu_us = duration * 16 / 1000;
+			u32 airtime;
+
+			KUNIT_EXPECT_LE_MSG(test, duration, prev,
+					    "group %d mcs %d", group, i);
+			prev = duration;
+
+			minstrel_test_he_rate(g, i, &status);
+			airtime = ieee80211_calc_rx_airtime(mp->hw, &status,
+							    1200 * 16);
+			airtime -= 36 + (g->streams << 2);
+
+			KUNIT_EXPECT_LE_MSG(test, abs((int)airtime - (int)ampdu_us),
+					    16 + ampdu_us / 50,
+					    "group %d mcs %d: %u us, airtime %u us",
+					    group, i, ampdu_us, airtime);
+		}
+
+		for (; i < MCS_GROUP_RATES; i++)
+			KUNIT_EXPECT_EQ(test, g->duration[i], 0);
+	}
+}
+
+/* the TX status rate must map back to the group and index of the rate */
+static void minstrel_ht_he_status(struct kunit *test)
+{
+	struct minstrel_priv *mp = minstrel_test_priv(test);
+	struct minstrel_ht_sta *mi = kunit_kzalloc(test, sizeof(*mi),
+						   GFP_KERNEL);
+	struct ieee80211_rate_status rs = {};
+	struct ieee80211_rx_status status;
+	int group, i;
+
+	KUNIT_ASSERT_NOT_NULL(test, mi);
+
+	for (group = MINSTREL_HE_GROUP_0; group < MINSTREL_GROUPS_NB;
+	     group++) {
+		const struct mcs_group *g = &minstrel_mcs_groups[group];
+
+		for (i = 0; i < minstrel_test_n_rates(g); i++) {
+			minstrel_test_he_rate(g, i, &status);
+			memset(&rs.rate_idx, 0, sizeof(rs.rate_idx));
+			rs.rate_idx.flags =
+				status.encoding == RX_ENC_EHT ?
+				RATE_INFO_FLAGS_EHT_MCS : RATE_INFO_FLAGS_HE_MCS;
+			rs.rate_idx.mcs = i;
+			rs.rate_idx.nss = g->streams;
+			rs.rate_idx.bw = status.bw;
+
+			KUNIT_EXPECT_EQ_MSG(test,
+					    minstrel_ht_ri_get_rate(mp, mi, &rs),
+					    MI_RATE(group, i),
+					    "group %d mcs %d", group, i);
+		}
+	}
+}
+
+static struct kunit_case minstrel_ht_test_cases[] = {
+	KUNIT_CASE_PARAM(minstrel_ht_idle_groups, minstrel_test_gen_params),
+	KUNIT_CASE_PARAM(minstrel_ht_rate_stats, minstrel_test_gen_params),
+	KUNIT_CASE(minstrel_ht_he_durations),
+	KUNIT_CASE(minstrel_ht_he_status),
+	{}
+};
+
+static struct kunit_suite minstrel_ht = {
+	.name = "mac80211-minstrel-ht",
+	.test_cases = minstrel_ht_test_cases,
+};
+
+kunit_test_suite(minstrel_ht);
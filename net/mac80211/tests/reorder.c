@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the RX A-MPDU reorder buffer
+ */
+#include <linux/prandom.h>
+#include <kunit/test.h>
+#include "../ieee80211_i.h"
+#include "../sta_info.h"
+
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+
+#define REORDER_TEST_SSN	4000
+#define REORDER_TEST_WINDOWS	8
+
+struct reorder_test_ctx {
+	struct ieee80211_sub_if_data *sdata;
+	struct tid_ampdu_rx *tid_agg_rx;
+	struct sk_buff_head frames;
+	u16 next_sn;
+	u32 released;
+	bool in_order;
+};
+
+static void reorder_test_timer(struct timer_list *t)
+{
+}
+
+static void reorder_test_free(void *data)
+{
+	struct reorder_test_ctx *ctx = data;
+
+	timer_shutdown_sync(&ctx->tid_agg_rx->reorder_timer);
+	ieee80211_rx_reorder_free(ctx->tid_agg_rx);
+	__skb_queue_purge(&ctx->frames);
+}
+
+static struct reorder_test_ctx *reorder_test_init(struct kunit *test,
+						  u16 buf_size)
+{
+	struct reorder_test_ctx *ctx;
+	struct tid_ampdu_rx *tid_agg_rx;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+	ctx->sdata = kunit_kzalloc(test, sizeof(*ctx->sdata), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->sdata);
+	strscpy(ctx->sdata->name, "reorder-test");
+
+	tid_agg_rx = kunit_kzalloc(test, sizeof(*tid_agg_rx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, tid_agg_rx);
+	ctx->tid_agg_rx = tid_agg_rx;
+
+	spin_lock_init(&tid_agg_rx->reorder_lock);
+	timer_setup(&tid_agg_rx->reorder_timer, reorder_test_timer, 0);
+	/* no timeouts here, don't arm the release timer */
+	tid_agg_rx->removed = true;
+	tid_agg_rx->ssn = REORDER_TEST_SSN;
+	tid_agg_rx->head_seq_num = REORDER_TEST_SSN;
+	__skb_queue_head_init(&ctx->frames);
+
+	KUNIT_ASSERT_EQ(test, 0,
+			ieee80211_rx_reorder_alloc(tid_agg_rx, buf_size,
+						   GFP_KERNEL));
+	KUNIT_ASSERT_EQ(test, 0,
+			kunit_add_action_or_reset(test, reorder_test_free,
+						  ctx));
+
+	ctx->next_sn = REORDER_TEST_SSN;
+	ctx->in_order = true;
+
+	return ctx;
+}
+
+static struct sk_buff *reorder_test_frame(u16 sn)
+{
+	struct ieee80211_qos_hdr *hdr;
+	struct sk_buff *skb;
+
+	skb = alloc_skb(sizeof(*hdr), GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	hdr = skb_put_zero(skb, sizeof(*hdr));
+	hdr->frame_control = cpu_to_le16(IEEE80211_FTYPE_DATA |
+					 IEEE80211_STYPE_QOS_DATA);
+	hdr->seq_ctrl = cpu_to_le16(sn << 4);
+
+	return skb;
+}
+
+/* check the order of, and free, the frames released so far */
+static void reorder_test_consume(struct reorder_test_ctx *ctx)
+{
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(&ctx->frames))) {
+		u16 sn = ieee80211_get_sn((void *)skb->data);
+
+		if (sn != ctx->next_sn)
+			ctx->in_order = false;
+		ctx->next_sn = ieee80211_sn_inc(sn);
+		ctx->released++;
+		kfree_skb(skb);
+	}
+}
+
+static void reorder_test_rx(struct reorder_test_ctx *ctx, struct sk_buff *skb)
+{
+	if (!ieee80211_sta_manage_reorder_buf(ctx->sdata, ctx->tid_agg_rx,
+					      skb, &ctx->frames))
+		__skb_queue_tail(&ctx->frames, skb);
+}
+
+static void reorder_window_move(struct kunit *test)
+{
+	struct reorder_test_ctx *ctx = reorder_test_init(test, 64);
+	struct sk_buff *skb;
+	u16 far = ieee80211_sn_add(REORDER_TEST_SSN, 100);
+	u16 sn;
+
+	/* a hole at the head keeps frames buffered */
+	skb = reorder_test_frame(ieee80211_sn_add(REORDER_TEST_SSN, 5));
+	KUNIT_ASSERT_NOT_NULL(test, skb);
+	reorder_test_rx(ctx, skb);
+	KUNIT_EXPECT_TRUE(test, skb_queue_empty(&ctx->frames));
+	KUNIT_EXPECT_EQ(test, ctx->tid_agg_rx->stored_mpdu_num, 1);
+
+	/* a frame beyond the window pushes out everything before it */
+	skb = reorder_test_frame(far);
+	KUNIT_ASSERT_NOT_NULL(test, skb);
+	reorder_test_rx(ctx, skb);
+	KUNIT_EXPECT_EQ(test, skb_queue_len(&ctx->frames), 1);
+	skb = skb_peek(&ctx->frames);
+	KUNIT_EXPECT_EQ(test, ieee80211_get_sn((void *)skb->data),
+			ieee80211_sn_add(REORDER_TEST_SSN, 5));
+	KUNIT_EXPECT_EQ(test, ctx->tid_agg_rx->head_seq_num,
+			ieee80211_sn_sub(far, 63));
+	KUNIT_EXPECT_EQ(test, ctx->tid_agg_rx->stored_mpdu_num, 1);
+	__skb_queue_purge(&ctx->frames);
+
+	/* filling the rest of the window releases it all in order */
+	ctx->next_sn = ieee80211_sn_sub(far, 63);
+	for (sn = ctx->next_sn; sn != far; sn = ieee80211_sn_inc(sn)) {
+		skb = reorder_test_frame(sn);
+		KUNIT_ASSERT_NOT_NULL(test, skb);
+		reorder_test_rx(ctx, skb);
+		reorder_test_consume(ctx);
+	}
+	KUNIT_EXPECT_TRUE(test, ctx->in_order);
+	KUNIT_EXPECT_EQ(test, ctx->released, 64);
+	KUNIT_EXPECT_EQ(test, ctx->tid_agg_rx->stored_mpdu_num, 0);
+	KUNIT_EXPECT_EQ(test, ctx->tid_agg_rx->head_seq_num,
+			ieee80211_sn_inc(far));
+
+	/* and a duplicate of an old frame is dropped */
+	skb = reorder_test_frame(far);
+	KUNIT_ASSERT_NOT_NULL(test, skb);
+	reorder_test_rx(ctx, skb);
+	KUNIT_EXPECT_TRUE(test, skb_queue_empty(&ctx->frames));
+}
+
+/*
+ * Feed each window's worth of sequence numbers in a random order, so most
+ * frames have to be buffered, and check that everything comes out in order.
+ */
+static void reorder_shuffled_size(struct kunit *test, u16 buf_size,
+				  struct rnd_state *rnd)
+{
+	struct reorder_test_ctx *ctx = reorder_test_init(test, buf_size);
+	u32 total = REORDER_TEST_WINDOWS * buf_size;
+	struct sk_buff **window;
+	int w, i;
+
+	window = kunit_kcalloc(test, buf_size, sizeof(*window), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, window);
+
+	for (w = 0; w < REORDER_TEST_WINDOWS; w++) {
+		u16 base = ieee80211_sn_add(REORDER_TEST_SSN, w * buf_size);
+
+		for (i = 0; i < buf_size; i++) {
+			u16 sn = ieee80211_sn_add(base, i);
+
+			window[i] = reorder_test_frame(sn);
+			KUNIT_ASSERT_NOT_NULL(test, window[i]);
+		}
+
+		for (i = buf_size - 1; i > 0; i--) {
+			u32 j = prandom_u32_state(rnd) % (i + 1);
+
+			swap(window[i], window[j]);
+		}
+
+		for (i = 0; i < buf_size; i++)
+			reorder_test_rx(ctx, window[i]);
+
+		reorder_test_consume(ctx);
+	}
+
+	KUNIT_EXPECT_TRUE_MSG(test, ctx->in_order, "buf_size=%u", buf_size);
+	KUNIT_EXPECT_EQ_MSG(test, ctx->released, total, "buf_size=%u",
+			    buf_size);
+	KUNIT_EXPECT_EQ_MSG(test, ctx->tid_agg_rx->stored_mpdu_num, 0,
+			    "buf_size=%u", buf_size);
+}
+
+static void reorder_shuffled(struct kunit *test)
+{
+	static const u16 buf_sizes[] = { 64, 256, 1024 };
+	struct rnd_state rnd;
+	int i;
+
+	prandom_seed_state(&rnd, 0x80211);
+
+	for (i = 0; i < ARRAY_SIZE(buf_sizes); i++)
+		reorder_shuffled_size(test, buf_sizes[i], &rnd);
+}
+
+static struct kunit_case reorder_test_cases[] = {
+	KUNIT_CASE(reorder_window_move),
+	KUNIT_CASE(reorder_shuffled),
+	{}
+};
+
+static struct kunit_suite reorder = {
+	.name = "mac80211-rx-reorder",
+	.test_cases = reorder_test_cases,
+};
+
+kunit_test_suite(reorder);
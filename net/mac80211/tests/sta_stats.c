@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the per-CPU station statistics
+ */
+#include <kunit/test.h>
+#include "../ieee80211_i.h"
+#include "../sta_info.h"
+
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+
+static void sta_stats_free(void *data)
+{
+	struct link_sta_info *link_sta = data;
+
+	free_percpu(link_sta->pcpu_rx_stats);
+	free_percpu(link_sta->pcpu_tx_stats);
+}
+
+static struct link_sta_info *sta_stats_alloc(struct kunit *test, bool rss)
+{
+	struct link_sta_info *link_sta;
+	int cpu;
+
+	link_sta = kunit_kzalloc(test, sizeof(*link_sta), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, link_sta);
+
+	link_sta->pcpu_tx_stats =
+		alloc_percpu(struct ieee80211_sta_tx_counters);
+	KUNIT_ASSERT_NOT_NULL(test, link_sta->pcpu_tx_stats);
+
+	if (rss) {
+		link_sta->pcpu_rx_stats =
+			alloc_percpu(struct ieee80211_sta_rx_stats);
+		KUNIT_ASSERT_NOT_NULL(test, link_sta->pcpu_rx_stats);
+	}
+
+	KUNIT_ASSERT_EQ(test, 0,
+			kunit_add_action_or_reset(test, sta_stats_free,
+						  link_sta));
+
+	u64_stats_init(&link_sta->rx_stats.syncp);
+	for_each_possible_cpu(cpu) {
+		u64_stats_init(&per_cpu_ptr(link_sta->pcpu_tx_stats,
+					    cpu)->syncp);
+		if (rss)
+			u64_stats_init(&per_cpu_ptr(link_sta->pcpu_rx_stats,
+						    cpu)->syncp);
+	}
+
+	return link_sta;
+}
+
+static void fold_tx(struct kunit *test)
+{
+	struct link_sta_info *link_sta = sta_stats_alloc(test, false);
+	struct ieee80211_sta_tx_counters sum;
+	u64 ncpus = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct ieee80211_sta_tx_counters *txc;
+
+		txc = per_cpu_ptr(link_sta->pcpu_tx_stats, cpu);
+		txc->packets[IEEE80211_AC_BE] = 2;
+		txc->packets[IEEE80211_AC_VO] = 1;
+		txc->bytes[IEEE80211_AC_BE] = 3000;
+		txc->msdu[0] = 2;
+		txc->msdu[IEEE80211_NUM_TIDS] = 1;
+		txc->msdu_retries[0] = 4;
+		txc->msdu_failed[0] = 1;
+		txc->filtered = 5;
+		txc->retry_failed = 1;
+		txc->retry_count = 7;
+		ncpus++;
+	}
+
+	sta_fold_tx_stats(link_sta, &sum);
+
+	KUNIT_EXPECT_EQ(test, sum.packets[IEEE80211_AC_BE], 2 * ncpus);
+	KUNIT_EXPECT_EQ(test, sum.packets[IEEE80211_AC_VO], ncpus);
+	KUNIT_EXPECT_EQ(test, sum.packets[IEEE80211_AC_VI], 0);
+	KUNIT_EXPECT_EQ(test, sum.bytes[IEEE80211_AC_BE], 3000 * ncpus);
+	KUNIT_EXPECT_EQ(test, sum.msdu[0], 2 * ncpus);
+	KUNIT_EXPECT_EQ(test, sum.msdu[1], 0);
+	KUNIT_EXPECT_EQ(test, sum.msdu[IEEE80211_NUM_TIDS], ncpus);
+	KUNIT_EXPECT_EQ(test, sum.msdu_retries[0], 4 * ncpus);
+	KUNIT_EXPECT_EQ(test, sum.msdu_failed[0], ncpus);
+	KUNIT_EXPECT_EQ(test, sum.filtered, 5 * ncpus);
+	KUNIT_EXPECT_EQ(test, sum.retry_failed, ncpus);
+	KUNIT_EXPECT_EQ(test, sum.retry_count, 7 * ncpus);
+
+	KUNIT_EXPECT_EQ(test, sta_get_tx_filtered(link_sta), 5 * ncpus);
+}
+
+static void fold_tx_update(struct kunit *test)
+{
+	struct link_sta_info *link_sta = sta_stats_alloc(test, false);
+	struct ieee80211_sta_tx_counters *txc, sum;
+	int i;
+
+	for (i = 0; i < 100; i++) {
+		local_bh_disable();
+		txc = sta_tx_stats_begin(link_sta);
+		txc->packets[IEEE80211_AC_VI]++;
+		txc->bytes[IEEE80211_AC_VI] += 100;
+		sta_tx_stats_end(txc);
+		local_bh_enable();
+	}
+
+	sta_fold_tx_stats(link_sta, &sum);
+	KUNIT_EXPECT_EQ(test, sum.packets[IEEE80211_AC_VI], 100);
+	KUNIT_EXPECT_EQ(test, sum.bytes[IEEE80211_AC_VI], 10000);
+}
+
+static void fold_rx(struct kunit *test)
+{
+	bool rss = *(const bool *)test->param_value;
+	struct link_sta_info *link_sta = sta_stats_alloc(test, rss);
+	struct ieee80211_sta_rx_counters sum;
+	u64 ncpus = 0;
+	int cpu;
+
+	link_sta->rx_stats.packets = 10;
+	link_sta->rx_stats.bytes = 1000;
+	link_sta->rx_stats.dropped = 1;
+	link_sta->rx_stats.msdu[3] = 10;
+
+	if (rss) {
+		for_each_possible_cpu(cpu) {
+			struct ieee80211_sta_rx_stats *rxs;
+
+			rxs = per_cpu_ptr(link_sta->pcpu_rx_stats, cpu);
+			rxs->packets = 3;
+			rxs->bytes = 300;
+			rxs->dropped = 2;
+			rxs->msdu[3] = 3;
+			ncpus++;
+		}
+	}
+
+	sta_fold_rx_stats(link_sta, &sum);
+
+	KUNIT_EXPECT_EQ(test, sum.packets, 10 + 3 * ncpus);
+	KUNIT_EXPECT_EQ(test, sum.bytes, 1000 + 300 * ncpus);
+	KUNIT_EXPECT_EQ(test, sum.dropped, 1 + 2 * ncpus);
+	KUNIT_EXPECT_EQ(test, sum.msdu[3], 10 + 3 * ncpus);
+	KUNIT_EXPECT_EQ(test, sum.msdu[0], 0);
+}
+
+static const bool fold_rx_rss_cases[] = { false, true };
+
+static void fold_rx_rss_desc(const bool *rss, char *desc)
+{
+	strscpy(desc, *rss ? "per-CPU" : "shared", KUNIT_PARAM_DESC_SIZE);
+}
+
+KUNIT_ARRAY_PARAM(fold_rx_rss, fold_rx_rss_cases, fold_rx_rss_desc);
+
+static const struct tx_latency_bin_case {
+	const char *desc;
+	u64 nsec;
+	unsigned int bin;
+} tx_latency_bin_cases[] = {
+	{ .desc = "zero", .nsec = 0, .bin = 0 },
+	{ .desc = "below 1 usec", .nsec = 999, .bin = 0 },
+	{ .desc = "1 usec", .nsec = 1000, .bin = 1 },
+	{ .desc = "just below 2 usec", .nsec = 1999, .bin = 1 },
+	{ .desc = "2 usec", .nsec = 2000, .bin = 2 },
+	{ .desc = "1 msec", .nsec = NSEC_PER_MSEC, .bin = 10 },
+	{ .desc = "last bin", .nsec = 262144ULL * NSEC_PER_USEC,
+	  .bin = NL80211_TX_LATENCY_BINS - 1 },
+	{ .desc = "1 sec", .nsec = NSEC_PER_SEC,
+	  .bin = NL80211_TX_LATENCY_BINS - 1 },
+	{ .desc = "huge", .nsec = U64_MAX, .bin = NL80211_TX_LATENCY_BINS - 1 },
+};
+
+KUNIT_ARRAY_PARAM_DESC(tx_latency_bin, tx_latency_bin_cases, desc);
+
+static void tx_latency_bin(struct kunit *test)
+{
+	const struct tx_latency_bin_case *params = test->param_value;
+
+	KUNIT_EXPECT_EQ(test, sta_tx_latency_bin(params->nsec), params->bin);
+}
+
+static void sta_tx_latency_free(void *data)
+{
+	struct sta_info *sta = data;
+
+	free_percpu(sta->tx_latency);
+}
+
+static void fold_tx_latency(struct kunit *test)
+{
+	struct cfg80211_tx_latency *sum;
+	struct sta_info *sta;
+	u32 ncpus = 0;
+	int cpu;
+
+	sta = kunit_kzalloc(test, sizeof(*sta), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, sta);
+	sum = kunit_kzalloc(test, sizeof(*sum), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, sum);
+
+	sta->tx_latency = alloc_percpu(struct cfg80211_tx_latency);
+	KUNIT_ASSERT_NOT_NULL(test, sta->tx_latency);
+	KUNIT_ASSERT_EQ(test, 0,
+			kunit_add_action_or_reset(test, sta_tx_latency_free,
+						  sta));
+
+	for_each_possible_cpu(cpu) {
+		struct cfg80211_tx_latency *lat;
+
+		lat = per_cpu_ptr(sta->tx_latency, cpu);
+		lat->queue[IEEE80211_AC_BE][3] = 2;
+		lat->driver[IEEE80211_AC_VO][NL80211_TX_LATENCY_BINS - 1] = 1;
+		ncpus++;
+	}
+
+	/* stale data in the output must not matter */
+	memset(sum, 0xff, sizeof(*sum));
+	sta_fold_tx_latency(sta, sum);
+
+	KUNIT_EXPECT_EQ(test, sum->queue[IEEE80211_AC_BE][3], 2 * ncpus);
+	KUNIT_EXPECT_EQ(test, sum->queue[IEEE80211_AC_BE][2], 0);
+	KUNIT_EXPECT_EQ(test, sum->queue[IEEE80211_AC_VO][3], 0);
+	KUNIT_EXPECT_EQ(test,
+			sum->driver[IEEE80211_AC_VO][NL80211_TX_LATENCY_BINS - 1],
+			ncpus);
+	KUNIT_EXPECT_EQ(test, sum->driver[IEEE80211_AC_BE][3], 0);
+}
+
+static struct kunit_case sta_stats_test_cases[] = {
+	KUNIT_CASE(fold_tx),
+	KUNIT_CASE(fold_tx_update),
+	KUNIT_CASE_PARAM(fold_rx, fold_rx_rss_gen_params),
+	KUNIT_CASE_PARAM(tx_latency_bin, tx_latency_bin_gen_params),
+	KUNIT_CASE(fold_tx_latency),
+	{}
+};
+
+static struct kunit_suite sta_stats = {
+	.name = "mac80211-sta-stats",
+	.test_cases = sta_stats_test_cases,
+};
+
+kunit_test_suite(sta_stats);
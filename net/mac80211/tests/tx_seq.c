@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit stress tests for lockless TX sequence number and PN allocation
+ */
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <kunit/test.h>
+#include "../ieee80211_i.h"
+#include "../sta_info.h"
+#include "../key.h"
+
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+
+#define TX_SEQ_THREADS		8
+#define TX_SEQ_PER_THREAD	(4 * 4096)
+#define TX_SEQ_TOTAL		(TX_SEQ_THREADS * TX_SEQ_PER_THREAD)
+#define TX_SEQ_TID		5
+
+struct tx_seq_ctx {
+	struct sta_info *sta;
+	struct ieee80211_key *key;
+	struct completion start;
+	struct completion done[TX_SEQ_THREADS];
+	atomic_t seq_hits[(IEEE80211_SCTL_SEQ >> 4) + 1];
+	unsigned long *pn_seen;
+	atomic_t errors;
+};
+
+struct tx_seq_thread {
+	struct tx_seq_ctx *ctx;
+	int idx;
+};
+
+static int tx_seq_thread_fn(void *data)
+{
+	struct tx_seq_thread *thread = data;
+	struct tx_seq_ctx *ctx = thread->ctx;
+	u64 last_pn = 0;
+	int i;
+
+	wait_for_completion(&ctx->start);
+
+	for (i = 0; i < TX_SEQ_PER_THREAD; i++) {
+		u16 seq = le16_to_cpu(ieee80211_tx_next_seq(ctx->sta,
+							    TX_SEQ_TID));
+		u64 pn = ieee80211_key_next_tx_pn(ctx->key);
+
+		if (seq & ~IEEE80211_SCTL_SEQ)
+			atomic_inc(&ctx->errors);
+		atomic_inc(&ctx->seq_hits[seq >> 4]);
+
+		/* PNs must strictly increase as seen by every single user */
+		if (pn <= last_pn || pn > TX_SEQ_TOTAL ||
+		    test_and_set_bit(pn - 1, ctx->pn_seen))
+			atomic_inc(&ctx->errors);
+		last_pn = pn;
+
+		if (!(i % 256))
+			cond_resched();
+	}
+
+	complete(&ctx->done[thread->idx]);
+	return 0;
+}
+
+static void tx_seq_pn_stress(struct kunit *test)
+{
+	struct tx_seq_thread threads[TX_SEQ_THREADS];
+	struct tx_seq_ctx *ctx;
+	int i;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+	ctx->sta = kunit_kzalloc(test, sizeof(*ctx->sta), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->sta);
+	ctx->key = kunit_kzalloc(test, sizeof(*ctx->key), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->key);
+	ctx->pn_seen = kunit_kcalloc(test, BITS_TO_LONGS(TX_SEQ_TOTAL),
+				     sizeof(long), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->pn_seen);
+
+	/* start close to the sequence number wrap */
+	atomic_set(&ctx->sta->tid_seq[TX_SEQ_TID], 0xff00);
+	ctx->key->conf.cipher = WLAN_CIPHER_SUITE_CCMP;
+	atomic64_set(&ctx->key->conf.tx_pn, 0);
+
+	init_completion(&ctx->start);
+	for (i = 0; i < TX_SEQ_THREADS; i++) {
+		struct task_struct *task;
+
+		init_completion(&ctx->done[i]);
+		threads[i].ctx = ctx;
+		threads[i].idx = i;
+
+		task = kthread_run(tx_seq_thread_fn, &threads[i],
+				   "mac80211-txseq/%d", i);
+		if (IS_ERR(task)) {
+			/* let the threads that did start finish */
+			complete_all(&ctx->start);
+			while (i--)
+				wait_for_completion(&ctx->done[i]);
+			KUNIT_FAIL(test, "failed to start thread: %ld",
+				   PTR_ERR(task));
+			return;
+		}
+	}
+
+	complete_all(&ctx->start);
+	for (i = 0; i < TX_SEQ_THREADS; i++)
+		wait_for_completion(&ctx->done[i]);
+
+	KUNIT_EXPECT_EQ(test, atomic_read(&ctx->errors), 0);
+	KUNIT_EXPECT_EQ(test, atomic64_read(&ctx->key->conf.tx_pn),
+			TX_SEQ_TOTAL);
+	KUNIT_EXPECT_EQ(test, bitmap_weight(ctx->pn_seen, TX_SEQ_TOTAL),
+			TX_SEQ_TOTAL);
+
+	/* every sequence number was handed out equally often */
+	for (i = 0; i < ARRAY_SIZE(ctx->seq_hits); i++)
+		KUNIT_EXPECT_EQ(test, atomic_read(&ctx->seq_hits[i]),
+				TX_SEQ_TOTAL / ARRAY_SIZE(ctx->seq_hits));
+
+	/* other TIDs are untouched */
+	KUNIT_EXPECT_EQ(test, atomic_read(&ctx->sta->tid_seq[0]), 0);
+}
+
+static struct kunit_case tx_seq_test_cases[] = {
+	KUNIT_CASE_SLOW(tx_seq_pn_stress),
+	{}
+};
+
+static struct kunit_suite tx_seq = {
+	.name = "mac80211-tx-seq",
+	.test_cases = tx_seq_test_cases,
+};
+
+kunit_test_suite(tx_seq);
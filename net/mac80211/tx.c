@@ -16,6 +16,7 @@
 #include <linux/if_vlan.h>
 #include <linux/etherdevice.h>
 #include <linux/bitmap.h>
+#include <linux/jhash.h>
 #include <linux/rcupdate.h>
 #include <linux/export.h>
 #include <net/net_namespace.h>
@@ -53,7 +54,8 @@ static __le16 ieee80211_duration(struct ieee80211_tx_data *tx,
 	u32 rate_flags = 0;
 
 	/* assume HW handles this */
-	if (tx->rate.flags & (IEEE80211_TX_RC_MCS | IEEE80211_TX_RC_VHT_MCS))
+	if (tx->rate.flags & (IEEE80211_TX_RC_MCS | IEEE80211_TX_RC_VHT_MCS) ||
+	    tx->flags & IEEE80211_TX_DRV_RATE)
 		return 0;
 
 	rcu_read_lock();
@@ -776,7 +778,17 @@ ieee80211_tx_h_rate_ctrl(struct ieee80211_tx_data *tx)
 			if (ratetbl->rate[0].idx < 0)
 				return TX_DROP;
 
-			tx->rate = rate;
+			/*
+			 * The driver handles the HE/EHT rate, it's reported
+			 * in the TX status. It has no tx->rate representation,
+			 * so leave that unset and mark the frame instead.
+			 */
+			if (rate_control_table_rate_is_he(ratetbl->rate[0].flags)) {
+				tx->rate.idx = -1;
+				tx->flags |= IEEE80211_TX_DRV_RATE;
+			} else {
+				tx->rate = rate;
+			}
 		} else {
 			return TX_DROP;
 		}
@@ -786,7 +798,8 @@ ieee80211_tx_h_rate_ctrl(struct ieee80211_tx_data *tx)
 
 	if (txrc.reported_rate.idx < 0) {
 		txrc.reported_rate = tx->rate;
-		if (tx->sta && ieee80211_is_tx_data(tx->skb))
+		if (tx->sta && ieee80211_is_tx_data(tx->skb) &&
+		    !(tx->flags & IEEE80211_TX_DRV_RATE))
 			tx->sta->deflink.tx_stats.last_rate = txrc.reported_rate;
 	} else if (tx->sta)
 		tx->sta->deflink.tx_stats.last_rate = txrc.reported_rate;
@@ -804,22 +817,26 @@ ieee80211_tx_h_rate_ctrl(struct ieee80211_tx_data *tx)
 	return TX_CONTINUE;
 }
 
-static __le16 ieee80211_tx_next_seq(struct sta_info *sta, int tid)
+VISIBLE_IF_MAC80211_KUNIT __le16
+ieee80211_tx_next_seq(struct sta_info *sta, int tid)
 {
-	u16 *seq = &sta->tid_seq[tid];
-	__le16 ret = cpu_to_le16(*seq);
-
-	/* Increase the sequence number. */
-	*seq = (*seq + 0x10) & IEEE80211_SCTL_SEQ;
+	/*
+	 * Frames for the same station may be sent from several TX queues
+	 * concurrently, so allocate the sequence number atomically. The
+	 * counter simply wraps around, only its low 16 bits are used.
+	 */
+	int seq = atomic_fetch_add(0x10, &sta->tid_seq[tid]);
 
-	return ret;
+	return cpu_to_le16(seq & IEEE80211_SCTL_SEQ);
 }
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(ieee80211_tx_next_seq);
 
 static ieee80211_tx_result debug_noinline
 ieee80211_tx_h_sequence(struct ieee80211_tx_data *tx)
 {
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
 	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)tx->skb->data;
+	struct ieee80211_sta_tx_counters *txstats;
 	int tid;
 
 	/*
@@ -865,8 +882,11 @@ ieee80211_tx_h_sequence(struct ieee80211_tx_data *tx)
 		/* for pure STA mode without beacons, we can do it */
 		hdr->seq_ctrl = cpu_to_le16(tx->sdata->sequence_number);
 		tx->sdata->sequence_number += 0x10;
-		if (tx->sta)
-			tx->sta->deflink.tx_stats.msdu[IEEE80211_NUM_TIDS]++;
+		if (tx->sta) {
+			txstats = sta_tx_stats_begin(&tx->sta->deflink);
+			txstats->msdu[IEEE80211_NUM_TIDS]++;
+			sta_tx_stats_end(txstats);
+		}
 		return TX_CONTINUE;
 	}
 
@@ -880,7 +900,9 @@ ieee80211_tx_h_sequence(struct ieee80211_tx_data *tx)
 
 	/* include per-STA, per-TID sequence counter */
 	tid = ieee80211_get_tid(hdr);
-	tx->sta->deflink.tx_stats.msdu[tid]++;
+	txstats = sta_tx_stats_begin(&tx->sta->deflink);
+	txstats->msdu[tid]++;
+	sta_tx_stats_end(txstats);
 
 	hdr->seq_ctrl = ieee80211_tx_next_seq(tx->sta, tid);
 
@@ -1025,18 +1047,21 @@ ieee80211_tx_h_fragment(struct ieee80211_tx_data *tx)
 static ieee80211_tx_result debug_noinline
 ieee80211_tx_h_stats(struct ieee80211_tx_data *tx)
 {
+	struct ieee80211_sta_tx_counters *txstats;
 	struct sk_buff *skb;
 	int ac = -1;
 
 	if (!tx->sta)
 		return TX_CONTINUE;
 
+	txstats = sta_tx_stats_begin(&tx->sta->deflink);
 	skb_queue_walk(&tx->skbs, skb) {
 		ac = skb_get_queue_mapping(skb);
-		tx->sta->deflink.tx_stats.bytes[ac] += skb->len;
+		txstats->bytes[ac] += skb->len;
 	}
 	if (ac >= 0)
-		tx->sta->deflink.tx_stats.packets[ac]++;
+		txstats->packets[ac]++;
+	sta_tx_stats_end(txstats);
 
 	return TX_CONTINUE;
 }
@@ -1445,11 +1470,11 @@ static void ieee80211_txq_enqueue(struct ieee80211_local *local,
 {
 	struct fq *fq = &local->fq;
 	struct fq_tin *tin = &txqi->tin;
-	u32 flow_idx = fq_flow_idx(fq, skb);
+	u32 flow_idx = fq_flow_idx(fq, tin, skb);
 
 	ieee80211_set_skb_enqueue_time(skb);
 
-	spin_lock_bh(&fq->lock);
+	fq_tin_lock_bh(fq, tin);
 	/*
 	 * For management frames, don't really apply codel etc.,
 	 * we don't want to apply any shaping or anything we just
@@ -1464,7 +1489,7 @@ static void ieee80211_txq_enqueue(struct ieee80211_local *local,
 		fq_tin_enqueue(fq, tin, flow_idx, skb,
 			       fq_skb_free_func);
 	}
-	spin_unlock_bh(&fq->lock);
+	fq_tin_unlock_bh(fq, tin);
 }
 
 static bool fq_vlan_filter_func(struct fq *fq, struct fq_tin *tin,
@@ -1495,17 +1520,32 @@ void ieee80211_txq_remove_vlan(struct ieee80211_local *local,
 	txqi = to_txq_info(ap->vif.txq);
 	tin = &txqi->tin;
 
-	spin_lock_bh(&fq->lock);
+	fq_tin_lock_bh(fq, tin);
 	fq_tin_filter(fq, tin, fq_vlan_filter_func, &sdata->vif,
 		      fq_skb_free_func);
-	spin_unlock_bh(&fq->lock);
+	fq_tin_unlock_bh(fq, tin);
+}
+
+/*
+ * Spread txqs over the fq shards by station (or interface) address, so that
+ * all txqs of one station share a lock and different stations mostly don't.
+ */
+static unsigned int ieee80211_txq_fq_shard(struct ieee80211_local *local,
+					   struct ieee80211_sub_if_data *sdata,
+					   struct sta_info *sta)
+{
+	const u8 *addr = sta ? sta->sta.addr : sdata->vif.addr;
+
+	return reciprocal_scale(jhash(addr, ETH_ALEN, 0),
+				local->fq.shards_cnt);
 }
 
 void ieee80211_txq_init(struct ieee80211_sub_if_data *sdata,
 			struct sta_info *sta,
 			struct txq_info *txqi, int tid)
 {
-	fq_tin_init(&txqi->tin);
+	fq_tin_init(&txqi->tin, ieee80211_txq_fq_shard(sdata->local, sdata,
+						       sta));
 	codel_vars_init(&txqi->def_cvars);
 	codel_stats_init(&txqi->cstats);
 	__skb_queue_head_init(&txqi->frags);
@@ -1548,13 +1588,13 @@ void ieee80211_txq_purge(struct ieee80211_local *local,
 	struct fq *fq = &local->fq;
 	struct fq_tin *tin = &txqi->tin;
 
-	spin_lock_bh(&fq->lock);
+	fq_tin_lock_bh(fq, tin);
 	fq_tin_reset(fq, tin, fq_skb_free_func);
 	ieee80211_purge_tx_queue(&local->hw, &txqi->frags);
-	spin_unlock_bh(&fq->lock);
+	fq_tin_unlock_bh(fq, tin);
 
 	spin_lock_bh(&local->active_txq_lock[txqi->txq.ac]);
-	list_del_init(&txqi->schedule_order);
+	ieee80211_txq_sched_del(local, txqi);
 	spin_unlock_bh(&local->active_txq_lock[txqi->txq.ac]);
 }
 
@@ -1584,7 +1624,8 @@ int ieee80211_txq_setup_flows(struct ieee80211_local *local)
 	bool supp_vht = false;
 	enum nl80211_band band;
 
-	ret = fq_init(fq, 4096);
+	ret = fq_init(fq, 4096, min_t(unsigned int, num_possible_cpus(),
+				      FQ_MAX_SHARDS));
 	if (ret)
 		return ret;
 
@@ -1613,9 +1654,9 @@ int ieee80211_txq_setup_flows(struct ieee80211_local *local)
 	local->cvars = kvcalloc(fq->flows_cnt, sizeof(local->cvars[0]),
 				GFP_KERNEL);
 	if (!local->cvars) {
-		spin_lock_bh(&fq->lock);
+		fq_lock_all_bh(fq);
 		fq_reset(fq, fq_skb_free_func);
-		spin_unlock_bh(&fq->lock);
+		fq_unlock_all_bh(fq);
 		return -ENOMEM;
 	}
 
@@ -1634,9 +1675,9 @@ void ieee80211_txq_teardown_flows(struct ieee80211_local *local)
 	kvfree(local->cvars);
 	local->cvars = NULL;
 
-	spin_lock_bh(&fq->lock);
+	fq_lock_all_bh(fq);
 	fq_reset(fq, fq_skb_free_func);
-	spin_unlock_bh(&fq->lock);
+	fq_unlock_all_bh(fq);
 }
 
 static bool ieee80211_queue_skb(struct ieee80211_local *local,
@@ -3409,7 +3450,7 @@ static bool ieee80211_amsdu_aggregate(struct ieee80211_sub_if_data *sdata,
 	u8 tid = skb->priority & IEEE80211_QOS_CTL_TAG1D_MASK;
 	struct ieee80211_txq *txq = sta->sta.txq[tid];
 	struct txq_info *txqi;
-	struct sk_buff **frag_tail, *head;
+	struct sk_buff **frag_tail, *head, *subhdr = NULL;
 	int subframe_len = skb->len - ETH_ALEN;
 	u8 max_subframes = sta->sta.max_amsdu_subframes;
 	int max_frags = local->hw.max_tx_fragments;
@@ -3450,15 +3491,29 @@ static bool ieee80211_amsdu_aggregate(struct ieee80211_sub_if_data *sdata,
 		max_amsdu_len = min_t(int, max_amsdu_len,
 				      sta->sta.cur->max_tid_amsdu_len[tid]);
 
-	flow_idx = fq_flow_idx(fq, skb);
+	/*
+	 * If the driver can take frag lists and the frame has no (writable)
+	 * room for the subframe header, put the header into a small buffer
+	 * of its own that's chained in front of the frame, instead of
+	 * reallocating and copying the whole frame.
+	 */
+	if (ieee80211_hw_check(&local->hw, TX_FRAG_LIST) &&
+	    (skb_headroom(skb) < sizeof(rfc1042_header) + 2 + 3 ||
+	     skb_header_cloned(skb))) {
+		subhdr = alloc_skb(IEEE80211_AMSDU_SUBHDR_MAX, GFP_ATOMIC);
+		if (!subhdr)
+			return false;
+	}
 
-	spin_lock_bh(&fq->lock);
+	tin = &txqi->tin;
+	flow_idx = fq_flow_idx(fq, tin, skb);
+
+	fq_tin_lock_bh(fq, tin);
 
 	/* TODO: Ideally aggregation should be done on dequeue to remain
 	 * responsive to environment changes.
 	 */
 
-	tin = &txqi->tin;
 	flow = fq_flow_classify(fq, tin, flow_idx, skb);
 	head = skb_peek_tail(&flow->queue);
 	if (!head || skb_is_gso(head))
@@ -3470,13 +3525,15 @@ static bool ieee80211_amsdu_aggregate(struct ieee80211_sub_if_data *sdata,
 	if (skb->len + head->len > max_amsdu_len)
 		goto out;
 
-	nfrags = 1 + skb_shinfo(skb)->nr_frags;
+	nfrags = 1 + skb_shinfo(skb)->nr_frags + !!subhdr;
 	nfrags += 1 + skb_shinfo(head)->nr_frags;
 	frag_tail = &skb_shinfo(head)->frag_list;
 	while (*frag_tail) {
 		nfrags += 1 + skb_shinfo(*frag_tail)->nr_frags;
+		if (!(IEEE80211_SKB_CB(*frag_tail)->control.flags &
+		      IEEE80211_TX_INTCFL_AMSDU_SUBHDR))
+			n++;
 		frag_tail = &(*frag_tail)->next;
-		n++;
 	}
 
 	if (max_subframes && n > max_subframes)
@@ -3510,12 +3567,22 @@ static bool ieee80211_amsdu_aggregate(struct ieee80211_sub_if_data *sdata,
 	if ((head->len - hdrlen) & 3)
 		pad = 4 - ((head->len - hdrlen) & 3);
 
-	if (!ieee80211_amsdu_realloc_pad(local, skb, sizeof(rfc1042_header) +
-						     2 + pad))
-		goto out_recalc;
+	if (subhdr) {
+		/* the frame keeps only the ethertype and payload */
+		memset(skb_put(subhdr, pad), 0, pad);
+		data = skb_put(subhdr, 2 * ETH_ALEN + 2 +
+				       sizeof(rfc1042_header));
+		skb_pull(skb, 2 * ETH_ALEN);
+	} else {
+		if (!ieee80211_amsdu_realloc_pad(local, skb,
+						 sizeof(rfc1042_header) +
+						 2 + pad))
+			goto out_recalc;
+
+		data = skb_push(skb, ETH_ALEN + 2);
+	}
 
 	ret = true;
-	data = skb_push(skb, ETH_ALEN + 2);
 	ether_addr_copy(data, da);
 	ether_addr_copy(data + ETH_ALEN, sa);
 
@@ -3524,20 +3591,34 @@ static bool ieee80211_amsdu_aggregate(struct ieee80211_sub_if_data *sdata,
 	memcpy(data, &len, 2);
 	memcpy(data + 2, rfc1042_header, sizeof(rfc1042_header));
 
-	memset(skb_push(skb, pad), 0, pad);
+	if (subhdr) {
+		IEEE80211_SKB_CB(subhdr)->control.flags =
+			IEEE80211_TX_INTCFL_AMSDU_SUBHDR;
+		head->len += subhdr->len;
+		head->data_len += subhdr->len;
+		*frag_tail = subhdr;
+		frag_tail = &subhdr->next;
+		subhdr = NULL;
+	} else {
+		memset(skb_push(skb, pad), 0, pad);
+	}
 
+	IEEE80211_SKB_CB(skb)->control.flags &=
+		~IEEE80211_TX_INTCFL_AMSDU_SUBHDR;
 	head->len += skb->len;
 	head->data_len += skb->len;
 	*frag_tail = skb;
 
 out_recalc:
-	fq->memory_usage += head->truesize - orig_truesize;
+	fq_adjust_truesize(fq, tin, head->truesize - orig_truesize);
 	if (head->len != orig_len) {
 		flow->backlog += head->len - orig_len;
 		tin->backlog_bytes += head->len - orig_len;
 	}
 out:
-	spin_unlock_bh(&fq->lock);
+	fq_tin_unlock_bh(fq, tin);
+
+	kfree_skb(subhdr);
 
 	return ret;
 }
@@ -3555,6 +3636,7 @@ ieee80211_xmit_fast_finish(struct ieee80211_sub_if_data *sdata,
 	struct sk_buff *skb = tx->skb;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	struct ieee80211_hdr *hdr = (void *)skb->data;
+	struct ieee80211_sta_tx_counters *txstats;
 	u8 tid = IEEE80211_NUM_TIDS;
 
 	if (!ieee80211_hw_check(&tx->local->hw, HAS_RATE_CONTROL) &&
@@ -3575,19 +3657,21 @@ ieee80211_xmit_fast_finish(struct ieee80211_sub_if_data *sdata,
 		sdata->sequence_number += 0x10;
 	}
 
+	txstats = sta_tx_stats_begin(&sta->deflink);
 	if (skb_shinfo(skb)->gso_size)
-		sta->deflink.tx_stats.msdu[tid] +=
+		txstats->msdu[tid] +=
 			DIV_ROUND_UP(skb->len, skb_shinfo(skb)->gso_size);
 	else
-		sta->deflink.tx_stats.msdu[tid]++;
+		txstats->msdu[tid]++;
 
 	info->hw_queue = sdata->vif.hw_queue[skb_get_queue_mapping(skb)];
 
 	/* statistics normally done by ieee80211_tx_h_stats (but that
 	 * has to consider fragmentation, so is more complex)
 	 */
-	sta->deflink.tx_stats.bytes[skb_get_queue_mapping(skb)] += skb->len;
-	sta->deflink.tx_stats.packets[skb_get_queue_mapping(skb)]++;
+	txstats->bytes[skb_get_queue_mapping(skb)] += skb->len;
+	txstats->packets[skb_get_queue_mapping(skb)]++;
+	sta_tx_stats_end(txstats);
 
 	if (pn_offs) {
 		u64 pn;
@@ -3598,7 +3682,7 @@ ieee80211_xmit_fast_finish(struct ieee80211_sub_if_data *sdata,
 		case WLAN_CIPHER_SUITE_CCMP_256:
 		case WLAN_CIPHER_SUITE_GCMP:
 		case WLAN_CIPHER_SUITE_GCMP_256:
-			pn = atomic64_inc_return(&key->conf.tx_pn);
+			pn = ieee80211_key_next_tx_pn(key);
 			crypto_hdr[0] = pn;
 			crypto_hdr[1] = pn >> 8;
 			crypto_hdr[3] = 0x20 | (key->conf.keyidx << 6);
@@ -3804,60 +3888,50 @@ static bool ieee80211_xmit_fast(struct ieee80211_sub_if_data *sdata,
 	return true;
 }
 
-struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
-				     struct ieee80211_txq *txq)
+/*
+ * Account the time @skb spent on the txq and remember when it was dequeued,
+ * for the station's TX latency statistics. The enqueue time lives in the
+ * control data that the driver overwrites with the TX status, so the dequeue
+ * time is kept in skb->tstamp until ieee80211_tx_status_ext() picks it up.
+ */
+static void ieee80211_tx_latency_dequeued(struct sta_info *sta,
+					  struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	u64 now = ktime_get_ns();
+	codel_time_t delay;
+	unsigned int bin;
+
+	delay = (codel_time_t)(now >> CODEL_SHIFT) -
+		info->control.enqueue_time;
+	bin = sta_tx_latency_bin((u64)delay << CODEL_SHIFT);
+	this_cpu_inc(sta->tx_latency->queue[skb_get_queue_mapping(skb)][bin]);
+
+	skb->tstamp = ns_to_ktime(now);
+	info->tx_latency = 1;
+}
+
+/*
+ * Finish a frame that was pulled off a txq: re-select the key, run the late
+ * TX handlers and resolve the vif the driver should see. Any additional
+ * fragments created by the handlers are appended to @frags. Returns %NULL
+ * if the frame was dropped, otherwise *@airtime holds the AQL estimate that
+ * the caller must charge to the station.
+ */
+static struct sk_buff *
+ieee80211_tx_dequeue_finish(struct ieee80211_hw *hw, struct ieee80211_txq *txq,
+			    struct sk_buff *skb, struct sk_buff_head *frags,
+			    u32 *airtime)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
 	struct txq_info *txqi = container_of(txq, struct txq_info, txq);
 	struct ieee80211_hdr *hdr;
-	struct sk_buff *skb = NULL;
-	struct fq *fq = &local->fq;
-	struct fq_tin *tin = &txqi->tin;
 	struct ieee80211_tx_info *info;
 	struct ieee80211_tx_data tx;
 	ieee80211_tx_result r;
 	struct ieee80211_vif *vif = txq->vif;
-	int q = vif->hw_queue[txq->ac];
-	unsigned long flags;
-	bool q_stopped;
 
-	WARN_ON_ONCE(softirq_count() == 0);
-
-	if (!ieee80211_txq_airtime_check(hw, txq))
-		return NULL;
-
-begin:
-	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
-	q_stopped = local->queue_stop_reasons[q];
-	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
-
-	if (unlikely(q_stopped)) {
-		/* mark for waking later */
-		set_bit(IEEE80211_TXQ_DIRTY, &txqi->flags);
-		return NULL;
-	}
-
-	spin_lock_bh(&fq->lock);
-
-	/* Make sure fragments stay together. */
-	skb = __skb_dequeue(&txqi->frags);
-	if (unlikely(skb)) {
-		if (!(IEEE80211_SKB_CB(skb)->control.flags &
-				IEEE80211_TX_INTCFL_NEED_TXPROCESSING))
-			goto out;
-		IEEE80211_SKB_CB(skb)->control.flags &=
-			~IEEE80211_TX_INTCFL_NEED_TXPROCESSING;
-	} else {
-		if (unlikely(test_bit(IEEE80211_TXQ_STOP, &txqi->flags)))
-			goto out;
-
-		skb = fq_tin_dequeue(fq, tin, fq_tin_dequeue_func);
-	}
-
-	if (!skb)
-		goto out;
-
-	spin_unlock_bh(&fq->lock);
+	*airtime = 0;
 
 	hdr = (struct ieee80211_hdr *)skb->data;
 	info = IEEE80211_SKB_CB(skb);
@@ -3885,8 +3959,7 @@ begin:
 			      !ieee80211_is_our_addr(tx.sdata, hdr->addr2,
 						     NULL)))) {
 			I802_DEBUG_INC(local->tx_handlers_drop_unauth_port);
-			ieee80211_free_txskb(&local->hw, skb);
-			goto begin;
+			goto drop;
 		}
 	}
 
@@ -3895,10 +3968,8 @@ begin:
 	 * this here to get the current key.
 	 */
 	r = ieee80211_tx_h_select_key(&tx);
-	if (r != TX_CONTINUE) {
-		ieee80211_free_txskb(&local->hw, skb);
-		goto begin;
-	}
+	if (r != TX_CONTINUE)
+		goto drop;
 
 	if (test_bit(IEEE80211_TXQ_AMPDU, &txqi->flags))
 		info->flags |= (IEEE80211_TX_CTL_AMPDU |
@@ -3907,10 +3978,8 @@ begin:
 	if (info->flags & IEEE80211_TX_CTL_HW_80211_ENCAP) {
 		if (!ieee80211_hw_check(&local->hw, HAS_RATE_CONTROL)) {
 			r = ieee80211_tx_h_rate_ctrl(&tx);
-			if (r != TX_CONTINUE) {
-				ieee80211_free_txskb(&local->hw, skb);
-				goto begin;
-			}
+			if (r != TX_CONTINUE)
+				goto drop;
 		}
 		goto encap_out;
 	}
@@ -3926,30 +3995,22 @@ begin:
 
 		r = ieee80211_xmit_fast_finish(sta->sdata, sta, pn_offs,
 					       tx.key, &tx);
-		if (r != TX_CONTINUE) {
-			ieee80211_free_txskb(&local->hw, skb);
-			goto begin;
-		}
+		if (r != TX_CONTINUE)
+			goto drop;
 	} else {
 		if (invoke_tx_handlers_late(&tx))
-			goto begin;
+			return NULL;
 
 		skb = __skb_dequeue(&tx.skbs);
 		info = IEEE80211_SKB_CB(skb);
 
-		if (!skb_queue_empty(&tx.skbs)) {
-			spin_lock_bh(&fq->lock);
-			skb_queue_splice_tail(&tx.skbs, &txqi->frags);
-			spin_unlock_bh(&fq->lock);
-		}
+		skb_queue_splice_tail(&tx.skbs, frags);
 	}
 
 	if (skb_has_frag_list(skb) &&
 	    !ieee80211_hw_check(&local->hw, TX_FRAG_LIST)) {
-		if (skb_linearize(skb)) {
-			ieee80211_free_txskb(&local->hw, skb);
-			goto begin;
-		}
+		if (skb_linearize(skb))
+			goto drop;
 	}
 
 	switch (tx.sdata->vif.type) {
@@ -3966,8 +4027,7 @@ begin:
 			info->hw_queue =
 				vif->hw_queue[skb_get_queue_mapping(skb)];
 		} else if (ieee80211_hw_check(&local->hw, QUEUE_CONTROL)) {
-			ieee80211_free_txskb(&local->hw, skb);
-			goto begin;
+			goto drop;
 		} else {
 			info->control.vif = NULL;
 			return skb;
@@ -3988,28 +4048,218 @@ encap_out:
 	if (tx.sta &&
 	    wiphy_ext_feature_isset(local->hw.wiphy, NL80211_EXT_FEATURE_AQL)) {
 		bool ampdu = txq->ac != IEEE80211_AC_VO;
-		u32 airtime;
-
-		airtime = ieee80211_calc_expected_tx_airtime(hw, vif, txq->sta,
-							     skb->len, ampdu);
-		if (airtime) {
-			airtime = ieee80211_info_set_tx_time_est(info, airtime);
-			ieee80211_sta_update_pending_airtime(local, tx.sta,
-							     txq->ac,
-							     airtime,
-							     false);
-		}
+		u32 est;
+
+		est = ieee80211_calc_expected_tx_airtime(hw, vif, txq->sta,
+							 skb->len, ampdu);
+		if (est)
+			*airtime = ieee80211_info_set_tx_time_est(info, est);
 	}
 
+	if (tx.sta)
+		ieee80211_tx_latency_dequeued(tx.sta, skb);
+
+	return skb;
+
+drop:
+	ieee80211_free_txskb(&local->hw, skb);
+	return NULL;
+}
+
+static void ieee80211_txq_charge_airtime(struct ieee80211_local *local,
+					 struct ieee80211_txq *txq,
+					 u32 airtime)
+{
+	struct sta_info *sta = container_of(txq->sta, struct sta_info, sta);
+
+	while (airtime) {
+		u16 chunk = min_t(u32, airtime, U16_MAX);
+
+		ieee80211_sta_update_pending_airtime(local, sta, txq->ac,
+						     chunk, false);
+		airtime -= chunk;
+	}
+}
+
+static bool ieee80211_txq_hw_queue_stopped(struct ieee80211_local *local,
+					   struct txq_info *txqi)
+{
+	int q = txqi->txq.vif->hw_queue[txqi->txq.ac];
+	unsigned long flags;
+	bool q_stopped;
+
+	spin_lock_irqsave(&local->queue_stop_reason_lock, flags);
+	q_stopped = local->queue_stop_reasons[q];
+	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
+
+	if (unlikely(q_stopped)) {
+		/* mark for waking later */
+		set_bit(IEEE80211_TXQ_DIRTY, &txqi->flags);
+		return true;
+	}
+
+	return false;
+}
+
+struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
+				     struct ieee80211_txq *txq)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct txq_info *txqi = container_of(txq, struct txq_info, txq);
+	struct sk_buff_head frags;
+	struct sk_buff *skb = NULL;
+	struct fq *fq = &local->fq;
+	struct fq_tin *tin = &txqi->tin;
+	u32 airtime;
+
+	WARN_ON_ONCE(softirq_count() == 0);
+
+	if (!ieee80211_txq_airtime_check(hw, txq))
+		return NULL;
+
+	__skb_queue_head_init(&frags);
+
+begin:
+	if (ieee80211_txq_hw_queue_stopped(local, txqi))
+		return NULL;
+
+	fq_tin_lock_bh(fq, tin);
+
+	/* Make sure fragments stay together. */
+	skb = __skb_dequeue(&txqi->frags);
+	if (unlikely(skb)) {
+		if (!(IEEE80211_SKB_CB(skb)->control.flags &
+				IEEE80211_TX_INTCFL_NEED_TXPROCESSING))
+			goto out;
+		IEEE80211_SKB_CB(skb)->control.flags &=
+			~IEEE80211_TX_INTCFL_NEED_TXPROCESSING;
+	} else {
+		if (unlikely(test_bit(IEEE80211_TXQ_STOP, &txqi->flags)))
+			goto out;
+
+		skb = fq_tin_dequeue(fq, tin, fq_tin_dequeue_func);
+	}
+
+	if (!skb)
+		goto out;
+
+	fq_tin_unlock_bh(fq, tin);
+
+	skb = ieee80211_tx_dequeue_finish(hw, txq, skb, &frags, &airtime);
+
+	if (unlikely(!skb_queue_empty(&frags))) {
+		fq_tin_lock_bh(fq, tin);
+		skb_queue_splice_tail_init(&frags, &txqi->frags);
+		fq_tin_unlock_bh(fq, tin);
+	}
+
+	if (!skb)
+		goto begin;
+
+	if (airtime)
+		ieee80211_txq_charge_airtime(local, txq, airtime);
+
 	return skb;
 
 out:
-	spin_unlock_bh(&fq->lock);
+	fq_tin_unlock_bh(fq, tin);
 
 	return skb;
 }
 EXPORT_SYMBOL(ieee80211_tx_dequeue);
 
+unsigned int ieee80211_tx_dequeue_bulk(struct ieee80211_hw *hw,
+				       struct ieee80211_txq *txq,
+				       struct sk_buff_head *skbs,
+				       unsigned int max_frames,
+				       u32 max_airtime)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct txq_info *txqi = container_of(txq, struct txq_info, txq);
+	struct sk_buff_head pulled, frags;
+	struct fq *fq = &local->fq;
+	struct fq_tin *tin = &txqi->tin;
+	u32 airtime, total_airtime = 0;
+	unsigned int n = 0;
+	struct sk_buff *skb;
+
+	WARN_ON_ONCE(softirq_count() == 0);
+
+	if (!max_frames || !ieee80211_txq_airtime_check(hw, txq))
+		return 0;
+
+	if (ieee80211_txq_hw_queue_stopped(local, txqi))
+		return 0;
+
+	__skb_queue_head_init(&pulled);
+	__skb_queue_head_init(&frags);
+
+	/*
+	 * Pull the whole burst under a single fq lock section. Frames taken
+	 * from the tin are tagged for TX processing so that any we don't get
+	 * to below can be put back on the frags queue and be handled exactly
+	 * like the frames already there.
+	 */
+	fq_tin_lock_bh(fq, tin);
+	while (skb_queue_len(&pulled) < max_frames) {
+		skb = __skb_dequeue(&txqi->frags);
+		if (!skb) {
+			if (unlikely(test_bit(IEEE80211_TXQ_STOP,
+					      &txqi->flags)))
+				break;
+
+			skb = fq_tin_dequeue(fq, tin, fq_tin_dequeue_func);
+			if (!skb)
+				break;
+
+			IEEE80211_SKB_CB(skb)->control.flags |=
+				IEEE80211_TX_INTCFL_NEED_TXPROCESSING;
+		}
+		__skb_queue_tail(&pulled, skb);
+	}
+	fq_tin_unlock_bh(fq, tin);
+
+	while ((skb = __skb_dequeue(&pulled))) {
+		struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+
+		if (!(info->control.flags &
+		      IEEE80211_TX_INTCFL_NEED_TXPROCESSING)) {
+			__skb_queue_tail(skbs, skb);
+			n++;
+			continue;
+		}
+
+		info->control.flags &= ~IEEE80211_TX_INTCFL_NEED_TXPROCESSING;
+
+		skb = ieee80211_tx_dequeue_finish(hw, txq, skb, &frags,
+						  &airtime);
+		if (skb) {
+			__skb_queue_tail(skbs, skb);
+			n++;
+		}
+
+		/* fragments of this MSDU go out right behind it */
+		n += skb_queue_len(&frags);
+		skb_queue_splice_tail_init(&frags, skbs);
+
+		total_airtime += airtime;
+		if (max_airtime && total_airtime >= max_airtime)
+			break;
+	}
+
+	if (unlikely(!skb_queue_empty(&pulled))) {
+		fq_tin_lock_bh(fq, tin);
+		skb_queue_splice_init(&pulled, &txqi->frags);
+		fq_tin_unlock_bh(fq, tin);
+	}
+
+	if (total_airtime)
+		ieee80211_txq_charge_airtime(local, txq, total_airtime);
+
+	return n;
+}
+EXPORT_SYMBOL(ieee80211_tx_dequeue_bulk);
+
 static inline s32 ieee80211_sta_deficit(struct sta_info *sta, u8 ac)
 {
 	struct airtime_info *air_info = &sta->airtime[ac];
@@ -4017,6 +4267,104 @@ static inline s32 ieee80211_sta_deficit(struct sta_info *sta, u8 ac)
 	return air_info->deficit - atomic_read(&air_info->aql_tx_pending);
 }
 
+void ieee80211_txq_sched_init(struct ieee80211_local *local)
+{
+	int ac, i;
+
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+		struct ieee80211_txq_sched *sched = &local->txq_sched[ac];
+
+		spin_lock_init(&local->active_txq_lock[ac]);
+		for (i = 0; i < IEEE80211_TXQ_SCHED_SLOTS; i++)
+			INIT_LIST_HEAD(&sched->slots[i]);
+		sched->used = 0;
+		sched->round = 0;
+		sched->num_txqs = 0;
+	}
+}
+EXPORT_SYMBOL_IF_MAC80211_KUNIT(ieee80211_txq_sched_init);
+
+static void ieee80211_txq_sched_add(struct ieee80211_local *local,
+				    struct txq_info *txqi, u64 round,
+				    bool head)
+{
+	struct ieee80211_txq_sched *sched = &local->txq_sched[txqi->txq.ac];
+	u64 last = sched->round + IEEE80211_TXQ_SCHED_SLOTS - 1;
+	u8 slot = min(round, last) % IEEE80211_TXQ_SCHED_SLOTS;
+
+	txqi->sched_round = round;
+	txqi->sched_slot = slot;
+	if (head)
+		list_add(&txqi->schedule_order, &sched->slots[slot]);
+	else
+		list_add_tail(&txqi->schedule_order, &sched->slots[slot]);
+	sched->used |= BIT_ULL(slot);
+	sched->num_txqs++;
+}
+
+void ieee80211_txq_sched_del(struct ieee80211_local *local,
+			     struct txq_info *txqi)
+{
+	struct ieee80211_txq_sched *sched = &local->txq_sched[txqi->txq.ac];
+	u8 slot = txqi->sched_slot;
+
+	lockdep_assert_held(&local->active_txq_lock[txqi->txq.ac]);
+
+	if (list_empty(&txqi->schedule_order))
+		return;
+
+	list_del_init(&txqi->schedule_order);
+	if (list_empty(&sched->slots[slot]))
+		sched->used &= ~BIT_ULL(slot);
+	sched->num_txqs--;
+}
+
+static void ieee80211_txq_sched_move(struct ieee80211_local *local,
+				     struct txq_info *txqi, u64 round)
+{
+	ieee80211_txq_sched_del(local, txqi);
+	ieee80211_txq_sched_add(local, txqi, round, false);
+}
+
+/*
+ * Advance to the first round that has TXQs filed under it and return the
+ * first of those, or %NULL if there are no active TXQs.
+ */
+static struct txq_info *
+ieee80211_txq_sched_peek(struct ieee80211_local *local, u8 ac)
+{
+	struct ieee80211_txq_sched *sched = &local->txq_sched[ac];
+	unsigned int cur, dist;
+
+	if (!sched->used)
+		return NULL;
+
+	/* rotate the current round's slot down to bit 0 */
+	cur = sched->round % IEEE80211_TXQ_SCHED_SLOTS;
+	dist = __ffs64(ror64(sched->used, cur));
+	sched->round += dist;
+
+	return list_first_entry(&sched->slots[(cur + dist) %
+					      IEEE80211_TXQ_SCHED_SLOTS],
+				struct txq_info, schedule_order);
+}
+
+/*
+ * The round by which the station will have been credited enough to have
+ * a non-negative deficit again; its credit must be in sync.
+ */
+static u64 ieee80211_sta_due_round(struct ieee80211_local *local,
+				   struct sta_info *sta, u8 ac)
+{
+	s32 deficit = ieee80211_sta_deficit(sta, ac);
+	u64 round = local->txq_sched[ac].round;
+
+	if (deficit >= 0)
+		return round;
+
+	return round + DIV_ROUND_UP((u32)-deficit, sta->airtime_weight);
+}
+
 static void
 ieee80211_txq_set_active(struct txq_info *txqi)
 {
@@ -4038,6 +4386,7 @@ ieee80211_txq_keep_active(struct txq_info *txqi)
 		return false;
 
 	sta = container_of(txqi->txq.sta, struct sta_info, sta);
+	ieee80211_sta_sync_airtime(sta, txqi->txq.ac);
 	if (ieee80211_sta_deficit(sta, txqi->txq.ac) >= 0)
 		return false;
 
@@ -4047,9 +4396,11 @@ ieee80211_txq_keep_active(struct txq_info *txqi)
 struct ieee80211_txq *ieee80211_next_txq(struct ieee80211_hw *hw, u8 ac)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
+	struct ieee80211_txq_sched *sched = &local->txq_sched[ac];
 	struct ieee80211_txq *ret = NULL;
-	struct txq_info *txqi = NULL, *head = NULL;
+	struct txq_info *txqi;
 	bool found_eligible_txq = false;
+	unsigned int visited = 0;
 
 	spin_lock_bh(&local->active_txq_lock[ac]);
 
@@ -4057,38 +4408,39 @@ struct ieee80211_txq *ieee80211_next_txq(struct ieee80211_hw *hw, u8 ac)
 		goto out;
 
  begin:
-	txqi = list_first_entry_or_null(&local->active_txqs[ac],
-					struct txq_info,
-					schedule_order);
+	txqi = ieee80211_txq_sched_peek(local, ac);
 	if (!txqi)
 		goto out;
 
-	if (txqi == head) {
+	/* parked in the calendar's last slot, file it closer to its round */
+	if (txqi->sched_round > sched->round) {
+		ieee80211_txq_sched_move(local, txqi, txqi->sched_round);
+		goto begin;
+	}
+
+	/* give up after looking at each TXQ once without any passing AQL */
+	if (visited++ == sched->num_txqs) {
 		if (!found_eligible_txq)
 			goto out;
-		else
-			found_eligible_txq = false;
+		found_eligible_txq = false;
+		visited = 1;
 	}
 
-	if (!head)
-		head = txqi;
-
 	if (txqi->txq.sta) {
 		struct sta_info *sta = container_of(txqi->txq.sta,
 						    struct sta_info, sta);
 		bool aql_check = ieee80211_txq_airtime_check(hw, &txqi->txq);
-		s32 deficit = ieee80211_sta_deficit(sta, txqi->txq.ac);
+		u64 due;
+
+		ieee80211_sta_sync_airtime(sta, ac);
+		due = ieee80211_sta_due_round(local, sta, ac);
 
 		if (aql_check)
 			found_eligible_txq = true;
 
-		if (deficit < 0)
-			sta->airtime[txqi->txq.ac].deficit +=
-				sta->airtime_weight;
-
-		if (deficit < 0 || !aql_check) {
-			list_move_tail(&txqi->schedule_order,
-				       &local->active_txqs[txqi->txq.ac]);
+		if (due > sched->round || !aql_check) {
+			ieee80211_txq_sched_move(local, txqi,
+						 max(due, sched->round + 1));
 			goto begin;
 		}
 	}
@@ -4096,7 +4448,7 @@ struct ieee80211_txq *ieee80211_next_txq(struct ieee80211_hw *hw, u8 ac)
 	if (txqi->schedule_round == local->schedule_round[ac])
 		goto out;
 
-	list_del_init(&txqi->schedule_order);
+	ieee80211_txq_sched_del(local, txqi);
 	txqi->schedule_round = local->schedule_round[ac];
 	ret = &txqi->txq;
 
@@ -4120,20 +4472,19 @@ void __ieee80211_schedule_txq(struct ieee80211_hw *hw,
 	if (list_empty(&txqi->schedule_order) &&
 	    (has_queue || ieee80211_txq_keep_active(txqi))) {
 		/* If airtime accounting is active, always enqueue STAs at the
-		 * head of the list to ensure that they only get moved to the
-		 * back by the airtime DRR scheduler once they have a negative
-		 * deficit. A station that already has a negative deficit will
-		 * get immediately moved to the back of the list on the next
-		 * call to ieee80211_next_txq().
+		 * head of the current round to ensure that they only get
+		 * moved on by the airtime DRR scheduler once they have a
+		 * negative deficit. A station that already has a negative
+		 * deficit will get immediately filed under a later round on
+		 * the next call to ieee80211_next_txq().
 		 */
-		if (txqi->txq.sta && local->airtime_flags && has_queue &&
-		    wiphy_ext_feature_isset(local->hw.wiphy,
-					    NL80211_EXT_FEATURE_AIRTIME_FAIRNESS))
-			list_add(&txqi->schedule_order,
-				 &local->active_txqs[txq->ac]);
-		else
-			list_add_tail(&txqi->schedule_order,
-				      &local->active_txqs[txq->ac]);
+		bool head = txqi->txq.sta && local->airtime_flags &&
+			    has_queue &&
+			    wiphy_ext_feature_isset(local->hw.wiphy,
+						    NL80211_EXT_FEATURE_AIRTIME_FAIRNESS);
+
+		ieee80211_txq_sched_add(local, txqi,
+					local->txq_sched[txq->ac].round, head);
 		if (has_queue)
 			ieee80211_txq_set_active(txqi);
 	}
@@ -4180,16 +4531,12 @@ EXPORT_SYMBOL(ieee80211_txq_airtime_check);
 static bool
 ieee80211_txq_schedule_airtime_check(struct ieee80211_local *local, u8 ac)
 {
-	unsigned int num_txq = 0;
-	struct txq_info *txq;
+	unsigned int num_txq = local->txq_sched[ac].num_txqs;
 	u32 aql_limit;
 
 	if (!wiphy_ext_feature_isset(local->hw.wiphy, NL80211_EXT_FEATURE_AQL))
 		return true;
 
-	list_for_each_entry(txq, &local->active_txqs[ac], schedule_order)
-		num_txq++;
-
 	aql_limit = (num_txq - 1) * local->aql_txq_limit_low[ac] / 2 +
 		    local->aql_txq_limit_high[ac];
 
@@ -4200,7 +4547,7 @@ bool ieee80211_txq_may_transmit(struct ieee80211_hw *hw,
 				struct ieee80211_txq *txq)
 {
 	struct ieee80211_local *local = hw_to_local(hw);
-	struct txq_info *iter, *tmp, *txqi = to_txq_info(txq);
+	struct txq_info *txqi = to_txq_info(txq);
 	struct sta_info *sta;
 	u8 ac = txq->ac;
 
@@ -4215,34 +4562,22 @@ bool ieee80211_txq_may_transmit(struct ieee80211_hw *hw,
 	if (!ieee80211_txq_schedule_airtime_check(local, ac))
 		goto out;
 
-	list_for_each_entry_safe(iter, tmp, &local->active_txqs[ac],
-				 schedule_order) {
-		if (iter == txqi)
-			break;
-
-		if (!iter->txq.sta) {
-			list_move_tail(&iter->schedule_order,
-				       &local->active_txqs[ac]);
-			continue;
-		}
-		sta = container_of(iter->txq.sta, struct sta_info, sta);
-		if (ieee80211_sta_deficit(sta, ac) < 0)
-			sta->airtime[ac].deficit += sta->airtime_weight;
-		list_move_tail(&iter->schedule_order, &local->active_txqs[ac]);
-	}
-
 	sta = container_of(txqi->txq.sta, struct sta_info, sta);
+	ieee80211_sta_sync_airtime(sta, ac);
 	if (sta->airtime[ac].deficit >= 0)
 		goto out;
 
+	/* Not this station's turn yet: credit it for being passed over and
+	 * put it behind the other TXQs of the current round. The rounds
+	 * ieee80211_next_txq() moves through credit all other stations.
+	 */
 	sta->airtime[ac].deficit += sta->airtime_weight;
-	list_move_tail(&txqi->schedule_order, &local->active_txqs[ac]);
+	ieee80211_txq_sched_move(local, txqi, local->txq_sched[ac].round);
 	spin_unlock_bh(&local->active_txq_lock[ac]);
 
 	return false;
 out:
-	if (!list_empty(&txqi->schedule_order))
-		list_del_init(&txqi->schedule_order);
+	ieee80211_txq_sched_del(local, txqi);
 	spin_unlock_bh(&local->active_txq_lock[ac]);
 
 	return true;
@@ -4604,6 +4939,7 @@ static void ieee80211_8023_xmit(struct ieee80211_sub_if_data *sdata,
 {
 	struct ieee80211_tx_info *info;
 	struct ieee80211_local *local = sdata->local;
+	struct ieee80211_sta_tx_counters *txstats;
 	struct tid_ampdu_tx *tid_tx;
 	struct sk_buff *seg, *next;
 	unsigned int skbs = 0, len = 0;
@@ -4673,8 +5009,10 @@ static void ieee80211_8023_xmit(struct ieee80211_sub_if_data *sdata,
 	}
 
 	dev_sw_netstats_tx_add(dev, skbs, len);
-	sta->deflink.tx_stats.packets[queue] += skbs;
-	sta->deflink.tx_stats.bytes[queue] += len;
+	txstats = sta_tx_stats_begin(&sta->deflink);
+	txstats->packets[queue] += skbs;
+	txstats->bytes[queue] += len;
+	sta_tx_stats_end(txstats);
 
 	ieee80211_tpt_led_trig_tx(local, len);
 
@@ -320,6 +320,21 @@ void ieee80211_handle_wake_tx_queue(struct ieee80211_hw *hw,
 }
 EXPORT_SYMBOL(ieee80211_handle_wake_tx_queue);
 
+/*
+ * Clear the dirty mark of a txq under its shard lock, which orders it with
+ * the TX path of that txq without holding up the other shards.
+ */
+static bool ieee80211_txq_clear_dirty(struct fq *fq, struct txq_info *txqi)
+{
+	bool dirty;
+
+	fq_tin_lock_bh(fq, &txqi->tin);
+	dirty = test_and_clear_bit(IEEE80211_TXQ_DIRTY, &txqi->flags);
+	fq_tin_unlock_bh(fq, &txqi->tin);
+
+	return dirty;
+}
+
 static void __ieee80211_wake_txqs(struct ieee80211_sub_if_data *sdata, int ac)
 {
 	struct ieee80211_local *local = sdata->local;
@@ -331,7 +346,6 @@ static void __ieee80211_wake_txqs(struct ieee80211_sub_if_data *sdata, int ac)
 	int i;
 
 	local_bh_disable();
-	spin_lock(&fq->lock);
 
 	if (!test_bit(SDATA_STATE_RUNNING, &sdata->state))
 		goto out;
@@ -354,13 +368,10 @@ static void __ieee80211_wake_txqs(struct ieee80211_sub_if_data *sdata, int ac)
 			if (ac != txq->ac)
 				continue;
 
-			if (!test_and_clear_bit(IEEE80211_TXQ_DIRTY,
-						&txqi->flags))
+			if (!ieee80211_txq_clear_dirty(fq, txqi))
 				continue;
 
-			spin_unlock(&fq->lock);
 			drv_wake_tx_queue(local, txqi);
-			spin_lock(&fq->lock);
 		}
 	}
 
@@ -369,17 +380,12 @@ static void __ieee80211_wake_txqs(struct ieee80211_sub_if_data *sdata, int ac)
 
 	txqi = to_txq_info(vif->txq);
 
-	if (!test_and_clear_bit(IEEE80211_TXQ_DIRTY, &txqi->flags) ||
+	if (!ieee80211_txq_clear_dirty(fq, txqi) ||
 	    (ps && atomic_read(&ps->num_sta_ps)) || ac != vif->txq->ac)
 		goto out;
 
-	spin_unlock(&fq->lock);
-
 	drv_wake_tx_queue(local, txqi);
-	local_bh_enable();
-	return;
 out:
-	spin_unlock(&fq->lock);
 	local_bh_enable();
 }
 
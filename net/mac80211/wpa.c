@@ -230,7 +230,7 @@ static int tkip_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 		return 0;
 
 	/* Increase IV for the frame */
-	pn = atomic64_inc_return(&key->conf.tx_pn);
+	pn = ieee80211_key_next_tx_pn(key);
 	pos = ieee80211_tkip_add_iv(pos, &key->conf, pn);
 
 	/* hwaccel - with software IV */
@@ -471,7 +471,7 @@ static int ccmp_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb,
 
 	pos += hdrlen;
 
-	pn64 = atomic64_inc_return(&key->conf.tx_pn);
+	pn64 = ieee80211_key_next_tx_pn(key);
 
 	pn[5] = pn64;
 	pn[4] = pn64 >> 8;
@@ -672,7 +672,7 @@ static int gcmp_encrypt_skb(struct ieee80211_tx_data *tx, struct sk_buff *skb)
 
 	pos += hdrlen;
 
-	pn64 = atomic64_inc_return(&key->conf.tx_pn);
+	pn64 = ieee80211_key_next_tx_pn(key);
 
 	pn[5] = pn64;
 	pn[4] = pn64 >> 8;
@@ -857,7 +857,7 @@ ieee80211_crypto_aes_cmac_encrypt(struct ieee80211_tx_data *tx)
 	mmie->key_id = cpu_to_le16(key->conf.keyidx);
 
 	/* PN = PN + 1 */
-	pn64 = atomic64_inc_return(&key->conf.tx_pn);
+	pn64 = ieee80211_key_next_tx_pn(key);
 
 	bip_ipn_set64(mmie->sequence_number, pn64);
 
@@ -905,7 +905,7 @@ ieee80211_crypto_aes_cmac_256_encrypt(struct ieee80211_tx_data *tx)
 	mmie->key_id = cpu_to_le16(key->conf.keyidx);
 
 	/* PN = PN + 1 */
-	pn64 = atomic64_inc_return(&key->conf.tx_pn);
+	pn64 = ieee80211_key_next_tx_pn(key);
 
 	bip_ipn_set64(mmie->sequence_number, pn64);
 
@@ -1054,7 +1054,7 @@ ieee80211_crypto_aes_gmac_encrypt(struct ieee80211_tx_data *tx)
 	mmie->key_id = cpu_to_le16(key->conf.keyidx);
 
 	/* PN = PN + 1 */
-	pn64 = atomic64_inc_return(&key->conf.tx_pn);
+	pn64 = ieee80211_key_next_tx_pn(key);
 
 	bip_ipn_set64(mmie->sequence_number, pn64);
 
@@ -485,6 +485,11 @@ struct wiphy *wiphy_new_nm(const struct cfg80211_ops *ops, int sizeof_priv,
 	/* atomic_inc_return makes it start at 1, make it start at 0 */
 	rdev->wiphy_idx--;
 
+	if (cfg80211_bss_hash_init(rdev)) {
+		kfree(rdev);
+		return NULL;
+	}
+
 	/* give it a proper name */
 	if (requested_name && requested_name[0]) {
 		int rv;
@@ -513,6 +518,7 @@ use_default_name:
 		 */
 		rv = dev_set_name(&rdev->wiphy.dev, PHY_NAME "%d", rdev->wiphy_idx);
 		if (rv < 0) {
+			cfg80211_bss_hash_destroy(rdev);
 			kfree(rdev);
 			return NULL;
 		}
@@ -523,7 +529,6 @@ use_default_name:
 	INIT_LIST_HEAD(&rdev->beacon_registrations);
 	spin_lock_init(&rdev->beacon_registrations_lock);
 	spin_lock_init(&rdev->bss_lock);
-	INIT_LIST_HEAD(&rdev->bss_list);
 	INIT_LIST_HEAD(&rdev->sched_scan_req_list);
 	wiphy_work_init(&rdev->scan_done_wk, __cfg80211_scan_done);
 	INIT_DELAYED_WORK(&rdev->dfs_update_channels_wk,
@@ -1202,6 +1207,7 @@ void cfg80211_dev_free(struct cfg80211_registered_device *rdev)
 	}
 	list_for_each_entry_safe(scan, tmp, &rdev->bss_list, list)
 		cfg80211_put_bss(&rdev->wiphy, &scan->pub);
+	cfg80211_bss_hash_destroy(rdev);
 	mutex_destroy(&rdev->wiphy.mtx);
 
 	/*
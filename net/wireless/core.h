@@ -10,6 +10,7 @@
 #include <linux/list.h>
 #include <linux/netdevice.h>
 #include <linux/rbtree.h>
+#include <linux/rhashtable.h>
 #include <linux/debugfs.h>
 #include <linux/rfkill.h>
 #include <linux/workqueue.h>
@@ -67,9 +68,15 @@ struct cfg80211_registered_device {
 	/* BSSes/scanning */
 	spinlock_t bss_lock;
 	struct list_head bss_list;
-	struct rb_root bss_tree;
+	struct list_head bss_lru;
+	struct rhltable bss_hash;
+	struct rhltable bss_ssid_hash;
 	u32 bss_generation;
 	u32 bss_entries;
+	/* removed BSSes for incremental dumps, oldest first */
+	struct list_head bss_tombstones;
+	u32 n_bss_tombstones;
+	u32 bss_tombstone_floor;
 	struct cfg80211_scan_request *scan_req; /* protected by RTNL */
 	struct cfg80211_scan_request *int_scan_req;
 	struct sk_buff *scan_msg;
@@ -170,6 +177,20 @@ static inline int for_each_rdev_check_rtnl(void)
 	if (for_each_rdev_check_rtnl()) {} else				\
 		list_for_each_entry(rdev, &cfg80211_rdev_list, list)
 
+/*
+ * What an incremental scan dump reports for a removed BSS; tombstones
+ * older than %bss_tombstone_floor were dropped.
+ */
+struct cfg80211_bss_tombstone {
+	struct list_head list;
+	u32 generation;
+	u32 center_freq;
+	u16 freq_offset;
+	u8 bssid[ETH_ALEN];
+	u8 ssid_len;
+	u8 ssid[IEEE80211_MAX_SSID_LEN];
+};
+
 enum bss_source_type {
 	BSS_SOURCE_DIRECT = 0,
 	BSS_SOURCE_MBSSID,
@@ -179,7 +200,15 @@ enum bss_source_type {
 struct cfg80211_internal_bss {
 	struct list_head list;
 	struct list_head hidden_list;
-	struct rb_node rbn;
+	struct list_head lru;
+	struct rhlist_head hash_node;
+	struct rhlist_head ssid_node;
+	u8 hash_addr[ETH_ALEN] __aligned(2);
+	u32 ssid_hash;
+	/* scan generation of the last insertion or update */
+	u32 generation;
+	/* colocated APs from the RNR, see cfg80211_bss_get_rnr() */
+	struct cfg80211_bss_rnr *rnr;
 	unsigned long ts;
 	unsigned long refcount;
 	atomic_t hold;
@@ -318,6 +347,8 @@ int cfg80211_dev_rename(struct cfg80211_registered_device *rdev,
 
 void ieee80211_set_bitrate_flags(struct wiphy *wiphy);
 
+int cfg80211_bss_hash_init(struct cfg80211_registered_device *rdev);
+void cfg80211_bss_hash_destroy(struct cfg80211_registered_device *rdev);
 void cfg80211_bss_expire(struct cfg80211_registered_device *rdev);
 void cfg80211_bss_age(struct cfg80211_registered_device *rdev,
                       unsigned long age_secs);
@@ -574,6 +605,7 @@ int cfg80211_assoc_ml_reconf(struct cfg80211_registered_device *rdev,
  * struct cfg80211_colocated_ap - colocated AP information
  *
  * @list: linked list to all colocated APs
+ * @hash_node: node in the hash table used to find duplicates
  * @bssid: BSSID of the reported AP
  * @ssid: SSID of the reported AP
  * @ssid_len: length of the ssid
@@ -594,6 +626,7 @@ int cfg80211_assoc_ml_reconf(struct cfg80211_registered_device *rdev,
  */
 struct cfg80211_colocated_ap {
 	struct list_head list;
+	struct hlist_node hash_node;
 	u8 bssid[ETH_ALEN];
 	u8 ssid[IEEE80211_MAX_SSID_LEN];
 	size_t ssid_len;
@@ -609,6 +642,23 @@ struct cfg80211_colocated_ap {
 	s8 psd_20;
 };
 
+/**
+ * struct cfg80211_bss_rnr - colocated APs parsed from the RNR of a BSS
+ *
+ * The IEs of a BSS are replaced by every beacon and probe response, but
+ * the reduced neighbor report rarely changes, so keep the parsed APs as
+ * long as the elements they were parsed from are the same.
+ *
+ * @crc: CRC32 of the RNR and SSID elements the APs were parsed from
+ * @n_aps: number of entries in @aps
+ * @aps: the colocated APs, without duplicates
+ */
+struct cfg80211_bss_rnr {
+	u32 crc;
+	unsigned int n_aps;
+	struct cfg80211_colocated_ap aps[] __counted_by(n_aps);
+};
+
 #if IS_ENABLED(CPTCFG_CFG80211_KUNIT_TEST)
 #define EXPORT_SYMBOL_IF_CFG80211_KUNIT(sym) EXPORT_SYMBOL_IF_KUNIT(sym)
 #define VISIBLE_IF_CFG80211_KUNIT
@@ -617,9 +667,25 @@ void cfg80211_free_coloc_ap_list(struct list_head *coloc_ap_list);
 int cfg80211_parse_colocated_ap(const struct cfg80211_bss_ies *ies,
 				struct list_head *list);
 
+struct cfg80211_colocated_ap *
+cfg80211_collect_colocated_aps(struct cfg80211_registered_device *rdev,
+			       const u8 *bssid, unsigned int *n_aps);
+
 size_t cfg80211_gen_new_ie(const u8 *ie, size_t ielen,
 			   const u8 *subie, size_t subie_len,
 			   u8 *new_ie, size_t new_ie_len);
+
+const struct ieee80211_reg_rule *
+freq_reg_info_regd(u32 center_freq,
+		   const struct ieee80211_regdomain *regd, u32 bw);
+
+struct fwdb_header;
+struct fwdb_country;
+
+const struct fwdb_header *regdb_replace(const struct fwdb_header *db);
+const struct fwdb_country *regdb_find_country(const char *alpha2);
+const struct ieee80211_regdomain *regdb_cache_get(const char *alpha2);
+void regdb_cache_add(struct ieee80211_regdomain *regd);
 #else
 #define EXPORT_SYMBOL_IF_CFG80211_KUNIT(sym)
 #define VISIBLE_IF_CFG80211_KUNIT static
@@ -851,6 +851,8 @@ static const struct nla_policy nl80211_policy[NUM_NL80211_ATTR] = {
 	[NL80211_ATTR_MLO_RECONF_REM_LINKS] = { .type = NLA_U16 },
 	[NL80211_ATTR_EPCS] = { .type = NLA_FLAG },
 	[NL80211_ATTR_ASSOC_MLD_EXT_CAPA_OPS] = { .type = NLA_U16 },
+	[NL80211_ATTR_BSS_DUMP_SINCE_GENERATION] = { .type = NLA_U32 },
+	[NL80211_ATTR_STA_RC_RATE_STATS] = { .type = NLA_FLAG },
 };
 
 /* policy for the key attributes */
@@ -6705,6 +6707,55 @@ static bool nl80211_put_signal(struct sk_buff *msg, u8 mask, s8 *signal,
 	return true;
 }
 
+static int nl80211_put_tx_latency_hist(struct sk_buff *msg, int id,
+				       const u32 *hist)
+{
+	struct nlattr *attr;
+	int i;
+
+	attr = nla_nest_start_noflag(msg, id);
+	if (!attr)
+		return -ENOBUFS;
+
+	for (i = 0; i < NL80211_TX_LATENCY_BINS; i++) {
+		if (hist[i] && nla_put_u32(msg, i + 1, hist[i]))
+			return -ENOBUFS;
+	}
+
+	nla_nest_end(msg, attr);
+
+	return 0;
+}
+
+static int nl80211_put_tx_latency(struct sk_buff *msg,
+				  const struct cfg80211_tx_latency *lat)
+{
+	struct nlattr *latattr, *acattr;
+	int ac;
+
+	latattr = nla_nest_start_noflag(msg, NL80211_STA_INFO_TX_LATENCY);
+	if (!latattr)
+		return -ENOBUFS;
+
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+		acattr = nla_nest_start_noflag(msg, ac + 1);
+		if (!acattr)
+			return -ENOBUFS;
+
+		if (nl80211_put_tx_latency_hist(msg, NL80211_TX_LATENCY_QUEUE,
+						lat->queue[ac]) ||
+		    nl80211_put_tx_latency_hist(msg, NL80211_TX_LATENCY_DRIVER,
+						lat->driver[ac]))
+			return -ENOBUFS;
+
+		nla_nest_end(msg, acattr);
+	}
+
+	nla_nest_end(msg, latattr);
+
+	return 0;
+}
+
 static int nl80211_send_station(struct sk_buff *msg, u32 cmd, u32 portid,
 				u32 seq, int flags,
 				struct cfg80211_registered_device *rdev,
@@ -6904,6 +6955,16 @@ static int nl80211_send_station(struct sk_buff *msg, u32 cmd, u32 portid,
 		nla_nest_end(msg, tidsattr);
 	}
 
+	if (sinfo->tx_latency &&
+	    nl80211_put_tx_latency(msg, sinfo->tx_latency))
+		goto nla_put_failure;
+
+	if (sinfo->rc_stats && sinfo->n_rc_stats &&
+	    nla_put(msg, NL80211_STA_INFO_RC_RATE_STATS,
+		    sinfo->n_rc_stats * sizeof(*sinfo->rc_stats),
+		    sinfo->rc_stats))
+		goto nla_put_failure;
+
 	nla_nest_end(msg, sinfoattr);
 
 	if (sinfo->assoc_req_ies_len &&
@@ -6940,6 +7001,7 @@ static int nl80211_send_station(struct sk_buff *msg, u32 cmd, u32 portid,
 static int nl80211_dump_station(struct sk_buff *skb,
 				struct netlink_callback *cb)
 {
+	struct nlattr **attrbuf;
 	struct station_info sinfo;
 	struct cfg80211_registered_device *rdev;
 	struct wireless_dev *wdev;
@@ -6947,12 +7009,23 @@ static int nl80211_dump_station(struct sk_buff *skb,
 	int sta_idx = cb->args[2];
 	int err;
 
-	err = nl80211_prepare_wdev_dump(cb, &rdev, &wdev, NULL);
-	if (err)
+	attrbuf = kcalloc(NUM_NL80211_ATTR, sizeof(*attrbuf), GFP_KERNEL);
+	if (!attrbuf)
+		return -ENOMEM;
+
+	err = nl80211_prepare_wdev_dump(cb, &rdev, &wdev, attrbuf);
+	if (err) {
+		kfree(attrbuf);
 		return err;
+	}
 	/* nl80211_prepare_wdev_dump acquired it in the successful case */
 	__acquire(&rdev->wiphy.mtx);
 
+	/* attributes are only parsed for the first message, remember it */
+	if (attrbuf[NL80211_ATTR_STA_RC_RATE_STATS])
+		cb->args[3] = 1;
+	kfree(attrbuf);
+
 	if (!wdev->netdev) {
 		err = -EINVAL;
 		goto out_err;
@@ -6965,6 +7038,7 @@ static int nl80211_dump_station(struct sk_buff *skb,
 
 	while (1) {
 		memset(&sinfo, 0, sizeof(sinfo));
+		sinfo.rc_stats_req = cb->args[3];
 		err = rdev_dump_station(rdev, wdev->netdev, sta_idx,
 					mac_addr, &sinfo);
 		if (err == -ENOENT)
@@ -6997,6 +7071,7 @@ static int nl80211_get_station(struct sk_buff *skb, struct genl_info *info)
 	struct net_device *dev = info->user_ptr[1];
 	struct station_info sinfo;
 	struct sk_buff *msg;
+	size_t msg_size;
 	u8 *mac_addr = NULL;
 	int err;
 
@@ -7010,11 +7085,20 @@ static int nl80211_get_station(struct sk_buff *skb, struct genl_info *info)
 	if (!rdev->ops->get_station)
 		return -EOPNOTSUPP;
 
+	sinfo.rc_stats_req =
+		nla_get_flag(info->attrs[NL80211_ATTR_STA_RC_RATE_STATS]);
+
 	err = rdev_get_station(rdev, dev, mac_addr, &sinfo);
 	if (err)
 		return err;
 
-	msg = nlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	/* the rate control statistics alone may not fit the default size */
+	msg_size = NLMSG_DEFAULT_SIZE;
+	if (sinfo.rc_stats && sinfo.n_rc_stats)
+		msg_size += nla_total_size(sinfo.n_rc_stats *
+					   sizeof(*sinfo.rc_stats));
+
+	msg = nlmsg_new(msg_size, GFP_KERNEL);
 	if (!msg) {
 		cfg80211_sinfo_release_content(&sinfo);
 		return -ENOMEM;
@@ -10592,6 +10676,9 @@ static int nl80211_send_bss(struct sk_buff *msg, struct netlink_callback *cb,
 			      NL80211_BSS_PAD))
 		goto nla_put_failure;
 
+	if (nla_put_u32(msg, NL80211_BSS_GENERATION, intbss->generation))
+		goto nla_put_failure;
+
 	nla_nest_end(msg, bss);
 
 	genlmsg_end(msg, hdr);
@@ -10604,14 +10691,76 @@ static int nl80211_send_bss(struct sk_buff *msg, struct netlink_callback *cb,
 	return -EMSGSIZE;
 }
 
+static int nl80211_send_bss_tombstone(struct sk_buff *msg,
+				      struct netlink_callback *cb,
+				      struct cfg80211_registered_device *rdev,
+				      struct wireless_dev *wdev,
+				      struct cfg80211_bss_tombstone *ts)
+{
+	struct nlattr *bss, *ie;
+	void *hdr;
+	u8 *ssid;
+
+	hdr = nl80211hdr_put(msg, NETLINK_CB(cb->skb).portid,
+			     cb->nlh->nlmsg_seq, NLM_F_MULTI,
+			     NL80211_CMD_NEW_SCAN_RESULTS);
+	if (!hdr)
+		return -1;
+
+	genl_dump_check_consistent(cb, hdr);
+
+	if (nla_put_u32(msg, NL80211_ATTR_GENERATION, rdev->bss_generation))
+		goto nla_put_failure;
+	if (wdev->netdev &&
+	    nla_put_u32(msg, NL80211_ATTR_IFINDEX, wdev->netdev->ifindex))
+		goto nla_put_failure;
+	if (nla_put_u64_64bit(msg, NL80211_ATTR_WDEV, wdev_id(wdev),
+			      NL80211_ATTR_PAD))
+		goto nla_put_failure;
+
+	bss = nla_nest_start_noflag(msg, NL80211_ATTR_BSS);
+	if (!bss)
+		goto nla_put_failure;
+	if (nla_put_flag(msg, NL80211_BSS_EXPIRED) ||
+	    nla_put_u32(msg, NL80211_BSS_GENERATION, ts->generation) ||
+	    (!is_zero_ether_addr(ts->bssid) &&
+	     nla_put(msg, NL80211_BSS_BSSID, ETH_ALEN, ts->bssid)) ||
+	    nla_put_u32(msg, NL80211_BSS_FREQUENCY, ts->center_freq) ||
+	    nla_put_u32(msg, NL80211_BSS_FREQUENCY_OFFSET, ts->freq_offset))
+		goto nla_put_failure;
+
+	/* just the SSID element, to tell apart entries of a multi-BSSID set */
+	ie = nla_reserve(msg, NL80211_BSS_INFORMATION_ELEMENTS,
+			 2 + ts->ssid_len);
+	if (!ie)
+		goto nla_put_failure;
+	ssid = nla_data(ie);
+	ssid[0] = WLAN_EID_SSID;
+	ssid[1] = ts->ssid_len;
+	memcpy(ssid + 2, ts->ssid, ts->ssid_len);
+
+	nla_nest_end(msg, bss);
+
+	genlmsg_end(msg, hdr);
+	return 0;
+
+ nla_put_failure:
+	genlmsg_cancel(msg, hdr);
+	return -EMSGSIZE;
+}
+
 static int nl80211_dump_scan(struct sk_buff *skb, struct netlink_callback *cb)
 {
 	struct cfg80211_registered_device *rdev;
 	struct cfg80211_internal_bss *scan;
+	struct cfg80211_bss_tombstone *ts;
 	struct wireless_dev *wdev;
 	struct nlattr **attrbuf;
 	int start = cb->args[2], idx = 0;
+	bool first = !cb->args[0];
 	bool dump_include_use_data;
+	bool done = true;
+	u32 since;
 	int err;
 
 	attrbuf = kcalloc(NUM_NL80211_ATTR, sizeof(*attrbuf), GFP_KERNEL);
@@ -10628,6 +10777,13 @@ static int nl80211_dump_scan(struct sk_buff *skb, struct netlink_callback *cb)
 
 	dump_include_use_data =
 		attrbuf[NL80211_ATTR_BSS_DUMP_INCLUDE_USE_DATA];
+	/* the attributes are only parsed for the first message */
+	if (first && attrbuf[NL80211_ATTR_BSS_DUMP_SINCE_GENERATION]) {
+		cb->args[3] = 1;
+		cb->args[4] =
+			nla_get_u32(attrbuf[NL80211_ATTR_BSS_DUMP_SINCE_GENERATION]);
+	}
+	since = cb->args[4];
 	kfree(attrbuf);
 
 	spin_lock_bh(&rdev->bss_lock);
@@ -10641,6 +10797,18 @@ static int nl80211_dump_scan(struct sk_buff *skb, struct netlink_callback *cb)
 	if (start == 0)
 		cfg80211_bss_expire(rdev);
 
+	/*
+	 * An incremental dump needs all removals since the given generation,
+	 * which might have been dropped, or the generation might be from
+	 * before the wiphy was re-created.
+	 */
+	if (first && cb->args[3] &&
+	    ((s32)(since - rdev->bss_tombstone_floor) < 0 ||
+	     (s32)(since - rdev->bss_generation) > 0)) {
+		err = -ESTALE;
+		goto out_err;
+	}
+
 	cb->seq = rdev->bss_generation;
 
 	list_for_each_entry(scan, &rdev->bss_list, list) {
@@ -10649,20 +10817,45 @@ static int nl80211_dump_scan(struct sk_buff *skb, struct netlink_callback *cb)
 		if (!dump_include_use_data &&
 		    !(scan->pub.use_for & NL80211_BSS_USE_FOR_NORMAL))
 			continue;
+		if (cb->args[3] && (s32)(scan->generation - since) <= 0)
+			continue;
 		if (nl80211_send_bss(skb, cb,
 				cb->nlh->nlmsg_seq, NLM_F_MULTI,
 				rdev, wdev, scan) < 0) {
 			idx--;
+			done = false;
 			break;
 		}
 	}
 
+	/* then the removed entries, newest first, in args[5] */
+	if (done && cb->args[3]) {
+		int ts_start = cb->args[5], ts_idx = 0;
+
+		list_for_each_entry_reverse(ts, &rdev->bss_tombstones, list) {
+			if ((s32)(ts->generation - since) <= 0)
+				break;
+			if (++ts_idx <= ts_start)
+				continue;
+			if (nl80211_send_bss_tombstone(skb, cb, rdev, wdev,
+						       ts) < 0) {
+				ts_idx--;
+				break;
+			}
+		}
+		cb->args[5] = ts_idx;
+	}
+
 	spin_unlock_bh(&rdev->bss_lock);
 
 	cb->args[2] = idx;
 	wiphy_unlock(&rdev->wiphy);
 
 	return skb->len;
+ out_err:
+	spin_unlock_bh(&rdev->bss_lock);
+	wiphy_unlock(&rdev->wiphy);
+	return err;
 }
 
 static int nl80211_send_survey(struct sk_buff *msg, u32 portid, u32 seq,
@@ -58,6 +58,7 @@
 #include <linux/moduleparam.h>
 #include <linux/firmware.h>
 #include <linux/units.h>
+#include <linux/sort.h>
 
 #include <net/cfg80211.h>
 #include "core.h"
@@ -206,10 +207,33 @@ out:
 	return dfs_region;
 }
 
+/*
+ * Compiled tables of the applied regulatory domains, added under RTNL and
+ * looked up under RCU, see reg_prepare_rule_table().
+ */
+static LIST_HEAD(reg_rule_tables);
+static DEFINE_SPINLOCK(reg_rule_tables_lock);
+
+static void reg_free_rule_table(const struct ieee80211_regdomain *regd)
+{
+	struct reg_rule_table *table;
+
+	spin_lock(&reg_rule_tables_lock);
+	list_for_each_entry(table, &reg_rule_tables, list) {
+		if (table->regd != regd)
+			continue;
+		list_del_rcu(&table->list);
+		kfree_rcu(table, rcu_head);
+		break;
+	}
+	spin_unlock(&reg_rule_tables_lock);
+}
+
 static void rcu_free_regdom(const struct ieee80211_regdomain *r)
 {
 	if (!r)
 		return;
+	reg_free_rule_table(r);
 	kfree_rcu((struct ieee80211_regdomain *)r, rcu_head);
 }
 
@@ -902,9 +926,159 @@ static int __regdb_query_wmm(const struct fwdb_header *db,
 	return -ENODATA;
 }
 
+/*
+ * The countries of the loaded database sorted by alpha2, built when it is
+ * loaded. If that fails the lookups search the database itself.
+ */
+static const struct fwdb_country **regdb_index;
+static unsigned int regdb_n_countries;
+
+/*
+ * Recently used regulatory domains built from the database, the most
+ * recent first, so repeated hints for a country don't parse it again.
+ * Protected by RTNL.
+ */
+#define REGDB_CACHE_SIZE	4
+static struct ieee80211_regdomain *regdb_cache[REGDB_CACHE_SIZE];
+
+static void regdb_cache_flush(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(regdb_cache); i++) {
+		kfree(regdb_cache[i]);
+		regdb_cache[i] = NULL;
+	}
+}
+
+VISIBLE_IF_CFG80211_KUNIT const struct ieee80211_regdomain *
+regdb_cache_get(const char *alpha2)
+{
+	struct ieee80211_regdomain *regd;
+	unsigned int i;
+
+	ASSERT_RTNL();
+
+	for (i = 0; i < ARRAY_SIZE(regdb_cache) && regdb_cache[i]; i++) {
+		regd = regdb_cache[i];
+		if (!alpha2_equal(regd->alpha2, alpha2))
+			continue;
+
+		memmove(&regdb_cache[1], &regdb_cache[0],
+			i * sizeof(regdb_cache[0]));
+		regdb_cache[0] = regd;
+		return regd;
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(regdb_cache_get);
+
+VISIBLE_IF_CFG80211_KUNIT void
+regdb_cache_add(struct ieee80211_regdomain *regd)
+{
+	ASSERT_RTNL();
+
+	kfree(regdb_cache[REGDB_CACHE_SIZE - 1]);
+	memmove(&regdb_cache[1], &regdb_cache[0],
+		(REGDB_CACHE_SIZE - 1) * sizeof(regdb_cache[0]));
+	regdb_cache[0] = regd;
+}
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(regdb_cache_add);
+
+static int regdb_country_cmp(const void *a, const void *b)
+{
+	const struct fwdb_country *ca = *(const struct fwdb_country * const *)a;
+	const struct fwdb_country *cb = *(const struct fwdb_country * const *)b;
+	int ret = memcmp(ca->alpha2, cb->alpha2, sizeof(ca->alpha2));
+
+	/* keep duplicates in database order, the first one is used */
+	if (ret)
+		return ret;
+	return ca < cb ? -1 : ca > cb;
+}
+
+/* must be called whenever regdb changes */
+static void regdb_reindex(void)
+{
+	const struct fwdb_country *country;
+	const struct fwdb_country **index;
+	unsigned int i, n = 0;
+
+	ASSERT_RTNL();
+
+	regdb_cache_flush();
+	kfree(regdb_index);
+	regdb_index = NULL;
+	regdb_n_countries = 0;
+
+	if (IS_ERR_OR_NULL(regdb))
+		return;
+
+	for (country = &regdb->country[0]; country->coll_ptr; country++)
+		n++;
+
+	index = kcalloc(n, sizeof(*index), GFP_KERNEL);
+	if (!index)
+		return;
+
+	for (i = 0; i < n; i++)
+		index[i] = &regdb->country[i];
+	sort(index, n, sizeof(*index), regdb_country_cmp, NULL);
+
+	regdb_index = index;
+	regdb_n_countries = n;
+}
+
+/* Install @db as the database and return the previous one to be freed. */
+VISIBLE_IF_CFG80211_KUNIT const struct fwdb_header *
+regdb_replace(const struct fwdb_header *db)
+{
+	const struct fwdb_header *old = regdb;
+
+	ASSERT_RTNL();
+
+	regdb = db;
+	regdb_reindex();
+
+	return old;
+}
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(regdb_replace);
+
+VISIBLE_IF_CFG80211_KUNIT const struct fwdb_country *
+regdb_find_country(const char *alpha2)
+{
+	const struct fwdb_country *country;
+	unsigned int lo = 0, hi = regdb_n_countries;
+
+	if (!regdb_index) {
+		for (country = &regdb->country[0]; country->coll_ptr; country++) {
+			if (alpha2_equal(alpha2, country->alpha2))
+				return country;
+		}
+		return NULL;
+	}
+
+	/* the first entry not below the alpha2 */
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (memcmp(regdb_index[mid]->alpha2, alpha2, 2) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < regdb_n_countries &&
+	    alpha2_equal(alpha2, regdb_index[lo]->alpha2))
+		return regdb_index[lo];
+
+	return NULL;
+}
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(regdb_find_country);
+
 int reg_query_regdb_wmm(char *alpha2, int freq, struct ieee80211_reg_rule *rule)
 {
-	const struct fwdb_header *hdr = regdb;
 	const struct fwdb_country *country;
 
 	if (!regdb)
@@ -913,20 +1087,17 @@ int reg_query_regdb_wmm(char *alpha2, int freq, struct ieee80211_reg_rule *rule)
 	if (IS_ERR(regdb))
 		return PTR_ERR(regdb);
 
-	country = &hdr->country[0];
-	while (country->coll_ptr) {
-		if (alpha2_equal(alpha2, country->alpha2))
-			return __regdb_query_wmm(regdb, country, freq, rule);
-
-		country++;
-	}
+	country = regdb_find_country(alpha2);
+	if (!country)
+		return -ENODATA;
 
-	return -ENODATA;
+	return __regdb_query_wmm(regdb, country, freq, rule);
 }
 EXPORT_SYMBOL(reg_query_regdb_wmm);
 
-static int regdb_query_country(const struct fwdb_header *db,
-			       const struct fwdb_country *country)
+static struct ieee80211_regdomain *
+regdb_build_regdom(const struct fwdb_header *db,
+		   const struct fwdb_country *country)
 {
 	unsigned int ptr = be16_to_cpu(country->coll_ptr) << 2;
 	struct fwdb_collection *coll = (void *)((u8 *)db + ptr);
@@ -936,7 +1107,7 @@ static int regdb_query_country(const struct fwdb_header *db,
 	regdom = kzalloc(struct_size(regdom, reg_rules, coll->n_rules),
 			 GFP_KERNEL);
 	if (!regdom)
-		return -ENOMEM;
+		return NULL;
 
 	regdom->n_reg_rules = coll->n_rules;
 	regdom->alpha2[0] = country->alpha2[0];
@@ -978,27 +1149,39 @@ static int regdb_query_country(const struct fwdb_header *db,
 			set_wmm_rule(db, country, rule, rrule);
 	}
 
-	return reg_schedule_apply(regdom);
+	return regdom;
 }
 
 static int query_regdb(const char *alpha2)
 {
-	const struct fwdb_header *hdr = regdb;
+	const struct ieee80211_regdomain *regdom;
 	const struct fwdb_country *country;
+	struct ieee80211_regdomain *new;
 
 	ASSERT_RTNL();
 
 	if (IS_ERR(regdb))
 		return PTR_ERR(regdb);
 
-	country = &hdr->country[0];
-	while (country->coll_ptr) {
-		if (alpha2_equal(alpha2, country->alpha2))
-			return regdb_query_country(regdb, country);
-		country++;
+	regdom = regdb_cache_get(alpha2);
+	if (!regdom) {
+		country = regdb_find_country(alpha2);
+		if (!country)
+			return -ENODATA;
+
+		new = regdb_build_regdom(regdb, country);
+		if (!new)
+			return -ENOMEM;
+		regdb_cache_add(new);
+		regdom = new;
 	}
 
-	return -ENODATA;
+	/* the applied regulatory domain is owned (and freed) by the core */
+	regdom = reg_copy_regd(regdom);
+	if (IS_ERR(regdom))
+		return PTR_ERR(regdom);
+
+	return reg_schedule_apply(regdom);
 }
 
 static void regdb_fw_cb(const struct firmware *fw, void *context)
@@ -1028,7 +1211,7 @@ static void regdb_fw_cb(const struct firmware *fw, void *context)
 	} else if (fw) {
 		db = kmemdup(fw->data, fw->size, GFP_KERNEL);
 		if (db) {
-			regdb = db;
+			regdb_replace(db);
 			restore = context && query_regdb(context);
 		} else {
 			restore = true;
@@ -1071,6 +1254,7 @@ static int query_regdb_file(const char *alpha2)
 
 int reg_reload_regdb(void)
 {
+	const struct fwdb_header *old;
 	const struct firmware *fw;
 	void *db;
 	int err;
@@ -1093,9 +1277,9 @@ int reg_reload_regdb(void)
 	}
 
 	rtnl_lock();
-	if (!IS_ERR_OR_NULL(regdb))
-		kfree(regdb);
-	regdb = db;
+	old = regdb_replace(db);
+	if (!IS_ERR_OR_NULL(old))
+		kfree(old);
 
 	/* reset regulatory domain */
 	current_regdomain = get_cfg80211_regdom();
@@ -1230,6 +1414,7 @@ unsigned int reg_get_max_bandwidth(const struct ieee80211_regdomain *rd,
 
 	return bw;
 }
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(reg_get_max_bandwidth);
 
 /* Sanity check on a regulatory rule */
 static bool is_valid_reg_rule(const struct ieee80211_reg_rule *rule)
@@ -1608,17 +1793,45 @@ static u32 map_regdom_flags(u32 rd_flags)
 	return channel_flags;
 }
 
+static u32 reg_max_bw_to_chan_flags(u32 max_bandwidth_khz)
+{
+	u32 bw_flags = 0;
+
+	if (max_bandwidth_khz < MHZ_TO_KHZ(10))
+		bw_flags |= IEEE80211_CHAN_NO_10MHZ;
+	if (max_bandwidth_khz < MHZ_TO_KHZ(20))
+		bw_flags |= IEEE80211_CHAN_NO_20MHZ;
+	if (max_bandwidth_khz < MHZ_TO_KHZ(40))
+		bw_flags |= IEEE80211_CHAN_NO_HT40;
+	if (max_bandwidth_khz < MHZ_TO_KHZ(80))
+		bw_flags |= IEEE80211_CHAN_NO_80MHZ;
+	if (max_bandwidth_khz < MHZ_TO_KHZ(160))
+		bw_flags |= IEEE80211_CHAN_NO_160MHZ;
+	if (max_bandwidth_khz < MHZ_TO_KHZ(320))
+		bw_flags |= IEEE80211_CHAN_NO_320MHZ;
+
+	return bw_flags;
+}
+
+static void reg_rule_info_init(const struct ieee80211_regdomain *regd,
+			       const struct ieee80211_reg_rule *rule,
+			       struct reg_rule_info *info)
+{
+	info->max_bandwidth_khz = rule->freq_range.max_bandwidth_khz;
+	/* Check if auto calculation requested */
+	if (rule->flags & NL80211_RRF_AUTO_BW)
+		info->max_bandwidth_khz = reg_get_max_bandwidth(regd, rule);
+	info->bw_flags = reg_max_bw_to_chan_flags(info->max_bandwidth_khz);
+}
+
 static const struct ieee80211_reg_rule *
-freq_reg_info_regd(u32 center_freq,
-		   const struct ieee80211_regdomain *regd, u32 bw)
+freq_reg_info_regd_linear(u32 center_freq,
+			  const struct ieee80211_regdomain *regd, u32 bw)
 {
 	int i;
 	bool band_rule_found = false;
 	bool bw_fits = false;
 
-	if (!regd)
-		return ERR_PTR(-EINVAL);
-
 	for (i = 0; i < regd->n_reg_rules; i++) {
 		const struct ieee80211_reg_rule *rr;
 		const struct ieee80211_freq_range *fr = NULL;
@@ -1646,6 +1859,238 @@ freq_reg_info_regd(u32 center_freq,
 	return ERR_PTR(-EINVAL);
 }
 
+static int reg_rule_range_cmp(const void *a, const void *b)
+{
+	const struct reg_rule_range *ra = a, *rb = b;
+
+	if (ra->start_freq_khz != rb->start_freq_khz)
+		return ra->start_freq_khz < rb->start_freq_khz ? -1 : 1;
+	return ra->idx < rb->idx ? -1 : ra->idx > rb->idx;
+}
+
+static int reg_freq_cmp(const void *a, const void *b)
+{
+	u32 fa = *(const u32 *)a, fb = *(const u32 *)b;
+
+	return fa < fb ? -1 : fa > fb;
+}
+
+struct reg_rule_table *
+reg_rule_table_compile(const struct ieee80211_regdomain *regd, gfp_t gfp)
+{
+	unsigned int i, n = regd->n_reg_rules;
+	struct reg_rule_table *table;
+	u32 max_end_freq_khz = 0;
+
+	table = kzalloc(struct_size(table, ranges, n) +
+			n * (sizeof(*table->info) + sizeof(*table->end_freqs)),
+			gfp);
+	if (!table)
+		return NULL;
+
+	table->regd = regd;
+	table->n_rules = n;
+	table->info = (void *)&table->ranges[n];
+	table->end_freqs = (void *)&table->info[n];
+
+	for (i = 0; i < n; i++) {
+		const struct ieee80211_reg_rule *rule = &regd->reg_rules[i];
+
+		reg_rule_info_init(regd, rule, &table->info[i]);
+		table->ranges[i].start_freq_khz = rule->freq_range.start_freq_khz;
+		table->ranges[i].end_freq_khz = rule->freq_range.end_freq_khz;
+		table->ranges[i].idx = i;
+		table->end_freqs[i] = rule->freq_range.end_freq_khz;
+	}
+
+	sort(table->ranges, n, sizeof(table->ranges[0]),
+	     reg_rule_range_cmp, NULL);
+	sort(table->end_freqs, n, sizeof(table->end_freqs[0]),
+	     reg_freq_cmp, NULL);
+
+	for (i = 0; i < n; i++) {
+		max_end_freq_khz = max(max_end_freq_khz,
+				       table->ranges[i].end_freq_khz);
+		table->ranges[i].max_end_freq_khz = max_end_freq_khz;
+	}
+
+	return table;
+}
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(reg_rule_table_compile);
+
+/* the same as freq_in_rule_band() being true for any of the rules */
+static bool reg_rule_table_in_band(const struct reg_rule_table *table,
+				   u32 freq_khz)
+{
+	u32 limit = freq_khz > 45 * KHZ_PER_GHZ ? 20 * KHZ_PER_GHZ : 2 * KHZ_PER_GHZ;
+	u32 low = freq_khz > limit ? freq_khz - limit : 0;
+	unsigned int lo, hi;
+
+	/* the first rule starting no more than the limit below */
+	for (lo = 0, hi = table->n_rules; lo < hi;) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (table->ranges[mid].start_freq_khz < low)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < table->n_rules &&
+	    table->ranges[lo].start_freq_khz <= freq_khz + limit)
+		return true;
+
+	/* and the same for the end frequencies */
+	for (lo = 0, hi = table->n_rules; lo < hi;) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (table->end_freqs[mid] < low)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo < table->n_rules && table->end_freqs[lo] <= freq_khz + limit;
+}
+
+const struct ieee80211_reg_rule *
+reg_rule_table_lookup(const struct reg_rule_table *table, u32 center_freq_khz,
+		      u32 bw_khz)
+{
+	u32 start_freq_khz = center_freq_khz - bw_khz / 2;
+	u32 end_freq_khz = center_freq_khz + bw_khz / 2;
+	const struct reg_rule_range *range = NULL;
+	const struct ieee80211_reg_rule *rule;
+	unsigned int lo, hi;
+	int i;
+
+	/* the first range starting above the start frequency */
+	for (lo = 0, hi = table->n_rules; lo < hi;) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (table->ranges[mid].start_freq_khz <= start_freq_khz)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/*
+	 * Of the ranges before it that fit the bandwidth, the rule that comes
+	 * first in the regulatory domain is used, as with a linear search.
+	 * Rules normally don't overlap, so this only looks at one range.
+	 */
+	for (i = (int)lo - 1;
+	     i >= 0 && table->ranges[i].max_end_freq_khz >= end_freq_khz;
+	     i--) {
+		if (table->ranges[i].end_freq_khz < end_freq_khz)
+			continue;
+		if (!range || table->ranges[i].idx < range->idx)
+			range = &table->ranges[i];
+	}
+
+	if (!range) {
+		if (!reg_rule_table_in_band(table, center_freq_khz))
+			return ERR_PTR(-ERANGE);
+		return ERR_PTR(-EINVAL);
+	}
+
+	/*
+	 * The linear search only accepts a rule after it has seen one in the
+	 * band of the frequency. Only a very wide rule can contain it and not
+	 * be in the band itself, leave such corner cases to the linear search.
+	 */
+	rule = &table->regd->reg_rules[range->idx];
+	if (!freq_in_rule_band(&rule->freq_range, center_freq_khz))
+		return freq_reg_info_regd_linear(center_freq_khz, table->regd,
+						 bw_khz);
+
+	return rule;
+}
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(reg_rule_table_lookup);
+
+/* must be called under RCU */
+static const struct reg_rule_table *
+reg_find_rule_table(const struct ieee80211_regdomain *regd)
+{
+	const struct reg_rule_table *table;
+
+	list_for_each_entry_rcu(table, &reg_rule_tables, list) {
+		if (table->regd == regd)
+			return table;
+	}
+
+	return NULL;
+}
+
+/*
+ * Compile the table for an applied regulatory domain, unless that was done
+ * already, so that updating the channels of all wiphys using it doesn't
+ * need to look through all rules for each channel. Without it (e.g. if the
+ * allocation fails, or for custom regulatory domains owned by drivers) the
+ * lookups just search the rules linearly.
+ */
+static void reg_prepare_rule_table(const struct ieee80211_regdomain *regd)
+{
+	struct reg_rule_table *table;
+	bool found;
+
+	ASSERT_RTNL();
+
+	if (!regd)
+		return;
+
+	rcu_read_lock();
+	found = reg_find_rule_table(regd);
+	rcu_read_unlock();
+	if (found)
+		return;
+
+	table = reg_rule_table_compile(regd, GFP_KERNEL);
+	if (!table)
+		return;
+
+	spin_lock(&reg_rule_tables_lock);
+	list_add_rcu(&table->list, &reg_rule_tables);
+	spin_unlock(&reg_rule_tables_lock);
+}
+
+static void reg_rule_get_info(const struct ieee80211_regdomain *regd,
+			      const struct ieee80211_reg_rule *rule,
+			      struct reg_rule_info *info)
+{
+	const struct reg_rule_table *table;
+
+	rcu_read_lock();
+	table = reg_find_rule_table(regd);
+	if (table && rule >= regd->reg_rules &&
+	    rule < regd->reg_rules + regd->n_reg_rules)
+		*info = table->info[rule - regd->reg_rules];
+	else
+		reg_rule_info_init(regd, rule, info);
+	rcu_read_unlock();
+}
+
+VISIBLE_IF_CFG80211_KUNIT const struct ieee80211_reg_rule *
+freq_reg_info_regd(u32 center_freq,
+		   const struct ieee80211_regdomain *regd, u32 bw)
+{
+	const struct ieee80211_reg_rule *rule;
+	const struct reg_rule_table *table;
+
+	if (!regd)
+		return ERR_PTR(-EINVAL);
+
+	rcu_read_lock();
+	table = reg_find_rule_table(regd);
+	if (table)
+		rule = reg_rule_table_lookup(table, center_freq, bw);
+	else
+		rule = freq_reg_info_regd_linear(center_freq, regd, bw);
+	rcu_read_unlock();
+
+	return rule;
+}
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(freq_reg_info_regd);
+
 static const struct ieee80211_reg_rule *
 __freq_reg_info(struct wiphy *wiphy, u32 center_freq, u32 min_bw)
 {
@@ -1698,14 +2143,13 @@ static uint32_t reg_rule_to_chan_bw_flags(const struct ieee80211_regdomain *regd
 	const struct ieee80211_freq_range *freq_range = NULL;
 	u32 max_bandwidth_khz, center_freq_khz, bw_flags = 0;
 	bool is_s1g = chan->band == NL80211_BAND_S1GHZ;
+	struct reg_rule_info info;
 
 	freq_range = &reg_rule->freq_range;
 
-	max_bandwidth_khz = freq_range->max_bandwidth_khz;
+	reg_rule_get_info(regd, reg_rule, &info);
+	max_bandwidth_khz = info.max_bandwidth_khz;
 	center_freq_khz = ieee80211_channel_to_khz(chan);
-	/* Check if auto calculation requested */
-	if (reg_rule->flags & NL80211_RRF_AUTO_BW)
-		max_bandwidth_khz = reg_get_max_bandwidth(regd, reg_rule);
 
 	/* If we get a reg_rule we can assume that at least 5Mhz fit */
 	if (!cfg80211_does_bw_fit_range(freq_range,
@@ -1757,18 +2201,7 @@ static uint32_t reg_rule_to_chan_bw_flags(const struct ieee80211_regdomain *regd
 			ch_bw /= 2;
 		}
 	} else {
-		if (max_bandwidth_khz < MHZ_TO_KHZ(10))
-			bw_flags |= IEEE80211_CHAN_NO_10MHZ;
-		if (max_bandwidth_khz < MHZ_TO_KHZ(20))
-			bw_flags |= IEEE80211_CHAN_NO_20MHZ;
-		if (max_bandwidth_khz < MHZ_TO_KHZ(40))
-			bw_flags |= IEEE80211_CHAN_NO_HT40;
-		if (max_bandwidth_khz < MHZ_TO_KHZ(80))
-			bw_flags |= IEEE80211_CHAN_NO_80MHZ;
-		if (max_bandwidth_khz < MHZ_TO_KHZ(160))
-			bw_flags |= IEEE80211_CHAN_NO_160MHZ;
-		if (max_bandwidth_khz < MHZ_TO_KHZ(320))
-			bw_flags |= IEEE80211_CHAN_NO_320MHZ;
+		bw_flags |= info.bw_flags;
 	}
 	return bw_flags;
 }
@@ -2287,13 +2720,48 @@ static bool is_ht40_allowed(struct ieee80211_channel *chan)
 	return true;
 }
 
+/*
+ * Find the channel with the given center frequency in the band, with a
+ * binary search if its channels are sorted by frequency, as they are for
+ * almost all drivers.
+ */
+static struct ieee80211_channel *
+reg_find_band_channel(struct ieee80211_supported_band *sband, u32 freq,
+		      bool sorted)
+{
+	struct ieee80211_channel *chan = NULL;
+	unsigned int lo = 0, hi = sband->n_channels, i;
+
+	if (!sorted) {
+		for (i = 0; i < sband->n_channels; i++) {
+			if (sband->channels[i].center_freq == freq)
+				chan = &sband->channels[i];
+		}
+		return chan;
+	}
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		u32 mid_freq = sband->channels[mid].center_freq;
+
+		if (mid_freq == freq)
+			return &sband->channels[mid];
+		if (mid_freq < freq)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
 static void reg_process_ht_flags_channel(struct wiphy *wiphy,
-					 struct ieee80211_channel *channel)
+					 struct ieee80211_channel *channel,
+					 bool sorted)
 {
 	struct ieee80211_supported_band *sband = wiphy->bands[channel->band];
-	struct ieee80211_channel *channel_before = NULL, *channel_after = NULL;
+	struct ieee80211_channel *channel_before, *channel_after;
 	const struct ieee80211_regdomain *regd;
-	unsigned int i;
 	u32 flags;
 
 	if (!is_ht40_allowed(channel)) {
@@ -2305,14 +2773,12 @@ static void reg_process_ht_flags_channel(struct wiphy *wiphy,
 	 * We need to ensure the extension channels exist to
 	 * be able to use HT40- or HT40+, this finds them (or not)
 	 */
-	for (i = 0; i < sband->n_channels; i++) {
-		struct ieee80211_channel *c = &sband->channels[i];
-
-		if (c->center_freq == (channel->center_freq - 20))
-			channel_before = c;
-		if (c->center_freq == (channel->center_freq + 20))
-			channel_after = c;
-	}
+	channel_before = reg_find_band_channel(sband,
+					       channel->center_freq - 20,
+					       sorted);
+	channel_after = reg_find_band_channel(sband,
+					      channel->center_freq + 20,
+					      sorted);
 
 	flags = 0;
 	regd = get_wiphy_regdom(wiphy);
@@ -2346,13 +2812,24 @@ static void reg_process_ht_flags_channel(struct wiphy *wiphy,
 static void reg_process_ht_flags_band(struct wiphy *wiphy,
 				      struct ieee80211_supported_band *sband)
 {
+	bool sorted = true;
 	unsigned int i;
 
 	if (!sband)
 		return;
 
+	/* channels with the same center frequency need the linear search */
+	for (i = 1; i < sband->n_channels; i++) {
+		if (sband->channels[i].center_freq <=
+		    sband->channels[i - 1].center_freq) {
+			sorted = false;
+			break;
+		}
+	}
+
 	for (i = 0; i < sband->n_channels; i++)
-		reg_process_ht_flags_channel(wiphy, &sband->channels[i]);
+		reg_process_ht_flags_channel(wiphy, &sband->channels[i],
+					     sorted);
 }
 
 static void reg_process_ht_flags(struct wiphy *wiphy)
@@ -2521,6 +2998,9 @@ static void wiphy_update_regulatory(struct wiphy *wiphy,
 
 	lr->dfs_region = get_cfg80211_regdom()->dfs_region;
 
+	reg_prepare_rule_table(reg_get_regdomain(wiphy));
+	reg_prepare_rule_table(get_wiphy_regdom(wiphy));
+
 	for (band = 0; band < NUM_NL80211_BANDS; band++)
 		handle_band(wiphy, initiator, wiphy->bands[band]);
 
@@ -3183,6 +3663,8 @@ static void reg_process_self_managed_hint(struct wiphy *wiphy)
 	rcu_assign_pointer(wiphy->regd, regd);
 	rcu_free_regdom(tmp);
 
+	reg_prepare_rule_table(regd);
+
 	for (band = 0; band < NUM_NL80211_BANDS; band++)
 		handle_band_custom(wiphy, wiphy->bands[band], regd);
 
@@ -4372,6 +4854,9 @@ void regulatory_exit(void)
 	reset_regdomains(true, NULL);
 	rtnl_unlock();
 
+	/* only the static world regulatory domain's table can be left */
+	reg_free_rule_table(&world_regdom);
+
 	dev_set_uevent_suppress(&reg_pdev->dev, true);
 
 	platform_device_unregister(reg_pdev);
@@ -4391,6 +4876,11 @@ void regulatory_exit(void)
 		kfree(reg_request);
 	}
 
+	rtnl_lock();
+	regdb_cache_flush();
+	kfree(regdb_index);
+	regdb_index = NULL;
+	rtnl_unlock();
 	if (!IS_ERR_OR_NULL(regdb))
 		kfree(regdb);
 	if (!IS_ERR_OR_NULL(cfg80211_user_regdom))
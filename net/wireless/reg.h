@@ -64,6 +64,62 @@ unsigned int reg_get_max_bandwidth(const struct ieee80211_regdomain *rd,
 
 bool reg_last_request_cell_base(void);
 
+/**
+ * struct reg_rule_info - precomputed information about a regulatory rule
+ * @max_bandwidth_khz: the maximum bandwidth, with %NL80211_RRF_AUTO_BW
+ *	already resolved
+ * @bw_flags: the channel flags implied by @max_bandwidth_khz, for channels
+ *	other than S1G ones
+ */
+struct reg_rule_info {
+	u32 max_bandwidth_khz;
+	u32 bw_flags;
+};
+
+/**
+ * struct reg_rule_range - frequency range of a rule in a &struct reg_rule_table
+ * @start_freq_khz: start frequency of the rule
+ * @end_freq_khz: end frequency of the rule
+ * @max_end_freq_khz: highest end frequency of this and all previous ranges,
+ *	so a lookup knows when no earlier range can contain a frequency
+ * @idx: index of the rule in the regulatory domain
+ */
+struct reg_rule_range {
+	u32 start_freq_khz;
+	u32 end_freq_khz;
+	u32 max_end_freq_khz;
+	u32 idx;
+};
+
+/**
+ * struct reg_rule_table - regulatory domain compiled for frequency lookups
+ * @list: entry in the list of tables for applied regulatory domains
+ * @rcu_head: RCU head for freeing
+ * @regd: the regulatory domain the table was compiled from
+ * @n_rules: number of rules
+ * @info: precomputed per-rule information, in the order of the rules
+ * @end_freqs: end frequencies of all rules, sorted
+ * @ranges: the rules' frequency ranges, sorted by start frequency
+ *
+ * Looking up the rule for a channel is a binary search in @ranges, and all
+ * wiphys using the same regulatory domain share its table.
+ */
+struct reg_rule_table {
+	struct list_head list;
+	struct rcu_head rcu_head;
+	const struct ieee80211_regdomain *regd;
+	unsigned int n_rules;
+	struct reg_rule_info *info;
+	u32 *end_freqs;
+	struct reg_rule_range ranges[];
+};
+
+struct reg_rule_table *
+reg_rule_table_compile(const struct ieee80211_regdomain *regd, gfp_t gfp);
+const struct ieee80211_reg_rule *
+reg_rule_table_lookup(const struct reg_rule_table *table, u32 center_freq_khz,
+		      u32 bw_khz);
+
 /**
  * regulatory_hint_found_beacon - hints a beacon was found on a channel
  * @wiphy: the wireless device where the beacon was found on
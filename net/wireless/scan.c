@@ -15,7 +15,10 @@
 #include <linux/nl80211.h>
 #include <linux/etherdevice.h>
 #include <linux/crc32.h>
+#include <linux/jhash.h>
+#include <linux/hashtable.h>
 #include <linux/bitfield.h>
+#include <linux/sort.h>
 #include <net/arp.h>
 #include <net/cfg80211.h>
 #include <net/cfg80211-wext.h>
@@ -29,11 +32,14 @@
 /**
  * DOC: BSS tree/list structure
  *
- * At the top level, the BSS list is kept in both a list in each
- * registered device (@bss_list) as well as an RB-tree for faster
- * lookup. In the RB-tree, entries can be looked up using their
- * channel, MESHID, MESHCONF (for MBSSes) or channel, BSSID, SSID
- * for other BSSes.
+ * At the top level, the BSS list is kept in a list in each registered
+ * device (@bss_list), in the order the entries were added. For faster
+ * lookup, entries are also hashed by their BSSID (@bss_hash) and by
+ * their SSID (@bss_ssid_hash); entries are unique by channel, MESHID,
+ * MESHCONF for MBSSes, which are all hashed under the zero address,
+ * and by channel, BSSID, SSID for other BSSes. A third list (@bss_lru)
+ * keeps the entries sorted by the time they were last updated, so that
+ * expiring them doesn't need to look at entries that are still fresh.
  *
  * Due to the possibility of hidden SSIDs, there's a second level
  * structure, the "hidden_list" and "hidden_beacon_bss" pointer.
@@ -98,6 +104,7 @@ static void bss_free(struct cfg80211_internal_bss *bss)
 	if (!list_empty(&bss->hidden_list))
 		list_del(&bss->hidden_list);
 
+	kfree(bss->rnr);
 	kfree(bss);
 }
 
@@ -143,6 +150,201 @@ static inline void bss_ref_put(struct cfg80211_registered_device *rdev,
 		bss_free(bss);
 }
 
+static const struct rhashtable_params bss_hash_params = {
+	.key_len = ETH_ALEN,
+	.key_offset = offsetof(struct cfg80211_internal_bss, hash_addr),
+	.head_offset = offsetof(struct cfg80211_internal_bss, hash_node),
+	.automatic_shrinking = true,
+};
+
+static const struct rhashtable_params bss_ssid_hash_params = {
+	.key_len = sizeof(u32),
+	.key_offset = offsetof(struct cfg80211_internal_bss, ssid_hash),
+	.head_offset = offsetof(struct cfg80211_internal_bss, ssid_node),
+	.automatic_shrinking = true,
+};
+
+/* mesh BSSes are compared by their mesh ID/config, not BSSID, see cmp_bss() */
+static const u8 bss_hash_mesh_addr[ETH_ALEN] __aligned(2);
+
+int cfg80211_bss_hash_init(struct cfg80211_registered_device *rdev)
+{
+	int err;
+
+	INIT_LIST_HEAD(&rdev->bss_list);
+	INIT_LIST_HEAD(&rdev->bss_lru);
+	INIT_LIST_HEAD(&rdev->bss_tombstones);
+
+	err = rhltable_init(&rdev->bss_hash, &bss_hash_params);
+	if (err)
+		return err;
+
+	err = rhltable_init(&rdev->bss_ssid_hash, &bss_ssid_hash_params);
+	if (err)
+		rhltable_destroy(&rdev->bss_hash);
+
+	return err;
+}
+
+void cfg80211_bss_hash_destroy(struct cfg80211_registered_device *rdev)
+{
+	struct cfg80211_bss_tombstone *ts, *tmp;
+
+	list_for_each_entry_safe(ts, tmp, &rdev->bss_tombstones, list)
+		kfree(ts);
+	rhltable_destroy(&rdev->bss_ssid_hash);
+	rhltable_destroy(&rdev->bss_hash);
+}
+
+static u32 cfg80211_bss_ssid_hash(const u8 *ssid, size_t ssid_len)
+{
+	return jhash(ssid, ssid_len, 0);
+}
+
+static void cfg80211_bss_hash_keys(struct cfg80211_internal_bss *bss)
+{
+	const struct cfg80211_bss_ies *ies = rcu_access_pointer(bss->pub.ies);
+	const struct element *ssid = NULL;
+
+	ether_addr_copy(bss->hash_addr, bss->pub.bssid);
+	bss->ssid_hash = cfg80211_bss_ssid_hash(NULL, 0);
+
+	if (!ies)
+		return;
+
+	if (WLAN_CAPABILITY_IS_STA_BSS(bss->pub.capability) &&
+	    cfg80211_find_elem(WLAN_EID_MESH_ID, ies->data, ies->len) &&
+	    cfg80211_find_elem(WLAN_EID_MESH_CONFIG, ies->data, ies->len))
+		eth_zero_addr(bss->hash_addr);
+
+	ssid = cfg80211_find_elem(WLAN_EID_SSID, ies->data, ies->len);
+	if (ssid)
+		bss->ssid_hash = cfg80211_bss_ssid_hash(ssid->data,
+							ssid->datalen);
+}
+
+static void cfg80211_bss_hash_remove(struct cfg80211_registered_device *rdev,
+				     struct cfg80211_internal_bss *bss)
+{
+	rhltable_remove(&rdev->bss_hash, &bss->hash_node, bss_hash_params);
+	rhltable_remove(&rdev->bss_ssid_hash, &bss->ssid_node,
+			bss_ssid_hash_params);
+}
+
+/*
+ * Return the first entry with the given BSSID (or in a mesh that might
+ * match it) that @match returns %true for.
+ */
+static struct cfg80211_internal_bss *
+cfg80211_bss_find_by_bssid(struct cfg80211_registered_device *rdev,
+			   const u8 *bssid,
+			   bool (*match)(struct cfg80211_internal_bss *bss,
+					 void *data),
+			   void *data)
+{
+	const u8 *addrs[] = { bssid, bss_hash_mesh_addr };
+	struct cfg80211_internal_bss *bss;
+	struct rhlist_head *tmp, *list;
+	int i;
+
+	lockdep_assert_held(&rdev->bss_lock);
+
+	/* the entries are protected by bss_lock, this is for the table */
+	rcu_read_lock();
+	for (i = 0; i < ARRAY_SIZE(addrs); i++) {
+		if (i && is_zero_ether_addr(bssid))
+			break;
+
+		list = rhltable_lookup(&rdev->bss_hash, addrs[i],
+				       bss_hash_params);
+		rhl_for_each_entry_rcu(bss, tmp, list, hash_node) {
+			if (match(bss, data)) {
+				rcu_read_unlock();
+				return bss;
+			}
+		}
+	}
+	rcu_read_unlock();
+
+	return NULL;
+}
+
+/*
+ * Keep the LRU list sorted by timestamp, oldest first. New timestamps are
+ * almost always the current time, so this rarely looks past the tail.
+ */
+static void cfg80211_bss_lru_update(struct cfg80211_registered_device *rdev,
+				    struct cfg80211_internal_bss *bss)
+{
+	struct cfg80211_internal_bss *pos;
+
+	list_del(&bss->lru);
+	list_for_each_entry_reverse(pos, &rdev->bss_lru, lru) {
+		if (!time_after(pos->ts, bss->ts))
+			break;
+	}
+	list_add(&bss->lru, &pos->lru);
+}
+
+/*
+ * Incremental scan dumps report entries whose generation is newer than what
+ * userspace saw, so mark an entry as changed in the generation that the
+ * caller is going to start by incrementing bss_generation.
+ */
+static void cfg80211_bss_changed(struct cfg80211_registered_device *rdev,
+				 struct cfg80211_internal_bss *bss)
+{
+	bss->generation = rdev->bss_generation + 1;
+}
+
+/*
+ * Remember that the entry as userspace knows it, i.e. its BSSID, channel
+ * and SSID, is going away in the generation the caller starts. Only as
+ * many tombstones as BSS entries are kept, and a dump from before the
+ * oldest one we dropped (or failed to allocate) fails with -ESTALE.
+ */
+static void cfg80211_bss_add_tombstone(struct cfg80211_registered_device *rdev,
+				       struct cfg80211_internal_bss *bss)
+{
+	u32 generation = rdev->bss_generation + 1;
+	struct cfg80211_bss_tombstone *ts;
+	const struct cfg80211_bss_ies *ies;
+	const struct element *ssid = NULL;
+
+	lockdep_assert_held(&rdev->bss_lock);
+
+	if (rdev->n_bss_tombstones >= bss_entries_limit) {
+		ts = list_first_entry(&rdev->bss_tombstones,
+				      struct cfg80211_bss_tombstone, list);
+		rdev->bss_tombstone_floor = ts->generation;
+		list_del(&ts->list);
+		rdev->n_bss_tombstones--;
+	} else {
+		ts = kmalloc(sizeof(*ts), GFP_ATOMIC);
+		if (!ts) {
+			rdev->bss_tombstone_floor = generation;
+			return;
+		}
+	}
+
+	ts->generation = generation;
+	ts->center_freq = bss->pub.channel->center_freq;
+	ts->freq_offset = bss->pub.channel->freq_offset;
+	ether_addr_copy(ts->bssid, bss->pub.bssid);
+
+	ies = rcu_access_pointer(bss->pub.ies);
+	if (ies)
+		ssid = cfg80211_find_elem(WLAN_EID_SSID, ies->data, ies->len);
+	ts->ssid_len = 0;
+	if (ssid && ssid->datalen <= IEEE80211_MAX_SSID_LEN) {
+		ts->ssid_len = ssid->datalen;
+		memcpy(ts->ssid, ssid->data, ssid->datalen);
+	}
+
+	list_add_tail(&ts->list, &rdev->bss_tombstones);
+	rdev->n_bss_tombstones++;
+}
+
 static bool __cfg80211_unlink_bss(struct cfg80211_registered_device *rdev,
 				  struct cfg80211_internal_bss *bss)
 {
@@ -162,9 +364,11 @@ static bool __cfg80211_unlink_bss(struct cfg80211_registered_device *rdev,
 		list_del_init(&bss->hidden_list);
 	}
 
+	cfg80211_bss_add_tombstone(rdev, bss);
 	list_del_init(&bss->list);
+	list_del_init(&bss->lru);
 	list_del_init(&bss->pub.nontrans_list);
-	rb_erase(&bss->rbn, &rdev->bss_tree);
+	cfg80211_bss_hash_remove(rdev, bss);
 	rdev->bss_entries--;
 	WARN_ONCE((rdev->bss_entries == 0) ^ list_empty(&rdev->bss_list),
 		  "rdev bss entries[%d]/list[empty:%d] corruption\n",
@@ -473,10 +677,11 @@ static void __cfg80211_bss_expire(struct cfg80211_registered_device *rdev,
 
 	lockdep_assert_held(&rdev->bss_lock);
 
-	list_for_each_entry_safe(bss, tmp, &rdev->bss_list, list) {
-		if (atomic_read(&bss->hold))
-			continue;
+	list_for_each_entry_safe(bss, tmp, &rdev->bss_lru, lru) {
+		/* sorted by age, so everything from here on is newer */
 		if (!time_after(expire_time, bss->ts))
+			break;
+		if (atomic_read(&bss->hold))
 			continue;
 
 		if (__cfg80211_unlink_bss(rdev, bss))
@@ -494,7 +699,7 @@ static bool cfg80211_bss_expire_oldest(struct cfg80211_registered_device *rdev)
 
 	lockdep_assert_held(&rdev->bss_lock);
 
-	list_for_each_entry(bss, &rdev->bss_list, list) {
+	list_for_each_entry(bss, &rdev->bss_lru, lru) {
 		if (atomic_read(&bss->hold))
 			continue;
 
@@ -502,9 +707,8 @@ static bool cfg80211_bss_expire_oldest(struct cfg80211_registered_device *rdev)
 		    !bss->pub.hidden_beacon_bss)
 			continue;
 
-		if (oldest && time_before(oldest->ts, bss->ts))
-			continue;
 		oldest = bss;
+		break;
 	}
 
 	if (WARN_ON(!oldest))
@@ -698,10 +902,17 @@ EXPORT_SYMBOL_GPL(cfg80211_iter_rnr);
 struct colocated_ap_data {
 	const struct element *ssid_elem;
 	struct list_head ap_list;
+	DECLARE_HASHTABLE(ap_hash, 5);
 	u32 s_ssid_tmp;
 	int n_coloc;
 };
 
+static u32 cfg80211_coloc_ap_hash(const struct cfg80211_colocated_ap *ap,
+				  u32 short_ssid)
+{
+	return jhash(ap->bssid, ETH_ALEN, ap->center_freq ^ short_ssid);
+}
+
 static enum cfg80211_rnr_iter_ret
 cfg80211_parse_colocated_ap_iter(void *_data, u8 type,
 				 const struct ieee80211_neighbor_ap_info *info,
@@ -739,9 +950,10 @@ cfg80211_parse_colocated_ap_iter(void *_data, u8 type,
 	if (!cfg80211_parse_ap_info(entry, tbtt_info, tbtt_info_len,
 				    data->ssid_elem, data->s_ssid_tmp)) {
 		struct cfg80211_colocated_ap *tmp;
+		u32 key = cfg80211_coloc_ap_hash(entry, 0);
 
 		/* Don't add duplicate BSSIDs on the same channel. */
-		list_for_each_entry(tmp, &data->ap_list, list) {
+		hash_for_each_possible(data->ap_hash, tmp, hash_node, key) {
 			if (ether_addr_equal(tmp->bssid, entry->bssid) &&
 			    tmp->center_freq == entry->center_freq) {
 				kfree(entry);
@@ -751,6 +963,7 @@ cfg80211_parse_colocated_ap_iter(void *_data, u8 type,
 
 		data->n_coloc++;
 		list_add_tail(&entry->list, &data->ap_list);
+		hash_add(data->ap_hash, &entry->hash_node, key);
 	} else {
 		kfree(entry);
 	}
@@ -766,6 +979,7 @@ cfg80211_parse_colocated_ap(const struct cfg80211_bss_ies *ies,
 	int ret;
 
 	INIT_LIST_HEAD(&data.ap_list);
+	hash_init(data.ap_hash);
 
 	ret = cfg80211_calc_short_ssid(ies, &data.ssid_elem, &data.s_ssid_tmp);
 	if (ret)
@@ -782,57 +996,352 @@ cfg80211_parse_colocated_ap(const struct cfg80211_bss_ies *ies,
 }
 EXPORT_SYMBOL_IF_CFG80211_KUNIT(cfg80211_parse_colocated_ap);
 
-static  void cfg80211_scan_req_add_chan(struct cfg80211_scan_request *request,
-					struct ieee80211_channel *chan,
-					bool add_to_6ghz)
+/*
+ * Return the colocated APs from the RNR of a BSS, parsing the elements
+ * again only when they changed. Must be called with the bss_lock held.
+ */
+static const struct cfg80211_bss_rnr *
+cfg80211_bss_get_rnr(struct cfg80211_internal_bss *bss)
 {
-	int i;
-	u32 n_channels = request->n_channels;
-	struct cfg80211_scan_6ghz_params *params =
-		&request->scan_6ghz_params[request->n_6ghz_params];
-
-	for (i = 0; i < n_channels; i++) {
-		if (request->channels[i] == chan) {
-			if (add_to_6ghz)
-				params->channel_idx = i;
+	const struct cfg80211_bss_ies *ies = rcu_access_pointer(bss->pub.ies);
+	struct cfg80211_colocated_ap *ap;
+	const struct element *elem;
+	struct cfg80211_bss_rnr *rnr;
+	LIST_HEAD(ap_list);
+	bool have_rnr = false;
+	u32 crc = ~0;
+	int n, i = 0;
+
+	if (!ies)
+		goto none;
+
+	for_each_element_id(elem, WLAN_EID_REDUCED_NEIGHBOR_REPORT,
+			    ies->data, ies->len) {
+		crc = crc32_le(crc, (const u8 *)elem,
+			       sizeof(*elem) + elem->datalen);
+		have_rnr = true;
+	}
+
+	if (!have_rnr)
+		goto none;
+
+	/* same_ssid entries take the SSID of the reporting BSS */
+	elem = cfg80211_find_elem(WLAN_EID_SSID, ies->data, ies->len);
+	if (elem)
+		crc = crc32_le(crc, (const u8 *)elem,
+			       sizeof(*elem) + elem->datalen);
+
+	if (bss->rnr && bss->rnr->crc == crc)
+		return bss->rnr;
+
+	kfree(bss->rnr);
+	bss->rnr = NULL;
+
+	/*
+	 * Nothing is kept when there are no 6 GHz APs, parsing again is
+	 * cheap then and a failed allocation isn't remembered.
+	 */
+	n = cfg80211_parse_colocated_ap(ies, &ap_list);
+	if (!n)
+		return NULL;
+
+	rnr = kmalloc(struct_size(rnr, aps, n), GFP_ATOMIC);
+	if (rnr) {
+		rnr->crc = crc;
+		rnr->n_aps = n;
+		list_for_each_entry(ap, &ap_list, list)
+			rnr->aps[i++] = *ap;
+		bss->rnr = rnr;
+	}
+
+	cfg80211_free_coloc_ap_list(&ap_list);
+	return bss->rnr;
+
+none:
+	kfree(bss->rnr);
+	bss->rnr = NULL;
+	return NULL;
+}
+
+struct cfg80211_coloc_ap_set {
+	struct cfg80211_colocated_ap *aps;
+	struct hlist_head *hash;
+	unsigned int hash_bits;
+	unsigned int n_aps;
+};
+
+/* add a scan target unless it was already reported by another BSS */
+static void cfg80211_coloc_ap_set_add(struct cfg80211_coloc_ap_set *set,
+				      const struct cfg80211_colocated_ap *ap)
+{
+	u32 short_ssid = ap->short_ssid_valid ? ap->short_ssid : 0;
+	struct cfg80211_colocated_ap *entry;
+	struct hlist_head *head;
+
+	head = &set->hash[hash_32(cfg80211_coloc_ap_hash(ap, short_ssid),
+				  set->hash_bits)];
+
+	hlist_for_each_entry(entry, head, hash_node) {
+		if (entry->center_freq == ap->center_freq &&
+		    entry->short_ssid_valid == ap->short_ssid_valid &&
+		    (!ap->short_ssid_valid ||
+		     entry->short_ssid == ap->short_ssid) &&
+		    ether_addr_equal(entry->bssid, ap->bssid))
 			return;
+	}
+
+	entry = &set->aps[set->n_aps++];
+	*entry = *ap;
+	hlist_add_head(&entry->hash_node, head);
+}
+
+static bool cfg80211_bss_is_6ghz_target(struct cfg80211_internal_bss *bss,
+					const u8 *bssid)
+{
+	return !is_broadcast_ether_addr(bssid) &&
+	       ether_addr_equal(bssid, bss->pub.bssid) &&
+	       bss->pub.channel->band == NL80211_BAND_6GHZ;
+}
+
+/*
+ * Collect the 6 GHz APs reported by all known BSSes, without duplicates
+ * of the same (channel, BSSID, short SSID). Returns an array to be freed
+ * by the caller, or %NULL if there are no APs or on allocation failure.
+ */
+VISIBLE_IF_CFG80211_KUNIT struct cfg80211_colocated_ap *
+cfg80211_collect_colocated_aps(struct cfg80211_registered_device *rdev,
+			       const u8 *bssid, unsigned int *n_aps)
+{
+	struct cfg80211_coloc_ap_set set = {};
+	struct cfg80211_internal_bss *intbss;
+	unsigned int max_aps = 0;
+
+	*n_aps = 0;
+
+	spin_lock_bh(&rdev->bss_lock);
+	list_for_each_entry(intbss, &rdev->bss_list, list) {
+		const struct cfg80211_bss_rnr *rnr = cfg80211_bss_get_rnr(intbss);
+
+		if (rnr)
+			max_aps += rnr->n_aps;
+		if (cfg80211_bss_is_6ghz_target(intbss, bssid))
+			max_aps++;
+	}
+
+	if (!max_aps)
+		goto out;
+
+	/* keep the hash table at most half full */
+	set.hash_bits = ilog2(roundup_pow_of_two(max_aps)) + 1;
+	set.hash = kcalloc(1 << set.hash_bits, sizeof(*set.hash), GFP_ATOMIC);
+	set.aps = kmalloc_array(max_aps, sizeof(*set.aps), GFP_ATOMIC);
+	if (!set.hash || !set.aps) {
+		kfree(set.aps);
+		set.aps = NULL;
+		goto out;
+	}
+
+	list_for_each_entry(intbss, &rdev->bss_list, list) {
+		struct cfg80211_bss *res = &intbss->pub;
+		struct cfg80211_colocated_ap entry = {};
+		const struct element *ssid_elem;
+		unsigned int i;
+
+		if (intbss->rnr) {
+			for (i = 0; i < intbss->rnr->n_aps; i++)
+				cfg80211_coloc_ap_set_add(&set,
+							  &intbss->rnr->aps[i]);
+		}
+
+		/* In case the scan request specified a specific BSSID
+		 * and the BSS is found and operating on 6GHz band then
+		 * add this AP to the collocated APs list.
+		 * This is relevant for ML probe requests when the lower
+		 * band APs have not been discovered.
+		 */
+		if (!cfg80211_bss_is_6ghz_target(intbss, bssid))
+			continue;
+
+		if (cfg80211_calc_short_ssid(rcu_access_pointer(res->ies),
+					     &ssid_elem, &entry.short_ssid))
+			continue;
+
+		memcpy(entry.bssid, res->bssid, ETH_ALEN);
+		memcpy(entry.ssid, ssid_elem->data, ssid_elem->datalen);
+		entry.ssid_len = ssid_elem->datalen;
+		entry.short_ssid_valid = true;
+		entry.center_freq = res->channel->center_freq;
+
+		cfg80211_coloc_ap_set_add(&set, &entry);
+	}
+	*n_aps = set.n_aps;
+out:
+	spin_unlock_bh(&rdev->bss_lock);
+	kfree(set.hash);
+	return set.aps;
+}
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(cfg80211_collect_colocated_aps);
+
+struct cfg80211_6ghz_ssid {
+	u32 short_ssid;
+	u32 idx;
+};
+
+struct cfg80211_6ghz_chan {
+	bool requested;
+	/* index in the new request + 1, zero if not added yet */
+	u32 req_idx;
+};
+
+/*
+ * Lookup tables for building a 6 GHz scan request, so that adding a
+ * target doesn't depend on the number of channels or SSIDs.
+ */
+struct cfg80211_6ghz_scan_plan {
+	struct ieee80211_supported_band *sband;
+	/* index into sband->channels + 1, by channel number */
+	u16 chan_idx[256];
+	/* the non-wildcard SSIDs of the request, sorted by short SSID */
+	struct cfg80211_6ghz_ssid *ssids;
+	unsigned int n_ssids;
+	bool wildcard;
+	/* by index into sband->channels */
+	struct cfg80211_6ghz_chan chans[];
+};
+
+static int cfg80211_6ghz_ssid_cmp(const void *a, const void *b)
+{
+	const struct cfg80211_6ghz_ssid *ssid_a = a, *ssid_b = b;
+
+	if (ssid_a->short_ssid != ssid_b->short_ssid)
+		return ssid_a->short_ssid < ssid_b->short_ssid ? -1 : 1;
+	return ssid_a->idx < ssid_b->idx ? -1 : 1;
+}
+
+static struct cfg80211_6ghz_scan_plan *
+cfg80211_6ghz_scan_plan_alloc(struct cfg80211_registered_device *rdev,
+			      struct cfg80211_scan_request *rdev_req)
+{
+	struct ieee80211_supported_band *sband =
+		rdev->wiphy.bands[NL80211_BAND_6GHZ];
+	struct cfg80211_6ghz_scan_plan *plan;
+	size_t size, offs_ssids;
+	int i;
+
+	size = struct_size(plan, chans, sband->n_channels);
+	offs_ssids = size;
+	size += sizeof(*plan->ssids) * rdev_req->n_ssids;
+
+	plan = kzalloc(size, GFP_KERNEL);
+	if (!plan)
+		return NULL;
+
+	plan->sband = sband;
+	plan->ssids = (void *)plan + offs_ssids;
+
+	for (i = 0; i < sband->n_channels; i++) {
+		int num = ieee80211_frequency_to_channel(sband->channels[i].center_freq);
+
+		if (num > 0 && num < ARRAY_SIZE(plan->chan_idx))
+			plan->chan_idx[num] = i + 1;
+	}
+
+	for (i = 0; i < rdev_req->n_channels; i++) {
+		struct ieee80211_channel *chan = rdev_req->channels[i];
+
+		if (chan->band == NL80211_BAND_6GHZ)
+			plan->chans[chan - sband->channels].requested = true;
+	}
+
+	for (i = 0; i < rdev_req->n_ssids; i++) {
+		const struct cfg80211_ssid *ssid = &rdev_req->ssids[i];
+
+		if (!ssid->ssid_len) {
+			plan->wildcard = true;
+			continue;
 		}
+
+		plan->ssids[plan->n_ssids].short_ssid =
+			~crc32_le(~0, ssid->ssid, ssid->ssid_len);
+		plan->ssids[plan->n_ssids].idx = i;
+		plan->n_ssids++;
+	}
+
+	sort(plan->ssids, plan->n_ssids, sizeof(*plan->ssids),
+	     cfg80211_6ghz_ssid_cmp, NULL);
+
+	return plan;
+}
+
+static struct ieee80211_channel *
+cfg80211_6ghz_scan_plan_chan(struct cfg80211_6ghz_scan_plan *plan, u32 freq)
+{
+	int num = ieee80211_frequency_to_channel(freq);
+	struct ieee80211_channel *chan;
+
+	if (num <= 0 || num >= ARRAY_SIZE(plan->chan_idx) ||
+	    !plan->chan_idx[num])
+		return NULL;
+
+	chan = &plan->sband->channels[plan->chan_idx[num] - 1];
+	if (chan->center_freq != freq || chan->freq_offset)
+		return NULL;
+
+	return chan;
+}
+
+static void cfg80211_scan_req_add_chan(struct cfg80211_6ghz_scan_plan *plan,
+				       struct cfg80211_scan_request *request,
+				       struct ieee80211_channel *chan,
+				       bool add_to_6ghz)
+{
+	struct cfg80211_6ghz_chan *plan_chan =
+		&plan->chans[chan - plan->sband->channels];
+
+	if (!plan_chan->req_idx) {
+		request->channels[request->n_channels++] = chan;
+		plan_chan->req_idx = request->n_channels;
 	}
 
-	request->n_channels++;
-	request->channels[n_channels] = chan;
 	if (add_to_6ghz)
 		request->scan_6ghz_params[request->n_6ghz_params].channel_idx =
-			n_channels;
+			plan_chan->req_idx - 1;
 }
 
-static bool cfg80211_find_ssid_match(struct cfg80211_colocated_ap *ap,
+static bool cfg80211_find_ssid_match(struct cfg80211_6ghz_scan_plan *plan,
+				     struct cfg80211_colocated_ap *ap,
 				     struct cfg80211_scan_request *request)
 {
-	int i;
-	u32 s_ssid;
+	unsigned int lo = 0, hi = plan->n_ssids;
 
-	for (i = 0; i < request->n_ssids; i++) {
-		/* wildcard ssid in the scan request */
-		if (!request->ssids[i].ssid_len) {
-			if (ap->multi_bss && !ap->transmitted_bssid)
-				continue;
+	/* wildcard ssid in the scan request */
+	if (plan->wildcard && !(ap->multi_bss && !ap->transmitted_bssid))
+		return true;
 
-			return true;
-		}
+	/*
+	 * The short SSID of an AP with a known SSID is calculated from it,
+	 * so only the SSIDs with the same short SSID can match.
+	 */
+	if (!ap->short_ssid_valid)
+		return false;
 
-		if (ap->ssid_len &&
-		    ap->ssid_len == request->ssids[i].ssid_len) {
-			if (!memcmp(request->ssids[i].ssid, ap->ssid,
-				    ap->ssid_len))
-				return true;
-		} else if (ap->short_ssid_valid) {
-			s_ssid = ~crc32_le(~0, request->ssids[i].ssid,
-					   request->ssids[i].ssid_len);
-
-			if (ap->short_ssid == s_ssid)
-				return true;
-		}
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (plan->ssids[mid].short_ssid < ap->short_ssid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < plan->n_ssids &&
+	       plan->ssids[lo].short_ssid == ap->short_ssid; lo++) {
+		const struct cfg80211_ssid *ssid =
+			&request->ssids[plan->ssids[lo].idx];
+
+		if (!ap->ssid_len || ap->ssid_len != ssid->ssid_len ||
+		    !memcmp(ssid->ssid, ap->ssid, ap->ssid_len))
+			return true;
 	}
 
 	return false;
@@ -841,10 +1350,11 @@ static bool cfg80211_find_ssid_match(struct cfg80211_colocated_ap *ap,
 static int cfg80211_scan_6ghz(struct cfg80211_registered_device *rdev)
 {
 	u8 i;
-	struct cfg80211_colocated_ap *ap;
-	int n_channels, count = 0, err;
+	struct cfg80211_colocated_ap *aps = NULL;
+	struct cfg80211_6ghz_scan_plan *plan;
+	unsigned int count = 0, n;
+	int n_channels, err;
 	struct cfg80211_scan_request *request, *rdev_req = rdev->scan_req;
-	LIST_HEAD(coloc_ap_list);
 	bool need_scan_psc = true;
 	const struct ieee80211_sband_iftype_data *iftd;
 	size_t size, offs_ssids, offs_6ghz_params, offs_ies;
@@ -861,54 +1371,14 @@ static int cfg80211_scan_6ghz(struct cfg80211_registered_device *rdev)
 
 	n_channels = rdev->wiphy.bands[NL80211_BAND_6GHZ]->n_channels;
 
-	if (rdev_req->flags & NL80211_SCAN_FLAG_COLOCATED_6GHZ) {
-		struct cfg80211_internal_bss *intbss;
+	if (rdev_req->flags & NL80211_SCAN_FLAG_COLOCATED_6GHZ)
+		aps = cfg80211_collect_colocated_aps(rdev, rdev_req->bssid,
+						     &count);
 
-		spin_lock_bh(&rdev->bss_lock);
-		list_for_each_entry(intbss, &rdev->bss_list, list) {
-			struct cfg80211_bss *res = &intbss->pub;
-			const struct cfg80211_bss_ies *ies;
-			const struct element *ssid_elem;
-			struct cfg80211_colocated_ap *entry;
-			u32 s_ssid_tmp;
-			int ret;
-
-			ies = rcu_access_pointer(res->ies);
-			count += cfg80211_parse_colocated_ap(ies,
-							     &coloc_ap_list);
-
-			/* In case the scan request specified a specific BSSID
-			 * and the BSS is found and operating on 6GHz band then
-			 * add this AP to the collocated APs list.
-			 * This is relevant for ML probe requests when the lower
-			 * band APs have not been discovered.
-			 */
-			if (is_broadcast_ether_addr(rdev_req->bssid) ||
-			    !ether_addr_equal(rdev_req->bssid, res->bssid) ||
-			    res->channel->band != NL80211_BAND_6GHZ)
-				continue;
-
-			ret = cfg80211_calc_short_ssid(ies, &ssid_elem,
-						       &s_ssid_tmp);
-			if (ret)
-				continue;
-
-			entry = kzalloc(sizeof(*entry), GFP_ATOMIC);
-			if (!entry)
-				continue;
-
-			memcpy(entry->bssid, res->bssid, ETH_ALEN);
-			entry->short_ssid = s_ssid_tmp;
-			memcpy(entry->ssid, ssid_elem->data,
-			       ssid_elem->datalen);
-			entry->ssid_len = ssid_elem->datalen;
-			entry->short_ssid_valid = true;
-			entry->center_freq = res->channel->center_freq;
-
-			list_add_tail(&entry->list, &coloc_ap_list);
-			count++;
-		}
-		spin_unlock_bh(&rdev->bss_lock);
+	plan = cfg80211_6ghz_scan_plan_alloc(rdev, rdev_req);
+	if (!plan) {
+		kfree(aps);
+		return -ENOMEM;
 	}
 
 	size = struct_size(request, channels, n_channels);
@@ -921,7 +1391,8 @@ static int cfg80211_scan_6ghz(struct cfg80211_registered_device *rdev)
 
 	request = kzalloc(size, GFP_KERNEL);
 	if (!request) {
-		cfg80211_free_coloc_ap_list(&coloc_ap_list);
+		kfree(plan);
+		kfree(aps);
 		return -ENOMEM;
 	}
 
@@ -954,9 +1425,9 @@ static int cfg80211_scan_6ghz(struct cfg80211_registered_device *rdev)
 	 * indicating that all APs in the same ESS are co-located
 	 */
 	if (count && request->n_ssids == 1 && request->ssids[0].ssid_len) {
-		list_for_each_entry(ap, &coloc_ap_list, list) {
-			if (ap->colocated_ess &&
-			    cfg80211_find_ssid_match(ap, request)) {
+		for (n = 0; n < count; n++) {
+			if (aps[n].colocated_ess &&
+			    cfg80211_find_ssid_match(plan, &aps[n], request)) {
 				need_scan_psc = false;
 				break;
 			}
@@ -973,7 +1444,7 @@ static int cfg80211_scan_6ghz(struct cfg80211_registered_device *rdev)
 		    ((need_scan_psc &&
 		      cfg80211_channel_is_psc(rdev_req->channels[i])) ||
 		     !(rdev_req->flags & NL80211_SCAN_FLAG_COLOCATED_6GHZ))) {
-			cfg80211_scan_req_add_chan(request,
+			cfg80211_scan_req_add_chan(plan, request,
 						   rdev_req->channels[i],
 						   false);
 		}
@@ -982,27 +1453,22 @@ static int cfg80211_scan_6ghz(struct cfg80211_registered_device *rdev)
 	if (!(rdev_req->flags & NL80211_SCAN_FLAG_COLOCATED_6GHZ))
 		goto skip;
 
-	list_for_each_entry(ap, &coloc_ap_list, list) {
-		bool found = false;
+	for (n = 0; n < count; n++) {
+		struct cfg80211_colocated_ap *ap = &aps[n];
 		struct cfg80211_scan_6ghz_params *scan_6ghz_params =
 			&request->scan_6ghz_params[request->n_6ghz_params];
 		struct ieee80211_channel *chan =
-			ieee80211_get_channel(&rdev->wiphy, ap->center_freq);
+			cfg80211_6ghz_scan_plan_chan(plan, ap->center_freq);
 
 		if (!chan || chan->flags & IEEE80211_CHAN_DISABLED ||
 		    !cfg80211_wdev_channel_allowed(rdev_req->wdev, chan))
 			continue;
 
-		for (i = 0; i < rdev_req->n_channels; i++) {
-			if (rdev_req->channels[i] == chan)
-				found = true;
-		}
-
-		if (!found)
+		if (!plan->chans[chan - plan->sband->channels].requested)
 			continue;
 
 		if (request->n_ssids > 0 &&
-		    !cfg80211_find_ssid_match(ap, request))
+		    !cfg80211_find_ssid_match(plan, ap, request))
 			continue;
 
 		if (!is_broadcast_ether_addr(request->bssid) &&
@@ -1012,7 +1478,7 @@ static int cfg80211_scan_6ghz(struct cfg80211_registered_device *rdev)
 		if (!request->n_ssids && ap->multi_bss && !ap->transmitted_bssid)
 			continue;
 
-		cfg80211_scan_req_add_chan(request, chan, true);
+		cfg80211_scan_req_add_chan(plan, request, chan, true);
 		memcpy(scan_6ghz_params->bssid, ap->bssid, ETH_ALEN);
 		scan_6ghz_params->short_ssid = ap->short_ssid;
 		scan_6ghz_params->short_ssid_valid = ap->short_ssid_valid;
@@ -1032,7 +1498,8 @@ static int cfg80211_scan_6ghz(struct cfg80211_registered_device *rdev)
 	}
 
 skip:
-	cfg80211_free_coloc_ap_list(&coloc_ap_list);
+	kfree(plan);
+	kfree(aps);
 
 	if (request->n_channels) {
 		struct cfg80211_scan_request *old = rdev->int_scan_req;
@@ -1372,11 +1839,13 @@ void cfg80211_bss_age(struct cfg80211_registered_device *rdev,
 		bss->ts -= age_jiffies;
 	spin_unlock_bh(&rdev->bss_lock);
 }
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(cfg80211_bss_age);
 
 void cfg80211_bss_expire(struct cfg80211_registered_device *rdev)
 {
 	__cfg80211_bss_expire(rdev, jiffies - IEEE80211_SCAN_RESULT_EXPIRE);
 }
+EXPORT_SYMBOL_IF_CFG80211_KUNIT(cfg80211_bss_expire);
 
 void cfg80211_bss_flush(struct wiphy *wiphy)
 {
@@ -1585,6 +2054,45 @@ static bool cfg80211_bss_type_match(u16 capability,
 	return ret;
 }
 
+struct cfg80211_get_bss_data {
+	struct ieee80211_channel *channel;
+	const u8 *bssid;
+	const u8 *ssid;
+	size_t ssid_len;
+	enum ieee80211_bss_type bss_type;
+	enum ieee80211_privacy privacy;
+	u32 use_for;
+	unsigned long now;
+};
+
+static bool cfg80211_get_bss_match(struct cfg80211_internal_bss *bss,
+				   void *data)
+{
+	struct cfg80211_get_bss_data *get = data;
+	int bss_privacy;
+
+	if (!cfg80211_bss_type_match(bss->pub.capability,
+				     bss->pub.channel->band, get->bss_type))
+		return false;
+
+	bss_privacy = (bss->pub.capability & WLAN_CAPABILITY_PRIVACY);
+	if ((get->privacy == IEEE80211_PRIVACY_ON && !bss_privacy) ||
+	    (get->privacy == IEEE80211_PRIVACY_OFF && bss_privacy))
+		return false;
+	if (get->channel && bss->pub.channel != get->channel)
+		return false;
+	if (!is_valid_ether_addr(bss->pub.bssid))
+		return false;
+	if ((bss->pub.use_for & get->use_for) != get->use_for)
+		return false;
+	/* Don't get expired BSS structs */
+	if (time_after(get->now, bss->ts + IEEE80211_SCAN_RESULT_EXPIRE) &&
+	    !atomic_read(&bss->hold))
+		return false;
+
+	return is_bss(&bss->pub, get->bssid, get->ssid, get->ssid_len);
+}
+
 /* Returned bss is reference counted and must be cleaned up appropriately. */
 struct cfg80211_bss *__cfg80211_get_bss(struct wiphy *wiphy,
 					struct ieee80211_channel *channel,
@@ -1595,41 +2103,53 @@ struct cfg80211_bss *__cfg80211_get_bss(struct wiphy *wiphy,
 					u32 use_for)
 {
 	struct cfg80211_registered_device *rdev = wiphy_to_rdev(wiphy);
+	struct cfg80211_get_bss_data get = {
+		.channel = channel,
+		.bssid = bssid,
+		.ssid = ssid,
+		.ssid_len = ssid_len,
+		.bss_type = bss_type,
+		.privacy = privacy,
+		.use_for = use_for,
+		.now = jiffies,
+	};
 	struct cfg80211_internal_bss *bss, *res = NULL;
-	unsigned long now = jiffies;
-	int bss_privacy;
+	struct rhlist_head *tmp, *list;
+	u32 ssid_hash;
 
 	trace_cfg80211_get_bss(wiphy, channel, bssid, ssid, ssid_len, bss_type,
 			       privacy);
 
 	spin_lock_bh(&rdev->bss_lock);
 
-	list_for_each_entry(bss, &rdev->bss_list, list) {
-		if (!cfg80211_bss_type_match(bss->pub.capability,
-					     bss->pub.channel->band, bss_type))
-			continue;
-
-		bss_privacy = (bss->pub.capability & WLAN_CAPABILITY_PRIVACY);
-		if ((privacy == IEEE80211_PRIVACY_ON && !bss_privacy) ||
-		    (privacy == IEEE80211_PRIVACY_OFF && bss_privacy))
-			continue;
-		if (channel && bss->pub.channel != channel)
-			continue;
-		if (!is_valid_ether_addr(bss->pub.bssid))
-			continue;
-		if ((bss->pub.use_for & use_for) != use_for)
-			continue;
-		/* Don't get expired BSS structs */
-		if (time_after(now, bss->ts + IEEE80211_SCAN_RESULT_EXPIRE) &&
-		    !atomic_read(&bss->hold))
-			continue;
-		if (is_bss(&bss->pub, bssid, ssid, ssid_len)) {
-			res = bss;
-			bss_ref_get(rdev, res);
-			break;
+	if (bssid) {
+		res = cfg80211_bss_find_by_bssid(rdev, bssid,
+						 cfg80211_get_bss_match, &get);
+	} else if (ssid) {
+		ssid_hash = cfg80211_bss_ssid_hash(ssid, ssid_len);
+
+		rcu_read_lock();
+		list = rhltable_lookup(&rdev->bss_ssid_hash, &ssid_hash,
+				       bss_ssid_hash_params);
+		rhl_for_each_entry_rcu(bss, tmp, list, ssid_node) {
+			if (cfg80211_get_bss_match(bss, &get)) {
+				res = bss;
+				break;
+			}
+		}
+		rcu_read_unlock();
+	} else {
+		list_for_each_entry(bss, &rdev->bss_list, list) {
+			if (cfg80211_get_bss_match(bss, &get)) {
+				res = bss;
+				break;
+			}
 		}
 	}
 
+	if (res)
+		bss_ref_get(rdev, res);
+
 	spin_unlock_bh(&rdev->bss_lock);
 	if (!res)
 		return NULL;
@@ -1638,69 +2158,68 @@ struct cfg80211_bss *__cfg80211_get_bss(struct wiphy *wiphy,
 }
 EXPORT_SYMBOL(__cfg80211_get_bss);
 
-static bool rb_insert_bss(struct cfg80211_registered_device *rdev,
-			  struct cfg80211_internal_bss *bss)
-{
-	struct rb_node **p = &rdev->bss_tree.rb_node;
-	struct rb_node *parent = NULL;
-	struct cfg80211_internal_bss *tbss;
-	int cmp;
-
-	while (*p) {
-		parent = *p;
-		tbss = rb_entry(parent, struct cfg80211_internal_bss, rbn);
+struct cfg80211_cmp_bss_data {
+	struct cfg80211_internal_bss *res;
+	enum bss_compare_mode mode;
+};
 
-		cmp = cmp_bss(&bss->pub, &tbss->pub, BSS_CMP_REGULAR);
+static bool cfg80211_cmp_bss_match(struct cfg80211_internal_bss *bss,
+				   void *data)
+{
+	struct cfg80211_cmp_bss_data *cmp = data;
 
-		if (WARN_ON(!cmp)) {
-			/* will sort of leak this BSS */
-			return false;
-		}
+	return !cmp_bss(&cmp->res->pub, &bss->pub, cmp->mode);
+}
 
-		if (cmp < 0)
-			p = &(*p)->rb_left;
-		else
-			p = &(*p)->rb_right;
-	}
+static struct cfg80211_internal_bss *
+cfg80211_find_bss(struct cfg80211_registered_device *rdev,
+		  struct cfg80211_internal_bss *res,
+		  enum bss_compare_mode mode)
+{
+	struct cfg80211_cmp_bss_data cmp = {
+		.res = res,
+		.mode = mode,
+	};
 
-	rb_link_node(&bss->rbn, parent, p);
-	rb_insert_color(&bss->rbn, &rdev->bss_tree);
-	return true;
+	return cfg80211_bss_find_by_bssid(rdev, res->pub.bssid,
+					  cfg80211_cmp_bss_match, &cmp);
 }
 
-static struct cfg80211_internal_bss *
-rb_find_bss(struct cfg80211_registered_device *rdev,
-	    struct cfg80211_internal_bss *res,
-	    enum bss_compare_mode mode)
+static bool cfg80211_bss_hash_insert(struct cfg80211_registered_device *rdev,
+				     struct cfg80211_internal_bss *bss)
 {
-	struct rb_node *n = rdev->bss_tree.rb_node;
-	struct cfg80211_internal_bss *bss;
-	int r;
+	if (WARN_ON(cfg80211_find_bss(rdev, bss, BSS_CMP_REGULAR))) {
+		/* will sort of leak this BSS */
+		return false;
+	}
 
-	while (n) {
-		bss = rb_entry(n, struct cfg80211_internal_bss, rbn);
-		r = cmp_bss(&res->pub, &bss->pub, mode);
+	cfg80211_bss_hash_keys(bss);
 
-		if (r == 0)
-			return bss;
-		else if (r < 0)
-			n = n->rb_left;
-		else
-			n = n->rb_right;
+	if (rhltable_insert(&rdev->bss_hash, &bss->hash_node,
+			    bss_hash_params))
+		return false;
+
+	if (rhltable_insert(&rdev->bss_ssid_hash, &bss->ssid_node,
+			    bss_ssid_hash_params)) {
+		rhltable_remove(&rdev->bss_hash, &bss->hash_node,
+				bss_hash_params);
+		return false;
 	}
 
-	return NULL;
+	return true;
 }
 
-static void cfg80211_insert_bss(struct cfg80211_registered_device *rdev,
+static bool cfg80211_insert_bss(struct cfg80211_registered_device *rdev,
 				struct cfg80211_internal_bss *bss)
 {
 	lockdep_assert_held(&rdev->bss_lock);
 
-	if (!rb_insert_bss(rdev, bss))
-		return;
+	if (!cfg80211_bss_hash_insert(rdev, bss))
+		return false;
 	list_add_tail(&bss->list, &rdev->bss_list);
+	cfg80211_bss_lru_update(rdev, bss);
 	rdev->bss_entries++;
+	return true;
 }
 
 static void cfg80211_rehash_bss(struct cfg80211_registered_device *rdev,
@@ -1708,27 +2227,75 @@ static void cfg80211_rehash_bss(struct cfg80211_registered_device *rdev,
 {
 	lockdep_assert_held(&rdev->bss_lock);
 
-	rb_erase(&bss->rbn, &rdev->bss_tree);
-	if (!rb_insert_bss(rdev, bss)) {
+	cfg80211_bss_hash_remove(rdev, bss);
+	if (!cfg80211_bss_hash_insert(rdev, bss)) {
 		list_del(&bss->list);
+		list_del_init(&bss->lru);
 		if (!list_empty(&bss->hidden_list))
 			list_del_init(&bss->hidden_list);
 		if (!list_empty(&bss->pub.nontrans_list))
 			list_del_init(&bss->pub.nontrans_list);
 		rdev->bss_entries--;
 	}
+	cfg80211_bss_changed(rdev, bss);
 	rdev->bss_generation++;
 }
 
+struct cfg80211_combine_bss_data {
+	struct cfg80211_registered_device *rdev;
+	struct cfg80211_internal_bss *new;
+	int ssidlen;
+};
+
+static bool cfg80211_combine_bss(struct cfg80211_internal_bss *bss,
+				 void *data)
+{
+	struct cfg80211_combine_bss_data *combine = data;
+	struct cfg80211_internal_bss *new = combine->new;
+	const struct cfg80211_bss_ies *ies;
+	const u8 *ie;
+
+	if (!ether_addr_equal(bss->pub.bssid, new->pub.bssid))
+		return false;
+	if (bss->pub.channel != new->pub.channel)
+		return false;
+	if (rcu_access_pointer(bss->pub.beacon_ies))
+		return false;
+	ies = rcu_access_pointer(bss->pub.ies);
+	if (!ies)
+		return false;
+	ie = cfg80211_find_ie(WLAN_EID_SSID, ies->data, ies->len);
+	if (!ie)
+		return false;
+	if (combine->ssidlen && ie[1] != combine->ssidlen)
+		return false;
+	if (WARN_ON_ONCE(bss->pub.hidden_beacon_bss))
+		return false;
+	if (WARN_ON_ONCE(!list_empty(&bss->hidden_list)))
+		list_del(&bss->hidden_list);
+	/* combine them */
+	list_add(&bss->hidden_list, &new->hidden_list);
+	bss->pub.hidden_beacon_bss = &new->pub;
+	new->refcount += bss->refcount;
+	rcu_assign_pointer(bss->pub.beacon_ies,
+			   new->pub.beacon_ies);
+	cfg80211_bss_changed(combine->rdev, bss);
+
+	/* keep going, there may be more probe responses to combine */
+	return false;
+}
+
 static bool cfg80211_combine_bsses(struct cfg80211_registered_device *rdev,
 				   struct cfg80211_internal_bss *new)
 {
+	struct cfg80211_combine_bss_data combine = {
+		.rdev = rdev,
+		.new = new,
+	};
 	const struct cfg80211_bss_ies *ies;
-	struct cfg80211_internal_bss *bss;
 	const u8 *ie;
-	int i, ssidlen;
+	int i;
 	u8 fold = 0;
-	u32 n_entries = 0;
 
 	ies = rcu_access_pointer(new->pub.beacon_ies);
 	if (WARN_ON(!ies))
@@ -1740,8 +2307,8 @@ static bool cfg80211_combine_bsses(struct cfg80211_registered_device *rdev,
 		return true;
 	}
 
-	ssidlen = ie[1];
-	for (i = 0; i < ssidlen; i++)
+	combine.ssidlen = ie[1];
+	for (i = 0; i < combine.ssidlen; i++)
 		fold |= ie[2 + i];
 
 	if (fold) {
@@ -1749,49 +2316,15 @@ static bool cfg80211_combine_bsses(struct cfg80211_registered_device *rdev,
 		return true;
 	}
 
-	/* This is the bad part ... */
-
-	list_for_each_entry(bss, &rdev->bss_list, list) {
-		/*
-		 * we're iterating all the entries anyway, so take the
-		 * opportunity to validate the list length accounting
-		 */
-		n_entries++;
-
-		if (!ether_addr_equal(bss->pub.bssid, new->pub.bssid))
-			continue;
-		if (bss->pub.channel != new->pub.channel)
-			continue;
-		if (rcu_access_pointer(bss->pub.beacon_ies))
-			continue;
-		ies = rcu_access_pointer(bss->pub.ies);
-		if (!ies)
-			continue;
-		ie = cfg80211_find_ie(WLAN_EID_SSID, ies->data, ies->len);
-		if (!ie)
-			continue;
-		if (ssidlen && ie[1] != ssidlen)
-			continue;
-		if (WARN_ON_ONCE(bss->pub.hidden_beacon_bss))
-			continue;
-		if (WARN_ON_ONCE(!list_empty(&bss->hidden_list)))
-			list_del(&bss->hidden_list);
-		/* combine them */
-		list_add(&bss->hidden_list, &new->hidden_list);
-		bss->pub.hidden_beacon_bss = &new->pub;
-		new->refcount += bss->refcount;
-		rcu_assign_pointer(bss->pub.beacon_ies,
-				   new->pub.beacon_ies);
-	}
-
-	WARN_ONCE(n_entries != rdev->bss_entries,
-		  "rdev bss entries[%d]/list[len:%d] corruption\n",
-		  rdev->bss_entries, n_entries);
+	/* the probe responses to combine are all in the BSSID's bucket */
+	cfg80211_bss_find_by_bssid(rdev, new->pub.bssid,
+				   cfg80211_combine_bss, &combine);
 
 	return true;
 }
 
-static void cfg80211_update_hidden_bsses(struct cfg80211_internal_bss *known,
+static void cfg80211_update_hidden_bsses(struct cfg80211_registered_device *rdev,
+					 struct cfg80211_internal_bss *known,
 					 const struct cfg80211_bss_ies *new_ies,
 					 const struct cfg80211_bss_ies *old_ies)
 {
@@ -1805,6 +2338,7 @@ static void cfg80211_update_hidden_bsses(struct cfg80211_internal_bss *known,
 		WARN_ON(ies != old_ies);
 
 		rcu_assign_pointer(bss->pub.beacon_ies, new_ies);
+		cfg80211_bss_changed(rdev, bss);
 	}
 }
 
@@ -1917,7 +2451,7 @@ cfg80211_update_known_bss(struct cfg80211_registered_device *rdev,
 		if (old == rcu_access_pointer(known->pub.ies))
 			rcu_assign_pointer(known->pub.ies, new->pub.beacon_ies);
 
-		cfg80211_update_hidden_bsses(known,
+		cfg80211_update_hidden_bsses(rdev, known,
 					     rcu_access_pointer(new->pub.beacon_ies),
 					     old);
 
@@ -1934,6 +2468,7 @@ cfg80211_update_known_bss(struct cfg80211_registered_device *rdev,
 		known->pub.signal = new->pub.signal;
 	known->pub.capability = new->pub.capability;
 	known->ts = new->ts;
+	cfg80211_bss_lru_update(rdev, known);
 	known->pub.ts_boottime = new->pub.ts_boottime;
 	known->parent_tsf = new->parent_tsf;
 	known->pub.chains = new->pub.chains;
@@ -1966,7 +2501,7 @@ __cfg80211_bss_update(struct cfg80211_registered_device *rdev,
 	if (WARN_ON(!rcu_access_pointer(tmp->pub.ies)))
 		goto free_ies;
 
-	found = rb_find_bss(rdev, tmp, BSS_CMP_REGULAR);
+	found = cfg80211_find_bss(rdev, tmp, BSS_CMP_REGULAR);
 
 	if (found) {
 		if (!cfg80211_update_known_bss(rdev, found, tmp, signal_valid))
@@ -1987,15 +2522,17 @@ __cfg80211_bss_update(struct cfg80211_registered_device *rdev,
 		memcpy(new, tmp, sizeof(*new));
 		new->refcount = 1;
 		INIT_LIST_HEAD(&new->hidden_list);
+		INIT_LIST_HEAD(&new->lru);
 		INIT_LIST_HEAD(&new->pub.nontrans_list);
 		/* we'll set this later if it was non-NULL */
 		new->pub.transmitted_bss = NULL;
 
 		if (rcu_access_pointer(tmp->pub.proberesp_ies)) {
-			hidden = rb_find_bss(rdev, tmp, BSS_CMP_HIDE_ZLEN);
+			hidden = cfg80211_find_bss(rdev, tmp,
+						   BSS_CMP_HIDE_ZLEN);
 			if (!hidden)
-				hidden = rb_find_bss(rdev, tmp,
-						     BSS_CMP_HIDE_NUL);
+				hidden = cfg80211_find_bss(rdev, tmp,
+							   BSS_CMP_HIDE_NUL);
 			if (hidden) {
 				new->pub.hidden_beacon_bss = &hidden->pub;
 				list_add(&new->hidden_list,
@@ -2033,10 +2570,21 @@ __cfg80211_bss_update(struct cfg80211_registered_device *rdev,
 			bss_ref_get(rdev, bss_from_pub(tmp->pub.transmitted_bss));
 		}
 
-		cfg80211_insert_bss(rdev, new);
+		if (!cfg80211_insert_bss(rdev, new)) {
+			/* not on any list, so it would never be expired */
+			if (new->pub.transmitted_bss) {
+				bss_ref_put(rdev,
+					    bss_from_pub(new->pub.transmitted_bss));
+				new->pub.transmitted_bss = NULL;
+			}
+			list_del_init(&new->hidden_list);
+			bss_ref_put(rdev, new);
+			return NULL;
+		}
 		found = new;
 	}
 
+	cfg80211_bss_changed(rdev, found);
 	rdev->bss_generation++;
 	bss_ref_get(rdev, found);
 
@@ -3399,6 +3947,26 @@ void cfg80211_bss_iter(struct wiphy *wiphy,
 }
 EXPORT_SYMBOL(cfg80211_bss_iter);
 
+struct cfg80211_assoc_bss_data {
+	struct cfg80211_internal_bss *cbss;
+	enum ieee80211_bss_type bss_type;
+};
+
+static bool cfg80211_assoc_bss_match(struct cfg80211_internal_bss *bss,
+				     void *data)
+{
+	struct cfg80211_assoc_bss_data *match = data;
+
+	if (!cfg80211_bss_type_match(bss->pub.capability,
+				     bss->pub.channel->band, match->bss_type))
+		return false;
+
+	if (bss == match->cbss)
+		return false;
+
+	return !cmp_bss(&bss->pub, &match->cbss->pub, BSS_CMP_REGULAR);
+}
+
 void cfg80211_update_assoc_bss_entry(struct wireless_dev *wdev,
 				     unsigned int link_id,
 				     struct ieee80211_channel *chan)
@@ -3406,6 +3974,9 @@ void cfg80211_update_assoc_bss_entry(struct wireless_dev *wdev,
 	struct wiphy *wiphy = wdev->wiphy;
 	struct cfg80211_registered_device *rdev = wiphy_to_rdev(wiphy);
 	struct cfg80211_internal_bss *cbss = wdev->links[link_id].client.current_bss;
+	struct cfg80211_assoc_bss_data match = {
+		.bss_type = wdev->conn_bss_type,
+	};
 	struct cfg80211_internal_bss *new = NULL;
 	struct cfg80211_internal_bss *bss;
 	struct cfg80211_bss *nontrans_bss;
@@ -3423,23 +3994,14 @@ void cfg80211_update_assoc_bss_entry(struct wireless_dev *wdev,
 	/* use transmitting bss */
 	if (cbss->pub.transmitted_bss)
 		cbss = bss_from_pub(cbss->pub.transmitted_bss);
+	match.cbss = cbss;
 
+	/* the entries move, so for dumps the old ones go away */
+	cfg80211_bss_add_tombstone(rdev, cbss);
 	cbss->pub.channel = chan;
 
-	list_for_each_entry(bss, &rdev->bss_list, list) {
-		if (!cfg80211_bss_type_match(bss->pub.capability,
-					     bss->pub.channel->band,
-					     wdev->conn_bss_type))
-			continue;
-
-		if (bss == cbss)
-			continue;
-
-		if (!cmp_bss(&bss->pub, &cbss->pub, BSS_CMP_REGULAR)) {
-			new = bss;
-			break;
-		}
-	}
+	new = cfg80211_bss_find_by_bssid(rdev, cbss->pub.bssid,
+					 cfg80211_assoc_bss_match, &match);
 
 	if (new) {
 		/* to save time, update IEs for transmitting bss only */
@@ -3465,6 +4027,7 @@ void cfg80211_update_assoc_bss_entry(struct wireless_dev *wdev,
 				 &cbss->pub.nontrans_list,
 				 nontrans_list) {
 		bss = bss_from_pub(nontrans_bss);
+		cfg80211_bss_add_tombstone(rdev, bss);
 		bss->pub.channel = chan;
 		cfg80211_rehash_bss(rdev, bss);
 	}
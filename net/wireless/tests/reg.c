@@ -0,0 +1,391 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the compiled regulatory rule tables and the
+ * regulatory database lookups
+ */
+#include <linux/rtnetlink.h>
+#include <net/cfg80211.h>
+#include <kunit/test.h>
+#include "../core.h"
+#include "../reg.h"
+
+MODULE_IMPORT_NS("EXPORTED_FOR_KUNIT_TESTING");
+
+#define REG_TEST_6GHZ_START	5925
+#define REG_TEST_6GHZ_END	7125
+
+static const u32 reg_test_bws[] = { 1, 2, 5, 10, 20, 40, 80, 160, 320 };
+
+static struct ieee80211_regdomain *reg_test_alloc(struct kunit *test,
+						  unsigned int n_rules)
+{
+	struct ieee80211_regdomain *regd;
+
+	regd = kunit_kzalloc(test, struct_size(regd, reg_rules, n_rules),
+			     GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, regd);
+	regd->n_reg_rules = n_rules;
+	regd->alpha2[0] = '9';
+	regd->alpha2[1] = '9';
+
+	return regd;
+}
+
+static void reg_test_rule(struct ieee80211_reg_rule *rule, u32 start, u32 end,
+			  u32 max_bw, u32 flags)
+{
+	rule->freq_range.start_freq_khz = MHZ_TO_KHZ(start);
+	rule->freq_range.end_freq_khz = MHZ_TO_KHZ(end);
+	rule->freq_range.max_bandwidth_khz = MHZ_TO_KHZ(max_bw);
+	rule->power_rule.max_eirp = DBM_TO_MBM(20);
+	rule->flags = flags;
+}
+
+/*
+ * The worst case for a linear search: as many rules as allowed, the ones
+ * for 6 GHz last and all of them in small pieces that need the automatic
+ * bandwidth calculation.
+ */
+static struct ieee80211_regdomain *reg_test_worst_case(struct kunit *test)
+{
+	unsigned int n_6ghz = (REG_TEST_6GHZ_END - REG_TEST_6GHZ_START) / 20;
+	unsigned int n_5ghz = NL80211_MAX_SUPP_REG_RULES - n_6ghz;
+	struct ieee80211_regdomain *regd;
+	unsigned int i;
+
+	regd = reg_test_alloc(test, NL80211_MAX_SUPP_REG_RULES);
+
+	for (i = 0; i < n_5ghz; i++)
+		reg_test_rule(&regd->reg_rules[i], 5150 + 10 * i,
+			      5160 + 10 * i, 10,
+			      NL80211_RRF_AUTO_BW |
+			      (i & 1 ? NL80211_RRF_DFS : 0));
+
+	for (i = 0; i < n_6ghz; i++)
+		reg_test_rule(&regd->reg_rules[n_5ghz + i],
+			      REG_TEST_6GHZ_START + 20 * i,
+			      REG_TEST_6GHZ_START + 20 * (i + 1), 20,
+			      NL80211_RRF_AUTO_BW | NL80211_RRF_PSD);
+
+	return regd;
+}
+
+/* lookups must agree with freq_reg_info_regd(), linear without a table */
+static void reg_test_check(struct kunit *test,
+			   const struct ieee80211_regdomain *regd,
+			   const struct reg_rule_table *table,
+			   u32 start, u32 end, u32 step_khz)
+{
+	unsigned int i;
+	u32 freq;
+
+	for (freq = MHZ_TO_KHZ(start); freq <= MHZ_TO_KHZ(end);
+	     freq += step_khz) {
+		for (i = 0; i < ARRAY_SIZE(reg_test_bws); i++) {
+			u32 bw = MHZ_TO_KHZ(reg_test_bws[i]);
+
+			KUNIT_EXPECT_PTR_EQ_MSG(test,
+						reg_rule_table_lookup(table,
+								      freq, bw),
+						freq_reg_info_regd(freq, regd,
+								   bw),
+						"freq %u kHz, bw %u kHz",
+						freq, bw);
+		}
+	}
+}
+
+static void reg_table_worst_case(struct kunit *test)
+{
+	struct ieee80211_regdomain *regd = reg_test_worst_case(test);
+	struct reg_rule_table *table;
+	unsigned int i;
+
+	table = reg_rule_table_compile(regd, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, table);
+
+	for (i = 0; i < regd->n_reg_rules; i++)
+		KUNIT_EXPECT_EQ(test, table->info[i].max_bandwidth_khz,
+				reg_get_max_bandwidth(regd,
+						      &regd->reg_rules[i]));
+
+	/* the 6 GHz rules are contiguous, so all bandwidths are allowed */
+	KUNIT_EXPECT_EQ(test,
+			table->info[regd->n_reg_rules - 1].max_bandwidth_khz,
+			MHZ_TO_KHZ(REG_TEST_6GHZ_END - REG_TEST_6GHZ_START));
+	KUNIT_EXPECT_EQ(test, table->info[regd->n_reg_rules - 1].bw_flags, 0);
+
+	reg_test_check(test, regd, table, 2400, 2500, 1000);
+	reg_test_check(test, regd, table, 5100, 7200, 5000);
+	reg_test_check(test, regd, table, 58000, 60000, 2160000);
+
+	kfree(table);
+}
+
+static void reg_table_overlapping(struct kunit *test)
+{
+	struct ieee80211_regdomain *regd = reg_test_alloc(test, 6);
+	struct reg_rule_table *table;
+
+	/* out of order and overlapping, the first matching rule wins */
+	reg_test_rule(&regd->reg_rules[0], 5490, 5730, 160, NL80211_RRF_DFS);
+	reg_test_rule(&regd->reg_rules[1], 5170, 5250, 80, 0);
+	reg_test_rule(&regd->reg_rules[2], 5150, 5350, 160, NL80211_RRF_DFS);
+	reg_test_rule(&regd->reg_rules[3], 2402, 2482, 40, 0);
+	reg_test_rule(&regd->reg_rules[4], 5250, 5330, 80, NL80211_RRF_AUTO_BW);
+	reg_test_rule(&regd->reg_rules[5], 57240, 63720, 2160, 0);
+
+	table = reg_rule_table_compile(regd, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, table);
+
+	KUNIT_EXPECT_PTR_EQ(test,
+			    reg_rule_table_lookup(table, MHZ_TO_KHZ(5180),
+						  MHZ_TO_KHZ(20)),
+			    &regd->reg_rules[1]);
+	KUNIT_EXPECT_PTR_EQ(test,
+			    reg_rule_table_lookup(table, MHZ_TO_KHZ(5160),
+						  MHZ_TO_KHZ(20)),
+			    &regd->reg_rules[2]);
+	KUNIT_EXPECT_PTR_EQ(test,
+			    reg_rule_table_lookup(table, MHZ_TO_KHZ(5300),
+						  MHZ_TO_KHZ(20)),
+			    &regd->reg_rules[2]);
+	KUNIT_EXPECT_TRUE(test,
+			  PTR_ERR(reg_rule_table_lookup(table,
+							MHZ_TO_KHZ(5400),
+							MHZ_TO_KHZ(20))) ==
+			  -EINVAL);
+	KUNIT_EXPECT_TRUE(test,
+			  PTR_ERR(reg_rule_table_lookup(table,
+							MHZ_TO_KHZ(10000),
+							MHZ_TO_KHZ(20))) ==
+			  -ERANGE);
+
+	reg_test_check(test, regd, table, 2400, 2500, 1000);
+	reg_test_check(test, regd, table, 5100, 5800, 5000);
+	reg_test_check(test, regd, table, 56000, 66000, 1080000);
+
+	kfree(table);
+}
+
+/*
+ * Look up the rules for all channels of a synthetic 6 GHz band with a
+ * channel every 5 MHz, as the regulatory code does when applying the
+ * worst-case regulatory domain, and compare with the linear search.
+ */
+static void reg_table_6ghz(struct kunit *test)
+{
+	struct ieee80211_regdomain *regd = reg_test_worst_case(test);
+	struct reg_rule_table *table;
+	u32 freq;
+
+	table = reg_rule_table_compile(regd, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, table);
+
+	for (freq = REG_TEST_6GHZ_START; freq < REG_TEST_6GHZ_END; freq += 5)
+		KUNIT_EXPECT_PTR_EQ_MSG(test,
+					reg_rule_table_lookup(table,
+							      MHZ_TO_KHZ(freq),
+							      MHZ_TO_KHZ(20)),
+					freq_reg_info_regd(MHZ_TO_KHZ(freq),
+							   regd,
+							   MHZ_TO_KHZ(20)),
+					"%u MHz", freq);
+
+	kfree(table);
+}
+
+static struct kunit_case reg_table_test_cases[] = {
+	KUNIT_CASE(reg_table_worst_case),
+	KUNIT_CASE(reg_table_overlapping),
+	KUNIT_CASE(reg_table_6ghz),
+	{}
+};
+
+static struct kunit_suite reg_table = {
+	.name = "cfg80211-reg-table",
+	.test_cases = reg_table_test_cases,
+};
+
+/* the regulatory.db format, only as much of it as the lookups need */
+#define REG_TEST_FWDB_MAGIC	0x52474442
+#define REG_TEST_FWDB_VERSION	20
+
+struct reg_test_fwdb_country {
+	u8 alpha2[2];
+	__be16 coll_ptr;
+} __packed __aligned(4);
+
+struct reg_test_fwdb {
+	__be32 magic;
+	__be32 version;
+	/* terminated by an entry without collection */
+	struct reg_test_fwdb_country country[8];
+} __packed __aligned(4);
+
+static struct reg_test_fwdb *reg_test_fwdb(struct kunit *test,
+					   const char * const *alpha2,
+					   unsigned int n)
+{
+	struct reg_test_fwdb *db;
+	unsigned int i;
+
+	KUNIT_ASSERT_LT(test, n, ARRAY_SIZE(db->country));
+
+	db = kunit_kzalloc(test, sizeof(*db), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, db);
+	db->magic = cpu_to_be32(REG_TEST_FWDB_MAGIC);
+	db->version = cpu_to_be32(REG_TEST_FWDB_VERSION);
+	for (i = 0; i < n; i++) {
+		memcpy(db->country[i].alpha2, alpha2[i], 2);
+		/* never followed, only needs to be non-zero */
+		db->country[i].coll_ptr = cpu_to_be16(i + 1);
+	}
+
+	return db;
+}
+
+static const struct fwdb_country *
+reg_test_country(struct reg_test_fwdb *db, unsigned int i)
+{
+	return (const struct fwdb_country *)&db->country[i];
+}
+
+/* regdomains in the cache are freed by it, so don't use kunit_kzalloc() */
+static struct ieee80211_regdomain *reg_test_cache_regd(struct kunit *test,
+						       const char *alpha2)
+{
+	struct ieee80211_regdomain *regd;
+
+	regd = kzalloc(sizeof(*regd), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, regd);
+	memcpy(regd->alpha2, alpha2, 2);
+
+	return regd;
+}
+
+/*
+ * Swap in a test database under RTNL, the original one is put back (and
+ * reindexed) by reg_regdb_end(). Nothing may assert in between, so that
+ * RTNL is always released again.
+ */
+static const struct fwdb_header *reg_regdb_begin(struct reg_test_fwdb *db)
+{
+	rtnl_lock();
+	return regdb_replace((const struct fwdb_header *)db);
+}
+
+static void reg_regdb_end(const struct fwdb_header *orig)
+{
+	regdb_replace(orig);
+	rtnl_unlock();
+}
+
+static void reg_regdb_find_country(struct kunit *test)
+{
+	static const char * const alpha2[] = { "US", "DE", "AA", "ZZ", "DE" };
+	const struct fwdb_header *orig;
+	struct reg_test_fwdb *db;
+
+	db = reg_test_fwdb(test, alpha2, ARRAY_SIZE(alpha2));
+
+	orig = reg_regdb_begin(db);
+
+	KUNIT_EXPECT_PTR_EQ(test, regdb_find_country("US"),
+			    reg_test_country(db, 0));
+	KUNIT_EXPECT_PTR_EQ(test, regdb_find_country("AA"),
+			    reg_test_country(db, 2));
+	KUNIT_EXPECT_PTR_EQ(test, regdb_find_country("ZZ"),
+			    reg_test_country(db, 3));
+	/* duplicates resolve to the first one in the database */
+	KUNIT_EXPECT_PTR_EQ(test, regdb_find_country("DE"),
+			    reg_test_country(db, 1));
+
+	KUNIT_EXPECT_NULL(test, regdb_find_country("FR"));
+	KUNIT_EXPECT_NULL(test, regdb_find_country("00"));
+
+	reg_regdb_end(orig);
+}
+
+static void reg_regdb_cache_lru(struct kunit *test)
+{
+	static const char * const alpha2[] = { "AA", "BB", "CC", "DD", "EE" };
+	struct ieee80211_regdomain *regd[ARRAY_SIZE(alpha2)];
+	const struct fwdb_header *orig;
+	struct reg_test_fwdb *db;
+	unsigned int i;
+
+	db = reg_test_fwdb(test, alpha2, ARRAY_SIZE(alpha2));
+	for (i = 0; i < ARRAY_SIZE(alpha2); i++)
+		regd[i] = reg_test_cache_regd(test, alpha2[i]);
+
+	orig = reg_regdb_begin(db);
+
+	/* fill the cache, "AA" is the least recently used entry */
+	for (i = 0; i < 4; i++)
+		regdb_cache_add(regd[i]);
+
+	for (i = 0; i < 4; i++)
+		KUNIT_EXPECT_PTR_EQ(test, regdb_cache_get(alpha2[i]), regd[i]);
+
+	/* that made "AA" the least recently used again, use it once more */
+	KUNIT_EXPECT_PTR_EQ(test, regdb_cache_get("AA"), regd[0]);
+
+	/* so adding another one evicts "BB" instead */
+	regdb_cache_add(regd[4]);
+	KUNIT_EXPECT_NULL(test, regdb_cache_get("BB"));
+	KUNIT_EXPECT_PTR_EQ(test, regdb_cache_get("AA"), regd[0]);
+	KUNIT_EXPECT_PTR_EQ(test, regdb_cache_get("CC"), regd[2]);
+	KUNIT_EXPECT_PTR_EQ(test, regdb_cache_get("DD"), regd[3]);
+	KUNIT_EXPECT_PTR_EQ(test, regdb_cache_get("EE"), regd[4]);
+
+	reg_regdb_end(orig);
+}
+
+static void reg_regdb_reload(struct kunit *test)
+{
+	static const char * const old_alpha2[] = { "AA", "BB" };
+	static const char * const new_alpha2[] = { "CC", "AA" };
+	struct ieee80211_regdomain *regd;
+	const struct fwdb_header *orig;
+	struct reg_test_fwdb *old, *new;
+
+	old = reg_test_fwdb(test, old_alpha2, ARRAY_SIZE(old_alpha2));
+	new = reg_test_fwdb(test, new_alpha2, ARRAY_SIZE(new_alpha2));
+	regd = reg_test_cache_regd(test, "AA");
+
+	orig = reg_regdb_begin(old);
+
+	KUNIT_EXPECT_PTR_EQ(test, regdb_find_country("AA"),
+			    reg_test_country(old, 0));
+	regdb_cache_add(regd);
+	KUNIT_EXPECT_PTR_EQ(test, regdb_cache_get("AA"), regd);
+
+	/* replacing the database drops what was built from the old one */
+	KUNIT_EXPECT_PTR_EQ(test,
+			    regdb_replace((const struct fwdb_header *)new),
+			    (const struct fwdb_header *)old);
+	KUNIT_EXPECT_NULL(test, regdb_cache_get("AA"));
+
+	KUNIT_EXPECT_PTR_EQ(test, regdb_find_country("AA"),
+			    reg_test_country(new, 1));
+	KUNIT_EXPECT_PTR_EQ(test, regdb_find_country("CC"),
+			    reg_test_country(new, 0));
+	KUNIT_EXPECT_NULL(test, regdb_find_country("BB"));
+
+	reg_regdb_end(orig);
+}
+
+static struct kunit_case reg_regdb_test_cases[] = {
+	KUNIT_CASE(reg_regdb_find_country),
+	KUNIT_CASE(reg_regdb_cache_lru),
+	KUNIT_CASE(reg_regdb_reload),
+	{}
+};
+
+static struct kunit_suite reg_regdb = {
+	.name = "cfg80211-reg-regdb",
+	.test_cases = reg_regdb_test_cases,
+};
+
+kunit_test_suites(&reg_table, &reg_regdb);
@@ -840,6 +840,430 @@ static void test_cfg80211_parse_colocated_ap(struct kunit *test)
 	cfg80211_free_coloc_ap_list(&coloc_ap_list);
 }
 
+static struct cfg80211_bss *bss_table_inform(struct wiphy *wiphy,
+					     unsigned int chan_idx,
+					     const u8 *bssid, const char *ssid)
+{
+	struct cfg80211_inform_bss inform_bss = {
+		.signal = 50,
+	};
+	u8 ies[2 + IEEE80211_MAX_SSID_LEN];
+	size_t ssid_len = strlen(ssid);
+
+	inform_bss.chan = &wiphy->bands[NL80211_BAND_2GHZ]->channels[chan_idx];
+
+	ies[0] = WLAN_EID_SSID;
+	ies[1] = ssid_len;
+	memcpy(ies + 2, ssid, ssid_len);
+
+	return cfg80211_inform_bss_data(wiphy, &inform_bss,
+					CFG80211_BSS_FTYPE_PRESP, bssid, 0,
+					WLAN_CAPABILITY_ESS, 100,
+					ies, 2 + ssid_len, GFP_KERNEL);
+}
+
+static struct cfg80211_bss *bss_table_get(struct wiphy *wiphy,
+					  struct ieee80211_channel *chan,
+					  const u8 *bssid, const char *ssid)
+{
+	return cfg80211_get_bss(wiphy, chan, bssid, ssid,
+				ssid ? strlen(ssid) : 0,
+				IEEE80211_BSS_TYPE_ANY,
+				IEEE80211_PRIVACY_ANY);
+}
+
+static void test_bss_table_lookup(struct kunit *test)
+{
+	struct inform_bss ctx = {
+		.test = test,
+	};
+	struct wiphy *wiphy = T_WIPHY(test, ctx);
+	struct cfg80211_registered_device *rdev = wiphy_to_rdev(wiphy);
+	struct ieee80211_channel *chan1, *chan6;
+	const u8 bssid1[ETH_ALEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+	const u8 bssid2[ETH_ALEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+	struct cfg80211_bss *a, *b, *c, *d, *bss;
+
+	chan1 = &wiphy->bands[NL80211_BAND_2GHZ]->channels[0];
+	chan6 = &wiphy->bands[NL80211_BAND_2GHZ]->channels[5];
+
+	/* same BSSID on two channels, and the same SSID on two BSSIDs */
+	a = bss_table_inform(wiphy, 0, bssid1, "alpha");
+	b = bss_table_inform(wiphy, 5, bssid1, "beta");
+	c = bss_table_inform(wiphy, 5, bssid2, "alpha");
+	KUNIT_ASSERT_NOT_NULL(test, a);
+	KUNIT_ASSERT_NOT_NULL(test, b);
+	KUNIT_ASSERT_NOT_NULL(test, c);
+	KUNIT_EXPECT_EQ(test, rdev->bss_entries, 3);
+
+	bss = bss_table_get(wiphy, chan6, bssid1, NULL);
+	KUNIT_EXPECT_PTR_EQ(test, bss, b);
+	cfg80211_put_bss(wiphy, bss);
+
+	bss = bss_table_get(wiphy, NULL, bssid1, "alpha");
+	KUNIT_EXPECT_PTR_EQ(test, bss, a);
+	cfg80211_put_bss(wiphy, bss);
+
+	bss = bss_table_get(wiphy, chan6, NULL, "alpha");
+	KUNIT_EXPECT_PTR_EQ(test, bss, c);
+	cfg80211_put_bss(wiphy, bss);
+
+	bss = bss_table_get(wiphy, chan1, bssid2, NULL);
+	KUNIT_EXPECT_NULL(test, bss);
+	bss = bss_table_get(wiphy, NULL, NULL, "gamma");
+	KUNIT_EXPECT_NULL(test, bss);
+
+	/* an update finds the existing entry */
+	bss = bss_table_inform(wiphy, 0, bssid1, "alpha");
+	KUNIT_EXPECT_PTR_EQ(test, bss, a);
+	KUNIT_EXPECT_EQ(test, rdev->bss_entries, 3);
+	cfg80211_put_bss(wiphy, bss);
+
+	cfg80211_put_bss(wiphy, a);
+	cfg80211_put_bss(wiphy, b);
+	cfg80211_put_bss(wiphy, c);
+
+	/* only the entries that are old enough expire */
+	cfg80211_bss_age(rdev, 20);
+	d = bss_table_inform(wiphy, 0, bssid2, "delta");
+	KUNIT_ASSERT_NOT_NULL(test, d);
+	cfg80211_put_bss(wiphy, d);
+	cfg80211_bss_age(rdev, 15);
+
+	spin_lock_bh(&rdev->bss_lock);
+	cfg80211_bss_expire(rdev);
+	spin_unlock_bh(&rdev->bss_lock);
+
+	KUNIT_EXPECT_EQ(test, rdev->bss_entries, 1);
+	bss = bss_table_get(wiphy, NULL, bssid1, NULL);
+	KUNIT_EXPECT_NULL(test, bss);
+	bss = bss_table_get(wiphy, NULL, bssid2, NULL);
+	KUNIT_EXPECT_PTR_EQ(test, bss, d);
+	cfg80211_put_bss(wiphy, bss);
+}
+
+static void test_bss_table_generations(struct kunit *test)
+{
+	struct inform_bss ctx = {
+		.test = test,
+	};
+	struct wiphy *wiphy = T_WIPHY(test, ctx);
+	struct cfg80211_registered_device *rdev = wiphy_to_rdev(wiphy);
+	const u8 bssid1[ETH_ALEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+	const u8 bssid2[ETH_ALEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+	struct cfg80211_bss_tombstone *ts;
+	struct cfg80211_bss *a, *b, *bss;
+	u32 since;
+
+	a = bss_table_inform(wiphy, 0, bssid1, "alpha");
+	b = bss_table_inform(wiphy, 5, bssid2, "beta");
+	KUNIT_ASSERT_NOT_NULL(test, a);
+	KUNIT_ASSERT_NOT_NULL(test, b);
+	KUNIT_EXPECT_EQ(test, bss_from_pub(b)->generation,
+			rdev->bss_generation);
+	since = rdev->bss_generation;
+
+	/* an update moves only that entry to a newer generation */
+	bss = bss_table_inform(wiphy, 0, bssid1, "alpha");
+	KUNIT_EXPECT_PTR_EQ(test, bss, a);
+	cfg80211_put_bss(wiphy, bss);
+	KUNIT_EXPECT_GT(test, (s32)(bss_from_pub(a)->generation - since), 0);
+	KUNIT_EXPECT_LE(test, (s32)(bss_from_pub(b)->generation - since), 0);
+	KUNIT_EXPECT_TRUE(test, list_empty(&rdev->bss_tombstones));
+
+	/* and removing one leaves a tombstone for the dump */
+	cfg80211_unlink_bss(wiphy, b);
+	KUNIT_ASSERT_EQ(test, rdev->n_bss_tombstones, 1);
+	ts = list_first_entry(&rdev->bss_tombstones,
+			      struct cfg80211_bss_tombstone, list);
+	KUNIT_EXPECT_EQ(test, ts->generation, rdev->bss_generation);
+	KUNIT_EXPECT_MEMEQ(test, ts->bssid, bssid2, ETH_ALEN);
+	KUNIT_EXPECT_EQ(test, ts->center_freq, b->channel->center_freq);
+	KUNIT_EXPECT_EQ(test, ts->ssid_len, 4);
+	KUNIT_EXPECT_MEMEQ(test, ts->ssid, "beta", 4);
+	KUNIT_EXPECT_EQ(test, rdev->bss_tombstone_floor, 0);
+
+	cfg80211_put_bss(wiphy, a);
+	cfg80211_put_bss(wiphy, b);
+}
+
+#define BSS_TABLE_SCALE_ENTRIES	10000
+
+static void bss_table_test_addr(u8 *addr, unsigned int i)
+{
+	addr[0] = 0x02;
+	addr[1] = 0x00;
+	addr[2] = 0x00;
+	addr[3] = 0x00;
+	addr[4] = i >> 8;
+	addr[5] = i & 0xff;
+}
+
+/*
+ * Inform a large number of BSSes, more than the table is allowed to hold,
+ * so that the oldest ones keep getting evicted, look up the survivors and
+ * finally age them all out.
+ */
+static void test_bss_table_scale(struct kunit *test)
+{
+	struct inform_bss ctx = {
+		.test = test,
+	};
+	struct wiphy *wiphy = T_WIPHY(test, ctx);
+	struct cfg80211_registered_device *rdev = wiphy_to_rdev(wiphy);
+	unsigned int n_channels = wiphy->bands[NL80211_BAND_2GHZ]->n_channels;
+	u8 bssid[ETH_ALEN] __aligned(2);
+	struct cfg80211_bss *bss;
+	char ssid[16];
+	unsigned int i, n;
+
+	for (i = 0; i < BSS_TABLE_SCALE_ENTRIES; i++) {
+		bss_table_test_addr(bssid, i);
+		snprintf(ssid, sizeof(ssid), "scale-%u", i % 64);
+		bss = bss_table_inform(wiphy, i % n_channels, bssid, ssid);
+		KUNIT_ASSERT_NOT_NULL(test, bss);
+		cfg80211_put_bss(wiphy, bss);
+	}
+
+	/* the most recently informed entries are the ones kept */
+	n = rdev->bss_entries;
+	KUNIT_ASSERT_GT(test, n, 0);
+	KUNIT_ASSERT_LE(test, n, BSS_TABLE_SCALE_ENTRIES);
+
+	for (i = BSS_TABLE_SCALE_ENTRIES - n; i < BSS_TABLE_SCALE_ENTRIES; i++) {
+		bss_table_test_addr(bssid, i);
+		bss = bss_table_get(wiphy, NULL, bssid, NULL);
+		KUNIT_EXPECT_NOT_NULL(test, bss);
+		if (bss)
+			cfg80211_put_bss(wiphy, bss);
+	}
+
+	if (n < BSS_TABLE_SCALE_ENTRIES) {
+		bss_table_test_addr(bssid, BSS_TABLE_SCALE_ENTRIES - n - 1);
+		bss = bss_table_get(wiphy, NULL, bssid, NULL);
+		KUNIT_EXPECT_NULL(test, bss);
+	}
+
+	cfg80211_bss_age(rdev, 60);
+	spin_lock_bh(&rdev->bss_lock);
+	cfg80211_bss_expire(rdev);
+	spin_unlock_bh(&rdev->bss_lock);
+
+	KUNIT_EXPECT_EQ(test, rdev->bss_entries, 0);
+	KUNIT_EXPECT_TRUE(test, list_empty(&rdev->bss_list));
+}
+
+#define COLOC_TEST_APS_PER_RNR	16
+
+/*
+ * Add an RNR element with 16 colocated APs on one 6 GHz channel, the AP
+ * numbered n has BSSID and short SSID derived from n.
+ */
+static void coloc_test_put_rnr(struct sk_buff *skb, u8 channel,
+			       unsigned int first)
+{
+	struct ieee80211_neighbor_ap_info info = {
+		.tbtt_info_hdr = u8_encode_bits(COLOC_TEST_APS_PER_RNR - 1,
+						IEEE80211_AP_INFO_TBTT_HDR_COUNT),
+		.tbtt_info_len = offsetofend(struct ieee80211_tbtt_info_ge_11,
+					     bss_params),
+		.op_class = 131,
+		.channel = channel,
+	};
+	unsigned int i;
+
+	skb_put_u8(skb, WLAN_EID_REDUCED_NEIGHBOR_REPORT);
+	skb_put_u8(skb, sizeof(info) +
+			COLOC_TEST_APS_PER_RNR * info.tbtt_info_len);
+	skb_put_data(skb, &info, sizeof(info));
+
+	for (i = first; i < first + COLOC_TEST_APS_PER_RNR; i++) {
+		struct ieee80211_tbtt_info_ge_11 tbtt = {
+			.short_ssid = cpu_to_le32(0x80211000 + i),
+			.bss_params = IEEE80211_RNR_TBTT_PARAMS_COLOC_AP,
+		};
+
+		bss_table_test_addr(tbtt.bssid, i);
+		skb_put_data(skb, &tbtt, info.tbtt_info_len);
+	}
+}
+
+/* the APs in groups of 16 on channels 1, 5, 9, ... by group number */
+static u8 coloc_test_channel(unsigned int first)
+{
+	return 1 + 4 * ((first / COLOC_TEST_APS_PER_RNR) % 32);
+}
+
+static void test_cfg80211_parse_colocated_ap_many(struct kunit *test)
+{
+	struct sk_buff *input = kunit_zalloc_skb(test, 8192, GFP_KERNEL);
+	struct cfg80211_colocated_ap *ap;
+	struct cfg80211_bss_ies *ies;
+	LIST_HEAD(coloc_ap_list);
+	unsigned int i, n = 0;
+	int count;
+
+	KUNIT_ASSERT_NOT_NULL(test, input);
+
+	skb_put_u8(input, WLAN_EID_SSID);
+	skb_put_u8(input, 4);
+	skb_put_data(input, "TEST", 4);
+
+	/* 256 APs, and then the first 128 of them again */
+	for (i = 0; i < 256; i += COLOC_TEST_APS_PER_RNR)
+		coloc_test_put_rnr(input, coloc_test_channel(i), i);
+	for (i = 0; i < 128; i += COLOC_TEST_APS_PER_RNR)
+		coloc_test_put_rnr(input, coloc_test_channel(i), i);
+
+	ies = kunit_kzalloc(test, struct_size(ies, data, input->len), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ies);
+
+	ies->len = input->len;
+	memcpy(ies->data, input->data, input->len);
+
+	count = cfg80211_parse_colocated_ap(ies, &coloc_ap_list);
+	KUNIT_EXPECT_EQ(test, count, 256);
+	KUNIT_EXPECT_EQ(test, list_count_nodes(&coloc_ap_list), 256);
+
+	/* in the order of the RNR, with the duplicates dropped */
+	list_for_each_entry(ap, &coloc_ap_list, list) {
+		u8 bssid[ETH_ALEN];
+
+		bss_table_test_addr(bssid, n);
+		KUNIT_EXPECT_MEMEQ(test, ap->bssid, bssid, ETH_ALEN);
+		KUNIT_EXPECT_EQ(test, ap->center_freq,
+				ieee80211_channel_to_frequency(coloc_test_channel(n),
+							       NL80211_BAND_6GHZ));
+		KUNIT_EXPECT_TRUE(test, ap->short_ssid_valid);
+		KUNIT_EXPECT_EQ(test, ap->short_ssid, 0x80211000 + n);
+		n++;
+	}
+
+	cfg80211_free_coloc_ap_list(&coloc_ap_list);
+}
+
+#define COLOC_TEST_REPORTERS	8
+#define COLOC_TEST_REPORTED	64
+
+/*
+ * Inform a 2.4 GHz BSS reporting 64 APs starting at AP number first, so
+ * that the reporters overlap by half.
+ */
+static struct cfg80211_bss *coloc_test_inform(struct kunit *test,
+					      struct wiphy *wiphy,
+					      unsigned int reporter,
+					      unsigned int first,
+					      unsigned int n_aps)
+{
+	struct sk_buff *ies = kunit_zalloc_skb(test, 1024, GFP_KERNEL);
+	struct cfg80211_inform_bss inform_bss = {
+		.signal = 50,
+	};
+	u8 bssid[ETH_ALEN];
+	unsigned int i;
+
+	KUNIT_ASSERT_NOT_NULL(test, ies);
+
+	inform_bss.chan = &wiphy->bands[NL80211_BAND_2GHZ]->channels[0];
+	bssid[0] = 0x06;
+	bssid[1] = 0x00;
+	bssid[2] = 0x00;
+	bssid[3] = 0x00;
+	bssid[4] = 0x00;
+	bssid[5] = reporter + 1;
+
+	skb_put_u8(ies, WLAN_EID_SSID);
+	skb_put_u8(ies, 4);
+	skb_put_data(ies, "TEST", 4);
+	for (i = first; i < first + n_aps; i += COLOC_TEST_APS_PER_RNR)
+		coloc_test_put_rnr(ies, coloc_test_channel(i), i);
+
+	return cfg80211_inform_bss_data(wiphy, &inform_bss,
+					CFG80211_BSS_FTYPE_PRESP, bssid, 0,
+					WLAN_CAPABILITY_ESS, 100,
+					ies->data, ies->len, GFP_KERNEL);
+}
+
+/*
+ * Collect the scan targets from BSSes that report hundreds of APs with
+ * many of them reported more than once, check the duplicates are dropped
+ * and that the parsed RNRs are only redone when they change.
+ */
+static void test_cfg80211_collect_colocated_aps(struct kunit *test)
+{
+	struct inform_bss ctx = {
+		.test = test,
+	};
+	struct wiphy *wiphy = T_WIPHY(test, ctx);
+	struct cfg80211_registered_device *rdev = wiphy_to_rdev(wiphy);
+	const u8 bcast[ETH_ALEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	unsigned int n_unique = (COLOC_TEST_REPORTERS + 1) *
+				COLOC_TEST_REPORTED / 2;
+	struct cfg80211_bss_rnr *rnr[COLOC_TEST_REPORTERS];
+	struct cfg80211_bss *bss[COLOC_TEST_REPORTERS], *tmp;
+	struct cfg80211_colocated_ap *aps;
+	unsigned int i, n_aps;
+
+	for (i = 0; i < COLOC_TEST_REPORTERS; i++) {
+		bss[i] = coloc_test_inform(test, wiphy, i,
+					   i * COLOC_TEST_REPORTED / 2,
+					   COLOC_TEST_REPORTED);
+		KUNIT_ASSERT_NOT_NULL(test, bss[i]);
+	}
+
+	aps = cfg80211_collect_colocated_aps(rdev, bcast, &n_aps);
+	KUNIT_ASSERT_NOT_NULL(test, aps);
+	KUNIT_EXPECT_EQ(test, n_aps, n_unique);
+	/* each AP is first reported by the next reporter */
+	for (i = 0; i < n_aps; i++) {
+		u8 bssid[ETH_ALEN];
+
+		bss_table_test_addr(bssid, i);
+		KUNIT_EXPECT_MEMEQ(test, aps[i].bssid, bssid, ETH_ALEN);
+		KUNIT_EXPECT_EQ(test, aps[i].short_ssid, 0x80211000 + i);
+	}
+	kfree(aps);
+
+	for (i = 0; i < COLOC_TEST_REPORTERS; i++) {
+		rnr[i] = bss_from_pub(bss[i])->rnr;
+		KUNIT_ASSERT_NOT_NULL(test, rnr[i]);
+		KUNIT_EXPECT_EQ(test, rnr[i]->n_aps, COLOC_TEST_REPORTED);
+	}
+
+	/* new IEs with the same RNR keep what was parsed */
+	for (i = 0; i < COLOC_TEST_REPORTERS; i++) {
+		tmp = coloc_test_inform(test, wiphy, i,
+					i * COLOC_TEST_REPORTED / 2,
+					COLOC_TEST_REPORTED);
+		KUNIT_EXPECT_PTR_EQ(test, tmp, bss[i]);
+		cfg80211_put_bss(wiphy, tmp);
+	}
+
+	aps = cfg80211_collect_colocated_aps(rdev, bcast, &n_aps);
+	KUNIT_ASSERT_NOT_NULL(test, aps);
+	KUNIT_EXPECT_EQ(test, n_aps, n_unique);
+	kfree(aps);
+
+	for (i = 0; i < COLOC_TEST_REPORTERS; i++)
+		KUNIT_EXPECT_PTR_EQ(test, bss_from_pub(bss[i])->rnr, rnr[i]);
+
+	/* but a changed one is parsed again */
+	tmp = coloc_test_inform(test, wiphy, 0, 0, COLOC_TEST_REPORTED / 2);
+	KUNIT_EXPECT_PTR_EQ(test, tmp, bss[0]);
+	cfg80211_put_bss(wiphy, tmp);
+
+	aps = cfg80211_collect_colocated_aps(rdev, bcast, &n_aps);
+	KUNIT_ASSERT_NOT_NULL(test, aps);
+	KUNIT_EXPECT_EQ(test, n_aps, n_unique);
+	kfree(aps);
+	KUNIT_ASSERT_NOT_NULL(test, bss_from_pub(bss[0])->rnr);
+	KUNIT_EXPECT_EQ(test, bss_from_pub(bss[0])->rnr->n_aps,
+			COLOC_TEST_REPORTED / 2);
+
+	for (i = 0; i < COLOC_TEST_REPORTERS; i++)
+		cfg80211_put_bss(wiphy, bss[i]);
+}
+
 static struct kunit_case gen_new_ie_test_cases[] = {
 	KUNIT_CASE_PARAM(test_gen_new_ie, gen_new_ie_gen_params),
 	KUNIT_CASE(test_gen_new_ie_malformed),
@@ -866,9 +1290,25 @@ static struct kunit_suite inform_bss = {
 
 kunit_test_suite(inform_bss);
 
+static struct kunit_case bss_table_test_cases[] = {
+	KUNIT_CASE(test_bss_table_lookup),
+	KUNIT_CASE(test_bss_table_generations),
+	KUNIT_CASE_SLOW(test_bss_table_scale),
+	{}
+};
+
+static struct kunit_suite bss_table = {
+	.name = "cfg80211-bss-table",
+	.test_cases = bss_table_test_cases,
+};
+
+kunit_test_suite(bss_table);
+
 static struct kunit_case scan_6ghz_cases[] = {
 	KUNIT_CASE_PARAM(test_cfg80211_parse_colocated_ap,
 			 cfg80211_parse_colocated_ap_gen_params),
+	KUNIT_CASE(test_cfg80211_parse_colocated_ap_many),
+	KUNIT_CASE(test_cfg80211_collect_colocated_aps),
 	{}
 };
 
@@ -2638,6 +2638,29 @@ int cfg80211_sinfo_alloc_tid_stats(struct station_info *sinfo, gfp_t gfp)
 }
 EXPORT_SYMBOL(cfg80211_sinfo_alloc_tid_stats);
 
+int cfg80211_sinfo_alloc_tx_latency(struct station_info *sinfo, gfp_t gfp)
+{
+	sinfo->tx_latency = kzalloc(sizeof(*sinfo->tx_latency), gfp);
+	if (!sinfo->tx_latency)
+		return -ENOMEM;
+
+	return 0;
+}
+EXPORT_SYMBOL(cfg80211_sinfo_alloc_tx_latency);
+
+int cfg80211_sinfo_alloc_rc_stats(struct station_info *sinfo,
+				  unsigned int n_rates, gfp_t gfp)
+{
+	sinfo->rc_stats = kcalloc(n_rates, sizeof(*sinfo->rc_stats), gfp);
+	if (!sinfo->rc_stats)
+		return -ENOMEM;
+
+	sinfo->n_rc_stats = n_rates;
+
+	return 0;
+}
+EXPORT_SYMBOL(cfg80211_sinfo_alloc_rc_stats);
+
 /* See IEEE 802.1H for LLC/SNAP encapsulation/decapsulation */
 /* Ethernet-II snap header (RFC1042 for most EtherTypes) */
 const unsigned char rfc1042_header[] __aligned(2) =